@@ -0,0 +1,371 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="AlphaCompositor.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "AlphaCompositor.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define ALPHA_COMPOSITOR_X86
+
+// Visual Studio only has the AVX2 intrinsics from Visual Studio 2012 on, older compilers keep the SSE2 path
+#if !defined(_MSC_VER) || _MSC_VER >= 1700
+#define ALPHA_COMPOSITOR_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ALPHA_COMPOSITOR_AVX2_FUNCTION
+#else
+#define ALPHA_COMPOSITOR_AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+static const int cBytesPerPixel = 4;
+static const int cAlphaByte = 3;
+
+/// <summary>
+/// Reference implementation, one pixel at a time
+/// </summary>
+void AlphaCompositeScalar(const unsigned char* pForeground, const unsigned char* pBackground, unsigned char* pOutput, unsigned int pixelCount)
+{
+    for (unsigned int i = 0; i < pixelCount; ++i)
+    {
+        const unsigned int alpha = pForeground[cAlphaByte];
+
+        for (int c = 0; c < cAlphaByte; ++c)
+        {
+            // x / 255 == (x + 1 + (x >> 8)) >> 8 for every x the blend can produce (0..255*255)
+            const unsigned int blend = (255 - alpha) * pBackground[c] + alpha * pForeground[c];
+            pOutput[c] = static_cast<unsigned char>((blend + 1 + (blend >> 8)) >> 8);
+        }
+        pOutput[cAlphaByte] = 255;
+
+        pForeground += cBytesPerPixel;
+        pBackground += cBytesPerPixel;
+        pOutput += cBytesPerPixel;
+    }
+}
+
+#ifdef ALPHA_COMPOSITOR_X86
+
+/// <summary>
+/// Blend two pixels whose channels were widened to 16 bits
+/// </summary>
+static inline __m128i BlendWideSSE2(__m128i foreground, __m128i background)
+{
+    // Copy each pixel's alpha into all four of its lanes
+    __m128i alpha = _mm_shufflelo_epi16(foreground, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i inverseAlpha = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+
+    // Both products sum to at most 255 * 255, so the 16 bit lanes cannot overflow
+    __m128i blend = _mm_add_epi16(_mm_mullo_epi16(foreground, alpha), _mm_mullo_epi16(background, inverseAlpha));
+
+    // Exact division by 255
+    blend = _mm_add_epi16(blend, _mm_add_epi16(_mm_set1_epi16(1), _mm_srli_epi16(blend, 8)));
+    return _mm_srli_epi16(blend, 8);
+}
+
+/// <summary>
+/// SSE2 implementation, 4 pixels per iteration
+/// </summary>
+void AlphaCompositeSSE2(const unsigned char* pForeground, const unsigned char* pBackground, unsigned char* pOutput, unsigned int pixelCount)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    unsigned int i = 0;
+
+    for (; i + 4 <= pixelCount; i += 4)
+    {
+        const __m128i foreground = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pForeground + i * cBytesPerPixel));
+        const __m128i background = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBackground + i * cBytesPerPixel));
+
+        const __m128i lo = BlendWideSSE2(_mm_unpacklo_epi8(foreground, zero), _mm_unpacklo_epi8(background, zero));
+        const __m128i hi = BlendWideSSE2(_mm_unpackhi_epi8(foreground, zero), _mm_unpackhi_epi8(background, zero));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOutput + i * cBytesPerPixel), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+
+    AlphaCompositeScalar(pForeground + i * cBytesPerPixel, pBackground + i * cBytesPerPixel, pOutput + i * cBytesPerPixel, pixelCount - i);
+}
+
+#ifdef ALPHA_COMPOSITOR_AVX2
+
+/// <summary>
+/// Blend four pixels whose channels were widened to 16 bits
+/// </summary>
+ALPHA_COMPOSITOR_AVX2_FUNCTION
+static inline __m256i BlendWideAVX2(__m256i foreground, __m256i background)
+{
+    __m256i alpha = _mm256_shufflelo_epi16(foreground, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m256i inverseAlpha = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+
+    __m256i blend = _mm256_add_epi16(_mm256_mullo_epi16(foreground, alpha), _mm256_mullo_epi16(background, inverseAlpha));
+
+    blend = _mm256_add_epi16(blend, _mm256_add_epi16(_mm256_set1_epi16(1), _mm256_srli_epi16(blend, 8)));
+    return _mm256_srli_epi16(blend, 8);
+}
+
+/// <summary>
+/// AVX2 implementation, 8 pixels per iteration
+/// Unpack and pack both work within 128 bit halves, so the pixel order is preserved
+/// </summary>
+ALPHA_COMPOSITOR_AVX2_FUNCTION
+void AlphaCompositeAVX2(const unsigned char* pForeground, const unsigned char* pBackground, unsigned char* pOutput, unsigned int pixelCount)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i opaque = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+    unsigned int i = 0;
+
+    for (; i + 8 <= pixelCount; i += 8)
+    {
+        const __m256i foreground = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pForeground + i * cBytesPerPixel));
+        const __m256i background = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pBackground + i * cBytesPerPixel));
+
+        const __m256i lo = BlendWideAVX2(_mm256_unpacklo_epi8(foreground, zero), _mm256_unpacklo_epi8(background, zero));
+        const __m256i hi = BlendWideAVX2(_mm256_unpackhi_epi8(foreground, zero), _mm256_unpackhi_epi8(background, zero));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOutput + i * cBytesPerPixel), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+    }
+
+    // Clear the upper halves before running SSE code, otherwise every short call pays an AVX to SSE transition
+    _mm256_zeroupper();
+
+    AlphaCompositeSSE2(pForeground + i * cBytesPerPixel, pBackground + i * cBytesPerPixel, pOutput + i * cBytesPerPixel, pixelCount - i);
+}
+
+/// <summary>
+/// Whether the CPU and operating system support AVX2
+/// </summary>
+bool AlphaCompositeHasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // The OS must save the YMM registers (OSXSAVE, and XCR0 bits 1 and 2)
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#else
+
+void AlphaCompositeAVX2(const unsigned char* pForeground, const unsigned char* pBackground, unsigned char* pOutput, unsigned int pixelCount)
+{
+    AlphaCompositeSSE2(pForeground, pBackground, pOutput, pixelCount);
+}
+
+bool AlphaCompositeHasAVX2()
+{
+    return false;
+}
+
+#endif
+
+#else
+
+void AlphaCompositeSSE2(const unsigned char* pForeground, const unsigned char* pBackground, unsigned char* pOutput, unsigned int pixelCount)
+{
+    AlphaCompositeScalar(pForeground, pBackground, pOutput, pixelCount);
+}
+
+void AlphaCompositeAVX2(const unsigned char* pForeground, const unsigned char* pBackground, unsigned char* pOutput, unsigned int pixelCount)
+{
+    AlphaCompositeScalar(pForeground, pBackground, pOutput, pixelCount);
+}
+
+bool AlphaCompositeHasAVX2()
+{
+    return false;
+}
+
+#endif
+
+/// <summary>
+/// Blend a BGRA foreground over a BGRX background, using the fastest implementation the CPU supports
+/// </summary>
+/// <param name="pForeground">foreground pixels, alpha in the fourth byte</param>
+/// <param name="pBackground">background pixels</param>
+/// <param name="pOutput">output pixels, may alias the background</param>
+/// <param name="pixelCount">number of pixels to blend</param>
+void AlphaComposite(const unsigned char* pForeground, const unsigned char* pBackground, unsigned char* pOutput, unsigned int pixelCount)
+{
+    static const bool bHasAVX2 = AlphaCompositeHasAVX2();
+
+    if (bHasAVX2)
+    {
+        AlphaCompositeAVX2(pForeground, pBackground, pOutput, pixelCount);
+    }
+    else
+    {
+        AlphaCompositeSSE2(pForeground, pBackground, pOutput, pixelCount);
+    }
+}
+
+enum AlphaBlockKind
+{
+    AlphaBlockTransparent,
+    AlphaBlockOpaque,
+    AlphaBlockMixed,
+
+    // Transparent, and the output already holds the background from the previous call
+    AlphaBlockUnchanged
+};
+
+/// <summary>
+/// Classify a block of foreground pixels by their alpha
+/// </summary>
+/// <param name="pForeground">first foreground pixel of the block</param>
+/// <param name="pixelCount">number of pixels in the block</param>
+/// <returns>whether all pixels are transparent, all are opaque, or neither</returns>
+static AlphaBlockKind ClassifyAlphaBlock(const unsigned char* pForeground, unsigned int pixelCount)
+{
+#ifdef ALPHA_COMPOSITOR_X86
+    if (cAlphaRunBlock == pixelCount)
+    {
+        // Keep only the alpha bytes of all 16 pixels, then compare the whole block at once
+        const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+        const __m128i* pBlock = reinterpret_cast<const __m128i*>(pForeground);
+
+        const __m128i a0 = _mm_and_si128(_mm_loadu_si128(pBlock + 0), alphaMask);
+        const __m128i a1 = _mm_and_si128(_mm_loadu_si128(pBlock + 1), alphaMask);
+        const __m128i a2 = _mm_and_si128(_mm_loadu_si128(pBlock + 2), alphaMask);
+        const __m128i a3 = _mm_and_si128(_mm_loadu_si128(pBlock + 3), alphaMask);
+
+        const __m128i anyAlpha = _mm_or_si128(_mm_or_si128(a0, a1), _mm_or_si128(a2, a3));
+        if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi8(anyAlpha, _mm_setzero_si128())))
+        {
+            return AlphaBlockTransparent;
+        }
+
+        const __m128i allAlpha = _mm_and_si128(_mm_and_si128(a0, a1), _mm_and_si128(a2, a3));
+        if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi8(allAlpha, alphaMask)))
+        {
+            return AlphaBlockOpaque;
+        }
+
+        return AlphaBlockMixed;
+    }
+#endif
+
+    unsigned int anyAlpha = 0;
+    unsigned int allAlpha = 255;
+
+    for (unsigned int i = 0; i < pixelCount; ++i)
+    {
+        anyAlpha |= pForeground[i * cBytesPerPixel + cAlphaByte];
+        allAlpha &= pForeground[i * cBytesPerPixel + cAlphaByte];
+    }
+
+    if (0 == anyAlpha)
+    {
+        return AlphaBlockTransparent;
+    }
+
+    return (255 == allAlpha) ? AlphaBlockOpaque : AlphaBlockMixed;
+}
+
+/// <summary>
+/// Classify a block and, when the previous kinds are known, find out whether it needs writing at all
+/// </summary>
+/// <param name="pForeground">first foreground pixel of the block</param>
+/// <param name="pixelCount">number of pixels in the block</param>
+/// <param name="pBlockKind">optional, kind written by the previous call, updated to this call's kind</param>
+/// <returns>kind of the block</returns>
+static AlphaBlockKind ClassifyAlphaBlock(const unsigned char* pForeground, unsigned int pixelCount, unsigned char* pBlockKind)
+{
+    const AlphaBlockKind kind = ClassifyAlphaBlock(pForeground, pixelCount);
+
+    if (NULL == pBlockKind)
+    {
+        return kind;
+    }
+
+    const bool bUnchanged = (AlphaBlockTransparent == kind && AlphaBlockTransparent == *pBlockKind);
+    *pBlockKind = static_cast<unsigned char>(kind);
+
+    return bUnchanged ? AlphaBlockUnchanged : kind;
+}
+
+/// <summary>
+/// Blend a BGRA foreground over a BGRX background, skipping the blend math where it is not needed
+/// </summary>
+/// <param name="pForeground">foreground pixels, alpha in the fourth byte</param>
+/// <param name="pBackground">background pixels</param>
+/// <param name="pOutput">output pixels, may be the background itself but must not partially overlap it</param>
+/// <param name="pixelCount">number of pixels to blend</param>
+/// <param name="pBlockKinds">optional, one byte per block remembering what was written to pOutput by the previous call</param>
+void AlphaCompositeRuns(const unsigned char* pForeground, const unsigned char* pBackground, unsigned char* pOutput, unsigned int pixelCount, unsigned char* pBlockKinds)
+{
+    unsigned int runStart = 0;
+    unsigned int blockCount = (pixelCount < cAlphaRunBlock) ? pixelCount : cAlphaRunBlock;
+    AlphaBlockKind runKind = ClassifyAlphaBlock(pForeground, blockCount, pBlockKinds);
+
+    while (runStart < pixelCount)
+    {
+        // Extend the run over every following block of the same kind
+        unsigned int runEnd = runStart + blockCount;
+        AlphaBlockKind nextKind = runKind;
+
+        while (runEnd < pixelCount)
+        {
+            blockCount = (pixelCount - runEnd < cAlphaRunBlock) ? pixelCount - runEnd : cAlphaRunBlock;
+            nextKind = ClassifyAlphaBlock(pForeground + runEnd * cBytesPerPixel, blockCount, pBlockKinds ? pBlockKinds + runEnd / cAlphaRunBlock : NULL);
+
+            if (nextKind != runKind)
+            {
+                break;
+            }
+
+            runEnd += blockCount;
+        }
+
+        const unsigned int offset = runStart * cBytesPerPixel;
+        const unsigned int runPixels = runEnd - runStart;
+
+        switch (runKind)
+        {
+        case AlphaBlockUnchanged:
+            break;
+
+        case AlphaBlockTransparent:
+            // Background shows through, nothing to do when compositing in place
+            if (pOutput != pBackground)
+            {
+                memcpy(pOutput + offset, pBackground + offset, runPixels * cBytesPerPixel);
+            }
+            break;
+
+        case AlphaBlockOpaque:
+            memcpy(pOutput + offset, pForeground + offset, runPixels * cBytesPerPixel);
+            break;
+
+        default:
+            AlphaComposite(pForeground + offset, pBackground + offset, pOutput + offset, runPixels);
+            break;
+        }
+
+        runStart = runEnd;
+        runKind = nextKind;
+    }
+}
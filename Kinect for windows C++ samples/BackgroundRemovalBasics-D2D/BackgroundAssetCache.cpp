@@ -0,0 +1,534 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="BackgroundAssetCache.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "BackgroundAssetCache.h"
+
+// "BGRC", and the layout version, bump it whenever CacheHeader changes
+static const DWORD cCacheMagic   = 0x43524742;
+static const DWORD cCacheVersion = 2;
+
+// Images start on a page boundary so each one can be read straight from the mapping
+static const UINT cCachePageSize = 4096;
+
+/// <summary>
+/// Constructor
+/// </summary>
+BackgroundAssetCache::BackgroundAssetCache() :
+    m_width(0),
+    m_height(0),
+    m_sourceCount(0),
+    m_hThread(NULL),
+    m_bStop(FALSE),
+    m_readyCount(0),
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hMapping(NULL),
+    m_pView(NULL),
+    m_pMemory(NULL)
+{
+    m_cachePath[0] = L'\0';
+}
+
+/// <summary>
+/// Destructor, waits for the loading thread
+/// </summary>
+BackgroundAssetCache::~BackgroundAssetCache()
+{
+    if (NULL != m_hThread)
+    {
+        InterlockedExchange(&m_bStop, TRUE);
+        WaitForSingleObject(m_hThread, INFINITE);
+        CloseHandle(m_hThread);
+    }
+
+    CloseCache();
+}
+
+/// <summary>
+/// Set the resolution the images are scaled to and where they are cached
+/// </summary>
+/// <param name="width">width (in pixels) of the images</param>
+/// <param name="height">height (in pixels) of the images</param>
+/// <param name="cachePath">path of the cache file</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT BackgroundAssetCache::Initialize(UINT width, UINT height, PCWSTR cachePath)
+{
+    if (NULL != m_hThread || 0 == width || 0 == height || NULL == cachePath)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_sourceCount = 0;
+
+    return (0 == wcscpy_s(m_cachePath, cachePath)) ? S_OK : E_INVALIDARG;
+}
+
+/// <summary>
+/// Add an image embedded as a resource
+/// </summary>
+/// <param name="hModule">module holding the resource</param>
+/// <param name="resourceName">name of the resource</param>
+/// <param name="resourceType">type of the resource</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT BackgroundAssetCache::AddResource(HMODULE hModule, PCWSTR resourceName, PCWSTR resourceType)
+{
+    if (NULL != m_hThread || m_sourceCount >= cMaxBackgrounds || NULL == hModule || IS_INTRESOURCE(resourceName) || IS_INTRESOURCE(resourceType))
+    {
+        return E_INVALIDARG;
+    }
+
+    if (0 != wcscpy_s(m_sources[m_sourceCount], resourceName) || 0 != wcscpy_s(m_resourceTypes[m_sourceCount], resourceType))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_hModules[m_sourceCount++] = hModule;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Add every .jpg, .png and .bmp image of a folder
+/// </summary>
+/// <param name="folder">folder to look into, a missing folder adds nothing</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT BackgroundAssetCache::AddFolder(PCWSTR folder)
+{
+    if (NULL != m_hThread || NULL == folder)
+    {
+        return E_INVALIDARG;
+    }
+
+    WCHAR pattern[MAX_PATH];
+    if (0 > _snwprintf_s(pattern, _TRUNCATE, L"%s\\*", folder))
+    {
+        return E_INVALIDARG;
+    }
+
+    WIN32_FIND_DATAW findData;
+    HANDLE hFind = FindFirstFileW(pattern, &findData);
+    if (INVALID_HANDLE_VALUE == hFind)
+    {
+        return S_OK;
+    }
+
+    do
+    {
+        const WCHAR* extension = wcsrchr(findData.cFileName, L'.');
+        if (0 != (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || NULL == extension ||
+            (0 != _wcsicmp(extension, L".jpg") && 0 != _wcsicmp(extension, L".png") && 0 != _wcsicmp(extension, L".bmp")))
+        {
+            continue;
+        }
+
+        if (m_sourceCount >= cMaxBackgrounds)
+        {
+            break;
+        }
+
+        // Files that do not fit a path are skipped
+        if (0 <= _snwprintf_s(m_sources[m_sourceCount], _TRUNCATE, L"%s\\%s", folder, findData.cFileName))
+        {
+            m_hModules[m_sourceCount] = NULL;
+            m_resourceTypes[m_sourceCount][0] = L'\0';
+            ++m_sourceCount;
+        }
+    }
+    while (FindNextFileW(hFind, &findData));
+
+    FindClose(hFind);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Start loading the images on a thread
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT BackgroundAssetCache::Start()
+{
+    if (NULL != m_hThread || 0 == m_width)
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_hThread = CreateThread(NULL, 0, LoadThread, this, 0, NULL);
+
+    return (NULL != m_hThread) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+}
+
+/// <summary>
+/// Pixels of an image, in BGRX format at the cache resolution
+/// </summary>
+/// <param name="index">image index, in the order the images were added</param>
+/// <returns>the pixels, NULL while the image is not loaded yet</returns>
+const BYTE* BackgroundAssetCache::GetImage(UINT index) const
+{
+    // The loading thread publishes the view before counting an image as ready
+    const LONG readyCount = InterlockedCompareExchange(const_cast<volatile LONG*>(&m_readyCount), 0, 0);
+
+    return (static_cast<LONG>(index) < readyCount) ? m_pView + GetImageOffset(index) : NULL;
+}
+
+/// <summary>
+/// Loading thread entry point
+/// </summary>
+DWORD WINAPI BackgroundAssetCache::LoadThread(LPVOID pParam)
+{
+    reinterpret_cast<BackgroundAssetCache*>(pParam)->Load();
+    return 0;
+}
+
+/// <summary>
+/// Map the cache file when it is up to date, otherwise decode the images into a new one
+/// </summary>
+void BackgroundAssetCache::Load()
+{
+    ULONGLONG stamps[cMaxBackgrounds];
+    bool knownFailures[cMaxBackgrounds];
+    for (UINT i = 0; i < m_sourceCount; ++i)
+    {
+        stamps[i] = GetSourceStamp(i);
+    }
+
+    if (!OpenCache(stamps, knownFailures))
+    {
+        BuildCache(stamps, knownFailures);
+    }
+}
+
+/// <summary>
+/// Tell whether a source changed: size and write time of a file, size and hash of a resource
+/// </summary>
+/// <returns>the stamp, 0 when the source cannot be read</returns>
+ULONGLONG BackgroundAssetCache::GetSourceStamp(UINT index) const
+{
+    if (NULL == m_hModules[index])
+    {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesExW(m_sources[index], GetFileExInfoStandard, &attributes))
+        {
+            return 0;
+        }
+
+        const ULONGLONG size = (static_cast<ULONGLONG>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+        const ULONGLONG time = (static_cast<ULONGLONG>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+        return time ^ (size * 0x9E3779B97F4A7C15ULL);
+    }
+
+    HRSRC imageResHandle = FindResourceW(m_hModules[index], m_sources[index], m_resourceTypes[index]);
+    HGLOBAL imageResDataHandle = (NULL != imageResHandle) ? LoadResource(m_hModules[index], imageResHandle) : NULL;
+    const BYTE* pImageFile = (NULL != imageResDataHandle) ? reinterpret_cast<const BYTE*>(LockResource(imageResDataHandle)) : NULL;
+    if (NULL == pImageFile)
+    {
+        return 0;
+    }
+
+    // FNV-1a, a few hundred kilobytes of compressed image hash far faster than they decode
+    const DWORD imageFileSize = SizeofResource(m_hModules[index], imageResHandle);
+    ULONGLONG hash = 0xCBF29CE484222325ULL ^ imageFileSize;
+    for (DWORD i = 0; i < imageFileSize; ++i)
+    {
+        hash = (hash ^ pImageFile[i]) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+/// <summary>
+/// Map the cache file if it holds every source with its current stamp
+/// </summary>
+/// <param name="pStamps">current stamp of every source</param>
+/// <param name="pKnownFailures">receives, for every source, whether the cache found it could not be decoded with its current stamp</param>
+/// <returns>true when the cache was mapped and every image is ready</returns>
+bool BackgroundAssetCache::OpenCache(const ULONGLONG* pStamps, bool* pKnownFailures)
+{
+    for (UINT i = 0; i < m_sourceCount; ++i)
+    {
+        pKnownFailures[i] = false;
+    }
+
+    m_hFile = CreateFileW(m_cachePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return false;
+    }
+
+    // A cache of other images still tells which of ours cannot be decoded, so only its header has to be there
+    LARGE_INTEGER fileSize;
+    bool bValid = GetFileSizeEx(m_hFile, &fileSize) && fileSize.QuadPart >= GetImageOffset(0);
+
+    if (bValid)
+    {
+        m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        m_pView = (NULL != m_hMapping) ? reinterpret_cast<BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0)) : NULL;
+        bValid = NULL != m_pView;
+    }
+
+    if (bValid)
+    {
+        const CacheHeader* pHeader = reinterpret_cast<const CacheHeader*>(m_pView);
+        bValid = cCacheMagic == pHeader->magic && cCacheVersion == pHeader->version && m_width == pHeader->width &&
+            m_height == pHeader->height && pHeader->imageCount <= cMaxBackgrounds;
+
+        // Sources move when images are added or removed, so failures are looked up by source
+        for (UINT i = 0; bValid && i < m_sourceCount; ++i)
+        {
+            for (UINT j = 0; j < pHeader->imageCount; ++j)
+            {
+                const CacheEntry& entry = pHeader->entries[j];
+                if (entry.decodeFailed && pStamps[i] == entry.stamp && 0 == wcscmp(m_sources[i], entry.source))
+                {
+                    pKnownFailures[i] = true;
+                    break;
+                }
+            }
+        }
+
+        bValid = bValid && fileSize.QuadPart == GetImageOffset(m_sourceCount) && m_sourceCount == pHeader->imageCount && pHeader->complete;
+
+        for (UINT i = 0; bValid && i < m_sourceCount; ++i)
+        {
+            bValid = pStamps[i] == pHeader->entries[i].stamp && 0 == wcscmp(m_sources[i], pHeader->entries[i].source);
+        }
+    }
+
+    if (!bValid)
+    {
+        CloseCache();
+        return false;
+    }
+
+    InterlockedExchange(&m_readyCount, m_sourceCount);
+
+    return true;
+}
+
+/// <summary>
+/// Decode every source into a new cache file, making each image available as soon as it is decoded
+/// </summary>
+/// <param name="pStamps">current stamp of every source</param>
+/// <param name="pKnownFailures">whether each source is known not to decode with its current stamp, it is not tried again</param>
+void BackgroundAssetCache::BuildCache(const ULONGLONG* pStamps, const bool* pKnownFailures)
+{
+    const UINT cacheSize = GetImageOffset(m_sourceCount);
+
+    m_hFile = CreateFileW(m_cachePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READWRITE, 0, cacheSize, NULL);
+        m_pView = (NULL != m_hMapping) ? reinterpret_cast<BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, 0)) : NULL;
+    }
+
+    // Without a cache file the images are still decoded, only into memory
+    if (NULL == m_pView)
+    {
+        CloseCache();
+        m_pMemory = new BYTE[cacheSize];
+        m_pView = m_pMemory;
+    }
+
+    CacheHeader* pHeader = reinterpret_cast<CacheHeader*>(m_pView);
+    ZeroMemory(pHeader, sizeof(CacheHeader));
+
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    const bool bUninitialize = SUCCEEDED(hr);
+
+    IWICImagingFactory* pIWICFactory = NULL;
+    hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_IWICImagingFactory, (LPVOID*)&pIWICFactory);
+
+    bool bComplete = true;
+    for (UINT i = 0; i < m_sourceCount; ++i)
+    {
+        if (InterlockedCompareExchange(&m_bStop, FALSE, FALSE))
+        {
+            bComplete = false;
+            break;
+        }
+
+        BYTE* pPixels = m_pView + GetImageOffset(i);
+
+        // A source that cannot be decoded shows black, and keeps its stamp so the cache stays
+        // valid; it is decoded again once its stamp changes
+        if (pKnownFailures[i] || FAILED(hr) || FAILED(DecodeImage(i, pIWICFactory, pPixels)))
+        {
+            ZeroMemory(pPixels, GetImageSize());
+            pHeader->entries[i].decodeFailed = TRUE;
+        }
+
+        pHeader->entries[i].stamp = pStamps[i];
+
+        wcscpy_s(pHeader->entries[i].source, m_sources[i]);
+        InterlockedExchange(&m_readyCount, i + 1);
+    }
+
+    SafeRelease(pIWICFactory);
+    if (bUninitialize)
+    {
+        CoUninitialize();
+    }
+
+    // The header goes in last, so a cache cut short by an exit is never taken as valid
+    pHeader->magic      = cCacheMagic;
+    pHeader->version    = cCacheVersion;
+    pHeader->width      = m_width;
+    pHeader->height     = m_height;
+    pHeader->imageCount = m_sourceCount;
+    pHeader->complete   = bComplete;
+
+    if (NULL == m_pMemory)
+    {
+        FlushViewOfFile(m_pView, 0);
+    }
+}
+
+/// <summary>
+/// Decode an image scaled to the cache resolution
+/// </summary>
+/// <param name="index">source index</param>
+/// <param name="pIWICFactory">WIC factory of the loading thread</param>
+/// <param name="pPixels">receives the pixels in BGRX format</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT BackgroundAssetCache::DecodeImage(UINT index, IWICImagingFactory* pIWICFactory, BYTE* pPixels) const
+{
+    HRESULT hr = S_OK;
+
+    IWICBitmapDecoder* pDecoder = NULL;
+    IWICStream* pStream = NULL;
+
+    if (NULL == m_hModules[index])
+    {
+        hr = pIWICFactory->CreateDecoderFromFilename(m_sources[index], NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &pDecoder);
+    }
+    else
+    {
+        // Locate and lock the resource to get a system memory pointer
+        HRSRC imageResHandle = FindResourceW(m_hModules[index], m_sources[index], m_resourceTypes[index]);
+        HGLOBAL imageResDataHandle = (NULL != imageResHandle) ? LoadResource(m_hModules[index], imageResHandle) : NULL;
+        void* pImageFile = (NULL != imageResDataHandle) ? LockResource(imageResDataHandle) : NULL;
+        DWORD imageFileSize = (NULL != pImageFile) ? SizeofResource(m_hModules[index], imageResHandle) : 0;
+        hr = imageFileSize ? S_OK : E_FAIL;
+
+        if (SUCCEEDED(hr))
+        {
+            // Create a WIC stream to map onto the memory.
+            hr = pIWICFactory->CreateStream(&pStream);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = pStream->InitializeFromMemory(reinterpret_cast<BYTE*>(pImageFile), imageFileSize);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = pIWICFactory->CreateDecoderFromStream(pStream, NULL, WICDecodeMetadataCacheOnLoad, &pDecoder);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = DecodeScaled(pIWICFactory, pDecoder, m_width, m_height, pPixels);
+    }
+
+    SafeRelease(pDecoder);
+    SafeRelease(pStream);
+
+    return hr;
+}
+
+/// <summary>
+/// Decode the first frame of an image scaled to a resolution
+/// </summary>
+/// <param name="pIWICFactory">WIC factory of the calling thread</param>
+/// <param name="pDecoder">decoder of the image</param>
+/// <param name="width">width (in pixels) to scale to</param>
+/// <param name="height">height (in pixels) to scale to</param>
+/// <param name="pPixels">receives the pixels in BGRX format</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT BackgroundAssetCache::DecodeScaled(IWICImagingFactory* pIWICFactory, IWICBitmapDecoder* pDecoder, UINT width, UINT height, BYTE* pPixels)
+{
+    IWICBitmapFrameDecode* pSource = NULL;
+    IWICFormatConverter* pConverter = NULL;
+    IWICBitmapScaler* pScaler = NULL;
+
+    HRESULT hr = pDecoder->GetFrame(0, &pSource);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pIWICFactory->CreateBitmapScaler(&pScaler);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pScaler->Initialize(pSource, width, height, WICBitmapInterpolationModeCubic);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Convert the image format to 32bppPBGRA
+        // (DXGI_FORMAT_B8G8R8A8_UNORM + D2D1_ALPHA_MODE_PREMULTIPLIED).
+        hr = pIWICFactory->CreateFormatConverter(&pConverter);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pConverter->Initialize(pScaler, GUID_WICPixelFormat32bppPBGRA, WICBitmapDitherTypeNone, NULL, 0.f, WICBitmapPaletteTypeMedianCut);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pConverter->CopyPixels(NULL, width * cBytesPerPixel, width * height * cBytesPerPixel, pPixels);
+    }
+
+    SafeRelease(pScaler);
+    SafeRelease(pConverter);
+    SafeRelease(pSource);
+
+    return hr;
+}
+
+/// <summary>
+/// Unmap and close the cache file, or free the memory used instead
+/// </summary>
+void BackgroundAssetCache::CloseCache()
+{
+    if (NULL != m_pMemory)
+    {
+        delete[] m_pMemory;
+        m_pMemory = NULL;
+    }
+    else if (NULL != m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+    m_pView = NULL;
+
+    if (NULL != m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+/// <summary>
+/// Byte offset of an image in the cache, the offset of the image past the last one is the cache size
+/// </summary>
+UINT BackgroundAssetCache::GetImageOffset(UINT index) const
+{
+    const UINT headerSize = (sizeof(CacheHeader) + cCachePageSize - 1) / cCachePageSize * cCachePageSize;
+    const UINT imageSize = (GetImageSize() + cCachePageSize - 1) / cCachePageSize * cCachePageSize;
+
+    return headerSize + index * imageSize;
+}
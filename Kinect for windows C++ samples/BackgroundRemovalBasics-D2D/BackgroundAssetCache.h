@@ -0,0 +1,145 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="BackgroundAssetCache.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Keeps the background images decoded and scaled to the output resolution in a cache file,
+// one file per resolution, so they are decoded once rather than at every start.
+// The file is raw BGRX pixels behind a header listing where every image came from:
+//     header   magic, version, resolution, image count, and the source and stamp of every image
+//     images   one full frame per image, starting on a page boundary
+// The file is mapped into memory and the images are used in place, so switching backgrounds
+// only changes a pointer. Loading happens on a thread: the cache is mapped as is when every
+// source still has the stamp it was cached with, otherwise the sources are decoded into a new
+// cache in order and each image becomes available as soon as it is decoded.
+
+#pragma once
+
+#include <Wincodec.h>
+
+class BackgroundAssetCache
+{
+    static const UINT       cMaxBackgrounds = 32;
+    static const UINT       cBytesPerPixel  = 4;
+    static const UINT       cMaxTypeLength  = 32;
+
+    // Where an image came from, the size, time or hash that tells whether it changed since, and
+    // whether it could not be decoded, in which case it is black and not decoded again, even when
+    // the cache is rebuilt for other images, until the source changes
+    struct CacheEntry
+    {
+        WCHAR     source[MAX_PATH];
+        ULONGLONG stamp;
+        UINT      decodeFailed;
+    };
+
+    struct CacheHeader
+    {
+        DWORD      magic;
+        DWORD      version;
+        UINT       width;
+        UINT       height;
+        UINT       imageCount;
+        UINT       complete;
+        CacheEntry entries[cMaxBackgrounds];
+    };
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    BackgroundAssetCache();
+
+    /// <summary>
+    /// Destructor, waits for the loading thread
+    /// </summary>
+    ~BackgroundAssetCache();
+
+    /// <summary>
+    /// Set the resolution the images are scaled to and where they are cached
+    /// </summary>
+    /// <param name="width">width (in pixels) of the images</param>
+    /// <param name="height">height (in pixels) of the images</param>
+    /// <param name="cachePath">path of the cache file</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Initialize(UINT width, UINT height, PCWSTR cachePath);
+
+    /// <summary>
+    /// Add an image embedded as a resource
+    /// </summary>
+    /// <param name="hModule">module holding the resource</param>
+    /// <param name="resourceName">name of the resource</param>
+    /// <param name="resourceType">type of the resource</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT AddResource(HMODULE hModule, PCWSTR resourceName, PCWSTR resourceType);
+
+    /// <summary>
+    /// Add every .jpg, .png and .bmp image of a folder
+    /// </summary>
+    /// <param name="folder">folder to look into, a missing folder adds nothing</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT AddFolder(PCWSTR folder);
+
+    /// <summary>
+    /// Start loading the images on a thread
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Start();
+
+    /// <summary>
+    /// Number of images added
+    /// </summary>
+    UINT GetCount() const { return m_sourceCount; }
+
+    /// <summary>
+    /// Pixels of an image, in BGRX format at the cache resolution
+    /// </summary>
+    /// <param name="index">image index, in the order the images were added</param>
+    /// <returns>the pixels, NULL while the image is not loaded yet</returns>
+    const BYTE* GetImage(UINT index) const;
+
+    /// <summary>
+    /// Decode the first frame of an image scaled to a resolution
+    /// </summary>
+    /// <param name="pIWICFactory">WIC factory of the calling thread</param>
+    /// <param name="pDecoder">decoder of the image</param>
+    /// <param name="width">width (in pixels) to scale to</param>
+    /// <param name="height">height (in pixels) to scale to</param>
+    /// <param name="pPixels">receives the pixels in BGRX format</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT DecodeScaled(IWICImagingFactory* pIWICFactory, IWICBitmapDecoder* pDecoder, UINT width, UINT height, BYTE* pPixels);
+
+private:
+    UINT                    m_width;
+    UINT                    m_height;
+    WCHAR                   m_cachePath[MAX_PATH];
+
+    // Images to load, a source is either a file path or the name of a resource of m_hModules
+    UINT                    m_sourceCount;
+    WCHAR                   m_sources[cMaxBackgrounds][MAX_PATH];
+    HMODULE                 m_hModules[cMaxBackgrounds];
+    WCHAR                   m_resourceTypes[cMaxBackgrounds][cMaxTypeLength];
+
+    HANDLE                  m_hThread;
+    volatile LONG           m_bStop;
+
+    // Images [0, m_readyCount) can be used
+    volatile LONG           m_readyCount;
+
+    // Cache file mapping, or memory when the file cannot be written
+    HANDLE                  m_hFile;
+    HANDLE                  m_hMapping;
+    BYTE*                   m_pView;
+    BYTE*                   m_pMemory;
+
+    static DWORD WINAPI     LoadThread(LPVOID pParam);
+    void                    Load();
+    ULONGLONG               GetSourceStamp(UINT index) const;
+    bool                    OpenCache(const ULONGLONG* pStamps, bool* pKnownFailures);
+    void                    BuildCache(const ULONGLONG* pStamps, const bool* pKnownFailures);
+    HRESULT                 DecodeImage(UINT index, IWICImagingFactory* pIWICFactory, BYTE* pPixels) const;
+    void                    CloseCache();
+    UINT                    GetImageOffset(UINT index) const;
+    UINT                    GetImageSize() const { return m_width * m_height * cBytesPerPixel; }
+};
@@ -0,0 +1,448 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="BackgroundBlur.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "BackgroundBlur.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define BACKGROUND_BLUR_X86
+#include <emmintrin.h>
+#endif
+
+static const int cBytesPerPixel = 4;
+
+// Bilinear weights are out of 1 << cWeightBits, so weighted sums of two bytes fit 16 bits
+static const int cWeightBits = 7;
+static const int cWeightOne  = 1 << cWeightBits;
+
+/// <summary>
+/// Fixed point reciprocal of a box size, (sum + radius) * reciprocal >> 16 is the rounded average.
+/// Rounded up so a box of 255s averages to 255, the error is then at most one step on some half way values
+/// </summary>
+static inline unsigned int BoxReciprocal(int radius)
+{
+    return (65536 + 2 * radius) / (2 * radius + 1);
+}
+
+/// <summary>
+/// Horizontal box pass, two rows at a time so each running sum covers 8 channels
+/// </summary>
+/// <param name="pSource">BGRX rows</param>
+/// <param name="pDest">receives the blurred rows</param>
+/// <param name="width">width (in pixels) of a row</param>
+/// <param name="height">number of rows</param>
+/// <param name="radius">box radius, the box is cut at the row ends by repeating the end pixels</param>
+static void BoxBlurRows(const unsigned char* pSource, unsigned char* pDest, int width, int height, int radius)
+{
+    const int stride = width * cBytesPerPixel;
+    const unsigned int reciprocal = BoxReciprocal(radius);
+
+    for (int y = 0; y < height; y += 2)
+    {
+        const unsigned char* pRowA = pSource + y * stride;
+        const unsigned char* pRowB = (y + 1 < height) ? pRowA + stride : pRowA;
+        unsigned char* pDestA = pDest + y * stride;
+        unsigned char* pDestB = (y + 1 < height) ? pDestA + stride : NULL;
+
+#ifdef BACKGROUND_BLUR_X86
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(static_cast<short>(radius));
+        const __m128i scale = _mm_set1_epi16(static_cast<short>(reciprocal));
+
+        // Channels of pixel x of both rows, widened to 16 bits
+#define BOX_PIXEL_PAIR(x) _mm_unpacklo_epi8(_mm_unpacklo_epi32( \
+            _mm_cvtsi32_si128(*reinterpret_cast<const int*>(pRowA + (x) * cBytesPerPixel)), \
+            _mm_cvtsi32_si128(*reinterpret_cast<const int*>(pRowB + (x) * cBytesPerPixel))), zero)
+
+        // Sums wrap around 16 bits in between, but every average of 2 * radius + 1 bytes fits
+        __m128i sum = _mm_mullo_epi16(BOX_PIXEL_PAIR(0), _mm_set1_epi16(static_cast<short>(radius + 1)));
+        for (int x = 1; x <= radius; ++x)
+        {
+            sum = _mm_add_epi16(sum, BOX_PIXEL_PAIR((x < width) ? x : width - 1));
+        }
+
+        for (int x = 0; x < width; ++x)
+        {
+            const __m128i average = _mm_mulhi_epu16(_mm_add_epi16(sum, round), scale);
+            const __m128i packed = _mm_packus_epi16(average, average);
+
+            *reinterpret_cast<int*>(pDestA + x * cBytesPerPixel) = _mm_cvtsi128_si32(packed);
+            if (NULL != pDestB)
+            {
+                *reinterpret_cast<int*>(pDestB + x * cBytesPerPixel) = _mm_cvtsi128_si32(_mm_srli_si128(packed, 4));
+            }
+
+            const int entering = (x + radius + 1 < width) ? x + radius + 1 : width - 1;
+            const int leaving = (x - radius > 0) ? x - radius : 0;
+            sum = _mm_sub_epi16(_mm_add_epi16(sum, BOX_PIXEL_PAIR(entering)), BOX_PIXEL_PAIR(leaving));
+        }
+
+#undef BOX_PIXEL_PAIR
+#else
+        const int rows = (NULL != pDestB) ? 2 : 1;
+        for (int row = 0; row < rows; ++row)
+        {
+            const unsigned char* pRow = (0 == row) ? pRowA : pRowB;
+            unsigned char* pOut = (0 == row) ? pDestA : pDestB;
+
+            for (int c = 0; c < cBytesPerPixel; ++c)
+            {
+                unsigned int sum = (radius + 1) * pRow[c];
+                for (int x = 1; x <= radius; ++x)
+                {
+                    sum += pRow[((x < width) ? x : width - 1) * cBytesPerPixel + c];
+                }
+
+                for (int x = 0; x < width; ++x)
+                {
+                    pOut[x * cBytesPerPixel + c] = static_cast<unsigned char>(((sum + radius) * reciprocal) >> 16);
+
+                    const int entering = (x + radius + 1 < width) ? x + radius + 1 : width - 1;
+                    const int leaving = (x - radius > 0) ? x - radius : 0;
+                    sum += pRow[entering * cBytesPerPixel + c];
+                    sum -= pRow[leaving * cBytesPerPixel + c];
+                }
+            }
+        }
+#endif
+    }
+}
+
+/// <summary>
+/// Vertical box pass, a running sum per channel of the row
+/// </summary>
+/// <param name="pSource">BGRX rows</param>
+/// <param name="pDest">receives the blurred rows</param>
+/// <param name="width">width (in pixels) of a row</param>
+/// <param name="height">number of rows</param>
+/// <param name="radius">box radius, the box is cut at the top and bottom by repeating the end rows</param>
+/// <param name="pSums">room for the sums of one row of channels</param>
+static void BoxBlurColumns(const unsigned char* pSource, unsigned char* pDest, int width, int height, int radius, unsigned short* pSums)
+{
+    const int stride = width * cBytesPerPixel;
+    const unsigned int reciprocal = BoxReciprocal(radius);
+
+    for (int i = 0; i < stride; ++i)
+    {
+        unsigned int sum = (radius + 1) * pSource[i];
+        for (int y = 1; y <= radius; ++y)
+        {
+            sum += pSource[((y < height) ? y : height - 1) * stride + i];
+        }
+        pSums[i] = static_cast<unsigned short>(sum);
+    }
+
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* pEntering = pSource + ((y + radius + 1 < height) ? y + radius + 1 : height - 1) * stride;
+        const unsigned char* pLeaving = pSource + ((y - radius > 0) ? y - radius : 0) * stride;
+        unsigned char* pOut = pDest + y * stride;
+        int i = 0;
+
+#ifdef BACKGROUND_BLUR_X86
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(static_cast<short>(radius));
+        const __m128i scale = _mm_set1_epi16(static_cast<short>(reciprocal));
+
+        for (; i + 8 <= stride; i += 8)
+        {
+            __m128i sum = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSums + i));
+            const __m128i average = _mm_mulhi_epu16(_mm_add_epi16(sum, round), scale);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pOut + i), _mm_packus_epi16(average, average));
+
+            const __m128i entering = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pEntering + i)), zero);
+            const __m128i leaving = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pLeaving + i)), zero);
+            sum = _mm_sub_epi16(_mm_add_epi16(sum, entering), leaving);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pSums + i), sum);
+        }
+#endif
+
+        for (; i < stride; ++i)
+        {
+            pOut[i] = static_cast<unsigned char>(((pSums[i] + radius) * reciprocal) >> 16);
+            pSums[i] = static_cast<unsigned short>(pSums[i] + pEntering[i] - pLeaving[i]);
+        }
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+BackgroundBlur::BackgroundBlur() :
+    m_width(0),
+    m_height(0),
+    m_scale(1),
+    m_smallWidth(0),
+    m_smallHeight(0)
+{
+    SetStrength(12.0f);
+}
+
+/// <summary>
+/// Set the frame size and allocate the working buffers
+/// </summary>
+/// <param name="width">width (in pixels) of the color frame</param>
+/// <param name="height">height (in pixels) of the color frame</param>
+/// <param name="scale">reduction of the blurred frame, it must divide the width and height</param>
+/// <returns>true on success</returns>
+bool BackgroundBlur::Initialize(int width, int height, int scale)
+{
+    if (width <= 0 || height <= 0 || scale <= 0 || 0 != width % scale || 0 != height % scale)
+    {
+        return false;
+    }
+
+    // The radii depend on the scale
+    m_scale = scale;
+    SetStrength(m_sigma);
+
+    m_width       = width;
+    m_height      = height;
+    m_smallWidth  = width / scale;
+    m_smallHeight = height / scale;
+
+    // One more pixel lets the last column of the last row read a right neighbour, which gets a weight of 0
+    m_small.assign((m_smallWidth * m_smallHeight + 1) * cBytesPerPixel, 0);
+    m_scratch.assign(m_smallWidth * m_smallHeight * cBytesPerPixel, 0);
+    m_columnSums.assign(m_smallWidth * cBytesPerPixel, 0);
+    m_wide.assign(m_smallHeight * width * cBytesPerPixel, 0);
+
+    // Reduced pixel i covers full resolution pixels i * scale to (i + 1) * scale - 1, so its center
+    // lands on full resolution coordinate (i + 0.5) * scale - 0.5. Outside the centers the end pixels repeat
+    m_tapX.resize(width);
+    m_weightX.resize(width);
+    for (int x = 0; x < width; ++x)
+    {
+        const float position = (x + 0.5f) / scale - 0.5f;
+        const int tap = static_cast<int>(floorf(position));
+
+        m_tapX[x] = (tap < 0) ? 0 : ((tap >= m_smallWidth) ? m_smallWidth - 1 : tap);
+        m_weightX[x] = (tap < 0 || tap >= m_smallWidth - 1) ? 0 : static_cast<int>((position - tap) * cWeightOne + 0.5f);
+    }
+
+    m_tapY.resize(height);
+    m_weightY.resize(height);
+    for (int y = 0; y < height; ++y)
+    {
+        const float position = (y + 0.5f) / scale - 0.5f;
+        const int tap = static_cast<int>(floorf(position));
+
+        m_tapY[y] = (tap < 0) ? 0 : ((tap >= m_smallHeight) ? m_smallHeight - 1 : tap);
+        m_weightY[y] = (tap < 0 || tap >= m_smallHeight - 1) ? 0 : static_cast<int>((position - tap) * cWeightOne + 0.5f);
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Set how strong the blur is
+/// </summary>
+/// <param name="sigma">standard deviation of the gaussian, in full resolution pixels</param>
+void BackgroundBlur::SetStrength(float sigma)
+{
+    m_sigma = (sigma > 0.0f) ? sigma : 0.0f;
+
+    // Box sizes whose succession has the variance of the gaussian (W. Jarosz, "Fast Image Convolutions")
+    const float smallSigma = m_sigma / m_scale;
+    const float ideal = sqrtf(12.0f * smallSigma * smallSigma / cPasses + 1.0f);
+
+    int lower = static_cast<int>(floorf(ideal));
+    lower -= (0 == lower % 2) ? 1 : 0;
+    const int upper = lower + 2;
+
+    const float lowerCount = (12.0f * smallSigma * smallSigma - cPasses * lower * lower - 4.0f * cPasses * lower - 3.0f * cPasses) / (-4.0f * lower - 4.0f);
+    const int lowerPasses = static_cast<int>(floorf(lowerCount + 0.5f));
+
+    for (int pass = 0; pass < cPasses; ++pass)
+    {
+        const int size = (pass < lowerPasses) ? lower : upper;
+        m_radii[pass] = (size - 1) / 2;
+        m_radii[pass] = (m_radii[pass] > cMaxRadius) ? cMaxRadius : m_radii[pass];
+    }
+}
+
+/// <summary>
+/// Blur a color frame at the reduced resolution
+/// </summary>
+/// <param name="pColor">color frame in BGRX format</param>
+void BackgroundBlur::Blur(const unsigned char* pColor)
+{
+    if (m_small.empty())
+    {
+        return;
+    }
+
+    Downsample(pColor);
+
+    for (int pass = 0; pass < cPasses; ++pass)
+    {
+        if (m_radii[pass] > 0)
+        {
+            BoxBlurRows(&m_small[0], &m_scratch[0], m_smallWidth, m_smallHeight, m_radii[pass]);
+            BoxBlurColumns(&m_scratch[0], &m_small[0], m_smallWidth, m_smallHeight, m_radii[pass], &m_columnSums[0]);
+        }
+    }
+}
+
+/// <summary>
+/// Write the last blurred frame at full resolution
+/// </summary>
+/// <param name="pOutput">receives the blurred frame in BGRX format</param>
+void BackgroundBlur::Render(unsigned char* pOutput)
+{
+    if (m_small.empty())
+    {
+        return;
+    }
+
+    const int stride = m_width * cBytesPerPixel;
+    const int round = 1 << (cWeightBits - 1);
+
+    // Widen every reduced row first, there are scale times fewer of them than output rows
+    for (int y = 0; y < m_smallHeight; ++y)
+    {
+        const unsigned char* pRow = &m_small[y * m_smallWidth * cBytesPerPixel];
+        unsigned char* pWide = &m_wide[y * stride];
+        int x = 0;
+
+#ifdef BACKGROUND_BLUR_X86
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i roundVector = _mm_set1_epi32(round);
+
+        // Left and right neighbours are adjacent, interleaving their channels lets one multiply-add weigh both
+#define WIDEN_COLUMN(x) _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16( \
+            _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pRow + m_tapX[x] * cBytesPerPixel)), zero), \
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(*reinterpret_cast<const int*>(pRow + (m_tapX[x] + 1) * cBytesPerPixel)), zero)), \
+            _mm_set1_epi32((m_weightX[x] << 16) | (cWeightOne - m_weightX[x]))), roundVector), cWeightBits)
+
+        for (; x + 4 <= m_width; x += 4)
+        {
+            const __m128i left = _mm_packs_epi32(WIDEN_COLUMN(x), WIDEN_COLUMN(x + 1));
+            const __m128i right = _mm_packs_epi32(WIDEN_COLUMN(x + 2), WIDEN_COLUMN(x + 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pWide + x * cBytesPerPixel), _mm_packus_epi16(left, right));
+        }
+
+#undef WIDEN_COLUMN
+#endif
+
+        for (; x < m_width; ++x)
+        {
+            const unsigned char* pLeft = pRow + m_tapX[x] * cBytesPerPixel;
+            const int rightWeight = m_weightX[x];
+            const int leftWeight = cWeightOne - rightWeight;
+
+            for (int c = 0; c < cBytesPerPixel; ++c)
+            {
+                pWide[x * cBytesPerPixel + c] = static_cast<unsigned char>((leftWeight * pLeft[c] + rightWeight * pLeft[c + cBytesPerPixel] + round) >> cWeightBits);
+            }
+        }
+    }
+
+    // Then interpolate every output row between the two widened rows around it
+    for (int y = 0; y < m_height; ++y)
+    {
+        const unsigned char* pTop = &m_wide[m_tapY[y] * stride];
+        unsigned char* pOut = pOutput + y * stride;
+        const int bottomWeight = m_weightY[y];
+        const int topWeight = cWeightOne - bottomWeight;
+
+        if (0 == bottomWeight)
+        {
+            memcpy(pOut, pTop, stride);
+            continue;
+        }
+
+        const unsigned char* pBottom = pTop + stride;
+        int i = 0;
+
+#ifdef BACKGROUND_BLUR_X86
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i roundVector = _mm_set1_epi16(static_cast<short>(round));
+        const __m128i topVector = _mm_set1_epi16(static_cast<short>(topWeight));
+        const __m128i bottomVector = _mm_set1_epi16(static_cast<short>(bottomWeight));
+
+        // Both weighted bytes add up to at most 255 * 128, which fits 16 bits
+        for (; i + 16 <= stride; i += 16)
+        {
+            const __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTop + i));
+            const __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBottom + i));
+
+            __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(top, zero), topVector), _mm_mullo_epi16(_mm_unpacklo_epi8(bottom, zero), bottomVector));
+            __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(top, zero), topVector), _mm_mullo_epi16(_mm_unpackhi_epi8(bottom, zero), bottomVector));
+            low = _mm_srli_epi16(_mm_add_epi16(low, roundVector), cWeightBits);
+            high = _mm_srli_epi16(_mm_add_epi16(high, roundVector), cWeightBits);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm_packus_epi16(low, high));
+        }
+#endif
+
+        for (; i < stride; ++i)
+        {
+            pOut[i] = static_cast<unsigned char>((topWeight * pTop[i] + bottomWeight * pBottom[i] + round) >> cWeightBits);
+        }
+    }
+}
+
+/// <summary>
+/// Average every block of scale x scale pixels into one reduced pixel
+/// </summary>
+/// <param name="pColor">color frame in BGRX format</param>
+void BackgroundBlur::Downsample(const unsigned char* pColor)
+{
+    const int stride = m_width * cBytesPerPixel;
+    const int blockPixels = m_scale * m_scale;
+    unsigned char* pSmall = &m_small[0];
+
+    for (int y = 0; y < m_smallHeight; ++y)
+    {
+        const unsigned char* pBlockRow = pColor + y * m_scale * stride;
+        int x = 0;
+
+#ifdef BACKGROUND_BLUR_X86
+        // Four pixels of a block row are exactly one vector
+        if (4 == m_scale)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i round = _mm_set1_epi16(8);
+
+            for (; x < m_smallWidth; ++x)
+            {
+                __m128i sum = zero;
+                for (int row = 0; row < 4; ++row)
+                {
+                    const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBlockRow + row * stride + x * 4 * cBytesPerPixel));
+                    sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero)));
+                }
+
+                sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+                const __m128i average = _mm_srli_epi16(_mm_add_epi16(sum, round), 4);
+                *reinterpret_cast<int*>(pSmall + x * cBytesPerPixel) = _mm_cvtsi128_si32(_mm_packus_epi16(average, average));
+            }
+        }
+#endif
+
+        for (; x < m_smallWidth; ++x)
+        {
+            for (int c = 0; c < cBytesPerPixel; ++c)
+            {
+                int sum = 0;
+                for (int row = 0; row < m_scale; ++row)
+                {
+                    const unsigned char* pPixel = pBlockRow + row * stride + x * m_scale * cBytesPerPixel + c;
+                    for (int column = 0; column < m_scale; ++column)
+                    {
+                        sum += pPixel[column * cBytesPerPixel];
+                    }
+                }
+
+                pSmall[x * cBytesPerPixel + c] = static_cast<unsigned char>((sum + blockPixels / 2) / blockPixels);
+            }
+        }
+
+        pSmall += m_smallWidth * cBytesPerPixel;
+    }
+}
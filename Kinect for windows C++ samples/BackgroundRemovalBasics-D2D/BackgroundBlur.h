@@ -0,0 +1,87 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="BackgroundBlur.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Blurs the live color frame, to be shown behind the player instead of a background image.
+// A gaussian blur is approximated by three box blurs, and a blurred picture has no detail
+// to lose, so the frame is shrunk first, blurred at the reduced resolution and grown back
+// with bilinear interpolation when it is rendered:
+//     Blur     average blocks of scale x scale pixels, then three horizontal and vertical
+//              box passes, each a running sum so the cost does not depend on the radius
+//     Render   bilinear upsampling to the full resolution, widening the reduced rows
+//              first and then interpolating between the widened rows
+// Rendering is separate so the blurred frame can be written straight into the output
+// image and the player composited over it in place.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+#include <vector>
+
+class BackgroundBlur
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    BackgroundBlur();
+
+    /// <summary>
+    /// Set the frame size and allocate the working buffers
+    /// </summary>
+    /// <param name="width">width (in pixels) of the color frame</param>
+    /// <param name="height">height (in pixels) of the color frame</param>
+    /// <param name="scale">reduction of the blurred frame, it must divide the width and height</param>
+    /// <returns>true on success</returns>
+    bool Initialize(int width, int height, int scale);
+
+    /// <summary>
+    /// Set how strong the blur is
+    /// </summary>
+    /// <param name="sigma">standard deviation of the gaussian, in full resolution pixels</param>
+    void SetStrength(float sigma);
+
+    /// <summary>
+    /// Blur a color frame at the reduced resolution
+    /// </summary>
+    /// <param name="pColor">color frame in BGRX format</param>
+    void Blur(const unsigned char* pColor);
+
+    /// <summary>
+    /// Write the last blurred frame at full resolution
+    /// </summary>
+    /// <param name="pOutput">receives the blurred frame in BGRX format</param>
+    void Render(unsigned char* pOutput);
+
+private:
+    static const int            cPasses = 3;
+
+    // Keeps the 16 bit running sums of a box from overflowing
+    static const int            cMaxRadius = 64;
+
+    int                         m_width;
+    int                         m_height;
+    int                         m_scale;
+    int                         m_smallWidth;
+    int                         m_smallHeight;
+    float                       m_sigma;
+    int                         m_radii[cPasses];
+
+    // Reduced frame in BGRX format, and the result of the horizontal pass
+    std::vector<unsigned char>  m_small;
+    std::vector<unsigned char>  m_scratch;
+    std::vector<unsigned short> m_columnSums;
+
+    // Bilinear taps of every output column and row, weights are out of 128
+    std::vector<int>            m_tapX;
+    std::vector<int>            m_weightX;
+    std::vector<int>            m_tapY;
+    std::vector<int>            m_weightY;
+
+    // Reduced rows widened to the full width
+    std::vector<unsigned char>  m_wide;
+
+    void Downsample(const unsigned char* pColor);
+};
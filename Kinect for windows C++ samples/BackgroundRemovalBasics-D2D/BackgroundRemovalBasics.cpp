@@ -7,6 +7,7 @@
 #include "stdafx.h"
 #include <vector>
 #include "BackgroundRemovalBasics.h"
+#include "AlphaCompositor.h"
 #include "resource.h"
 
 #include <Wincodec.h>
@@ -49,10 +50,25 @@ CBackgroundRemovalBasics::CBackgroundRemovalBasics() :
     m_pColorStreamHandle(INVALID_HANDLE_VALUE),
     m_bNearMode(false),
     m_pNuiSensor(NULL),
+    m_pDrawBackgroundRemovalBasics(NULL),
+    m_pD2DFactory(NULL),
     m_pSensorChooser(NULL),
     m_pSensorChooserUI(NULL),
     m_pBackgroundRemovalStream(NULL),
-    m_trackedSkeleton(NUI_SKELETON_INVALID_TRACKING_ID)
+    m_trackedSkeleton(NUI_SKELETON_INVALID_TRACKING_ID),
+    m_bUseDepthRemover(false),
+    m_pCoordinateMapper(NULL),
+    m_depthRemoverFrames(0),
+    m_pacingReportFrames(0),
+    m_bAllPlayers(false),
+    m_bCenterZone(false),
+    m_bLockPlayers(false),
+    m_selectedPlayers(0),
+    m_bBlurBackground(false),
+    m_bColorKey(false),
+    m_backgroundIndex(0),
+    m_pBackground(NULL),
+    m_videoCount(0)
 {
     DWORD width = 0;
     DWORD height = 0;
@@ -69,6 +85,44 @@ CBackgroundRemovalBasics::CBackgroundRemovalBasics() :
     m_outputRGBX = new BYTE[m_colorWidth * m_colorHeight * cBytesPerPixel];
     m_backgroundRGBX = new BYTE[m_colorWidth * m_colorHeight * cBytesPerPixel];
 
+    // Shown until the background images are loaded, or when none could be
+    memset(m_backgroundRGBX, 0, m_colorWidth * m_colorHeight * cBytesPerPixel);
+    m_pBackground = m_backgroundRGBX;
+
+    // The center zone is the floor straight in front of the sensor, a meter to either side, from 0.8 to 3 meters away
+    m_playerSelector.SetZone(-1.0f, 1.0f, 0.8f, 3.0f);
+
+    // Nothing has been composited into the output yet
+    m_outputBlockKinds = new BYTE[AlphaCompositeBlockCount(m_colorWidth * m_colorHeight)];
+    memset(m_outputBlockKinds, cAlphaBlockUnknown, AlphaCompositeBlockCount(m_colorWidth * m_colorHeight));
+
+    // The blurred background is computed at a reduced resolution (take a look at BackgroundBlur.h)
+    m_backgroundBlur.Initialize(m_colorWidth, m_colorHeight, cBlurScale);
+
+    // Video backgrounds are decoded ahead into frames of the output size (take a look at VideoBackground.h)
+    m_videoBackground.Initialize(m_colorWidth, m_colorHeight);
+
+    // create heap storage for the frames our own depth engine works on (take a look at DepthBackgroundRemover.h)
+    m_depthRemover.Initialize(m_depthWidth, m_depthHeight, m_colorWidth, m_colorHeight);
+    m_depthPixels = new DepthPlayerPixel[cSyncWindow * m_depthWidth * m_depthHeight];
+    m_depthToColor = new ColorPoint[m_depthWidth * m_depthHeight];
+    m_colorFrames = new BYTE[cSyncWindow * m_colorWidth * m_colorHeight * cBytesPerPixel];
+    m_removedRGBA = new BYTE[m_colorWidth * m_colorHeight * cBytesPerPixel];
+    memset(&m_depthRemoverTimings, 0, sizeof(m_depthRemoverTimings));
+
+    // Every color frame shown is matched with a depth frame, the skeleton frame only refines the player selection
+    m_frameSync.Initialize(cSyncWindow, cSyncTolerance);
+    m_syncColor    = m_frameSync.AddStream(true);
+    m_syncDepth    = m_frameSync.AddStream(true);
+    m_syncSkeleton = m_frameSync.AddStream(false);
+
+    // The skeleton frame is light and the player selection depends on it, so it never waits behind
+    // a frame being composed; depth and color go in the order they fall due (take a look at StreamScheduler.h)
+    m_streamSkeleton  = m_streamScheduler.AddStream(3, cSkeletonDeadline);
+    m_streamDepth     = m_streamScheduler.AddStream(2, cFrameDeadline);
+    m_streamColor     = m_streamScheduler.AddStream(2, cFrameDeadline);
+    m_streamComposite = m_streamScheduler.AddStream(1, cCompositeDeadline);
+
     // Create an event that will be signaled when depth data is available
     m_hNextDepthFrameEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
@@ -91,6 +145,11 @@ CBackgroundRemovalBasics::~CBackgroundRemovalBasics()
     // clean up arrays
     delete[] m_outputRGBX;
     delete[] m_backgroundRGBX;
+    delete[] m_outputBlockKinds;
+    delete[] m_depthPixels;
+    delete[] m_depthToColor;
+    delete[] m_colorFrames;
+    delete[] m_removedRGBA;
 
     // clean up Direct2D renderer
     delete m_pDrawBackgroundRemovalBasics;
@@ -106,6 +165,7 @@ CBackgroundRemovalBasics::~CBackgroundRemovalBasics()
     SafeCloseHandle(m_hNextSkeletonFrameEvent);
 
     SafeRelease(m_pD2DFactory);
+    SafeRelease(m_pCoordinateMapper);
     SafeRelease(m_pNuiSensor);
     SafeRelease(m_pBackgroundRemovalStream);
 }
@@ -152,19 +212,27 @@ int CBackgroundRemovalBasics::Run(HINSTANCE hInstance, int nCmdShow)
 
    
     const HANDLE hEvents[] = {m_hNextDepthFrameEvent, m_hNextColorFrameEvent, m_hNextSkeletonFrameEvent, m_hNextBackgroundRemovedFrameEvent};
-    LoadResourceImage(L"Background", L"Image", m_colorWidth * m_colorHeight * cBytesPerPixel, m_backgroundRGBX);
+    LoadBackgrounds();
 
     // Main message loop
     while (WM_QUIT != msg.message)
     {
         // Check to see if we have either a message (by passing in QS_ALLINPUT)
         // Or a Kinect event (hEvents)
+        // Or a frame held back by the renderer's pacing being due
         // Update() will check for Kinect events individually, in case more than one are signaled
-        MsgWaitForMultipleObjects(_countof(hEvents), hEvents, FALSE, INFINITE, QS_ALLINPUT);
+        DWORD timeout = (NULL != m_pDrawBackgroundRemovalBasics) ? m_pDrawBackgroundRemovalBasics->GetPendingTimeout() : INFINITE;
+        MsgWaitForMultipleObjects(_countof(hEvents), hEvents, FALSE, timeout, QS_ALLINPUT);
 
         // Individually check the Kinect stream events since MsgWaitForMultipleObjects
         // can return for other reasons even though these are signaled.
         Update();
+
+        // Present the newest coalesced frame once its refresh slot arrives
+        if (NULL != m_pDrawBackgroundRemovalBasics)
+        {
+            m_pDrawBackgroundRemovalBasics->PresentPending();
+        }
         
         while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
         {
@@ -196,7 +264,7 @@ void CALLBACK CBackgroundRemovalBasics::StatusChangeCallback(HRESULT hrStatus, c
 }
 
 /// <summary>
-/// Main processing function
+/// Main processing function, handles the streams that have a frame waiting, most urgent first
 /// </summary>
 void CBackgroundRemovalBasics::Update()
 {
@@ -205,24 +273,72 @@ void CBackgroundRemovalBasics::Update()
         return;
     }
 
-    if (WAIT_OBJECT_0 == WaitForSingleObject(m_hNextBackgroundRemovedFrameEvent, 0))
-    {
-        ComposeImage();
-    }
+    HANDLE hStreamEvents[cMaxScheduledStreams];
+    hStreamEvents[m_streamSkeleton]  = m_hNextSkeletonFrameEvent;
+    hStreamEvents[m_streamDepth]     = m_hNextDepthFrameEvent;
+    hStreamEvents[m_streamColor]     = m_hNextColorFrameEvent;
+    hStreamEvents[m_streamComposite] = m_hNextBackgroundRemovedFrameEvent;
+
+    // Every stream is handled at most once per call, a stream whose frame could not be taken
+    // would otherwise stay signaled and keep the loop going
+    UINT handledStreams = 0;
 
-    if ( WAIT_OBJECT_0 == WaitForSingleObject(m_hNextDepthFrameEvent, 0) )
+    for (;;)
     {
-        ProcessDepth();
+        // The events are checked again after every handler, so a frame that came in meanwhile
+        // goes before the less urgent streams already waiting. The events stay set until their
+        // frame is taken, so the streams already waiting are not checked again
+        const LONGLONG now = StreamScheduler::Now();
+        for (int stream = 0; stream < m_streamScheduler.GetStreamCount(); ++stream)
+        {
+            if (0 == (handledStreams & (1 << stream)) && !m_streamScheduler.IsPending(stream) &&
+                WAIT_OBJECT_0 == WaitForSingleObject(hStreamEvents[stream], 0))
+            {
+                m_streamScheduler.Signal(stream, now);
+            }
+        }
+
+        const int stream = m_streamScheduler.Next(StreamScheduler::Now());
+        if (stream < 0)
+        {
+            break;
+        }
+        handledStreams |= 1 << stream;
+
+        if (m_streamSkeleton == stream)
+        {
+            ProcessSkeleton();
+        }
+        else if (m_streamDepth == stream)
+        {
+            ProcessDepth();
+        }
+        else if (m_streamColor == stream)
+        {
+            ProcessColor();
+        }
+        else
+        {
+            ComposeImage();
+        }
     }
+}
 
-    if ( WAIT_OBJECT_0 == WaitForSingleObject(m_hNextColorFrameEvent, 0) )
+/// <summary>
+/// Select players according to the all players and center zone controls
+/// </summary>
+void CBackgroundRemovalBasics::UpdatePlayerPolicy()
+{
+    // The SDK stream only keeps one player, every other one needs the depth engine
+    const int maxPlayers = m_bAllPlayers ? NUI_SKELETON_COUNT : 1;
+
+    if (m_bCenterZone)
     {
-        ProcessColor();
+        m_playerSelector.SetPolicy(PlayerSelectInsideZone, maxPlayers);
     }
-
-    if (WAIT_OBJECT_0 == WaitForSingleObject(m_hNextSkeletonFrameEvent, 0) )
+    else
     {
-        ProcessSkeleton();
+        m_playerSelector.SetPolicy(m_bAllPlayers ? PlayerSelectClosest : PlayerSelectSticky, maxPlayers);
     }
 }
 
@@ -330,6 +446,16 @@ LRESULT CALLBACK CBackgroundRemovalBasics::DlgProc(HWND hWnd, UINT uMsg, WPARAM
             PostQuitMessage(0);
             break;
 
+        // The renderer skips frames whose content did not change, so once the window
+        // was uncovered, restored or resized the next frame has to be presented in full
+        case WM_PAINT:
+        case WM_SIZE:
+            if (NULL != m_pDrawBackgroundRemovalBasics)
+            {
+                m_pDrawBackgroundRemovalBasics->Invalidate();
+            }
+            break;
+
         // Handle button press
         case WM_COMMAND:
             // If it was for the near mode control and a clicked event, change near mode
@@ -344,6 +470,81 @@ LRESULT CALLBACK CBackgroundRemovalBasics::DlgProc(HWND hWnd, UINT uMsg, WPARAM
                     m_pNuiSensor->NuiImageStreamSetImageFrameFlags(m_pDepthStreamHandle, m_bNearMode ? NUI_IMAGE_STREAM_FLAG_ENABLE_NEAR_MODE : 0);
                 }
             }
+
+            // If it was for the depth engine control and a clicked event, switch between our engine and the SDK stream
+            if (IDC_CHECK_DEPTHENGINE == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+            {
+                m_bUseDepthRemover = !m_bUseDepthRemover;
+
+                // Wait for frames taken while the engine is on before composing
+                m_frameSync.Reset();
+                m_depthRemover.ResetHistory();
+                m_depthRemoverFrames = 0;
+                memset(&m_depthRemoverTimings, 0, sizeof(m_depthRemoverTimings));
+            }
+
+            // If it was for the all players control and a clicked event, keep every player or only the closest one
+            if (IDC_CHECK_ALLPLAYERS == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+            {
+                m_bAllPlayers = !m_bAllPlayers;
+                UpdatePlayerPolicy();
+            }
+
+            // If it was for the center zone control and a clicked event, only keep the players standing in front of the sensor
+            if (IDC_CHECK_CENTERZONE == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+            {
+                m_bCenterZone = !m_bCenterZone;
+                UpdatePlayerPolicy();
+            }
+
+            // If it was for the lock players control and a clicked event, only ever keep the players kept now, or anyone again
+            if (IDC_CHECK_LOCKPLAYERS == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+            {
+                m_bLockPlayers = !m_bLockPlayers;
+
+                // The selector keeps players by person ID, so a locked player who is lost for a moment is still allowed back.
+                // An empty list allows everyone, when unlocking or when nobody is kept
+                unsigned long personIds[NUI_SKELETON_COUNT];
+                const int personCount = m_bLockPlayers ? min(m_playerSelector.GetSelectedCount(), NUI_SKELETON_COUNT) : 0;
+                for (int i = 0; i < personCount; ++i)
+                {
+                    personIds[i] = m_playerSelector.GetSelectedTrackingId(i);
+                }
+
+                m_playerSelector.SetWhitelist(personIds, personCount);
+            }
+
+            // If it was for the blur control and a clicked event, switch between the background image and the blurred color frame
+            if (IDC_CHECK_BLUR == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+            {
+                m_bBlurBackground = !m_bBlurBackground;
+
+                // The output no longer shows what the compositor remembers
+                memset(m_outputBlockKinds, cAlphaBlockUnknown, AlphaCompositeBlockCount(m_colorWidth * m_colorHeight));
+            }
+
+            // If it was for the color key control and a clicked event, key the edge of the depth engine's mask against the learned background
+            if (IDC_CHECK_COLORKEY == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+            {
+                m_bColorKey = !m_bColorKey;
+                m_depthRemover.SetKeying(FALSE != m_bColorKey);
+            }
+
+            // If it was for the next background control and a clicked event, show the next background image or video
+            if (IDC_BUTTON_NEXTBACKGROUND == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam) && m_backgroundCache.GetCount() + m_videoCount > 0)
+            {
+                m_backgroundIndex = (m_backgroundIndex + 1) % (m_backgroundCache.GetCount() + m_videoCount);
+
+                // Videos come after the images, only the one shown is being decoded
+                if (m_backgroundIndex >= m_backgroundCache.GetCount())
+                {
+                    m_videoBackground.Open(m_videoSources[m_backgroundIndex - m_backgroundCache.GetCount()]);
+                }
+                else
+                {
+                    m_videoBackground.Close();
+                }
+            }
             break;
 
         case WM_NOTIFY:
@@ -499,6 +700,17 @@ HRESULT CBackgroundRemovalBasics::ProcessDepth()
 	if (LockedRect.Pitch != 0)
 	{
 		bghr = m_pBackgroundRemovalStream->ProcessDepth(m_depthWidth * m_depthHeight * cBytesPerPixel, LockedRect.pBits, depthTimeStamp);
+
+        // Buffer a copy for our own engine until the color frame taken at the same time comes in
+        if (m_bUseDepthRemover)
+        {
+            const int slot = m_frameSync.BeginFrame(m_syncDepth);
+            if (slot >= 0)
+            {
+                memcpy(m_depthPixels + slot * m_depthWidth * m_depthHeight, LockedRect.pBits, m_depthWidth * m_depthHeight * sizeof(DepthPlayerPixel));
+                m_frameSync.EndFrame(m_syncDepth, slot, depthTimeStamp.QuadPart);
+            }
+        }
 	}
 
     // We're done with the texture so unlock it. Even if above process failed, we still need to unlock and release.
@@ -508,6 +720,12 @@ HRESULT CBackgroundRemovalBasics::ProcessDepth()
     // Release the frame
     hr = m_pNuiSensor->NuiImageStreamReleaseFrame(m_pDepthStreamHandle, &imageFrame);
 
+    // This depth frame may be the one a buffered color frame was waiting for
+    if (m_bUseDepthRemover && LockedRect.Pitch != 0)
+    {
+        ProcessSyncedFrames();
+    }
+
 	if (FAILED(bghr))
 	{
 		return bghr;
@@ -546,6 +764,23 @@ HRESULT CBackgroundRemovalBasics::ProcessColor()
 	if (LockedRect.Pitch != 0)
 	{
 		bghr = m_pBackgroundRemovalStream->ProcessColor(m_colorWidth * m_colorHeight * cBytesPerPixel, LockedRect.pBits, colorTimeStamp);
+
+        // The SDK stream composes its next frame over the latest blurred color frame
+        if (m_bBlurBackground && !m_bUseDepthRemover)
+        {
+            m_backgroundBlur.Blur(LockedRect.pBits);
+        }
+
+        // Buffer a copy for our own engine until the depth frame taken at the same time comes in
+        if (m_bUseDepthRemover)
+        {
+            const int slot = m_frameSync.BeginFrame(m_syncColor);
+            if (slot >= 0)
+            {
+                memcpy(m_colorFrames + slot * m_colorWidth * m_colorHeight * cBytesPerPixel, LockedRect.pBits, m_colorWidth * m_colorHeight * cBytesPerPixel);
+                m_frameSync.EndFrame(m_syncColor, slot, colorTimeStamp.QuadPart);
+            }
+        }
     }
 
     // We're done with the texture so unlock it
@@ -554,6 +789,12 @@ HRESULT CBackgroundRemovalBasics::ProcessColor()
     // Release the frame
     hr = m_pNuiSensor->NuiImageStreamReleaseFrame(m_pColorStreamHandle, &imageFrame);
 
+    // This color frame may be the one a buffered depth frame was waiting for
+    if (m_bUseDepthRemover && LockedRect.Pitch != 0)
+    {
+        ProcessSyncedFrames();
+    }
+
 	if (FAILED(bghr))
 	{
 		return bghr;
@@ -579,12 +820,23 @@ HRESULT CBackgroundRemovalBasics::ProcessSkeleton()
 
 	NUI_SKELETON_DATA* pSkeletonData = skeletonFrame.SkeletonData;
     // Background Removal Stream requires us to specifically tell it what skeleton ID to use as the foreground
-	hr = ChooseSkeleton(pSkeletonData);
+	hr = ChooseSkeleton(pSkeletonData, skeletonFrame.liTimeStamp.QuadPart);
 	if (FAILED(hr))
     {
         return hr;
     }
 
+    // Our engine applies the selection to the depth frame taken at the same time
+    if (m_bUseDepthRemover)
+    {
+        const int slot = m_frameSync.BeginFrame(m_syncSkeleton);
+        if (slot >= 0)
+        {
+            m_skeletonPlayers[slot] = m_selectedPlayers;
+            m_frameSync.EndFrame(m_syncSkeleton, slot, skeletonFrame.liTimeStamp.QuadPart);
+        }
+    }
+
     hr = m_pBackgroundRemovalStream->ProcessSkeleton(NUI_SKELETON_COUNT, pSkeletonData, skeletonFrame.liTimeStamp);
 
     return hr;
@@ -605,26 +857,16 @@ HRESULT  CBackgroundRemovalBasics::ComposeImage()
         return hr;
     }
 
-    const BYTE* pBackgroundRemovedColor = bgRemovedFrame.pBackgroundRemovedColorData;
-
-    int dataLength = static_cast<int>(m_colorWidth) * static_cast<int>(m_colorHeight) * cBytesPerPixel;
-    BYTE alpha = 0;
-    const int alphaChannelBytePosition = 3;
-    for (int i = 0; i < dataLength; ++i)
+    // The SDK stream keeps running while our own engine is selected, so switching back is immediate
+    if (m_bUseDepthRemover)
     {
-        if (i % cBytesPerPixel == 0)
-        {
-            alpha = pBackgroundRemovedColor[i + alphaChannelBytePosition];
-        }
-
-        if (i % cBytesPerPixel != alphaChannelBytePosition)
-        {
-            m_outputRGBX[i] = static_cast<BYTE>(
-                ( (UCHAR_MAX - alpha) * m_backgroundRGBX[i] + alpha * pBackgroundRemovedColor[i] ) / UCHAR_MAX
-                );
-        }
+        return m_pBackgroundRemovalStream->ReleaseFrame(&bgRemovedFrame);
     }
 
+    const BYTE* pBackgroundRemovedColor = bgRemovedFrame.pBackgroundRemovedColorData;
+
+    ComposeOverBackground(pBackgroundRemovedColor, bgRemovedFrame.liTimeStamp.QuadPart);
+
     hr = m_pBackgroundRemovalStream->ReleaseFrame(&bgRemovedFrame);
     if (FAILED(hr))
     {
@@ -633,209 +875,367 @@ HRESULT  CBackgroundRemovalBasics::ComposeImage()
 
     hr = m_pDrawBackgroundRemovalBasics->Draw(m_outputRGBX, m_colorWidth * m_colorHeight * cBytesPerPixel);
 
+    ReportPacing();
+
     return hr;
 }
 
 /// <summary>
-/// Use the sticky player logic to determine the player whom the background removed
-/// color stream should consider as foreground.
+/// Remove the background of the next matching depth and color frames with our own depth engine
 /// </summary>
 /// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT CBackgroundRemovalBasics::ChooseSkeleton(NUI_SKELETON_DATA* pSkeletonData)
+HRESULT CBackgroundRemovalBasics::ProcessSyncedFrames()
 {
-	HRESULT hr = S_OK;
+    int slots[cMaxSyncStreams];
+    if (!m_frameSync.Match(slots))
+    {
+        return S_OK;
+    }
 
-	// First we go through the stream to find the closest skeleton, and also check whether our current tracked
-	// skeleton is still visibile in the stream
-	float closestSkeletonDistance = FLT_MAX;
-	DWORD closestSkeleton = NUI_SKELETON_INVALID_TRACKING_ID;
-	BOOL isTrackedSkeletonVisible = false;
-	for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
-	{
-		NUI_SKELETON_DATA skeleton = pSkeletonData[i];
-		if (NUI_SKELETON_TRACKED == skeleton.eTrackingState)
-		{
-			if (m_trackedSkeleton == skeleton.dwTrackingID)
-			{
-				isTrackedSkeletonVisible = true;
-				break;
-			}
+    // The player indices of a depth frame belong to the skeleton frame taken with it, when it came in time
+    m_depthRemover.SetTrackedPlayers((slots[m_syncSkeleton] >= 0) ? m_skeletonPlayers[slots[m_syncSkeleton]] : m_selectedPlayers);
 
-			if (skeleton.Position.z < closestSkeletonDistance)
-			{
-				closestSkeleton = skeleton.dwTrackingID;
-				closestSkeletonDistance = skeleton.Position.z;
-			}
-		}
-	}
+    // Only depth frames that found their color frame are mapped to color space
+    DepthPlayerPixel* pDepth = m_depthPixels + slots[m_syncDepth] * m_depthWidth * m_depthHeight;
 
-	// Now we choose a new skeleton unless the currently tracked skeleton is still visible
-	if (!isTrackedSkeletonVisible && closestSkeleton != NUI_SKELETON_INVALID_TRACKING_ID)
-	{
-		hr = m_pBackgroundRemovalStream->SetTrackedPlayer(closestSkeleton);
-		if (FAILED(hr))
-		{
-			return hr;
-		}
+    if (NULL == m_pCoordinateMapper)
+    {
+        m_pNuiSensor->NuiGetCoordinateMapper(&m_pCoordinateMapper);
+    }
 
-		m_trackedSkeleton = closestSkeleton;
-	}
+    if (NULL == m_pCoordinateMapper)
+    {
+        return E_FAIL;
+    }
 
-	return hr;
+    HRESULT hr = m_pCoordinateMapper->MapDepthFrameToColorFrame(cDepthResolution, m_depthWidth * m_depthHeight,
+        reinterpret_cast<NUI_DEPTH_IMAGE_PIXEL*>(pDepth), NUI_IMAGE_TYPE_COLOR, cColorResolution,
+        m_depthWidth * m_depthHeight, reinterpret_cast<NUI_COLOR_IMAGE_POINT*>(m_depthToColor));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const BYTE* pColor = m_colorFrames + slots[m_syncColor] * m_colorWidth * m_colorHeight * cBytesPerPixel;
+    m_depthRemover.Process(pDepth, m_depthToColor, pColor, m_removedRGBA);
+
+    if (m_bBlurBackground)
+    {
+        m_backgroundBlur.Blur(pColor);
+    }
+
+    return ComposeDepthRemovedImage(m_frameSync.GetTimestamp(m_syncColor, slots[m_syncColor]));
 }
 
 /// <summary>
-/// Load an image from a resource into a buffer
+/// remove the background with our own depth engine and compose the result with the background image
 /// </summary>
-/// <param name="resourceName">name of image resource to load</param>
-/// <param name="resourceType">type of resource to load</param>
-/// <param name="cOutputBuffer">size of output buffer, in bytes</param>
-/// <param name="outputBuffer">buffer that will hold the loaded image</param>
+/// <param name="timestamp">time stamp of the color frame</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT CBackgroundRemovalBasics::LoadResourceImage(
-    PCWSTR resourceName,
-    PCWSTR resourceType,
-    DWORD cOutputBuffer,
-    BYTE* outputBuffer
-    )
+HRESULT CBackgroundRemovalBasics::ComposeDepthRemovedImage(LONGLONG timestamp)
 {
-    HRESULT hr = S_OK;
-
-    IWICImagingFactory* pIWICFactory = NULL;
-    IWICBitmapDecoder* pDecoder = NULL;
-    IWICBitmapFrameDecode* pSource = NULL;
-    IWICStream* pStream = NULL;
-    IWICFormatConverter* pConverter = NULL;
-    IWICBitmapScaler* pScaler = NULL;
+    // Same blending as for the SDK stream, our engine produces the same BGRA layout
+    ComposeOverBackground(m_removedRGBA, timestamp);
 
-    HRSRC imageResHandle = NULL;
-    HGLOBAL imageResDataHandle = NULL;
-    void *pImageFile = NULL;
-    DWORD imageFileSize = 0;
+    ReportDepthRemoverTimings();
 
-    hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_IWICImagingFactory, (LPVOID*)&pIWICFactory);
-    if ( FAILED(hr) ) return hr;
-
-    // Locate the resource.
-    imageResHandle = FindResourceW(HINST_THISCOMPONENT, resourceName, resourceType);
-    hr = imageResHandle ? S_OK : E_FAIL;
+    return m_pDrawBackgroundRemovalBasics->Draw(m_outputRGBX, m_colorWidth * m_colorHeight * cBytesPerPixel);
+}
 
-    if (SUCCEEDED(hr))
+/// <summary>
+/// Blend a background removed color frame over the background image, video or the blurred color frame
+/// </summary>
+/// <param name="pForeground">background removed color frame in BGRA format</param>
+/// <param name="timestamp">time stamp of the color frame, the video frame shown is the one due at that time</param>
+void CBackgroundRemovalBasics::ComposeOverBackground(const BYTE* pForeground, LONGLONG timestamp)
+{
+    if (m_bBlurBackground)
     {
-        // Load the resource.
-        imageResDataHandle = LoadResource(HINST_THISCOMPONENT, imageResHandle);
-        hr = imageResDataHandle ? S_OK : E_FAIL;
+        // The blurred frame changes every frame, so it is written straight into the output
+        // and the player is blended over it in place, which leaves the background spans alone
+        m_backgroundBlur.Render(m_outputRGBX);
+        AlphaCompositeRuns(pForeground, m_outputRGBX, m_outputRGBX, m_colorWidth * m_colorHeight);
     }
-
-    if (SUCCEEDED(hr))
+    else
     {
-        // Lock it to get a system memory pointer.
-        pImageFile = LockResource(imageResDataHandle);
-        hr = pImageFile ? S_OK : E_FAIL;
-    }
+        const BYTE* pBackground = NULL;
 
-    if (SUCCEEDED(hr))
-    {
-        // Calculate the size.
-        imageFileSize = SizeofResource(HINST_THISCOMPONENT, imageResHandle);
-        hr = imageFileSize ? S_OK : E_FAIL;
-    }
+        if (m_backgroundIndex >= m_backgroundCache.GetCount())
+        {
+            // A video frame is only shown once, so there is nothing to gain from remembering what the
+            // output holds: the frame is copied whole and the next image starts from a blank record
+            const BYTE* pVideoFrame = m_videoBackground.GetFrame(timestamp);
+            if (NULL != pVideoFrame)
+            {
+                m_pBackground = NULL;
+                AlphaCompositeRuns(pForeground, pVideoFrame, m_outputRGBX, m_colorWidth * m_colorHeight);
+                return;
+            }
+        }
+        else
+        {
+            // Images are used in place from the cache (take a look at BackgroundAssetCache.h)
+            pBackground = m_backgroundCache.GetImage(m_backgroundIndex);
+        }
 
-    if (SUCCEEDED(hr))
-    {
-        // Create a WIC stream to map onto the memory.
-        hr = pIWICFactory->CreateStream(&pStream);
-    }
+        // Black stands in for an image or video that is not loaded yet
+        if (NULL == pBackground)
+        {
+            pBackground = m_backgroundRGBX;
+        }
 
-    if (SUCCEEDED(hr))
-    {
-        // Initialize the stream with the memory pointer and size.
-        hr = pStream->InitializeFromMemory(
-            reinterpret_cast<BYTE*>(pImageFile),
-            imageFileSize
-            );
-    }
+        // The output no longer holds the current background anywhere
+        if (pBackground != m_pBackground)
+        {
+            m_pBackground = pBackground;
+            memset(m_outputBlockKinds, cAlphaBlockUnknown, AlphaCompositeBlockCount(m_colorWidth * m_colorHeight));
+        }
 
-    if (SUCCEEDED(hr))
-    {
-        // Create a decoder for the stream.
-        hr = pIWICFactory->CreateDecoderFromStream(
-            pStream,
-            NULL,
-            WICDecodeMetadataCacheOnLoad,
-            &pDecoder
-            );
+        // Blend the player over the background image (take a look at AlphaCompositor.h)
+        // Background and player spans are copied, only the player's edges need blending,
+        // and background the output already shows from the last frame is not copied again
+        AlphaCompositeRuns(pForeground, m_pBackground, m_outputRGBX, m_colorWidth * m_colorHeight, m_outputBlockKinds);
     }
+}
 
-    if (SUCCEEDED(hr))
+/// <summary>
+/// Show the depth engine's per stage timings, averaged over a few frames
+/// </summary>
+void CBackgroundRemovalBasics::ReportDepthRemoverTimings()
+{
+    const DepthBackgroundRemoverTimings& timings = m_depthRemover.GetTimings();
+
+    m_depthRemoverTimings.mask         += timings.mask;
+    m_depthRemoverTimings.registration += timings.registration;
+    m_depthRemoverTimings.refine       += timings.refine;
+    m_depthRemoverTimings.stabilize    += timings.stabilize;
+    m_depthRemoverTimings.compose      += timings.compose;
+    m_depthRemoverTimings.total        += timings.total;
+
+    if (++m_depthRemoverFrames < cTimingReportFrames)
     {
-        // Create the initial frame.
-        hr = pDecoder->GetFrame(0, &pSource);
+        return;
     }
 
-    if (SUCCEEDED(hr))
+    const FrameSyncStats& syncStats = m_frameSync.GetStats();
+    const StreamSchedulerStats& streamStats = m_streamScheduler.GetStats();
+
+    WCHAR szMessage[cStatusMessageMaxLen];
+    swprintf_s(szMessage, L"Depth engine: mask %.2f ms, registration %.2f ms, refine %.2f ms (%d pixels keyed), stabilize %.2f ms, compose %.2f ms, total %.2f ms. "
+        L"Depth skew %.1f ms (max %lld ms), dropped %d color and %d depth frames. Skeleton handled %.2f ms after arrival (max %.2f ms). "
+        L"Presented %lu of %lu frames, %lu replaced before their refresh",
+        m_depthRemoverTimings.mask / m_depthRemoverFrames,
+        m_depthRemoverTimings.registration / m_depthRemoverFrames,
+        m_depthRemoverTimings.refine / m_depthRemoverFrames,
+        m_depthRemover.GetKeyedPixelCount(),
+        m_depthRemoverTimings.stabilize / m_depthRemoverFrames,
+        m_depthRemoverTimings.compose / m_depthRemoverFrames,
+        m_depthRemoverTimings.total / m_depthRemoverFrames,
+        static_cast<double>(syncStats.skewSum[m_syncDepth]) / (syncStats.matched > 0 ? syncStats.matched : 1),
+        syncStats.maxSkew[m_syncDepth],
+        syncStats.dropped[m_syncColor],
+        syncStats.dropped[m_syncDepth],
+        streamStats.latencySum[m_streamSkeleton] / 1000.0 / (streamStats.dispatched[m_streamSkeleton] > 0 ? streamStats.dispatched[m_streamSkeleton] : 1),
+        streamStats.maxLatency[m_streamSkeleton] / 1000.0,
+        m_pDrawBackgroundRemovalBasics->GetPresentedFrameCount(),
+        m_pDrawBackgroundRemovalBasics->GetSubmittedFrameCount(),
+        m_pDrawBackgroundRemovalBasics->GetCoalescedFrameCount());
+    SetStatusMessage(szMessage);
+    m_frameSync.ResetStats();
+    m_streamScheduler.ResetStats();
+
+    m_depthRemoverFrames = 0;
+    memset(&m_depthRemoverTimings, 0, sizeof(m_depthRemoverTimings));
+}
+
+/// <summary>
+/// Show how many of the SDK stream's frames the renderer presented, every few frames
+/// </summary>
+void CBackgroundRemovalBasics::ReportPacing()
+{
+    if (++m_pacingReportFrames < cTimingReportFrames)
     {
-        // Convert the image format to 32bppPBGRA
-        // (DXGI_FORMAT_B8G8R8A8_UNORM + D2D1_ALPHA_MODE_PREMULTIPLIED).
-        hr = pIWICFactory->CreateFormatConverter(&pConverter);
+        return;
     }
 
-    if (SUCCEEDED(hr))
+    WCHAR szMessage[cStatusMessageMaxLen];
+    swprintf_s(szMessage, L"Presented %lu of %lu frames, %lu replaced before their refresh",
+        m_pDrawBackgroundRemovalBasics->GetPresentedFrameCount(),
+        m_pDrawBackgroundRemovalBasics->GetSubmittedFrameCount(),
+        m_pDrawBackgroundRemovalBasics->GetCoalescedFrameCount());
+    SetStatusMessage(szMessage);
+
+    m_pacingReportFrames = 0;
+}
+
+/// <summary>
+/// Use the player selector to determine the players whom the background removed
+/// color stream and our depth engine should consider as foreground.
+/// By default the closest player is kept for as long as they stay visible, even when the
+/// sensor loses them for a moment and gives them a new tracking ID.
+/// </summary>
+/// <param name="pSkeletonData">skeletons of the frame</param>
+/// <param name="timestamp">time stamp (in milliseconds) of the skeleton frame</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CBackgroundRemovalBasics::ChooseSkeleton(NUI_SKELETON_DATA* pSkeletonData, LONGLONG timestamp)
+{
+	HRESULT hr = S_OK;
+
+	C_ASSERT(cIdentityJointCount == NUI_SKELETON_POSITION_COUNT);
+
+	// Everyone in the frame is identified, whether or not they can be selected
+	SkeletonObservation observations[NUI_SKELETON_COUNT];
+	int observationCount = 0;
+	for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+	{
+		const NUI_SKELETON_DATA& skeleton = pSkeletonData[i];
+		if (NUI_SKELETON_NOT_TRACKED == skeleton.eTrackingState)
+		{
+			continue;
+		}
+
+		SkeletonObservation& observation = observations[observationCount++];
+		observation.trackingId = skeleton.dwTrackingID;
+		observation.x = skeleton.Position.x;
+		observation.y = skeleton.Position.y;
+		observation.z = skeleton.Position.z;
+
+		for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+		{
+			observation.jointX[j] = skeleton.SkeletonPositions[j].x;
+			observation.jointY[j] = skeleton.SkeletonPositions[j].y;
+			observation.jointZ[j] = skeleton.SkeletonPositions[j].z;
+			observation.jointTracked[j] = (NUI_SKELETON_TRACKED == skeleton.eTrackingState &&
+				NUI_SKELETON_POSITION_TRACKED == skeleton.eSkeletonPositionTrackingState[j]) ? 1 : 0;
+		}
+	}
+
+	m_skeletonIdentifier.Update(observations, observationCount, timestamp);
+
+	// Then we gather the people in the stream, people without a full skeleton only count when every player is kept
+	PlayerCandidate candidates[NUI_SKELETON_COUNT];
+	int candidateCount = 0;
+	for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+	{
+		const NUI_SKELETON_DATA& skeleton = pSkeletonData[i];
+		if (NUI_SKELETON_TRACKED == skeleton.eTrackingState ||
+			(m_bAllPlayers && NUI_SKELETON_POSITION_ONLY == skeleton.eTrackingState))
+		{
+			PlayerCandidate& candidate = candidates[candidateCount++];
+			// The selector keeps players by person ID, which outlives the tracking ID
+			candidate.trackingId = m_skeletonIdentifier.GetPersonId(skeleton.dwTrackingID);
+
+			// The depth frame marks the pixels of the skeleton at index i with player index i + 1
+			candidate.playerIndex = i + 1;
+			candidate.x = skeleton.Position.x;
+			candidate.y = skeleton.Position.y;
+			candidate.z = skeleton.Position.z;
+		}
+	}
+
+	// Our engine keeps every selected player in a single pass over the depth frame, it applies
+	// the selection once the depth frame taken with this skeleton frame comes in
+	m_selectedPlayers = m_playerSelector.Select(candidates, candidateCount);
+
+	// The SDK stream keeps one player only, the closest selected player with a full skeleton
+	for (int selected = 0; selected < m_playerSelector.GetSelectedCount(); ++selected)
+	{
+		const DWORD trackingId = m_skeletonIdentifier.GetTrackingId(m_playerSelector.GetSelectedTrackingId(selected));
+
+		for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+		{
+			if (NUI_SKELETON_TRACKED == pSkeletonData[i].eTrackingState && trackingId == pSkeletonData[i].dwTrackingID)
+			{
+				if (m_trackedSkeleton != trackingId)
+				{
+					hr = m_pBackgroundRemovalStream->SetTrackedPlayer(trackingId);
+					if (FAILED(hr))
+					{
+						return hr;
+					}
+
+					m_trackedSkeleton = trackingId;
+				}
+
+				return hr;
+			}
+		}
+	}
+
+	return hr;
+}
+
+/// <summary>
+/// Start loading the background images and list the video backgrounds: the embedded image, then the images,
+/// .y4m videos and image sequence folders of the Backgrounds folder next to the executable
+/// </summary>
+void CBackgroundRemovalBasics::LoadBackgrounds()
+{
+    WCHAR folder[MAX_PATH];
+    DWORD length = GetModuleFileNameW(HINST_THISCOMPONENT, folder, _countof(folder));
+    WCHAR* pFileName = (0 < length && length < _countof(folder)) ? wcsrchr(folder, L'\\') : NULL;
+    const bool bFolder = NULL != pFileName && 0 == wcscpy_s(pFileName, _countof(folder) - (pFileName - folder), L"\\Backgrounds");
+
+    // The images are decoded once per resolution, and only decoded again when a source changes
+    WCHAR cachePath[MAX_PATH];
+    WCHAR tempPath[MAX_PATH];
+    length = GetTempPathW(_countof(tempPath), tempPath);
+    if (0 < length && length < _countof(tempPath) &&
+        0 <= _snwprintf_s(cachePath, _TRUNCATE, L"%sBackgroundRemovalBasics-%ux%u.bgcache", tempPath, m_colorWidth, m_colorHeight) &&
+        SUCCEEDED(m_backgroundCache.Initialize(m_colorWidth, m_colorHeight, cachePath)))
     {
-        hr = pIWICFactory->CreateBitmapScaler(&pScaler);
+        m_backgroundCache.AddResource(HINST_THISCOMPONENT, L"Background", L"Image");
+
+        if (bFolder)
+        {
+            m_backgroundCache.AddFolder(folder);
+        }
+
+        m_backgroundCache.Start();
     }
 
-    if (SUCCEEDED(hr))
+    if (bFolder)
     {
-        hr = pScaler->Initialize(
-            pSource,
-            m_colorWidth,
-            m_colorHeight,
-            WICBitmapInterpolationModeCubic
-            );
+        FindVideoBackgrounds(folder);
     }
+}
 
-    if (SUCCEEDED(hr))
+/// <summary>
+/// List the .y4m videos of a folder, and its sub folders as image sequences
+/// </summary>
+/// <param name="folder">folder to look into</param>
+void CBackgroundRemovalBasics::FindVideoBackgrounds(PCWSTR folder)
+{
+    WCHAR pattern[MAX_PATH];
+    if (0 > _snwprintf_s(pattern, _TRUNCATE, L"%s\\*", folder))
     {
-        hr = pConverter->Initialize(
-            pScaler,
-            GUID_WICPixelFormat32bppPBGRA,
-            WICBitmapDitherTypeNone,
-            NULL,
-            0.f,
-            WICBitmapPaletteTypeMedianCut
-            );
+        return;
     }
 
-    UINT width = 0;
-    UINT height = 0;
-    if (SUCCEEDED(hr))
+    WIN32_FIND_DATAW findData;
+    HANDLE hFind = FindFirstFileW(pattern, &findData);
+    if (INVALID_HANDLE_VALUE == hFind)
     {
-        hr = pConverter->GetSize(&width, &height);
+        return;
     }
 
-    // make sure the output buffer is large enough
-    if (SUCCEEDED(hr))
+    do
     {
-        if ( width*height*cBytesPerPixel > cOutputBuffer )
+        const bool bSubFolder = 0 != (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+        const WCHAR* extension = wcsrchr(findData.cFileName, L'.');
+
+        if ((bSubFolder && L'.' != findData.cFileName[0]) || (!bSubFolder && NULL != extension && 0 == _wcsicmp(extension, L".y4m")))
         {
-            hr = E_FAIL;
+            if (m_videoCount < cMaxVideoBackgrounds &&
+                0 <= _snwprintf_s(m_videoSources[m_videoCount], _TRUNCATE, L"%s\\%s", folder, findData.cFileName))
+            {
+                ++m_videoCount;
+            }
         }
     }
+    while (FindNextFileW(hFind, &findData));
 
-    if (SUCCEEDED(hr))
-    {
-        hr = pConverter->CopyPixels(NULL, width*cBytesPerPixel, cOutputBuffer, outputBuffer);
-    }
-
-    SafeRelease(pScaler);
-    SafeRelease(pConverter);
-    SafeRelease(pSource);
-    SafeRelease(pDecoder);
-    SafeRelease(pStream);
-    SafeRelease(pIWICFactory);
-
-    return hr;
+    FindClose(hFind);
 }
 
 /// <summary>
@@ -858,7 +1258,9 @@ void CBackgroundRemovalBasics::UpdateSensorAndStatus(DWORD changedFlags)
     case NUISENSORCHOOSER_SENSOR_CHANGED_FLAG:
         {
             // Free the previous sensor and try to get a new one
+            SafeRelease(m_pCoordinateMapper);
             SafeRelease(m_pNuiSensor);
+            m_frameSync.Reset();
             HRESULT hr = CreateFirstConnected();
             if (SUCCEEDED(hr))
             {
@@ -9,6 +9,13 @@
 #include "resource.h"
 #include "NuiApi.h"
 #include "ImageRenderer.h"
+#include "DepthBackgroundRemover.h"
+#include "FrameSynchronizer.h"
+#include "StreamScheduler.h"
+#include "BackgroundBlur.h"
+#include "BackgroundAssetCache.h"
+#include "VideoBackground.h"
+#include "SkeletonIdentifier.h"
 #include <KinectBackgroundRemoval.h>
 #include <NuiSensorChooser.h>
 #include "NuiSensorChooserUI.h"
@@ -24,6 +31,26 @@ class CBackgroundRemovalBasics
 
     static const int        cStatusMessageMaxLen = MAX_PATH*2;
 
+    // number of frames the depth engine timings are averaged over before they are shown
+    static const int        cTimingReportFrames = 30;
+
+    // frames buffered per stream while waiting for the matching frames of the other streams
+    static const int        cSyncWindow = 4;
+
+    // largest time stamp difference (in milliseconds) of matched frames, half a frame at 30 frames per second
+    static const int        cSyncTolerance = 16;
+
+    // the blurred background is computed at a quarter of the color resolution
+    static const int        cBlurScale = 4;
+
+    // time (in microseconds) after it comes in by which a frame of each stream should be handled
+    static const int        cSkeletonDeadline  = 5000;
+    static const int        cFrameDeadline     = 10000;
+    static const int        cCompositeDeadline = 33000;
+
+    // largest number of video backgrounds listed
+    static const UINT       cMaxVideoBackgrounds = 16;
+
 public:
     /// <summary>
     /// Constructor
@@ -86,8 +113,54 @@ private:
     HANDLE                             m_hNextSkeletonFrameEvent;
     HANDLE                             m_hNextBackgroundRemovedFrameEvent;
 
+    // Black background, shown while the background images load
     BYTE*                              m_backgroundRGBX;
     BYTE*                              m_outputRGBX;
+    BYTE*                              m_outputBlockKinds;
+
+    // Blurred live color frame, shown instead of the background image when selected
+    BackgroundBlur                     m_backgroundBlur;
+    BOOL                               m_bBlurBackground;
+
+    // Whether the depth engine keys the edge of its mask against the background colors
+    BOOL                               m_bColorKey;
+
+    // Background images, decoded once and kept in a cache file
+    BackgroundAssetCache               m_backgroundCache;
+    UINT                               m_backgroundIndex;
+    const BYTE*                        m_pBackground;
+
+    // Video backgrounds, shown after the images, and the one playing
+    UINT                               m_videoCount;
+    WCHAR                              m_videoSources[cMaxVideoBackgrounds][MAX_PATH];
+    VideoBackground                    m_videoBackground;
+
+    // Our own depth driven background removal, used instead of the SDK stream when selected
+    DepthBackgroundRemover             m_depthRemover;
+    BOOL                               m_bUseDepthRemover;
+    INuiCoordinateMapper*              m_pCoordinateMapper;
+    DepthPlayerPixel*                  m_depthPixels;
+    ColorPoint*                        m_depthToColor;
+    BYTE*                              m_removedRGBA;
+    DepthBackgroundRemoverTimings      m_depthRemoverTimings;
+    int                                m_depthRemoverFrames;
+    int                                m_pacingReportFrames;
+
+    // Depth, color and skeleton frames are matched by time stamp before our engine uses them,
+    // each stream buffers its frames in the slots of its own array
+    FrameSynchronizer                  m_frameSync;
+    int                                m_syncColor;
+    int                                m_syncDepth;
+    int                                m_syncSkeleton;
+    BYTE*                              m_colorFrames;
+    UINT                               m_skeletonPlayers[cSyncWindow];
+
+    // Order in which the streams with a frame waiting are handled
+    StreamScheduler                    m_streamScheduler;
+    int                                m_streamSkeleton;
+    int                                m_streamDepth;
+    int                                m_streamColor;
+    int                                m_streamComposite;
 
     INuiBackgroundRemovedColorStream*  m_pBackgroundRemovalStream;
 
@@ -100,22 +173,38 @@ private:
     UINT                               m_depthHeight;
     DWORD                              m_trackedSkeleton;
 
+    // Players kept in the foreground, the SDK stream keeps the closest of them and our engine keeps them all.
+    // The selector sees person IDs, so a player the sensor loses for a moment keeps their place
+    SkeletonIdentifier                 m_skeletonIdentifier;
+    PlayerSelector                     m_playerSelector;
+    BOOL                               m_bAllPlayers;
+    BOOL                               m_bCenterZone;
+    BOOL                               m_bLockPlayers;
+    UINT                               m_selectedPlayers;
+
 
     /// <summary>
-    /// Load an image from a resource into a buffer
+    /// Start loading the background images and list the video backgrounds: the embedded image, then the images,
+    /// .y4m videos and image sequence folders of the Backgrounds folder next to the executable
     /// </summary>
-    /// <param name="resourceName">name of image resource to load</param>
-    /// <param name="resourceType">type of resource to load</param>
-    /// <param name="cOutputBuffer">size of output buffer, in bytes</param>
-    /// <param name="outputBuffer">buffer that will hold the loaded image</param>
-    /// <returns>S_OK on success, otherwise failure code</returns>
-    HRESULT                 LoadResourceImage(PCWSTR resourceName, PCWSTR resourceType, DWORD cOutputBuffer, BYTE* outputBuffer);
+    void                    LoadBackgrounds();
 
     /// <summary>
-    /// Main processing function
+    /// List the .y4m videos of a folder, and its sub folders as image sequences
+    /// </summary>
+    /// <param name="folder">folder to look into</param>
+    void                    FindVideoBackgrounds(PCWSTR folder);
+
+    /// <summary>
+    /// Main processing function, handles the streams that have a frame waiting, most urgent first
     /// </summary>
     void                    Update();
 
+    /// <summary>
+    /// Select players according to the all players and center zone controls
+    /// </summary>
+    void                    UpdatePlayerPolicy();
+
     /// <summary>
     /// Create the first connected Kinect found 
     /// </summary>
@@ -152,12 +241,44 @@ private:
     /// <returns>S_OK on success, otherwise failure code</returns>
     HRESULT                 ComposeImage();
 
+    /// <summary>
+    /// remove the background with our own depth engine and compose the result with the background image
+    /// </summary>
+    /// <param name="timestamp">time stamp of the color frame</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 ComposeDepthRemovedImage(LONGLONG timestamp);
+
+    /// <summary>
+    /// Blend a background removed color frame over the background image, video or the blurred color frame
+    /// </summary>
+    /// <param name="pForeground">background removed color frame in BGRA format</param>
+    /// <param name="timestamp">time stamp of the color frame, the video frame shown is the one due at that time</param>
+    void                    ComposeOverBackground(const BYTE* pForeground, LONGLONG timestamp);
+
+    /// <summary>
+    /// Remove the background of the next matching depth and color frames with our own depth engine
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 ProcessSyncedFrames();
+
+    /// <summary>
+    /// Show the depth engine's per stage timings, averaged over a few frames
+    /// </summary>
+    void                    ReportDepthRemoverTimings();
+
+    /// <summary>
+    /// Show how many of the SDK stream's frames the renderer presented, every few frames
+    /// </summary>
+    void                    ReportPacing();
+
 	/// <summary>
     /// Use the sticky player logic to determine the player whom the background removed
 	/// color stream should consider as foreground.
     /// </summary>
+    /// <param name="pSkeletonData">skeletons of the frame</param>
+    /// <param name="timestamp">time stamp (in milliseconds) of the skeleton frame</param>
     /// <returns>S_OK on success, otherwise failure code</returns>
-	HRESULT                 ChooseSkeleton(NUI_SKELETON_DATA* pSkeletonData);
+	HRESULT                 ChooseSkeleton(NUI_SKELETON_DATA* pSkeletonData, LONGLONG timestamp);
 
     /// <summary>
     /// Set the status bar message
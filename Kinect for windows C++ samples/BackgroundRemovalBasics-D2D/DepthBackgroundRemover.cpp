@@ -0,0 +1,596 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthBackgroundRemover.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DepthBackgroundRemover.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+static const int cBytesPerPixel = 4;
+
+/// <summary>
+/// Current time for the stage timings
+/// </summary>
+/// <returns>time in milliseconds from an arbitrary origin</returns>
+static double GetTimeMilliseconds()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return 1000.0 * static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+#else
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/// <summary>
+/// Horizontal pass of a binary dilation (any pixel of the window set) or erosion (every pixel set)
+/// Counts set pixels with a running sum so the cost does not depend on the radius
+/// </summary>
+static void MorphologyRows(const unsigned char* pSource, unsigned char* pDest, int width, int height, int radius, bool dilate)
+{
+    // Dilation keeps pixels whose window count is above 0, erosion those whose whole window is set.
+    // The window is cut at the borders, so the image edge neither grows nor erodes the mask.
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* pRow = pSource + y * width;
+        unsigned char* pOut = pDest + y * width;
+        int count = 0;
+
+        for (int x = 0; x < radius && x < width; ++x)
+        {
+            count += (0 != pRow[x]);
+        }
+
+        for (int x = 0; x < width; ++x)
+        {
+            if (x + radius < width)
+            {
+                count += (0 != pRow[x + radius]);
+            }
+            if (x > radius)
+            {
+                count -= (0 != pRow[x - radius - 1]);
+            }
+
+            const int window = ((x + radius < width) ? x + radius : width - 1) - ((x > radius) ? x - radius : 0) + 1;
+            const int threshold = dilate ? 1 : window;
+            pOut[x] = (count >= threshold) ? 255 : 0;
+        }
+    }
+}
+
+/// <summary>
+/// Vertical pass of a binary dilation or erosion, walking rows so memory is read in order
+/// </summary>
+static void MorphologyColumns(const unsigned char* pSource, unsigned char* pDest, int width, int height, int radius, bool dilate, unsigned int* pCounts)
+{
+    memset(pCounts, 0, width * sizeof(unsigned int));
+
+    for (int y = 0; y < radius && y < height; ++y)
+    {
+        const unsigned char* pRow = pSource + y * width;
+        for (int x = 0; x < width; ++x)
+        {
+            pCounts[x] += (0 != pRow[x]);
+        }
+    }
+
+    for (int y = 0; y < height; ++y)
+    {
+        if (y + radius < height)
+        {
+            const unsigned char* pAdd = pSource + (y + radius) * width;
+            for (int x = 0; x < width; ++x)
+            {
+                pCounts[x] += (0 != pAdd[x]);
+            }
+        }
+        if (y > radius)
+        {
+            const unsigned char* pRemove = pSource + (y - radius - 1) * width;
+            for (int x = 0; x < width; ++x)
+            {
+                pCounts[x] -= (0 != pRemove[x]);
+            }
+        }
+
+        const int window = ((y + radius < height) ? y + radius : height - 1) - ((y > radius) ? y - radius : 0) + 1;
+        const unsigned int threshold = dilate ? 1 : window;
+        unsigned char* pOut = pDest + y * width;
+
+        for (int x = 0; x < width; ++x)
+        {
+            pOut[x] = (pCounts[x] >= threshold) ? 255 : 0;
+        }
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+DepthBackgroundRemover::DepthBackgroundRemover() :
+    m_depthWidth(0),
+    m_depthHeight(0),
+    m_colorWidth(0),
+    m_colorHeight(0),
+    m_trackedPlayers(0),
+    m_closeRadius(2),
+    m_featherRadius(2),
+    m_refineMode(DepthRefineGuided),
+    m_bUpsamplerReady(false),
+    m_bStabilize(true),
+    m_bKey(false)
+{
+    memset(&m_timings, 0, sizeof(m_timings));
+    memset(m_playerStats, 0, sizeof(m_playerStats));
+    SetTrackedPlayer(0);
+}
+
+/// <summary>
+/// Set the frame sizes and allocate the working buffers
+/// </summary>
+/// <param name="depthWidth">width (in pixels) of the depth frame</param>
+/// <param name="depthHeight">height (in pixels) of the depth frame</param>
+/// <param name="colorWidth">width (in pixels) of the color frame</param>
+/// <param name="colorHeight">height (in pixels) of the color frame</param>
+/// <returns>true on success</returns>
+bool DepthBackgroundRemover::Initialize(int depthWidth, int depthHeight, int colorWidth, int colorHeight)
+{
+    if (depthWidth <= 0 || depthHeight <= 0 || colorWidth <= 0 || colorHeight <= 0)
+    {
+        return false;
+    }
+
+    m_depthWidth  = depthWidth;
+    m_depthHeight = depthHeight;
+    m_colorWidth  = colorWidth;
+    m_colorHeight = colorHeight;
+
+    m_depthMask.assign(depthWidth * depthHeight, 0);
+    m_colorMask.assign(colorWidth * colorHeight, 0);
+    m_scratch.assign(depthWidth * depthHeight, 0);
+    m_horizontalSums.assign(colorWidth * colorHeight, 0);
+    m_columnSums.assign((colorWidth > depthWidth) ? colorWidth : depthWidth, 0);
+    m_registration.clear();
+
+    // The guided filter works at depth resolution, which must divide the color resolution evenly
+    const int scale = colorWidth / depthWidth;
+    m_bUpsamplerReady = scale >= 1 && scale * depthWidth == colorWidth && scale * depthHeight == colorHeight &&
+        m_upsampler.Initialize(colorWidth, colorHeight, scale);
+
+    m_stabilizer.Initialize(colorWidth, colorHeight);
+    m_keyer.Initialize(colorWidth, colorHeight);
+
+    return true;
+}
+
+/// <summary>
+/// Select the player kept in the foreground
+/// </summary>
+/// <param name="playerIndex">player index as found in the depth frame (1 to 6), 0 keeps every player</param>
+void DepthBackgroundRemover::SetTrackedPlayer(unsigned short playerIndex)
+{
+    SetTrackedPlayers((0 == playerIndex) ? ~1u : (1u << (playerIndex & cMaxPlayerIndex)));
+}
+
+/// <summary>
+/// Select the players kept in the foreground, as returned by PlayerSelector::Select
+/// </summary>
+/// <param name="players">bit i set to keep player index i</param>
+void DepthBackgroundRemover::SetTrackedPlayers(unsigned int players)
+{
+    // Player index 0 is the background
+    players &= ((1u << (cMaxPlayerIndex + 1)) - 1) & ~1u;
+
+    // The mask of other players has nothing to do with the previous one
+    if (players != m_trackedPlayers)
+    {
+        m_stabilizer.Reset();
+    }
+
+    m_trackedPlayers = players;
+
+    for (int i = 0; i <= cMaxPlayerIndex; ++i)
+    {
+        m_playerMask[i] = (0 != (players & (1u << i))) ? 255 : 0;
+    }
+}
+
+/// <summary>
+/// Turn the temporal stabilization of the alpha on or off, it is on by default
+/// </summary>
+/// <param name="enable">true to stabilize</param>
+void DepthBackgroundRemover::SetStabilization(bool enable)
+{
+    // Start over from the next frame rather than from a stale history
+    if (enable && !m_bStabilize)
+    {
+        m_stabilizer.Reset();
+    }
+
+    m_bStabilize = enable;
+}
+
+/// <summary>
+/// Turn the color keying of the edge on or off, it is off by default
+/// </summary>
+/// <param name="enable">true to key</param>
+void DepthBackgroundRemover::SetKeying(bool enable)
+{
+    // The background may have changed while the keyer was not learning
+    if (enable && !m_bKey)
+    {
+        m_keyer.Reset();
+    }
+
+    m_bKey = enable;
+}
+
+/// <summary>
+/// Set a fixed depth to color table, used for frames processed without their own table
+/// </summary>
+/// <param name="pRegistration">color coordinates of every depth pixel, NULL to scale depth coordinates instead</param>
+void DepthBackgroundRemover::SetRegistration(const ColorPoint* pRegistration)
+{
+    if (NULL == pRegistration)
+    {
+        m_registration.clear();
+    }
+    else
+    {
+        m_registration.assign(pRegistration, pRegistration + m_depthWidth * m_depthHeight);
+    }
+}
+
+/// <summary>
+/// Tune the refine stage
+/// </summary>
+/// <param name="closeRadius">radius (in depth pixels) of the holes and gaps to close, 0 to skip</param>
+/// <param name="featherRadius">radius (in color pixels) of the soft edge when feathering, 0 for a hard edge</param>
+void DepthBackgroundRemover::SetRefinement(int closeRadius, int featherRadius)
+{
+    m_closeRadius = (closeRadius > 0) ? closeRadius : 0;
+
+    // Keep the feather window sums within range
+    m_featherRadius = (featherRadius > 0) ? featherRadius : 0;
+    if (m_featherRadius > cMaxFeatherRadius)
+    {
+        m_featherRadius = cMaxFeatherRadius;
+    }
+}
+
+/// <summary>
+/// Remove the background of a color frame
+/// </summary>
+/// <param name="pDepth">depth frame with player index</param>
+/// <param name="pRegistration">color coordinates of every depth pixel for this frame, NULL to use the fixed table</param>
+/// <param name="pColor">color frame in BGRX format</param>
+/// <param name="pOutput">receives the color frame in BGRA format, alpha 0 on the background</param>
+/// <returns>true on success</returns>
+bool DepthBackgroundRemover::Process(const DepthPlayerPixel* pDepth, const ColorPoint* pRegistration, const unsigned char* pColor, unsigned char* pOutput)
+{
+    if (m_colorMask.empty() || NULL == pDepth || NULL == pColor || NULL == pOutput)
+    {
+        return false;
+    }
+
+    const double start = GetTimeMilliseconds();
+
+    BuildDepthMask(pDepth);
+    const double masked = GetTimeMilliseconds();
+
+    // Holes come from missing depth, so they are closed at depth resolution before the mask grows
+    CloseMask();
+    const double closed = GetTimeMilliseconds();
+
+    RegisterMask((NULL != pRegistration) ? pRegistration : (m_registration.empty() ? NULL : &m_registration[0]));
+    const double registered = GetTimeMilliseconds();
+
+    SoftenMask(pColor);
+
+    if (m_bKey)
+    {
+        m_keyer.Refine(&m_colorMask[0], pColor);
+    }
+    const double refined = GetTimeMilliseconds();
+
+    if (m_bStabilize)
+    {
+        m_stabilizer.Stabilize(&m_colorMask[0], pColor);
+    }
+    const double stabilized = GetTimeMilliseconds();
+
+    ComposeOutput(pColor, pOutput);
+    const double composed = GetTimeMilliseconds();
+
+    m_timings.mask         = masked - start;
+    m_timings.registration = registered - closed;
+    m_timings.refine       = (closed - masked) + (refined - registered);
+    m_timings.stabilize    = stabilized - refined;
+    m_timings.compose      = composed - stabilized;
+    m_timings.total        = composed - start;
+
+    return true;
+}
+
+/// <summary>
+/// Mask stage: mark the depth pixels that belong to the tracked players
+/// The mask value comes from a table indexed by player index, so the pass costs the same for one
+/// player or all of them, and the pixel count and bounds of every player are gathered on the way
+/// </summary>
+/// <param name="pDepth">depth frame with player index</param>
+void DepthBackgroundRemover::BuildDepthMask(const DepthPlayerPixel* pDepth)
+{
+    unsigned char* pMask = &m_depthMask[0];
+    int counts[cMaxPlayerIndex + 1] = { 0 };
+    int left[cMaxPlayerIndex + 1];
+    int right[cMaxPlayerIndex + 1];
+    int top[cMaxPlayerIndex + 1];
+    int bottom[cMaxPlayerIndex + 1];
+
+    for (int i = 0; i <= cMaxPlayerIndex; ++i)
+    {
+        left[i]   = m_depthWidth;
+        right[i]  = -1;
+        top[i]    = m_depthHeight;
+        bottom[i] = -1;
+    }
+
+    for (int y = 0; y < m_depthHeight; ++y)
+    {
+        const DepthPlayerPixel* pRow = pDepth + y * m_depthWidth;
+        unsigned char* pMaskRow = pMask + y * m_depthWidth;
+
+        // Bounds only need the first and last pixel of each player on the row
+        int rowCounts[cMaxPlayerIndex + 1] = { 0 };
+        int rowLeft[cMaxPlayerIndex + 1];
+        int rowRight[cMaxPlayerIndex + 1];
+
+        for (int x = 0; x < m_depthWidth; ++x)
+        {
+            const int player = pRow[x].playerIndex & cMaxPlayerIndex;
+            pMaskRow[x] = m_playerMask[player];
+
+            if (0 == rowCounts[player]++)
+            {
+                rowLeft[player] = x;
+            }
+            rowRight[player] = x;
+        }
+
+        for (int i = 1; i <= cMaxPlayerIndex; ++i)
+        {
+            if (0 != rowCounts[i])
+            {
+                counts[i] += rowCounts[i];
+                left[i]    = (rowLeft[i] < left[i]) ? rowLeft[i] : left[i];
+                right[i]   = (rowRight[i] > right[i]) ? rowRight[i] : right[i];
+                top[i]     = (y < top[i]) ? y : top[i];
+                bottom[i]  = y;
+            }
+        }
+    }
+
+    for (int i = 0; i <= cMaxPlayerIndex; ++i)
+    {
+        m_playerStats[i].pixelCount = counts[i];
+        m_playerStats[i].left       = left[i];
+        m_playerStats[i].top        = top[i];
+        m_playerStats[i].right      = right[i];
+        m_playerStats[i].bottom     = bottom[i];
+    }
+}
+
+/// <summary>
+/// Registration stage: splat every player pixel over the block of color pixels it covers
+/// </summary>
+/// <param name="pRegistration">color coordinates of every depth pixel, NULL to scale depth coordinates</param>
+void DepthBackgroundRemover::RegisterMask(const ColorPoint* pRegistration)
+{
+    unsigned char* pColorMask = &m_colorMask[0];
+    memset(pColorMask, 0, m_colorMask.size());
+
+    // Size of a depth pixel in color pixels, rounded up so neighbouring splats leave no gaps
+    const int blockWidth  = (m_colorWidth + m_depthWidth - 1) / m_depthWidth;
+    const int blockHeight = (m_colorHeight + m_depthHeight - 1) / m_depthHeight;
+
+    for (int y = 0; y < m_depthHeight; ++y)
+    {
+        const unsigned char* pMaskRow = &m_depthMask[y * m_depthWidth];
+
+        for (int x = 0; x < m_depthWidth; ++x)
+        {
+            if (0 == pMaskRow[x])
+            {
+                continue;
+            }
+
+            int left;
+            int top;
+            if (NULL != pRegistration)
+            {
+                left = pRegistration[y * m_depthWidth + x].x;
+                top  = pRegistration[y * m_depthWidth + x].y;
+            }
+            else
+            {
+                left = x * m_colorWidth / m_depthWidth;
+                top  = y * m_colorHeight / m_depthHeight;
+            }
+
+            int right  = left + blockWidth;
+            int bottom = top + blockHeight;
+
+            left   = (left < 0) ? 0 : left;
+            top    = (top < 0) ? 0 : top;
+            right  = (right > m_colorWidth) ? m_colorWidth : right;
+            bottom = (bottom > m_colorHeight) ? m_colorHeight : bottom;
+
+            for (int row = top; row < bottom; ++row)
+            {
+                for (int column = left; column < right; ++column)
+                {
+                    pColorMask[row * m_colorWidth + column] = 255;
+                }
+            }
+        }
+    }
+}
+
+/// <summary>
+/// First part of the refine stage: a morphological close of the depth mask fills the holes and
+/// cracks left where the sensor found no depth inside the player
+/// </summary>
+void DepthBackgroundRemover::CloseMask()
+{
+    if (0 == m_closeRadius)
+    {
+        return;
+    }
+
+    unsigned char* pMask = &m_depthMask[0];
+    unsigned char* pScratch = &m_scratch[0];
+    unsigned int* pCounts = &m_columnSums[0];
+
+    MorphologyRows(pMask, pScratch, m_depthWidth, m_depthHeight, m_closeRadius, true);
+    MorphologyColumns(pScratch, pMask, m_depthWidth, m_depthHeight, m_closeRadius, true, pCounts);
+    MorphologyRows(pMask, pScratch, m_depthWidth, m_depthHeight, m_closeRadius, false);
+    MorphologyColumns(pScratch, pMask, m_depthWidth, m_depthHeight, m_closeRadius, false, pCounts);
+}
+
+/// <summary>
+/// Second part of the refine stage: turn the hard mask into a soft alpha
+/// </summary>
+/// <param name="pColor">color frame in BGRX format, guides the edges</param>
+void DepthBackgroundRemover::SoftenMask(const unsigned char* pColor)
+{
+    if (DepthRefineGuided == m_refineMode && m_bUpsamplerReady)
+    {
+        m_upsampler.Upsample(&m_colorMask[0], pColor, &m_colorMask[0]);
+    }
+    else
+    {
+        FeatherMask();
+    }
+}
+
+/// <summary>
+/// Feathering: a box blur turns the hard mask edge into a soft alpha ramp
+/// Running sums in both directions keep the cost linear in the pixel count whatever the radius
+/// </summary>
+void DepthBackgroundRemover::FeatherMask()
+{
+    if (0 == m_featherRadius)
+    {
+        return;
+    }
+
+    const int radius = m_featherRadius;
+    const int window = 2 * radius + 1;
+    unsigned char* pMask = &m_colorMask[0];
+    unsigned short* pSums = &m_horizontalSums[0];
+    unsigned int* pColumns = &m_columnSums[0];
+
+    // Horizontal sums, pixels past the borders repeat the edge pixel
+    for (int y = 0; y < m_colorHeight; ++y)
+    {
+        const unsigned char* pRow = pMask + y * m_colorWidth;
+        unsigned short* pRowSums = pSums + y * m_colorWidth;
+        const int last = m_colorWidth - 1;
+
+        unsigned int sum = (radius + 1) * pRow[0];
+        for (int x = 1; x <= radius; ++x)
+        {
+            sum += pRow[(x < last) ? x : last];
+        }
+
+        int x = 0;
+        for (; x < m_colorWidth && x <= radius; ++x)
+        {
+            const int add = x + radius + 1;
+            pRowSums[x] = static_cast<unsigned short>(sum);
+            sum += pRow[(add < last) ? add : last] - pRow[0];
+        }
+
+        // No clamping needed in the middle of the row
+        for (; x + radius + 1 <= last; ++x)
+        {
+            pRowSums[x] = static_cast<unsigned short>(sum);
+            sum += pRow[x + radius + 1] - pRow[x - radius];
+        }
+
+        for (; x < m_colorWidth; ++x)
+        {
+            pRowSums[x] = static_cast<unsigned short>(sum);
+            sum += pRow[last] - pRow[x - radius];
+        }
+    }
+
+    // Vertical sums of the horizontal sums, divided through a fixed point reciprocal of the window area.
+    // The reciprocal is rounded up so a full window gives exactly 255.
+    const unsigned int reciprocal = ((1U << 24) + window * window - 1) / (window * window);
+    const int last = m_colorHeight - 1;
+
+    for (int x = 0; x < m_colorWidth; ++x)
+    {
+        pColumns[x] = (radius + 1) * pSums[x];
+    }
+    for (int y = 1; y <= radius; ++y)
+    {
+        const unsigned short* pRowSums = pSums + ((y < last) ? y : last) * m_colorWidth;
+        for (int x = 0; x < m_colorWidth; ++x)
+        {
+            pColumns[x] += pRowSums[x];
+        }
+    }
+
+    for (int y = 0; y < m_colorHeight; ++y)
+    {
+        unsigned char* pOut = pMask + y * m_colorWidth;
+        const int add = y + radius + 1;
+        const int remove = y - radius;
+        const unsigned short* pAdd = pSums + ((add < last) ? add : last) * m_colorWidth;
+        const unsigned short* pRemove = pSums + ((remove > 0) ? remove : 0) * m_colorWidth;
+
+        for (int x = 0; x < m_colorWidth; ++x)
+        {
+            pOut[x] = static_cast<unsigned char>((pColumns[x] * reciprocal) >> 24);
+            pColumns[x] += pAdd[x] - pRemove[x];
+        }
+    }
+}
+
+/// <summary>
+/// Compose stage: color with the mask as alpha, background pixels are fully transparent black
+/// </summary>
+/// <param name="pColor">color frame in BGRX format</param>
+/// <param name="pOutput">receives the color frame in BGRA format</param>
+void DepthBackgroundRemover::ComposeOutput(const unsigned char* pColor, unsigned char* pOutput) const
+{
+    const int count = m_colorWidth * m_colorHeight;
+    const unsigned char* pMask = &m_colorMask[0];
+
+    for (int i = 0; i < count; ++i)
+    {
+        const unsigned char alpha = pMask[i];
+        const unsigned char keep = (0 != alpha) ? 0xFF : 0;
+
+        pOutput[0] = pColor[0] & keep;
+        pOutput[1] = pColor[1] & keep;
+        pOutput[2] = pColor[2] & keep;
+        pOutput[3] = alpha;
+
+        pColor += cBytesPerPixel;
+        pOutput += cBytesPerPixel;
+    }
+}
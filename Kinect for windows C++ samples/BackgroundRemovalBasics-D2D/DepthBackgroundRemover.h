@@ -0,0 +1,227 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthBackgroundRemover.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Removes the background of a color frame using the player index of the depth stream,
+// as an alternative to INuiBackgroundRemovedColorStream that can be tuned and profiled.
+// A frame goes through five stages:
+//     mask          select the pixels of the kept players in one pass over the depth frame,
+//                   whatever the number of players kept
+//     registration  map them into color space through a depth to color table
+//     refine        close small holes in the depth mask, then turn the blocky color mask
+//                   into a soft alpha, either with a guided filter that snaps the edges
+//                   to the color image (take a look at GuidedMaskUpsampler.h) or with a
+//                   plain feather, and optionally key the edge against a learned picture
+//                   of the background to bring back detail depth misses (take a look at
+//                   HybridKeyer.h)
+//     stabilize     keep the alpha from flickering between frames (take a look at MaskStabilizer.h)
+//     compose       write BGRA pixels with the mask as alpha, the same layout as
+//                   NUI_BACKGROUND_REMOVED_COLOR_FRAME::pBackgroundRemovedColorData
+// Only depends on the C++ standard library so it can run from recorded frames anywhere.
+
+#pragma once
+
+#include <vector>
+#include "GuidedMaskUpsampler.h"
+#include "HybridKeyer.h"
+#include "MaskStabilizer.h"
+#include "PlayerSelector.h"
+
+// Same layout as NUI_DEPTH_IMAGE_PIXEL
+struct DepthPlayerPixel
+{
+    unsigned short playerIndex;
+    unsigned short depth;
+};
+
+// Same layout as NUI_COLOR_IMAGE_POINT
+struct ColorPoint
+{
+    int x;
+    int y;
+};
+
+// Pixels of one player in the last depth frame, bounds are inclusive and only valid when pixelCount is not 0
+struct DepthPlayerStats
+{
+    int pixelCount;
+    int left;
+    int top;
+    int right;
+    int bottom;
+};
+
+// How the refine stage softens the edges of the mask
+enum DepthRefineMode
+{
+    DepthRefineFeather,
+    DepthRefineGuided
+};
+
+// Time spent in each stage of the last frame, in milliseconds
+struct DepthBackgroundRemoverTimings
+{
+    double mask;
+    double registration;
+    double refine;
+    double stabilize;
+    double compose;
+    double total;
+};
+
+class DepthBackgroundRemover
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    DepthBackgroundRemover();
+
+    /// <summary>
+    /// Set the frame sizes and allocate the working buffers
+    /// </summary>
+    /// <param name="depthWidth">width (in pixels) of the depth frame</param>
+    /// <param name="depthHeight">height (in pixels) of the depth frame</param>
+    /// <param name="colorWidth">width (in pixels) of the color frame</param>
+    /// <param name="colorHeight">height (in pixels) of the color frame</param>
+    /// <returns>true on success</returns>
+    bool Initialize(int depthWidth, int depthHeight, int colorWidth, int colorHeight);
+
+    /// <summary>
+    /// Select the player kept in the foreground
+    /// </summary>
+    /// <param name="playerIndex">player index as found in the depth frame (1 to 6), 0 keeps every player</param>
+    void SetTrackedPlayer(unsigned short playerIndex);
+
+    /// <summary>
+    /// Select the players kept in the foreground, as returned by PlayerSelector::Select
+    /// </summary>
+    /// <param name="players">bit i set to keep player index i</param>
+    void SetTrackedPlayers(unsigned int players);
+
+    /// <summary>
+    /// Where the pixels of a player were in the last depth frame, kept or not
+    /// </summary>
+    /// <param name="playerIndex">player index as found in the depth frame (1 to 7)</param>
+    const DepthPlayerStats& GetPlayerStats(int playerIndex) const { return m_playerStats[playerIndex & cMaxPlayerIndex]; }
+
+    /// <summary>
+    /// Set a fixed depth to color table, used for frames processed without their own table
+    /// </summary>
+    /// <param name="pRegistration">color coordinates of every depth pixel, NULL to scale depth coordinates instead</param>
+    void SetRegistration(const ColorPoint* pRegistration);
+
+    /// <summary>
+    /// Tune the refine stage
+    /// </summary>
+    /// <param name="closeRadius">radius (in depth pixels) of the holes and gaps to close, 0 to skip</param>
+    /// <param name="featherRadius">radius (in color pixels) of the soft edge when feathering, 0 for a hard edge</param>
+    void SetRefinement(int closeRadius, int featherRadius);
+
+    /// <summary>
+    /// Select how the refine stage softens the edges
+    /// </summary>
+    /// <param name="mode">guided upsampling (the default) or feathering</param>
+    void SetRefineMode(DepthRefineMode mode) { m_refineMode = mode; }
+
+    /// <summary>
+    /// Tune the guided upsampling
+    /// </summary>
+    /// <param name="radius">radius of the filter window, in depth pixels</param>
+    /// <param name="epsilon">regularization, larger values give softer edges that follow the color less</param>
+    void SetGuidedParameters(int radius, float epsilon) { m_upsampler.SetParameters(radius, epsilon); }
+
+    /// <summary>
+    /// Turn the temporal stabilization of the alpha on or off, it is on by default
+    /// </summary>
+    /// <param name="enable">true to stabilize</param>
+    void SetStabilization(bool enable);
+
+    /// <summary>
+    /// Tune the temporal stabilization (take a look at MaskStabilizer.h)
+    /// </summary>
+    void SetStabilizationParameters(int baseWeight, int motionGain, int confidenceGain) { m_stabilizer.SetParameters(baseWeight, motionGain, confidenceGain); }
+
+    /// <summary>
+    /// Forget earlier frames, call it when frames stopped coming for a while
+    /// </summary>
+    void ResetHistory() { m_stabilizer.Reset(); m_keyer.Reset(); }
+
+    /// <summary>
+    /// Turn the color keying of the edge on or off, it is off by default
+    /// </summary>
+    /// <param name="enable">true to key</param>
+    void SetKeying(bool enable);
+
+    /// <summary>
+    /// Tune the color keying (take a look at HybridKeyer.h)
+    /// </summary>
+    void SetKeyingParameters(int bandRadius, int lowThreshold, int highThreshold, int colorWeight) { m_keyer.SetParameters(bandRadius, lowThreshold, highThreshold, colorWeight); }
+
+    /// <summary>
+    /// Number of pixels in the band keyed in the last frame, only counted while keying
+    /// </summary>
+    int GetKeyedPixelCount() const { return m_bKey ? m_keyer.GetBandPixelCount() : 0; }
+
+    /// <summary>
+    /// Remove the background of a color frame
+    /// </summary>
+    /// <param name="pDepth">depth frame with player index</param>
+    /// <param name="pRegistration">color coordinates of every depth pixel for this frame, NULL to use the fixed table</param>
+    /// <param name="pColor">color frame in BGRX format</param>
+    /// <param name="pOutput">receives the color frame in BGRA format, alpha 0 on the background</param>
+    /// <returns>true on success</returns>
+    bool Process(const DepthPlayerPixel* pDepth, const ColorPoint* pRegistration, const unsigned char* pColor, unsigned char* pOutput);
+
+    /// <summary>
+    /// Alpha mask of the last frame in color space, one byte per color pixel
+    /// </summary>
+    const unsigned char* GetColorMask() const { return m_colorMask.empty() ? 0 : &m_colorMask[0]; }
+
+    const DepthBackgroundRemoverTimings& GetTimings() const { return m_timings; }
+
+private:
+    // Keeps the feather window sums within 16 bits horizontally and the fixed point division within 32 bits
+    static const int              cMaxFeatherRadius = 64;
+
+    int                           m_depthWidth;
+    int                           m_depthHeight;
+    int                           m_colorWidth;
+    int                           m_colorHeight;
+
+    // Kept players as a bit set, and as the mask value of each player index
+    unsigned int                  m_trackedPlayers;
+    unsigned char                 m_playerMask[cMaxPlayerIndex + 1];
+    DepthPlayerStats              m_playerStats[cMaxPlayerIndex + 1];
+    int                           m_closeRadius;
+    int                           m_featherRadius;
+    DepthRefineMode               m_refineMode;
+    GuidedMaskUpsampler           m_upsampler;
+    bool                          m_bUpsamplerReady;
+    MaskStabilizer                m_stabilizer;
+    bool                          m_bStabilize;
+    HybridKeyer                   m_keyer;
+    bool                          m_bKey;
+
+    std::vector<ColorPoint>       m_registration;
+
+    // Player mask in depth space (0 or 255), then alpha in color space
+    std::vector<unsigned char>    m_depthMask;
+    std::vector<unsigned char>    m_colorMask;
+    std::vector<unsigned char>    m_scratch;
+
+    // Running sums of the refine stage
+    std::vector<unsigned short>   m_horizontalSums;
+    std::vector<unsigned int>     m_columnSums;
+
+    DepthBackgroundRemoverTimings m_timings;
+
+    void BuildDepthMask(const DepthPlayerPixel* pDepth);
+    void RegisterMask(const ColorPoint* pRegistration);
+    void CloseMask();
+    void FeatherMask();
+    void SoftenMask(const unsigned char* pColor);
+    void ComposeOutput(const unsigned char* pColor, unsigned char* pOutput) const;
+};
@@ -0,0 +1,219 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DirtyTileTracker.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DirtyTileTracker.h"
+#include <string.h>
+
+static const unsigned long long cHashSeed  = 0xcbf29ce484222325ULL;
+static const unsigned long long cHashPrime = 0x100000001b3ULL;
+
+/// <summary>
+/// Constructor
+/// </summary>
+DirtyTileTracker::DirtyTileTracker() :
+    m_width(0),
+    m_height(0),
+    m_stride(0),
+    m_bytesPerPixel(0),
+    m_tilesX(0),
+    m_tilesY(0),
+    m_bValid(false)
+{
+}
+
+/// <summary>
+/// Set the format of the images that will be tracked and forget any previous frame
+/// </summary>
+/// <param name="width">width (in pixels) of the image</param>
+/// <param name="height">height (in pixels) of the image</param>
+/// <param name="stride">length (in bytes) of a single scanline</param>
+/// <param name="bytesPerPixel">size (in bytes) of a single pixel</param>
+/// <returns>true if the format is valid</returns>
+bool DirtyTileTracker::Initialize(unsigned int width, unsigned int height, unsigned int stride, unsigned int bytesPerPixel)
+{
+    if (0 == width || 0 == height || 0 == bytesPerPixel || stride < width * bytesPerPixel)
+    {
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_stride = stride;
+    m_bytesPerPixel = bytesPerPixel;
+    m_tilesX = (width + cTileSize - 1) / cTileSize;
+    m_tilesY = (height + cTileSize - 1) / cTileSize;
+
+    m_tileHashes.assign(m_tilesX * m_tilesY, 0);
+    m_rowHashes.assign(m_tilesX, 0);
+    m_dirtyRects.clear();
+    m_dirtyRects.reserve(cMaxDirtyRects);
+
+    Invalidate();
+
+    return true;
+}
+
+/// <summary>
+/// Force the next Update to report the whole image as dirty, e.g. after the upload target was lost
+/// </summary>
+void DirtyTileTracker::Invalidate()
+{
+    m_bValid = false;
+}
+
+/// <summary>
+/// Hash a run of bytes, 8 bytes at a time
+/// </summary>
+/// <param name="hash">running hash value</param>
+/// <param name="pData">data to hash</param>
+/// <param name="cbData">size of data in bytes</param>
+/// <returns>updated hash value</returns>
+unsigned long long DirtyTileTracker::HashBytes(unsigned long long hash, const unsigned char* pData, unsigned int cbData)
+{
+    const unsigned char* pEnd = pData + (cbData & ~7u);
+
+    while (pData < pEnd)
+    {
+        unsigned long long word;
+        memcpy(&word, pData, sizeof(word));
+
+        // FNV-1a on 64 bit words, with a fold of the high bits so every input bit reaches the low bits
+        hash = (hash ^ word) * cHashPrime;
+        hash ^= hash >> 29;
+
+        pData += sizeof(word);
+    }
+
+    for (unsigned int i = 0; i < (cbData & 7u); ++i)
+    {
+        hash = (hash ^ pData[i]) * cHashPrime;
+    }
+
+    return hash;
+}
+
+/// <summary>
+/// Hash every tile of the image, compare against the previous frame and collect the changed regions
+/// </summary>
+/// <param name="pImage">image data of the previously specified format</param>
+/// <returns>number of dirty rectangles, 0 if the image is identical to the previous one</returns>
+unsigned int DirtyTileTracker::Update(const unsigned char* pImage)
+{
+    m_dirtyRects.clear();
+
+    if (0 == m_tilesX || NULL == pImage)
+    {
+        return 0;
+    }
+
+    const unsigned int tileBytes = cTileSize * m_bytesPerPixel;
+    const unsigned int rowBytes = m_width * m_bytesPerPixel;
+    unsigned int dirtyTiles = 0;
+
+    for (unsigned int ty = 0; ty < m_tilesY; ++ty)
+    {
+        const unsigned int top = ty * cTileSize;
+        const unsigned int bottom = (top + cTileSize < m_height) ? top + cTileSize : m_height;
+
+        // Walk the band scanline by scanline so memory is read strictly in order
+        for (unsigned int tx = 0; tx < m_tilesX; ++tx)
+        {
+            m_rowHashes[tx] = cHashSeed;
+        }
+
+        for (unsigned int y = top; y < bottom; ++y)
+        {
+            const unsigned char* pRow = pImage + y * m_stride;
+
+            for (unsigned int tx = 0; tx < m_tilesX; ++tx)
+            {
+                const unsigned int offset = tx * tileBytes;
+                const unsigned int cb = (offset + tileBytes < rowBytes) ? tileBytes : rowBytes - offset;
+                m_rowHashes[tx] = HashBytes(m_rowHashes[tx], pRow + offset, cb);
+            }
+        }
+
+        // Compare against the previous frame and merge horizontally adjacent dirty tiles into one rectangle
+        bool bInRun = false;
+        for (unsigned int tx = 0; tx < m_tilesX; ++tx)
+        {
+            unsigned long long& previous = m_tileHashes[ty * m_tilesX + tx];
+            const bool bDirty = !m_bValid || previous != m_rowHashes[tx];
+            previous = m_rowHashes[tx];
+
+            if (bDirty)
+            {
+                ++dirtyTiles;
+
+                const unsigned int right = ((tx + 1) * cTileSize < m_width) ? (tx + 1) * cTileSize : m_width;
+                if (bInRun)
+                {
+                    m_dirtyRects.back().right = right;
+                }
+                else
+                {
+                    DirtyRect rect = { tx * cTileSize, top, right, bottom };
+                    m_dirtyRects.push_back(rect);
+                    bInRun = true;
+                }
+            }
+            else
+            {
+                bInRun = false;
+            }
+        }
+    }
+
+    m_bValid = true;
+
+    if (0 == dirtyTiles)
+    {
+        return 0;
+    }
+
+    // Merge a run with the one directly above it when they span the same columns
+    std::vector<DirtyRect>::size_type write = 0;
+    for (std::vector<DirtyRect>::size_type read = 0; read < m_dirtyRects.size(); ++read)
+    {
+        const DirtyRect& rect = m_dirtyRects[read];
+        bool bMerged = false;
+
+        for (std::vector<DirtyRect>::size_type i = 0; i < write; ++i)
+        {
+            DirtyRect& above = m_dirtyRects[i];
+            if (above.bottom == rect.top && above.left == rect.left && above.right == rect.right)
+            {
+                above.bottom = rect.bottom;
+                bMerged = true;
+                break;
+            }
+        }
+
+        if (!bMerged)
+        {
+            m_dirtyRects[write++] = rect;
+        }
+    }
+    m_dirtyRects.resize(write);
+
+    // Many fragments, or most of the frame changed: one full upload is cheaper
+    if (m_dirtyRects.size() > cMaxDirtyRects || dirtyTiles * 4 >= m_tilesX * m_tilesY * 3)
+    {
+        AddFullFrame();
+    }
+
+    return GetDirtyRectCount();
+}
+
+/// <summary>
+/// Replace the dirty rectangles with a single rectangle covering the whole image
+/// </summary>
+void DirtyTileTracker::AddFullFrame()
+{
+    DirtyRect rect = { 0, 0, m_width, m_height };
+    m_dirtyRects.clear();
+    m_dirtyRects.push_back(rect);
+}
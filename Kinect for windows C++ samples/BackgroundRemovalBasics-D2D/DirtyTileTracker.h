@@ -0,0 +1,89 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DirtyTileTracker.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Detects which parts of an image changed since the previous frame.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+#include <vector>
+
+/// <summary>
+/// Rectangle in pixels, right and bottom are exclusive (same convention as D2D1_RECT_U)
+/// </summary>
+struct DirtyRect
+{
+    unsigned int left;
+    unsigned int top;
+    unsigned int right;
+    unsigned int bottom;
+};
+
+class DirtyTileTracker
+{
+public:
+    static const unsigned int cTileSize = 64;
+
+    // Beyond this many rectangles a single full-frame upload is cheaper than many small ones
+    static const unsigned int cMaxDirtyRects = 32;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    DirtyTileTracker();
+
+    /// <summary>
+    /// Set the format of the images that will be tracked and forget any previous frame
+    /// </summary>
+    /// <param name="width">width (in pixels) of the image</param>
+    /// <param name="height">height (in pixels) of the image</param>
+    /// <param name="stride">length (in bytes) of a single scanline</param>
+    /// <param name="bytesPerPixel">size (in bytes) of a single pixel</param>
+    /// <returns>true if the format is valid</returns>
+    bool Initialize(unsigned int width, unsigned int height, unsigned int stride, unsigned int bytesPerPixel);
+
+    /// <summary>
+    /// Hash every tile of the image, compare against the previous frame and collect the changed regions
+    /// </summary>
+    /// <param name="pImage">image data of the previously specified format</param>
+    /// <returns>number of dirty rectangles, 0 if the image is identical to the previous one</returns>
+    unsigned int Update(const unsigned char* pImage);
+
+    /// <summary>
+    /// Force the next Update to report the whole image as dirty, e.g. after the upload target was lost
+    /// </summary>
+    void Invalidate();
+
+    /// <summary>
+    /// Dirty rectangles found by the last Update
+    /// </summary>
+    unsigned int GetDirtyRectCount() const { return static_cast<unsigned int>(m_dirtyRects.size()); }
+    const DirtyRect& GetDirtyRect(unsigned int index) const { return m_dirtyRects[index]; }
+
+    /// <summary>
+    /// Hash a run of bytes. Exposed so the hashing cost can be measured on its own.
+    /// </summary>
+    /// <param name="hash">running hash value</param>
+    /// <param name="pData">data to hash</param>
+    /// <param name="cbData">size of data in bytes</param>
+    /// <returns>updated hash value</returns>
+    static unsigned long long HashBytes(unsigned long long hash, const unsigned char* pData, unsigned int cbData);
+
+private:
+    unsigned int                    m_width;
+    unsigned int                    m_height;
+    unsigned int                    m_stride;
+    unsigned int                    m_bytesPerPixel;
+    unsigned int                    m_tilesX;
+    unsigned int                    m_tilesY;
+    bool                            m_bValid;
+
+    std::vector<unsigned long long> m_tileHashes;
+    std::vector<unsigned long long> m_rowHashes;
+    std::vector<DirtyRect>          m_dirtyRects;
+
+    void AddFullFrame();
+};
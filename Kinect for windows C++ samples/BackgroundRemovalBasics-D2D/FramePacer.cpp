@@ -0,0 +1,127 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="FramePacer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FramePacer.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+FramePacer::FramePacer() :
+    m_interval(0),
+    m_lastPresent(0),
+    m_bPresentedOnce(false),
+    m_bPending(false),
+    m_submitted(0),
+    m_presented(0),
+    m_coalesced(0)
+{
+}
+
+/// <summary>
+/// Set the minimum time between two presents, 0 disables pacing
+/// </summary>
+/// <param name="intervalMicroseconds">refresh interval in microseconds</param>
+void FramePacer::SetInterval(long long intervalMicroseconds)
+{
+    m_interval = (intervalMicroseconds > 0) ? intervalMicroseconds : 0;
+}
+
+/// <summary>
+/// Whether a present is allowed at the given time
+/// </summary>
+/// <param name="now">current time in microseconds</param>
+/// <returns>true if a full interval has passed since the last present</returns>
+bool FramePacer::IsDue(long long now) const
+{
+    return !m_bPresentedOnce || now - m_lastPresent >= m_interval;
+}
+
+/// <summary>
+/// Record a newly produced frame
+/// </summary>
+/// <param name="now">current time in microseconds</param>
+/// <returns>true if the frame should be presented right away, false if it is now the pending frame</returns>
+bool FramePacer::Submit(long long now)
+{
+    ++m_submitted;
+
+    if (IsDue(now))
+    {
+        // The new frame supersedes anything still waiting
+        if (m_bPending)
+        {
+            ++m_coalesced;
+            m_bPending = false;
+        }
+
+        return true;
+    }
+
+    if (m_bPending)
+    {
+        ++m_coalesced;
+    }
+
+    m_bPending = true;
+    return false;
+}
+
+/// <summary>
+/// Check whether the pending frame is due, and if so take it
+/// </summary>
+/// <param name="now">current time in microseconds</param>
+/// <returns>true if the caller should present the pending frame now</returns>
+bool FramePacer::TakePending(long long now)
+{
+    if (!m_bPending || !IsDue(now))
+    {
+        return false;
+    }
+
+    m_bPending = false;
+    return true;
+}
+
+/// <summary>
+/// Record that a frame was presented
+/// </summary>
+/// <param name="now">current time in microseconds</param>
+void FramePacer::OnPresented(long long now)
+{
+    ++m_presented;
+
+    // Stay on the refresh grid when we are only slightly late, so one late wakeup does not shift every later present
+    if (m_bPresentedOnce && m_interval > 0 && now - m_lastPresent < 2 * m_interval)
+    {
+        m_lastPresent += m_interval;
+    }
+    else
+    {
+        m_lastPresent = now;
+    }
+
+    m_bPresentedOnce = true;
+}
+
+/// <summary>
+/// Time left until the pending frame is due
+/// </summary>
+/// <param name="now">current time in microseconds</param>
+/// <returns>microseconds to wait, 0 if due now, -1 if there is no pending frame</returns>
+long long FramePacer::GetTimeUntilDue(long long now) const
+{
+    if (!m_bPending)
+    {
+        return -1;
+    }
+
+    if (IsDue(now))
+    {
+        return 0;
+    }
+
+    return m_lastPresent + m_interval - now;
+}
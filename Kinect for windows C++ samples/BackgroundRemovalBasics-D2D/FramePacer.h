@@ -0,0 +1,74 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="FramePacer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Decides when submitted frames are presented so that at most one frame is
+// presented per display refresh. Frames that arrive early are held back and
+// only the newest one is kept (latest frame wins).
+// Times are passed in by the caller, in microseconds from any fixed origin.
+
+#pragma once
+
+class FramePacer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    FramePacer();
+
+    /// <summary>
+    /// Set the minimum time between two presents, 0 disables pacing
+    /// </summary>
+    /// <param name="intervalMicroseconds">refresh interval in microseconds</param>
+    void SetInterval(long long intervalMicroseconds);
+
+    /// <summary>
+    /// Record a newly produced frame
+    /// </summary>
+    /// <param name="now">current time in microseconds</param>
+    /// <returns>true if the frame should be presented right away, false if it is now the pending frame</returns>
+    bool Submit(long long now);
+
+    /// <summary>
+    /// Check whether the pending frame is due, and if so take it
+    /// </summary>
+    /// <param name="now">current time in microseconds</param>
+    /// <returns>true if the caller should present the pending frame now</returns>
+    bool TakePending(long long now);
+
+    /// <summary>
+    /// Record that a frame was presented
+    /// </summary>
+    /// <param name="now">current time in microseconds</param>
+    void OnPresented(long long now);
+
+    /// <summary>
+    /// Time left until the pending frame is due
+    /// </summary>
+    /// <param name="now">current time in microseconds</param>
+    /// <returns>microseconds to wait, 0 if due now, -1 if there is no pending frame</returns>
+    long long GetTimeUntilDue(long long now) const;
+
+    bool HasPending() const { return m_bPending; }
+    unsigned long GetSubmittedCount() const { return m_submitted; }
+    unsigned long GetPresentedCount() const { return m_presented; }
+
+    /// <summary>
+    /// Frames replaced by a newer one before they were ever presented
+    /// </summary>
+    unsigned long GetCoalescedCount() const { return m_coalesced; }
+
+private:
+    long long     m_interval;
+    long long     m_lastPresent;
+    bool          m_bPresentedOnce;
+    bool          m_bPending;
+    unsigned long m_submitted;
+    unsigned long m_presented;
+    unsigned long m_coalesced;
+
+    bool IsDue(long long now) const;
+};
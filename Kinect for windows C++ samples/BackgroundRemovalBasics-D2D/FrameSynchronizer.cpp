@@ -0,0 +1,293 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="FrameSynchronizer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FrameSynchronizer.h"
+#include <string.h>
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameSynchronizer::FrameSynchronizer() :
+    m_window(4),
+    m_tolerance(16),
+    m_streamCount(0)
+{
+    memset(m_streams, 0, sizeof(m_streams));
+    ResetStats();
+}
+
+/// <summary>
+/// Set the number of frames buffered per stream and the matching tolerance, drops every stream
+/// </summary>
+/// <param name="window">frames buffered per stream, 3 or more so one can be filled while another is being used</param>
+/// <param name="tolerance">largest time stamp difference of matched frames, in time stamp units</param>
+void FrameSynchronizer::Initialize(int window, long long tolerance)
+{
+    m_window = (window < 3) ? 3 : ((window > cMaxSyncWindow) ? cMaxSyncWindow : window);
+    m_tolerance = (tolerance < 0) ? 0 : tolerance;
+    Reset();
+}
+
+/// <summary>
+/// Add a stream, the first one added is the anchor
+/// </summary>
+/// <param name="required">true when a match needs a frame of this stream, false when it can go without</param>
+/// <returns>index of the stream, -1 when there are too many streams</returns>
+int FrameSynchronizer::AddStream(bool required)
+{
+    if (m_streamCount >= cMaxSyncStreams)
+    {
+        return -1;
+    }
+
+    Stream& stream = m_streams[m_streamCount];
+    stream.required = required;
+
+    for (int slot = 0; slot < cMaxSyncWindow; ++slot)
+    {
+        stream.state[slot] = SlotFree;
+    }
+
+    return m_streamCount++;
+}
+
+/// <summary>
+/// Get a slot to fill with the next frame of a stream, dropping the oldest buffered frame when the window is full
+/// </summary>
+/// <param name="stream">index of the stream</param>
+/// <returns>slot index, from 0 to the window size</returns>
+int FrameSynchronizer::BeginFrame(int stream)
+{
+    Stream& frames = m_streams[stream];
+
+    for (int slot = 0; slot < m_window; ++slot)
+    {
+        if (SlotFree == frames.state[slot])
+        {
+            frames.state[slot] = SlotFilling;
+            return slot;
+        }
+    }
+
+    // The other streams fell behind, the oldest frame will never be matched in time
+    const int oldest = FindOldest(stream);
+    if (oldest >= 0)
+    {
+        Drop(stream, oldest);
+        frames.state[oldest] = SlotFilling;
+    }
+
+    return oldest;
+}
+
+/// <summary>
+/// Buffer the frame filled into a slot
+/// </summary>
+/// <param name="stream">index of the stream</param>
+/// <param name="slot">slot returned by BeginFrame</param>
+/// <param name="timestamp">time stamp of the frame</param>
+void FrameSynchronizer::EndFrame(int stream, int slot, long long timestamp)
+{
+    if (slot >= 0 && SlotFilling == m_streams[stream].state[slot])
+    {
+        m_streams[stream].state[slot] = SlotPending;
+        m_streams[stream].timestamp[slot] = timestamp;
+    }
+}
+
+/// <summary>
+/// Give back a slot that could not be filled
+/// </summary>
+void FrameSynchronizer::CancelFrame(int stream, int slot)
+{
+    if (slot >= 0 && SlotFilling == m_streams[stream].state[slot])
+    {
+        m_streams[stream].state[slot] = SlotFree;
+    }
+}
+
+/// <summary>
+/// Find the oldest set of matching frames. The slots stay untouched until the next call
+/// </summary>
+/// <param name="pSlots">receives the slot of every stream, -1 for optional streams without a matching frame</param>
+/// <returns>true when a match was found</returns>
+bool FrameSynchronizer::Match(int* pSlots)
+{
+    // The frames of the previous match are done with
+    for (int s = 0; s < m_streamCount; ++s)
+    {
+        for (int slot = 0; slot < m_window; ++slot)
+        {
+            if (SlotHeld == m_streams[s].state[slot])
+            {
+                m_streams[s].state[slot] = SlotFree;
+            }
+        }
+    }
+
+    for (;;)
+    {
+        const int anchor = FindOldest(0);
+        if (anchor < 0)
+        {
+            return false;
+        }
+
+        const long long anchorTime = m_streams[0].timestamp[anchor];
+        bool bWait = false;
+        bool bDropAnchor = false;
+
+        for (int s = 1; s < m_streamCount; ++s)
+        {
+            Stream& frames = m_streams[s];
+            int best = -1;
+            long long bestSkew = 0;
+            bool bNewer = false;
+
+            for (int slot = 0; slot < m_window; ++slot)
+            {
+                if (SlotPending != frames.state[slot])
+                {
+                    continue;
+                }
+
+                const long long skew = frames.timestamp[slot] - anchorTime;
+
+                // Too old for this anchor frame, so too old for every later one
+                if (skew < -m_tolerance)
+                {
+                    Drop(s, slot);
+                    continue;
+                }
+
+                if (skew > m_tolerance)
+                {
+                    bNewer = true;
+                    continue;
+                }
+
+                const long long distance = (skew < 0) ? -skew : skew;
+                if (best < 0 || distance < bestSkew)
+                {
+                    best = slot;
+                    bestSkew = distance;
+                }
+            }
+
+            pSlots[s] = best;
+
+            // Frames arrive in time stamp order, so once a newer frame is in the matching one is never coming
+            if (best < 0 && frames.required)
+            {
+                if (bNewer)
+                {
+                    bDropAnchor = true;
+                }
+                else
+                {
+                    bWait = true;
+                }
+            }
+        }
+
+        if (bDropAnchor)
+        {
+            Drop(0, anchor);
+            continue;
+        }
+
+        if (bWait)
+        {
+            return false;
+        }
+
+        pSlots[0] = anchor;
+        m_streams[0].state[anchor] = SlotHeld;
+        ++m_stats.matched;
+
+        for (int s = 1; s < m_streamCount; ++s)
+        {
+            if (pSlots[s] < 0)
+            {
+                continue;
+            }
+
+            Stream& frames = m_streams[s];
+            const long long matchedTime = frames.timestamp[pSlots[s]];
+            frames.state[pSlots[s]] = SlotHeld;
+
+            // Frames older than the match are further from every later anchor frame than the match is
+            for (int slot = 0; slot < m_window; ++slot)
+            {
+                if (SlotPending == frames.state[slot] && frames.timestamp[slot] < matchedTime)
+                {
+                    Drop(s, slot);
+                }
+            }
+
+            const long long skew = (matchedTime > anchorTime) ? matchedTime - anchorTime : anchorTime - matchedTime;
+            m_stats.skewSum[s] += skew;
+            m_stats.maxSkew[s] = (skew > m_stats.maxSkew[s]) ? skew : m_stats.maxSkew[s];
+        }
+
+        return true;
+    }
+}
+
+/// <summary>
+/// Drop every buffered frame, call it when a stream stopped for a while
+/// </summary>
+void FrameSynchronizer::Reset()
+{
+    for (int s = 0; s < m_streamCount; ++s)
+    {
+        for (int slot = 0; slot < cMaxSyncWindow; ++slot)
+        {
+            // A slot being filled is still committed or cancelled by its stream
+            if (SlotFilling != m_streams[s].state[slot])
+            {
+                m_streams[s].state[slot] = SlotFree;
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Clear the matching statistics
+/// </summary>
+void FrameSynchronizer::ResetStats()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Find the oldest buffered frame of a stream
+/// </summary>
+/// <returns>slot of the frame, -1 when none is buffered</returns>
+int FrameSynchronizer::FindOldest(int stream) const
+{
+    const Stream& frames = m_streams[stream];
+    int oldest = -1;
+
+    for (int slot = 0; slot < m_window; ++slot)
+    {
+        if (SlotPending == frames.state[slot] && (oldest < 0 || frames.timestamp[slot] < frames.timestamp[oldest]))
+        {
+            oldest = slot;
+        }
+    }
+
+    return oldest;
+}
+
+/// <summary>
+/// Drop a buffered frame that will never be matched
+/// </summary>
+void FrameSynchronizer::Drop(int stream, int slot)
+{
+    m_streams[stream].state[slot] = SlotFree;
+    ++m_stats.dropped[stream];
+}
@@ -0,0 +1,119 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="FrameSynchronizer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Matches the frames of several streams by time stamp, so the stages that combine
+// them always work on frames taken at the same time.
+// Each stream buffers a small window of frames in slots the caller owns: the caller
+// asks for a slot, fills it with the frame and commits it with its time stamp.
+// The first stream added is the anchor: every anchor frame is matched with the
+// nearest frame of each other stream, within a tolerance. Frames that can no longer
+// match anything are dropped as soon as that is known, before any work is spent on them.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+static const int cMaxSyncStreams = 4;
+static const int cMaxSyncWindow  = 8;
+
+// Matching statistics of each stream since the last reset, skews are relative to the anchor frame
+struct FrameSyncStats
+{
+    int       matched;
+    int       dropped[cMaxSyncStreams];
+    long long skewSum[cMaxSyncStreams];
+    long long maxSkew[cMaxSyncStreams];
+};
+
+class FrameSynchronizer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    FrameSynchronizer();
+
+    /// <summary>
+    /// Set the number of frames buffered per stream and the matching tolerance, drops every stream
+    /// </summary>
+    /// <param name="window">frames buffered per stream, 3 or more so one can be filled while another is being used</param>
+    /// <param name="tolerance">largest time stamp difference of matched frames, in time stamp units</param>
+    void Initialize(int window, long long tolerance);
+
+    /// <summary>
+    /// Add a stream, the first one added is the anchor
+    /// </summary>
+    /// <param name="required">true when a match needs a frame of this stream, false when it can go without</param>
+    /// <returns>index of the stream, -1 when there are too many streams</returns>
+    int AddStream(bool required);
+
+    /// <summary>
+    /// Get a slot to fill with the next frame of a stream, dropping the oldest buffered frame when the window is full
+    /// </summary>
+    /// <param name="stream">index of the stream</param>
+    /// <returns>slot index, from 0 to the window size</returns>
+    int BeginFrame(int stream);
+
+    /// <summary>
+    /// Buffer the frame filled into a slot
+    /// </summary>
+    /// <param name="stream">index of the stream</param>
+    /// <param name="slot">slot returned by BeginFrame</param>
+    /// <param name="timestamp">time stamp of the frame</param>
+    void EndFrame(int stream, int slot, long long timestamp);
+
+    /// <summary>
+    /// Give back a slot that could not be filled
+    /// </summary>
+    void CancelFrame(int stream, int slot);
+
+    /// <summary>
+    /// Find the oldest set of matching frames. The slots stay untouched until the next call
+    /// </summary>
+    /// <param name="pSlots">receives the slot of every stream, -1 for optional streams without a matching frame</param>
+    /// <returns>true when a match was found</returns>
+    bool Match(int* pSlots);
+
+    /// <summary>
+    /// Time stamp of a buffered frame
+    /// </summary>
+    long long GetTimestamp(int stream, int slot) const { return m_streams[stream].timestamp[slot]; }
+
+    /// <summary>
+    /// Drop every buffered frame, call it when a stream stopped for a while
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Matching statistics since the last call to ResetStats
+    /// </summary>
+    const FrameSyncStats& GetStats() const { return m_stats; }
+    void ResetStats();
+
+private:
+    enum SlotState
+    {
+        SlotFree,
+        SlotFilling,
+        SlotPending,
+        SlotHeld
+    };
+
+    struct Stream
+    {
+        bool      required;
+        SlotState state[cMaxSyncWindow];
+        long long timestamp[cMaxSyncWindow];
+    };
+
+    int            m_window;
+    long long      m_tolerance;
+    int            m_streamCount;
+    Stream         m_streams[cMaxSyncStreams];
+    FrameSyncStats m_stats;
+
+    int  FindOldest(int stream) const;
+    void Drop(int stream, int slot);
+};
@@ -0,0 +1,419 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="GuidedMaskUpsampler.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "GuidedMaskUpsampler.h"
+#include <string.h>
+
+// Luminance weights of blue, green and red in 8 bit fixed point, they add up to 256
+static const unsigned int cLumaBlue  = 29;
+static const unsigned int cLumaGreen = 150;
+static const unsigned int cLumaRed   = 77;
+
+// Scales a fixed point luminance so that white is 1
+static const float cLumaScale = 1.0f / (255 * 256);
+
+static const int cInterleavedRows = 4;
+
+/// <summary>
+/// Sums over a window of 2 * radius + 1 values along each of a few rows, cut at the row ends
+/// </summary>
+/// <param name="pSource">first row</param>
+/// <param name="pSums">receives the sums of the first row, the others follow</param>
+/// <param name="width">number of values in a row</param>
+/// <param name="radius">window radius</param>
+/// <param name="rows">number of rows, at most cInterleavedRows</param>
+static void HorizontalWindowSums(const float* pSource, float* pSums, int width, int radius, int rows)
+{
+    float sums[cInterleavedRows] = { 0.0f };
+
+    // Values entering the first window
+    for (int x = 0; x < radius && x < width; ++x)
+    {
+        for (int row = 0; row < rows; ++row)
+        {
+            sums[row] += pSource[row * width + x];
+        }
+    }
+
+    // Window still cut on the left
+    const int growEnd = (radius + 1 < width - radius) ? radius + 1 : width - radius;
+    int x = 0;
+    for (; x < growEnd; ++x)
+    {
+        for (int row = 0; row < rows; ++row)
+        {
+            sums[row] += pSource[row * width + x + radius];
+            pSums[row * width + x] = sums[row];
+        }
+    }
+
+    // Whole window inside the row
+    for (; x < width - radius; ++x)
+    {
+        for (int row = 0; row < rows; ++row)
+        {
+            sums[row] += pSource[row * width + x + radius] - pSource[row * width + x - radius - 1];
+            pSums[row * width + x] = sums[row];
+        }
+    }
+
+    // Window cut on the right, and on the left too when the row is narrower than the window
+    for (; x < width; ++x)
+    {
+        for (int row = 0; row < rows; ++row)
+        {
+            if (x > radius)
+            {
+                sums[row] -= pSource[row * width + x - radius - 1];
+            }
+            pSums[row * width + x] = sums[row];
+        }
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+GuidedMaskUpsampler::GuidedMaskUpsampler() :
+    m_width(0),
+    m_height(0),
+    m_scale(1),
+    m_lowWidth(0),
+    m_lowHeight(0),
+    m_radius(4),
+    m_epsilon(0.002f)
+{
+}
+
+/// <summary>
+/// Set the image size and allocate the working buffers
+/// </summary>
+/// <param name="width">width (in pixels) of the color image and mask</param>
+/// <param name="height">height (in pixels) of the color image and mask</param>
+/// <param name="scale">how many times lower the resolution of the mask's source is, 1 or more</param>
+/// <returns>true on success</returns>
+bool GuidedMaskUpsampler::Initialize(int width, int height, int scale)
+{
+    if (scale < 1 || width < 2 * scale || height < 2 * scale)
+    {
+        return false;
+    }
+
+    m_width     = width;
+    m_height    = height;
+    m_scale     = scale;
+    m_lowWidth  = (width + scale - 1) / scale;
+    m_lowHeight = (height + scale - 1) / scale;
+
+    const int lowCount = m_lowWidth * m_lowHeight;
+    m_guide.assign(lowCount, 0.0f);
+    m_mask.assign(lowCount, 0.0f);
+    m_guideMask.assign(lowCount, 0.0f);
+    m_guideSquared.assign(lowCount, 0.0f);
+    m_coefficientA.assign(lowCount, 0.0f);
+    m_coefficientB.assign(lowCount, 0.0f);
+    m_rowSums.assign(lowCount, 0.0f);
+    m_columnSums.assign(m_lowWidth, 0.0f);
+    m_rowA.assign(m_lowWidth, 0.0f);
+    m_rowB.assign(m_lowWidth, 0.0f);
+    m_fullRowA.assign(width, 0.0f);
+    m_fullRowB.assign(width, 0.0f);
+    m_luma.assign(width * height, 0);
+
+    // Sample the coefficients at the centers of the full resolution pixels, clamped to the low resolution grid
+    m_tapX.resize(width);
+    m_weightX.resize(width);
+    for (int x = 0; x < width; ++x)
+    {
+        float position = (x + 0.5f) / scale - 0.5f;
+        position = (position < 0.0f) ? 0.0f : position;
+        position = (position > m_lowWidth - 1) ? static_cast<float>(m_lowWidth - 1) : position;
+
+        int tap = static_cast<int>(position);
+        tap = (tap > m_lowWidth - 2) ? m_lowWidth - 2 : tap;
+
+        m_tapX[x] = tap;
+        m_weightX[x] = position - tap;
+    }
+
+    SetParameters(m_radius, m_epsilon);
+
+    return true;
+}
+
+/// <summary>
+/// Tune the filter
+/// </summary>
+/// <param name="radius">radius of the filter window, in low resolution pixels</param>
+/// <param name="epsilon">regularization, larger values give softer edges that follow the color less</param>
+void GuidedMaskUpsampler::SetParameters(int radius, float epsilon)
+{
+    m_radius = (radius > 1) ? radius : 1;
+    m_epsilon = (epsilon > 0.0f) ? epsilon : 1e-6f;
+
+    // Number of pixels in each column's window, cut at the borders
+    m_inverseCountX.resize(m_lowWidth);
+    for (int x = 0; x < m_lowWidth; ++x)
+    {
+        const int right = (x + m_radius < m_lowWidth) ? x + m_radius : m_lowWidth - 1;
+        const int left = (x > m_radius) ? x - m_radius : 0;
+        m_inverseCountX[x] = 1.0f / (right - left + 1);
+    }
+}
+
+/// <summary>
+/// Compute the soft alpha of a mask
+/// </summary>
+/// <param name="pMask">mask at full resolution, one byte per pixel</param>
+/// <param name="pColor">color image in BGRX format</param>
+/// <param name="pAlpha">receives the alpha, one byte per pixel, may be the same buffer as pMask</param>
+void GuidedMaskUpsampler::Upsample(const unsigned char* pMask, const unsigned char* pColor, unsigned char* pAlpha)
+{
+    if (m_guide.empty())
+    {
+        return;
+    }
+
+    ComputeLuma(pColor);
+    Downsample(pMask);
+
+    const int count = m_lowWidth * m_lowHeight;
+    float* pGuide = &m_guide[0];
+    float* pLowMask = &m_mask[0];
+    float* pGuideMask = &m_guideMask[0];
+    float* pGuideSquared = &m_guideSquared[0];
+
+    for (int i = 0; i < count; ++i)
+    {
+        pGuideMask[i] = pGuide[i] * pLowMask[i];
+        pGuideSquared[i] = pGuide[i] * pGuide[i];
+    }
+
+    BoxMean(m_guide);
+    BoxMean(m_mask);
+    BoxMean(m_guideMask);
+    BoxMean(m_guideSquared);
+
+    // Fit alpha = a * guide + b in every window
+    float* pA = &m_coefficientA[0];
+    float* pB = &m_coefficientB[0];
+
+    for (int i = 0; i < count; ++i)
+    {
+        const float covariance = pGuideMask[i] - pGuide[i] * pLowMask[i];
+        const float variance = pGuideSquared[i] - pGuide[i] * pGuide[i];
+
+        pA[i] = covariance / (variance + m_epsilon);
+        pB[i] = pLowMask[i] - pA[i] * pGuide[i];
+    }
+
+    // Every pixel is covered by many windows, average their fits
+    BoxMean(m_coefficientA);
+    BoxMean(m_coefficientB);
+
+    ApplyCoefficients(pAlpha);
+}
+
+/// <summary>
+/// Fixed point luminance of every color pixel, the full resolution guide
+/// </summary>
+/// <param name="pColor">color image in BGRX format</param>
+void GuidedMaskUpsampler::ComputeLuma(const unsigned char* pColor)
+{
+    const int count = m_width * m_height;
+    unsigned short* pLuma = &m_luma[0];
+
+    for (int i = 0; i < count; ++i)
+    {
+        const unsigned char* pPixel = pColor + i * cBytesPerPixel;
+        pLuma[i] = static_cast<unsigned short>(cLumaBlue * pPixel[0] + cLumaGreen * pPixel[1] + cLumaRed * pPixel[2]);
+    }
+}
+
+/// <summary>
+/// Average the mask and the luminance over blocks of scale x scale pixels
+/// </summary>
+/// <param name="pMask">mask at full resolution</param>
+void GuidedMaskUpsampler::Downsample(const unsigned char* pMask)
+{
+    const unsigned short* pLuma = &m_luma[0];
+    float* pGuide = &m_guide[0];
+    float* pLowMask = &m_mask[0];
+
+    // Full blocks cover every column but possibly a few on the right, which are added to the last block
+    const int fullWidth = (m_width / m_scale) * m_scale;
+
+    for (int lowY = 0; lowY < m_lowHeight; ++lowY)
+    {
+        const int top = lowY * m_scale;
+        const int bottom = (top + m_scale < m_height) ? top + m_scale : m_height;
+        float* pGuideRow = pGuide + lowY * m_lowWidth;
+        float* pLowMaskRow = pLowMask + lowY * m_lowWidth;
+
+        memset(pGuideRow, 0, m_lowWidth * sizeof(float));
+        memset(pLowMaskRow, 0, m_lowWidth * sizeof(float));
+
+        // Add each row of the block, first its columns in step of the block width, one column offset at a time
+        for (int y = top; y < bottom; ++y)
+        {
+            const unsigned short* pLumaRow = pLuma + y * m_width;
+            const unsigned char* pMaskRow = pMask + y * m_width;
+
+            for (int offset = 0; offset < m_scale; ++offset)
+            {
+                for (int x = offset, lowX = 0; x < fullWidth; x += m_scale, ++lowX)
+                {
+                    pGuideRow[lowX] += pLumaRow[x];
+                    pLowMaskRow[lowX] += pMaskRow[x];
+                }
+            }
+
+            for (int x = fullWidth; x < m_width; ++x)
+            {
+                pGuideRow[m_lowWidth - 1] += pLumaRow[x];
+                pLowMaskRow[m_lowWidth - 1] += pMaskRow[x];
+            }
+        }
+
+        // Blocks on the right and bottom edges may be cut short
+        const float inverseRows = 1.0f / (bottom - top);
+        for (int lowX = 0; lowX < m_lowWidth; ++lowX)
+        {
+            const int left = lowX * m_scale;
+            const int right = (left + m_scale < m_width) ? left + m_scale : m_width;
+            const float inverseArea = inverseRows / (right - left);
+
+            pGuideRow[lowX] *= inverseArea * cLumaScale;
+            pLowMaskRow[lowX] *= inverseArea * (1.0f / 255.0f);
+        }
+    }
+}
+
+/// <summary>
+/// Replace a low resolution plane by its mean over the filter window, cut at the borders
+/// </summary>
+/// <param name="plane">plane to filter in place</param>
+void GuidedMaskUpsampler::BoxMean(std::vector<float>& plane)
+{
+    const int width = m_lowWidth;
+    const int height = m_lowHeight;
+    const int radius = m_radius;
+    float* pPlane = &plane[0];
+    float* pRows = &m_rowSums[0];
+    float* pColumns = &m_columnSums[0];
+    const float* pInverseCountX = &m_inverseCountX[0];
+
+    // Horizontal window sums, several rows at once so their running sums do not wait on each other
+    int y = 0;
+    for (; y + cInterleavedRows <= height; y += cInterleavedRows)
+    {
+        HorizontalWindowSums(pPlane + y * width, pRows + y * width, width, radius, cInterleavedRows);
+    }
+    for (; y < height; ++y)
+    {
+        HorizontalWindowSums(pPlane + y * width, pRows + y * width, width, radius, 1);
+    }
+
+    // Vertical sums of the horizontal sums, walking rows so memory is read in order
+    memset(pColumns, 0, width * sizeof(float));
+
+    for (int y = 0; y < radius && y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            pColumns[x] += pRows[y * width + x];
+        }
+    }
+
+    for (int y = 0; y < height; ++y)
+    {
+        if (y + radius < height)
+        {
+            const float* pAdd = pRows + (y + radius) * width;
+            for (int x = 0; x < width; ++x)
+            {
+                pColumns[x] += pAdd[x];
+            }
+        }
+        if (y > radius)
+        {
+            const float* pRemove = pRows + (y - radius - 1) * width;
+            for (int x = 0; x < width; ++x)
+            {
+                pColumns[x] -= pRemove[x];
+            }
+        }
+
+        const int bottom = (y + radius < height) ? y + radius : height - 1;
+        const int top = (y > radius) ? y - radius : 0;
+        const float inverseCountY = 1.0f / (bottom - top + 1);
+        float* pOut = pPlane + y * width;
+
+        for (int x = 0; x < width; ++x)
+        {
+            pOut[x] = pColumns[x] * inverseCountY * pInverseCountX[x];
+        }
+    }
+}
+
+/// <summary>
+/// Interpolate the averaged coefficients to full resolution and apply them to the full resolution guide
+/// </summary>
+/// <param name="pAlpha">receives the alpha, one byte per pixel</param>
+void GuidedMaskUpsampler::ApplyCoefficients(unsigned char* pAlpha)
+{
+    const float* pA = &m_coefficientA[0];
+    const float* pB = &m_coefficientB[0];
+    float* pRowA = &m_rowA[0];
+    float* pRowB = &m_rowB[0];
+    float* pFullRowA = &m_fullRowA[0];
+    float* pFullRowB = &m_fullRowB[0];
+    const int* pTapX = &m_tapX[0];
+    const float* pWeightX = &m_weightX[0];
+
+    // The guide is in fixed point, fold its scale and the final scale to 0..255 into the coefficients
+    const float scaleA = 255.0f * cLumaScale;
+
+    for (int y = 0; y < m_height; ++y)
+    {
+        float position = (y + 0.5f) / m_scale - 0.5f;
+        position = (position < 0.0f) ? 0.0f : position;
+        position = (position > m_lowHeight - 1) ? static_cast<float>(m_lowHeight - 1) : position;
+
+        int tapY = static_cast<int>(position);
+        tapY = (tapY > m_lowHeight - 2) ? m_lowHeight - 2 : tapY;
+        const float weightY = position - tapY;
+
+        // Blend the two low resolution rows around this row once, then only interpolate along the row
+        const float* pA0 = pA + tapY * m_lowWidth;
+        const float* pB0 = pB + tapY * m_lowWidth;
+        for (int x = 0; x < m_lowWidth; ++x)
+        {
+            pRowA[x] = scaleA * (pA0[x] + weightY * (pA0[x + m_lowWidth] - pA0[x]));
+            pRowB[x] = 255.0f * (pB0[x] + weightY * (pB0[x + m_lowWidth] - pB0[x])) + 0.5f;
+        }
+
+        for (int x = 0; x < m_width; ++x)
+        {
+            const int tap = pTapX[x];
+            const float weight = pWeightX[x];
+            pFullRowA[x] = pRowA[tap] + weight * (pRowA[tap + 1] - pRowA[tap]);
+            pFullRowB[x] = pRowB[tap] + weight * (pRowB[tap + 1] - pRowB[tap]);
+        }
+
+        const unsigned short* pLumaRow = &m_luma[y * m_width];
+        unsigned char* pAlphaRow = pAlpha + y * m_width;
+
+        for (int x = 0; x < m_width; ++x)
+        {
+            float alpha = pFullRowA[x] * pLumaRow[x] + pFullRowB[x];
+            alpha = (alpha < 0.0f) ? 0.0f : alpha;
+            alpha = (alpha > 255.0f) ? 255.0f : alpha;
+
+            pAlphaRow[x] = static_cast<unsigned char>(alpha);
+        }
+    }
+}
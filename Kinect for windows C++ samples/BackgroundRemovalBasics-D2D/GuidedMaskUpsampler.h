@@ -0,0 +1,88 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="GuidedMaskUpsampler.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Turns a blocky player mask, registered from the lower resolution depth frame,
+// into a soft full resolution alpha that follows the edges of the color image.
+// This is a guided filter (He, Sun and Tang) run at the depth resolution with the
+// color image's luminance as the guide. Only its linear coefficients are brought
+// up to the color resolution, so the cost stays linear in the pixel count.
+// Every box filter is a pair of running sums, independent of the radius.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+#include <vector>
+
+class GuidedMaskUpsampler
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    GuidedMaskUpsampler();
+
+    /// <summary>
+    /// Set the image size and allocate the working buffers
+    /// </summary>
+    /// <param name="width">width (in pixels) of the color image and mask</param>
+    /// <param name="height">height (in pixels) of the color image and mask</param>
+    /// <param name="scale">how many times lower the resolution of the mask's source is, 1 or more</param>
+    /// <returns>true on success</returns>
+    bool Initialize(int width, int height, int scale);
+
+    /// <summary>
+    /// Tune the filter
+    /// </summary>
+    /// <param name="radius">radius of the filter window, in low resolution pixels</param>
+    /// <param name="epsilon">regularization, larger values give softer edges that follow the color less</param>
+    void SetParameters(int radius, float epsilon);
+
+    /// <summary>
+    /// Compute the soft alpha of a mask
+    /// </summary>
+    /// <param name="pMask">mask at full resolution, one byte per pixel</param>
+    /// <param name="pColor">color image in BGRX format</param>
+    /// <param name="pAlpha">receives the alpha, one byte per pixel, may be the same buffer as pMask</param>
+    void Upsample(const unsigned char* pMask, const unsigned char* pColor, unsigned char* pAlpha);
+
+private:
+    static const int    cBytesPerPixel = 4;
+
+    int                 m_width;
+    int                 m_height;
+    int                 m_scale;
+    int                 m_lowWidth;
+    int                 m_lowHeight;
+    int                 m_radius;
+    float               m_epsilon;
+
+    // Low resolution planes: guide, mask, their products and the filter coefficients
+    std::vector<float>  m_guide;
+    std::vector<float>  m_mask;
+    std::vector<float>  m_guideMask;
+    std::vector<float>  m_guideSquared;
+    std::vector<float>  m_coefficientA;
+    std::vector<float>  m_coefficientB;
+    std::vector<float>  m_rowSums;
+    std::vector<float>  m_columnSums;
+    std::vector<float>  m_inverseCountX;
+
+    // Bilinear taps from full resolution columns into the low resolution coefficients
+    std::vector<int>    m_tapX;
+    std::vector<float>  m_weightX;
+    std::vector<float>  m_rowA;
+    std::vector<float>  m_rowB;
+    std::vector<float>  m_fullRowA;
+    std::vector<float>  m_fullRowB;
+
+    // Full resolution guide, fixed point luminance of the color image
+    std::vector<unsigned short> m_luma;
+
+    void ComputeLuma(const unsigned char* pColor);
+    void Downsample(const unsigned char* pMask);
+    void BoxMean(std::vector<float>& plane);
+    void ApplyCoefficients(unsigned char* pAlpha);
+};
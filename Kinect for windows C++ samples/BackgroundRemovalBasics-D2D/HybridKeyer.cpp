@@ -0,0 +1,388 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="HybridKeyer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "HybridKeyer.h"
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define HYBRID_KEYER_X86
+#include <emmintrin.h>
+#endif
+
+static const int cBytesPerPixel = 4;
+
+// Kinds of blocks of the alpha mask
+static const unsigned char cBlockTransparent = 0;
+static const unsigned char cBlockOpaque      = 1;
+static const unsigned char cBlockMixed       = 2;
+
+// Every time a background pixel is seen adds this much to its count, which saturates at 255,
+// and its color is trusted for keying once it was seen three times
+static const int cConfidenceStep = 32;
+static const int cMinConfidence  = 3 * cConfidenceStep;
+
+/// <summary>
+/// Rounded up average of two bytes, as _mm_avg_epu8 computes it
+/// </summary>
+static inline int AverageBytes(int a, int b)
+{
+    return (a + b + 1) >> 1;
+}
+
+/// <summary>
+/// Move the alpha of one pixel toward the color key, when the background color there is known
+/// </summary>
+static inline unsigned char KeyPixel(int alpha, const unsigned char* pColor, const unsigned char* pModel, int lowThreshold, int keyScale, int colorWeight)
+{
+    if (pModel[3] < cMinConfidence)
+    {
+        return static_cast<unsigned char>(alpha);
+    }
+
+    // Largest difference of the three channels
+    int distance = 0;
+    for (int c = 0; c < 3; ++c)
+    {
+        const int difference = (pColor[c] > pModel[c]) ? pColor[c] - pModel[c] : pModel[c] - pColor[c];
+        distance = (difference > distance) ? difference : distance;
+    }
+
+    const int excess = (distance > lowThreshold) ? distance - lowThreshold : 0;
+    int key = ((excess << 8) * keyScale) >> 16;
+    key = (key > 255) ? 255 : key;
+
+    return static_cast<unsigned char>(alpha + (((key - alpha) * colorWeight) >> 7));
+}
+
+/// <summary>
+/// Key a span of pixels of the uncertain band
+/// </summary>
+static void KeyPixels(unsigned char* pAlpha, const unsigned char* pColor, const unsigned char* pModel, int count, int lowThreshold, int keyScale, int colorWeight)
+{
+    int i = 0;
+
+#ifdef HYBRID_KEYER_X86
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i low = _mm_set1_epi16(static_cast<short>(lowThreshold));
+    const __m128i scale = _mm_set1_epi16(static_cast<short>(keyScale));
+    const __m128i weight = _mm_set1_epi16(static_cast<short>(colorWeight));
+    const __m128i maxKey = _mm_set1_epi16(255);
+    const __m128i minConfidence = _mm_set1_epi8(static_cast<char>(cMinConfidence));
+
+    for (; i + 16 <= count; i += 16)
+    {
+        // Distance and count of 4 pixels per register, one per 32 bit lane
+        __m128i distances[4];
+        __m128i confidences[4];
+        for (int q = 0; q < 4; ++q)
+        {
+            const __m128i color = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pColor + (i + 4 * q) * cBytesPerPixel));
+            const __m128i model = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pModel + (i + 4 * q) * cBytesPerPixel));
+            const __m128i difference = _mm_or_si128(_mm_subs_epu8(color, model), _mm_subs_epu8(model, color));
+            const __m128i largest = _mm_max_epu8(_mm_max_epu8(difference, _mm_srli_epi32(difference, 8)), _mm_srli_epi32(difference, 16));
+            distances[q] = _mm_and_si128(largest, byteMask);
+            confidences[q] = _mm_srli_epi32(model, 24);
+        }
+
+        const __m128i confidence = _mm_packus_epi16(_mm_packs_epi32(confidences[0], confidences[1]), _mm_packs_epi32(confidences[2], confidences[3]));
+        const __m128i known = _mm_cmpeq_epi8(_mm_max_epu8(confidence, minConfidence), confidence);
+
+        const __m128i alpha = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAlpha + i));
+        __m128i keyed[2];
+        for (int half = 0; half < 2; ++half)
+        {
+            const __m128i distance = _mm_packs_epi32(distances[2 * half], distances[2 * half + 1]);
+            const __m128i depthAlpha = half ? _mm_unpackhi_epi8(alpha, zero) : _mm_unpacklo_epi8(alpha, zero);
+
+            __m128i key = _mm_mulhi_epu16(_mm_slli_epi16(_mm_subs_epu16(distance, low), 8), scale);
+            key = _mm_sub_epi16(key, _mm_subs_epu16(key, maxKey));
+
+            keyed[half] = _mm_add_epi16(depthAlpha, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(key, depthAlpha), weight), 7));
+        }
+
+        const __m128i result = _mm_packus_epi16(keyed[0], keyed[1]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pAlpha + i), _mm_or_si128(_mm_and_si128(known, result), _mm_andnot_si128(known, alpha)));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        pAlpha[i] = KeyPixel(pAlpha[i], pColor + i * cBytesPerPixel, pModel + i * cBytesPerPixel, lowThreshold, keyScale, colorWeight);
+    }
+}
+
+/// <summary>
+/// Blend a span of sure background pixels into the model, a quarter of the new color at a time
+/// </summary>
+static void LearnPixels(const unsigned char* pColor, unsigned char* pModel, int count)
+{
+    int i = 0;
+
+#ifdef HYBRID_KEYER_X86
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i countMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    const __m128i step = _mm_set1_epi32(cConfidenceStep << 24);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i color = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pColor + i * cBytesPerPixel));
+        const __m128i model = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pModel + i * cBytesPerPixel));
+
+        // A pixel never seen takes the color as it is
+        const __m128i average = _mm_avg_epu8(model, _mm_avg_epu8(model, color));
+        const __m128i unseen = _mm_cmpeq_epi32(_mm_and_si128(model, countMask), zero);
+        const __m128i learned = _mm_or_si128(_mm_and_si128(unseen, color), _mm_andnot_si128(unseen, average));
+        const __m128i seen = _mm_and_si128(_mm_adds_epu8(model, step), countMask);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pModel + i * cBytesPerPixel), _mm_or_si128(_mm_andnot_si128(countMask, learned), seen));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        const unsigned char* pPixel = pColor + i * cBytesPerPixel;
+        unsigned char* pLearned = pModel + i * cBytesPerPixel;
+
+        for (int c = 0; c < 3; ++c)
+        {
+            pLearned[c] = static_cast<unsigned char>((0 == pLearned[3]) ? pPixel[c] : AverageBytes(pLearned[c], AverageBytes(pLearned[c], pPixel[c])));
+        }
+
+        pLearned[3] = static_cast<unsigned char>((pLearned[3] + cConfidenceStep > 255) ? 255 : pLearned[3] + cConfidenceStep);
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+HybridKeyer::HybridKeyer() :
+    m_width(0),
+    m_height(0),
+    m_blocksPerRow(0),
+    m_frame(0),
+    m_bandPixels(0)
+{
+    SetParameters(8, 20, 60, 96);
+}
+
+/// <summary>
+/// Set the frame size and allocate the background model
+/// </summary>
+/// <param name="width">width (in pixels) of the mask and color frame</param>
+/// <param name="height">height (in pixels) of the mask and color frame</param>
+/// <returns>true on success</returns>
+bool HybridKeyer::Initialize(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_blocksPerRow = (width + cBlockSize - 1) / cBlockSize;
+
+    m_blockKinds.assign(m_blocksPerRow * height, cBlockTransparent);
+    m_band.assign(m_blocksPerRow * height, 0);
+    m_transparentCounts.assign(m_blocksPerRow, 0);
+    m_opaqueCounts.assign(m_blocksPerRow, 0);
+    m_model.assign(width * height * cBytesPerPixel, 0);
+
+    return true;
+}
+
+/// <summary>
+/// Tune the keying
+/// </summary>
+/// <param name="bandRadius">rows (in pixels) the uncertain band reaches above and below an edge, the band reaches a block sideways</param>
+/// <param name="lowThreshold">color distance up to which a pixel is taken as background</param>
+/// <param name="highThreshold">color distance from which a pixel is taken as foreground</param>
+/// <param name="colorWeight">weight (out of 128) of the color key against the alpha from depth in the band</param>
+void HybridKeyer::SetParameters(int bandRadius, int lowThreshold, int highThreshold, int colorWeight)
+{
+    // Sideways the band reaches a whole block, so going further up and down than that would only make it lopsided
+    m_bandRadius = (bandRadius < 1) ? 1 : ((bandRadius > cBlockSize) ? cBlockSize : bandRadius);
+    m_lowThreshold = (lowThreshold < 0) ? 0 : ((lowThreshold > 254) ? 254 : lowThreshold);
+    highThreshold = (highThreshold <= m_lowThreshold) ? m_lowThreshold + 1 : ((highThreshold > 255) ? 255 : highThreshold);
+    m_colorWeight = (colorWeight < 0) ? 0 : ((colorWeight > 128) ? 128 : colorWeight);
+
+    // Ramp from the low to the high threshold, in 8.8 fixed point so it fits the 16 bit lanes
+    m_keyScale = 255 * 256 / (highThreshold - m_lowThreshold);
+}
+
+/// <summary>
+/// Forget the background model, call it when the camera or the scene changed
+/// </summary>
+void HybridKeyer::Reset()
+{
+    if (!m_model.empty())
+    {
+        memset(&m_model[0], 0, m_model.size());
+    }
+}
+
+/// <summary>
+/// Refine the uncertain band of an alpha mask and learn the background from the rest
+/// </summary>
+/// <param name="pAlpha">alpha of the frame, one byte per pixel, refined in place</param>
+/// <param name="pColor">color frame in BGRX format</param>
+void HybridKeyer::Refine(unsigned char* pAlpha, const unsigned char* pColor)
+{
+    if (m_model.empty() || NULL == pAlpha || NULL == pColor)
+    {
+        return;
+    }
+
+    ClassifyBlocks(pAlpha);
+    FindBand();
+
+    unsigned char* pModel = &m_model[0];
+    const int learnRow = m_frame % cLearnInterval;
+    m_bandPixels = 0;
+
+    for (int y = 0; y < m_height; ++y)
+    {
+        const unsigned char* pKinds = &m_blockKinds[y * m_blocksPerRow];
+        const unsigned char* pBand = &m_band[y * m_blocksPerRow];
+        const bool bLearn = learnRow == y % cLearnInterval;
+
+        for (int b = 0; b < m_blocksPerRow; ++b)
+        {
+            const int x = b * cBlockSize;
+            const int count = (x + cBlockSize <= m_width) ? cBlockSize : m_width - x;
+            const int offset = y * m_width + x;
+
+            if (pBand[b])
+            {
+                KeyPixels(pAlpha + offset, pColor + offset * cBytesPerPixel, pModel + offset * cBytesPerPixel, count, m_lowThreshold, m_keyScale, m_colorWeight);
+                m_bandPixels += count;
+            }
+            else if (bLearn && cBlockTransparent == pKinds[b])
+            {
+                LearnPixels(pColor + offset * cBytesPerPixel, pModel + offset * cBytesPerPixel, count);
+            }
+        }
+    }
+
+    ++m_frame;
+}
+
+/// <summary>
+/// Sort the blocks of the alpha mask into fully transparent, fully opaque and mixed
+/// </summary>
+/// <param name="pAlpha">alpha of the frame, one byte per pixel</param>
+void HybridKeyer::ClassifyBlocks(const unsigned char* pAlpha)
+{
+#ifdef HYBRID_KEYER_X86
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi8(static_cast<char>(0xFF));
+#endif
+
+    for (int y = 0; y < m_height; ++y)
+    {
+        const unsigned char* pRow = pAlpha + y * m_width;
+        unsigned char* pKinds = &m_blockKinds[y * m_blocksPerRow];
+
+        for (int b = 0; b < m_blocksPerRow; ++b)
+        {
+            const int x = b * cBlockSize;
+
+#ifdef HYBRID_KEYER_X86
+            if (x + cBlockSize <= m_width)
+            {
+                const __m128i alpha = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + x));
+                pKinds[b] = (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi8(alpha, zero))) ? cBlockTransparent :
+                    ((0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi8(alpha, opaque))) ? cBlockOpaque : cBlockMixed);
+                continue;
+            }
+#endif
+
+            const int end = (x + cBlockSize <= m_width) ? x + cBlockSize : m_width;
+            bool bTransparent = true;
+            bool bOpaque = true;
+            for (int i = x; i < end; ++i)
+            {
+                bTransparent = bTransparent && 0 == pRow[i];
+                bOpaque = bOpaque && 255 == pRow[i];
+            }
+
+            pKinds[b] = bTransparent ? cBlockTransparent : (bOpaque ? cBlockOpaque : cBlockMixed);
+        }
+    }
+}
+
+/// <summary>
+/// Mark the blocks that have a block of another kind, or a mixed one, within the band radius
+/// Counts of each kind per block column are kept for a window of rows sliding down the mask
+/// </summary>
+void HybridKeyer::FindBand()
+{
+    memset(&m_transparentCounts[0], 0, m_blocksPerRow * sizeof(int));
+    memset(&m_opaqueCounts[0], 0, m_blocksPerRow * sizeof(int));
+
+    for (int y = 0; y <= m_bandRadius && y < m_height; ++y)
+    {
+        CountBlockRow(y, 1);
+    }
+
+    for (int y = 0; y < m_height; ++y)
+    {
+        const int top = (y > m_bandRadius) ? y - m_bandRadius : 0;
+        const int bottom = (y + m_bandRadius < m_height) ? y + m_bandRadius : m_height - 1;
+        const int rows = bottom - top + 1;
+        unsigned char* pBand = &m_band[y * m_blocksPerRow];
+
+        for (int b = 0; b < m_blocksPerRow; ++b)
+        {
+            const int left = (b > 0) ? b - 1 : 0;
+            const int right = (b + 1 < m_blocksPerRow) ? b + 1 : b;
+
+            int transparent = 0;
+            int opaque = 0;
+            for (int i = left; i <= right; ++i)
+            {
+                transparent += m_transparentCounts[i];
+                opaque += m_opaqueCounts[i];
+            }
+
+            const int blocks = rows * (right - left + 1);
+            pBand[b] = (transparent != blocks && opaque != blocks) ? 1 : 0;
+        }
+
+        if (y + m_bandRadius + 1 < m_height)
+        {
+            CountBlockRow(y + m_bandRadius + 1, 1);
+        }
+
+        if (y >= m_bandRadius)
+        {
+            CountBlockRow(y - m_bandRadius, -1);
+        }
+    }
+}
+
+/// <summary>
+/// Add a row of blocks to the counts of the sliding window, or take it out
+/// </summary>
+/// <param name="y">row of blocks</param>
+/// <param name="delta">1 to add the row, -1 to take it out</param>
+void HybridKeyer::CountBlockRow(int y, int delta)
+{
+    const unsigned char* pKinds = &m_blockKinds[y * m_blocksPerRow];
+
+    for (int b = 0; b < m_blocksPerRow; ++b)
+    {
+        if (cBlockTransparent == pKinds[b])
+        {
+            m_transparentCounts[b] += delta;
+        }
+        else if (cBlockOpaque == pKinds[b])
+        {
+            m_opaqueCounts[b] += delta;
+        }
+    }
+}
@@ -0,0 +1,96 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="HybridKeyer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Recovers the edge detail depth misses (hair, fingers, the gaps between them) by keying
+// the edge of the alpha mask against a learned picture of the background.
+// The alpha mask from depth is used as a trimap:
+//     sure background   blocks of 16 pixels that are fully transparent, with no other kind of
+//                       block nearby; their colors teach a per pixel background model
+//     sure foreground   the same for fully opaque blocks, left alone
+//     uncertain band    every other block, the only place the color image is looked at
+// Inside the band, the alpha of every pixel whose background color is known is moved toward
+// a color key: how far the pixel's color is from the background color at that place.
+// The background model is a running average of each background pixel's color, updated on a
+// few rows per frame, so neither learning nor keying costs a pass over the whole color frame.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+#include <vector>
+
+class HybridKeyer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    HybridKeyer();
+
+    /// <summary>
+    /// Set the frame size and allocate the background model
+    /// </summary>
+    /// <param name="width">width (in pixels) of the mask and color frame</param>
+    /// <param name="height">height (in pixels) of the mask and color frame</param>
+    /// <returns>true on success</returns>
+    bool Initialize(int width, int height);
+
+    /// <summary>
+    /// Tune the keying
+    /// </summary>
+    /// <param name="bandRadius">rows (in pixels) the uncertain band reaches above and below an edge, the band reaches a block sideways</param>
+    /// <param name="lowThreshold">color distance up to which a pixel is taken as background</param>
+    /// <param name="highThreshold">color distance from which a pixel is taken as foreground</param>
+    /// <param name="colorWeight">weight (out of 128) of the color key against the alpha from depth in the band</param>
+    void SetParameters(int bandRadius, int lowThreshold, int highThreshold, int colorWeight);
+
+    /// <summary>
+    /// Forget the background model, call it when the camera or the scene changed
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Refine the uncertain band of an alpha mask and learn the background from the rest
+    /// </summary>
+    /// <param name="pAlpha">alpha of the frame, one byte per pixel, refined in place</param>
+    /// <param name="pColor">color frame in BGRX format</param>
+    void Refine(unsigned char* pAlpha, const unsigned char* pColor);
+
+    /// <summary>
+    /// Number of pixels in the uncertain band of the last frame
+    /// </summary>
+    int GetBandPixelCount() const { return m_bandPixels; }
+
+private:
+    static const int            cBlockSize = 16;
+
+    // Background rows learned per frame are one in cLearnInterval
+    static const int            cLearnInterval = 8;
+
+    int                         m_width;
+    int                         m_height;
+    int                         m_blocksPerRow;
+    int                         m_bandRadius;
+    int                         m_lowThreshold;
+    int                         m_keyScale;
+    int                         m_colorWeight;
+    int                         m_frame;
+    int                         m_bandPixels;
+
+    // Kind of every block (transparent, opaque or mixed), and whether it is in the band
+    std::vector<unsigned char>  m_blockKinds;
+    std::vector<unsigned char>  m_band;
+
+    // Transparent and opaque blocks per block column within the band radius of the current row
+    std::vector<int>            m_transparentCounts;
+    std::vector<int>            m_opaqueCounts;
+
+    // Background color of every pixel in BGRX format, X is how many times it was seen
+    std::vector<unsigned char>  m_model;
+
+    void ClassifyBlocks(const unsigned char* pAlpha);
+    void FindBand();
+    void CountBlockRow(int y, int delta);
+};
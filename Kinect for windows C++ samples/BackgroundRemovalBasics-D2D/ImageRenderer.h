@@ -9,6 +9,9 @@
 #pragma once
 
 #include <d2d1.h>
+#include <vector>
+#include "DirtyTileTracker.h"
+#include "FramePacer.h"
 
 class ImageRenderer
 {
@@ -43,6 +46,48 @@ public:
     /// <returns>indicates success or failure</returns>
     HRESULT Draw(BYTE* pImage, unsigned long cbImage);
 
+    /// <summary>
+    /// Draws a plane of 16 bit values of previously specified width and height, mapping each value
+    /// through a palette straight into the upload path, without a full-frame RGBX intermediate
+    /// </summary>
+    /// <param name="pValues">first value of the plane, rows are packed back to back</param>
+    /// <param name="valueStep">distance (in USHORTs) between two consecutive values</param>
+    /// <param name="pPalette">65536 RGBX colors indexed by value</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT DrawPalettized(const USHORT* pValues, UINT valueStep, const UINT* pPalette);
+
+    /// <summary>
+    /// Force the next Draw to upload and present the full image even if its content did not change
+    /// </summary>
+    void Invalidate();
+
+    /// <summary>
+    /// Present the newest frame held back by pacing, if its refresh slot has arrived
+    /// Call this whenever the wait returned by GetPendingTimeout elapses
+    /// </summary>
+    /// <returns>S_OK if a frame was presented, S_FALSE if nothing was due, otherwise failure code</returns>
+    HRESULT PresentPending();
+
+    /// <summary>
+    /// How long the caller may wait before PresentPending needs to be called
+    /// </summary>
+    /// <returns>timeout in milliseconds, INFINITE if no frame is pending</returns>
+    DWORD GetPendingTimeout();
+
+    /// <summary>
+    /// Turn presenting at most once per display refresh on or off, it is on by default
+    /// </summary>
+    /// <param name="enabled">whether draws are coalesced to the refresh interval</param>
+    void SetPacingEnabled(bool enabled);
+
+    /// <summary>
+    /// Frames handed to Draw or DrawPalettized, frames that actually reached the window,
+    /// and frames replaced by a newer one while waiting for their refresh
+    /// </summary>
+    unsigned long GetSubmittedFrameCount() const { return m_pacer.GetSubmittedCount(); }
+    unsigned long GetPresentedFrameCount() const { return m_pacer.GetPresentedCount(); }
+    unsigned long GetCoalescedFrameCount() const { return m_pacer.GetCoalescedCount(); }
+
 private:
     HWND                     m_hWnd;
 
@@ -56,6 +101,25 @@ private:
     ID2D1HwndRenderTarget*   m_pRenderTarget;
     ID2D1Bitmap*             m_pBitmap;
 
+    // Change tracking, so unchanged regions are neither uploaded nor presented again
+    DirtyTileTracker         m_dirtyTiles;
+
+    // The bitmap holds an upload the window does not show yet, e.g. a frame held back by pacing
+    bool                     m_bUnshownUpload;
+
+    // Palettized drawing converts a few rows at a time so the converted pixels never leave the cache
+    static const UINT        cBandHeight = 16;
+    BYTE*                    m_pBand;
+    std::vector<unsigned long long> m_bandHashes;
+    const UINT*              m_pBandPalette;
+    bool                     m_bBandHashesValid;
+
+    // Pacing, frames arriving faster than the display refreshes are coalesced and only the newest is kept
+    static const int         cDefaultRefreshRate = 60;
+    FramePacer               m_pacer;
+    LONGLONG                 m_refreshInterval;
+    LARGE_INTEGER            m_performanceFrequency;
+
     /// <summary>
     /// Ensure necessary Direct2d resources are created
     /// </summary>
@@ -66,4 +130,32 @@ private:
     /// Dispose of Direct2d resources 
     /// </summary>
     void DiscardResources( );
+
+    /// <summary>
+    /// Upload an RGBX image into the bitmap, skipping unchanged regions
+    /// </summary>
+    /// <param name="pImage">image data in RGBX format</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT UploadImage(const BYTE* pImage);
+
+    /// <summary>
+    /// Map a plane of values through a palette band by band into the bitmap, skipping unchanged bands
+    /// </summary>
+    /// <param name="pValues">first value of the plane</param>
+    /// <param name="valueStep">distance (in USHORTs) between two consecutive values</param>
+    /// <param name="pPalette">65536 RGBX colors indexed by value</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT UploadPalettized(const USHORT* pValues, UINT valueStep, const UINT* pPalette);
+
+    /// <summary>
+    /// Current time for pacing decisions
+    /// </summary>
+    /// <returns>time in microseconds</returns>
+    LONGLONG GetTimeMicroseconds( );
+
+    /// <summary>
+    /// Draw the bitmap to the window
+    /// </summary>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Present( );
 };
\ No newline at end of file
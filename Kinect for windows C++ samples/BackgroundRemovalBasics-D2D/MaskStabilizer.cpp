@@ -0,0 +1,202 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="MaskStabilizer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "MaskStabilizer.h"
+
+// Settled state of a pixel
+static const unsigned char cPixelSoft        = 0;
+static const unsigned char cPixelTransparent = 1;
+static const unsigned char cPixelOpaque      = 2;
+
+// A pixel settles past the inner thresholds and only leaves its settled state past the outer ones
+static const int cSettleTransparent  = 16;
+static const int cReleaseTransparent = 32;
+static const int cSettleOpaque       = 240;
+static const int cReleaseOpaque      = 224;
+
+// Soft pixels keep their last value until the average moves further than this
+static const int cSoftDeadband = 6;
+
+// Luminance changes up to this much are sensor noise, not motion
+static const int cMotionNoise = 4;
+
+/// <summary>
+/// Fixed point luminance of a BGRX pixel
+/// </summary>
+static inline unsigned char Luma(const unsigned char* pPixel)
+{
+    return static_cast<unsigned char>((29 * pPixel[0] + 150 * pPixel[1] + 77 * pPixel[2]) >> 8);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+MaskStabilizer::MaskStabilizer() :
+    m_width(0),
+    m_height(0),
+    m_baseWeight(48),
+    m_motionGain(8),
+    m_confidenceGain(32),
+    m_bPrimed(false)
+{
+}
+
+/// <summary>
+/// Set the mask size and allocate the per pixel state
+/// </summary>
+/// <param name="width">width (in pixels) of the mask and color image</param>
+/// <param name="height">height (in pixels) of the mask and color image</param>
+/// <returns>true on success</returns>
+bool MaskStabilizer::Initialize(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return false;
+    }
+
+    m_width  = width;
+    m_height = height;
+
+    m_average.assign(width * height, 0);
+    m_output.assign(width * height, 0);
+    m_state.assign(width * height, cPixelTransparent);
+    m_luma.assign(width * height, 0);
+    m_bPrimed = false;
+
+    return true;
+}
+
+/// <summary>
+/// Tune how quickly the average follows the new alpha, weights are out of 256
+/// </summary>
+/// <param name="baseWeight">weight of the new alpha in a still scene</param>
+/// <param name="motionGain">weight added per step of luminance change since the last frame</param>
+/// <param name="confidenceGain">weight added for a fully decisive (0 or 255) new alpha</param>
+void MaskStabilizer::SetParameters(int baseWeight, int motionGain, int confidenceGain)
+{
+    m_baseWeight     = (baseWeight < 1) ? 1 : ((baseWeight > 256) ? 256 : baseWeight);
+    m_motionGain     = (motionGain < 0) ? 0 : motionGain;
+    m_confidenceGain = (confidenceGain < 0) ? 0 : confidenceGain;
+}
+
+/// <summary>
+/// Stabilize a new mask against the previous ones
+/// </summary>
+/// <param name="pAlpha">alpha of the new frame, one byte per pixel, replaced by the stabilized alpha</param>
+/// <param name="pColor">color image of the new frame in BGRX format</param>
+void MaskStabilizer::Stabilize(unsigned char* pAlpha, const unsigned char* pColor)
+{
+    if (m_average.empty())
+    {
+        return;
+    }
+
+    if (!m_bPrimed)
+    {
+        Prime(pAlpha, pColor);
+        return;
+    }
+
+    const int count = m_width * m_height;
+    unsigned short* pAverage = &m_average[0];
+    unsigned char* pOutput = &m_output[0];
+    unsigned char* pState = &m_state[0];
+    unsigned char* pLuma = &m_luma[0];
+
+    for (int i = 0; i < count; ++i)
+    {
+        const int alpha = pAlpha[i];
+        const int luma = Luma(pColor + i * cBytesPerPixel);
+        const int change = (luma > pLuma[i]) ? luma - pLuma[i] : pLuma[i] - luma;
+        const int motion = (change > cMotionNoise) ? change - cMotionNoise : 0;
+        pLuma[i] = static_cast<unsigned char>(luma);
+
+        // Settled pixels that the new alpha agrees with need no work, which covers most of the frame
+        if ((cPixelTransparent == pState[i] && 0 == alpha && 0 == pAverage[i]) ||
+            (cPixelOpaque == pState[i] && 255 == alpha && (255 << 8) == pAverage[i]))
+        {
+            pAlpha[i] = pOutput[i];
+            continue;
+        }
+
+        // Follow the new alpha faster where the picture moves and where the new alpha is decisive
+        const int confidence = (alpha > 127) ? 2 * alpha - 255 : 255 - 2 * alpha;
+        int weight = m_baseWeight + motion * m_motionGain + ((confidence * m_confidenceGain) >> 8);
+        weight = (weight > 256) ? 256 : weight;
+
+        // Steps too small to move the fixed point average land on the target, so the average always converges
+        const int target = alpha << 8;
+        const int step = (target - pAverage[i]) * weight / 256;
+        const int average = (0 != step) ? pAverage[i] + step : target;
+        pAverage[i] = static_cast<unsigned short>(average);
+
+        const int value = (average + 128) >> 8;
+        unsigned char state = pState[i];
+
+        if (cPixelTransparent == state && value > cReleaseTransparent)
+        {
+            state = cPixelSoft;
+        }
+        else if (cPixelOpaque == state && value < cReleaseOpaque)
+        {
+            state = cPixelSoft;
+        }
+
+        if (cPixelSoft == state)
+        {
+            if (value <= cSettleTransparent)
+            {
+                state = cPixelTransparent;
+            }
+            else if (value >= cSettleOpaque)
+            {
+                state = cPixelOpaque;
+            }
+        }
+
+        int output;
+        if (cPixelTransparent == state)
+        {
+            output = 0;
+        }
+        else if (cPixelOpaque == state)
+        {
+            output = 255;
+        }
+        else
+        {
+            // Small moves of a soft pixel are noise, keep showing the last value
+            const int delta = value - pOutput[i];
+            output = (delta > cSoftDeadband || delta < -cSoftDeadband || cPixelSoft != pState[i]) ? value : pOutput[i];
+        }
+
+        pState[i] = state;
+        pOutput[i] = static_cast<unsigned char>(output);
+        pAlpha[i] = static_cast<unsigned char>(output);
+    }
+}
+
+/// <summary>
+/// Take the first mask as it is
+/// </summary>
+/// <param name="pAlpha">alpha of the frame, one byte per pixel</param>
+/// <param name="pColor">color image of the frame in BGRX format</param>
+void MaskStabilizer::Prime(const unsigned char* pAlpha, const unsigned char* pColor)
+{
+    const int count = m_width * m_height;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const int alpha = pAlpha[i];
+
+        m_average[i] = static_cast<unsigned short>(alpha << 8);
+        m_output[i] = static_cast<unsigned char>(alpha);
+        m_state[i] = (0 == alpha) ? cPixelTransparent : ((255 == alpha) ? cPixelOpaque : cPixelSoft);
+        m_luma[i] = Luma(pColor + i * cBytesPerPixel);
+    }
+
+    m_bPrimed = true;
+}
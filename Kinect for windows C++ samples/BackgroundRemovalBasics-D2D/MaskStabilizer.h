@@ -0,0 +1,75 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="MaskStabilizer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Keeps the alpha mask of the background removal from flickering between frames.
+// Each pixel's alpha is a running average of the new alpha, which is followed
+// faster where the color image moves or the new alpha is decisive, and slower
+// where the scene is still and the alpha is uncertain.
+// Hysteresis then holds pixels still: a pixel that settled to fully transparent or
+// fully opaque stays so until its average moves well past the threshold that let it
+// settle, and soft pixels keep their last value until the average moves a few steps.
+// Besides looking better, stable pixels leave the transparent spans of the compositor
+// and the tiles of the renderer unchanged, so they are neither recomposited nor uploaded.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+#include <vector>
+
+class MaskStabilizer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    MaskStabilizer();
+
+    /// <summary>
+    /// Set the mask size and allocate the per pixel state
+    /// </summary>
+    /// <param name="width">width (in pixels) of the mask and color image</param>
+    /// <param name="height">height (in pixels) of the mask and color image</param>
+    /// <returns>true on success</returns>
+    bool Initialize(int width, int height);
+
+    /// <summary>
+    /// Tune how quickly the average follows the new alpha, weights are out of 256
+    /// </summary>
+    /// <param name="baseWeight">weight of the new alpha in a still scene</param>
+    /// <param name="motionGain">weight added per step of luminance change since the last frame</param>
+    /// <param name="confidenceGain">weight added for a fully decisive (0 or 255) new alpha</param>
+    void SetParameters(int baseWeight, int motionGain, int confidenceGain);
+
+    /// <summary>
+    /// Forget the previous frames, the next mask is taken as it is
+    /// </summary>
+    void Reset() { m_bPrimed = false; }
+
+    /// <summary>
+    /// Stabilize a new mask against the previous ones
+    /// </summary>
+    /// <param name="pAlpha">alpha of the new frame, one byte per pixel, replaced by the stabilized alpha</param>
+    /// <param name="pColor">color image of the new frame in BGRX format</param>
+    void Stabilize(unsigned char* pAlpha, const unsigned char* pColor);
+
+private:
+    static const int            cBytesPerPixel = 4;
+
+    int                         m_width;
+    int                         m_height;
+    int                         m_baseWeight;
+    int                         m_motionGain;
+    int                         m_confidenceGain;
+    bool                        m_bPrimed;
+
+    // Per pixel state: running average in 8.8 fixed point, last output, settled state and luminance
+    std::vector<unsigned short> m_average;
+    std::vector<unsigned char>  m_output;
+    std::vector<unsigned char>  m_state;
+    std::vector<unsigned char>  m_luma;
+
+    void Prime(const unsigned char* pAlpha, const unsigned char* pColor);
+};
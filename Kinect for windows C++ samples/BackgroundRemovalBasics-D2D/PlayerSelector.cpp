@@ -0,0 +1,170 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="PlayerSelector.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "PlayerSelector.h"
+#include <cstddef>
+
+/// <summary>
+/// Constructor, selects the single closest player and keeps them while visible
+/// </summary>
+PlayerSelector::PlayerSelector() :
+    m_policy(PlayerSelectSticky),
+    m_maxPlayers(1),
+    m_zoneLeft(-1.0f),
+    m_zoneRight(1.0f),
+    m_zoneNear(0.5f),
+    m_zoneFar(3.0f),
+    m_whitelistCount(0),
+    m_selectedCount(0)
+{
+}
+
+/// <summary>
+/// Set how players are selected
+/// </summary>
+/// <param name="policy">selection policy</param>
+/// <param name="maxPlayers">largest number of players kept</param>
+void PlayerSelector::SetPolicy(PlayerSelectionPolicy policy, int maxPlayers)
+{
+    m_policy = policy;
+    m_maxPlayers = (maxPlayers < 1) ? 1 : ((maxPlayers > cMaxPlayerIndex) ? cMaxPlayerIndex : maxPlayers);
+}
+
+/// <summary>
+/// Set the floor area used by PlayerSelectInsideZone, in skeleton space meters
+/// </summary>
+/// <param name="left">smallest x</param>
+/// <param name="right">largest x</param>
+/// <param name="nearest">smallest distance from the sensor</param>
+/// <param name="farthest">largest distance from the sensor</param>
+void PlayerSelector::SetZone(float left, float right, float nearest, float farthest)
+{
+    m_zoneLeft  = left;
+    m_zoneRight = right;
+    m_zoneNear  = nearest;
+    m_zoneFar   = farthest;
+}
+
+/// <summary>
+/// Only ever select these tracking IDs, whatever the policy
+/// </summary>
+/// <param name="pTrackingIds">allowed tracking IDs, NULL to allow everyone</param>
+/// <param name="count">number of tracking IDs</param>
+void PlayerSelector::SetWhitelist(const unsigned long* pTrackingIds, int count)
+{
+    m_whitelistCount = 0;
+
+    for (int i = 0; NULL != pTrackingIds && i < count && i < cMaxWhitelist; ++i)
+    {
+        m_whitelist[m_whitelistCount++] = pTrackingIds[i];
+    }
+}
+
+/// <summary>
+/// Select players among the people of a new skeleton frame
+/// </summary>
+/// <param name="pCandidates">people in the frame</param>
+/// <param name="count">number of people</param>
+/// <returns>selected player indices, bit i set for player index i</returns>
+unsigned int PlayerSelector::Select(const PlayerCandidate* pCandidates, int count)
+{
+    // Allowed candidates sorted from the closest, there are only a handful so insertion sort is plenty
+    const PlayerCandidate* sorted[cMaxPlayerIndex];
+    int sortedCount = 0;
+
+    for (int i = 0; i < count && sortedCount < cMaxPlayerIndex; ++i)
+    {
+        const PlayerCandidate& candidate = pCandidates[i];
+
+        if (candidate.playerIndex < 1 || candidate.playerIndex > cMaxPlayerIndex || !IsAllowed(candidate))
+        {
+            continue;
+        }
+
+        if (PlayerSelectInsideZone == m_policy &&
+            (candidate.x < m_zoneLeft || candidate.x > m_zoneRight || candidate.z < m_zoneNear || candidate.z > m_zoneFar))
+        {
+            continue;
+        }
+
+        int position = sortedCount++;
+        while (position > 0 && sorted[position - 1]->z > candidate.z)
+        {
+            sorted[position] = sorted[position - 1];
+            --position;
+        }
+        sorted[position] = &candidate;
+    }
+
+    // Sticky players keep their place first, in distance order, then the closest of the others fill up
+    bool taken[cMaxPlayerIndex] = { false };
+    int selectedCount = 0;
+    unsigned int players = 0;
+
+    for (int pass = (PlayerSelectSticky == m_policy) ? 0 : 1; pass < 2; ++pass)
+    {
+        for (int i = 0; i < sortedCount && selectedCount < m_maxPlayers; ++i)
+        {
+            if (taken[i] || (0 == pass && !WasSelected(sorted[i]->trackingId)))
+            {
+                continue;
+            }
+
+            taken[i] = true;
+            ++selectedCount;
+            players |= 1u << sorted[i]->playerIndex;
+        }
+    }
+
+    // Report the selection closest first, whichever pass picked each player
+    m_selectedCount = 0;
+    for (int i = 0; i < sortedCount; ++i)
+    {
+        if (taken[i])
+        {
+            m_selectedIds[m_selectedCount++] = sorted[i]->trackingId;
+        }
+    }
+
+    return players;
+}
+
+/// <summary>
+/// Whether the whitelist allows a candidate
+/// </summary>
+bool PlayerSelector::IsAllowed(const PlayerCandidate& candidate) const
+{
+    if (0 == m_whitelistCount)
+    {
+        return true;
+    }
+
+    for (int i = 0; i < m_whitelistCount; ++i)
+    {
+        if (m_whitelist[i] == candidate.trackingId)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Whether a tracking ID was selected by the previous call to Select
+/// </summary>
+bool PlayerSelector::WasSelected(unsigned long trackingId) const
+{
+    for (int i = 0; i < m_selectedCount; ++i)
+    {
+        if (m_selectedIds[i] == trackingId)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
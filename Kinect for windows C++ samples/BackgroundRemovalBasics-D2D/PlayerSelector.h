@@ -0,0 +1,107 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="PlayerSelector.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Decides which of the people in front of the sensor are kept in the foreground.
+// The result is a set of depth frame player indices, ready for the depth background
+// removal engine, and the selected tracking IDs ordered from the closest.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+// Player indices in the depth frame go from 1 to 7
+static const int cMaxPlayerIndex = 7;
+
+// A person seen in a skeleton frame
+struct PlayerCandidate
+{
+    unsigned long trackingId;
+
+    // Player index of the person's pixels in the depth frame
+    int           playerIndex;
+
+    // Skeleton position in meters
+    float         x;
+    float         y;
+    float         z;
+};
+
+enum PlayerSelectionPolicy
+{
+    // The closest players, up to the maximum count
+    PlayerSelectClosest,
+
+    // The closest players standing inside the zone, up to the maximum count
+    PlayerSelectInsideZone,
+
+    // Players stay selected while they are visible, free places go to the closest
+    PlayerSelectSticky
+};
+
+class PlayerSelector
+{
+public:
+    /// <summary>
+    /// Constructor, selects the single closest player and keeps them while visible
+    /// </summary>
+    PlayerSelector();
+
+    /// <summary>
+    /// Set how players are selected
+    /// </summary>
+    /// <param name="policy">selection policy</param>
+    /// <param name="maxPlayers">largest number of players kept</param>
+    void SetPolicy(PlayerSelectionPolicy policy, int maxPlayers);
+
+    /// <summary>
+    /// Set the floor area used by PlayerSelectInsideZone, in skeleton space meters
+    /// </summary>
+    /// <param name="left">smallest x</param>
+    /// <param name="right">largest x</param>
+    /// <param name="nearest">smallest distance from the sensor</param>
+    /// <param name="farthest">largest distance from the sensor</param>
+    void SetZone(float left, float right, float nearest, float farthest);
+
+    /// <summary>
+    /// Only ever select these tracking IDs, whatever the policy
+    /// </summary>
+    /// <param name="pTrackingIds">allowed tracking IDs, NULL to allow everyone</param>
+    /// <param name="count">number of tracking IDs</param>
+    void SetWhitelist(const unsigned long* pTrackingIds, int count);
+
+    /// <summary>
+    /// Select players among the people of a new skeleton frame
+    /// </summary>
+    /// <param name="pCandidates">people in the frame</param>
+    /// <param name="count">number of people</param>
+    /// <returns>selected player indices, bit i set for player index i</returns>
+    unsigned int Select(const PlayerCandidate* pCandidates, int count);
+
+    /// <summary>
+    /// Players selected by the last call to Select, closest first
+    /// </summary>
+    int GetSelectedCount() const { return m_selectedCount; }
+    unsigned long GetSelectedTrackingId(int i) const { return m_selectedIds[i]; }
+
+private:
+    static const int      cMaxWhitelist = 16;
+
+    PlayerSelectionPolicy m_policy;
+    int                   m_maxPlayers;
+
+    float                 m_zoneLeft;
+    float                 m_zoneRight;
+    float                 m_zoneNear;
+    float                 m_zoneFar;
+
+    unsigned long         m_whitelist[cMaxWhitelist];
+    int                   m_whitelistCount;
+
+    unsigned long         m_selectedIds[cMaxPlayerIndex];
+    int                   m_selectedCount;
+
+    bool IsAllowed(const PlayerCandidate& candidate) const;
+    bool WasSelected(unsigned long trackingId) const;
+};
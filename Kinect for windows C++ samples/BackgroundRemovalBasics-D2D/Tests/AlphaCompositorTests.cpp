@@ -0,0 +1,157 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="AlphaCompositorTests.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "BackgroundRemovalTests.h"
+#include "AlphaCompositor.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static const char* cCheckName = "AlphaCompositor";
+static const unsigned int cBytesPerPixel = 4;
+static const unsigned int cAlphaByte = 3;
+
+/// <summary>
+/// Fill a synthetic frame: a background, and a foreground whose alpha follows the given mask
+/// </summary>
+/// <param name="pattern">0 all transparent, 1 all opaque, 2 a soft edged figure, 3 random alpha</param>
+static void FillSyntheticFrame(int pattern, unsigned int width, unsigned int height, unsigned char* pForeground, unsigned char* pBackground)
+{
+    unsigned int seed = 12345u + pattern;
+
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            unsigned char* pFore = pForeground + (y * width + x) * cBytesPerPixel;
+            unsigned char* pBack = pBackground + (y * width + x) * cBytesPerPixel;
+
+            for (unsigned int c = 0; c < cAlphaByte; ++c)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                pFore[c] = static_cast<unsigned char>(seed >> 24);
+                pBack[c] = static_cast<unsigned char>(seed >> 16);
+            }
+            pBack[cAlphaByte] = 255;
+
+            // Figure: an ellipse in the middle third, fading out over 8 pixels
+            const int dx = static_cast<int>(x) - static_cast<int>(width / 2);
+            const int dy = static_cast<int>(y) - static_cast<int>(height / 2);
+            const int rx = static_cast<int>(width / 6) + 1;
+            const int ry = static_cast<int>(height / 3) + 1;
+            const int inside = 255 - (dx * dx * 255 / (rx * rx) + dy * dy * 255 / (ry * ry));
+            const int figure = (inside <= 0) ? 0 : ((inside >= 64) ? 255 : inside * 4);
+
+            seed = seed * 1664525u + 1013904223u;
+            const unsigned int alphas[4] = { 0, 255, static_cast<unsigned int>(figure), seed >> 24 };
+            pFore[cAlphaByte] = static_cast<unsigned char>(alphas[pattern & 3]);
+        }
+    }
+}
+
+/// <summary>
+/// Check every implementation against the reference on synthetic alpha masks
+/// (transparent, opaque, a soft edged figure and random alpha) of every length up to a few vectors
+/// </summary>
+/// <returns>true when they all produce the same bytes as AlphaCompositeScalar</returns>
+bool AlphaCompositorCheck()
+{
+    // Odd sizes so the vector loops leave tails and the runs end mid block
+    const unsigned int width = 67;
+    const unsigned int height = 41;
+    const unsigned int pixels = width * height;
+
+    std::vector<unsigned char> foreground(pixels * cBytesPerPixel);
+    std::vector<unsigned char> background(pixels * cBytesPerPixel);
+    std::vector<unsigned char> expected(pixels * cBytesPerPixel);
+    std::vector<unsigned char> output(pixels * cBytesPerPixel);
+    std::vector<unsigned char> blockKinds(AlphaCompositeBlockCount(pixels));
+
+    const bool bHasAVX2 = AlphaCompositeHasAVX2();
+    bool bPassed = true;
+
+    for (int pattern = 0; pattern < 4; ++pattern)
+    {
+        FillSyntheticFrame(pattern, width, height, &foreground[0], &background[0]);
+
+        // Every length from 0 to a few vectors, then the whole frame
+        for (unsigned int step = 0; step <= 41; ++step)
+        {
+            const unsigned int count = (step < 41) ? step : pixels;
+            const size_t bytes = count * cBytesPerPixel;
+
+            AlphaCompositeScalar(&foreground[0], &background[0], &expected[0], count);
+
+            AlphaCompositeSSE2(&foreground[0], &background[0], &output[0], count);
+            bPassed = Expect(0 == memcmp(&expected[0], &output[0], bytes), cCheckName, "SSE2 matches the reference") && bPassed;
+
+            if (bHasAVX2)
+            {
+                AlphaCompositeAVX2(&foreground[0], &background[0], &output[0], count);
+                bPassed = Expect(0 == memcmp(&expected[0], &output[0], bytes), cCheckName, "AVX2 matches the reference") && bPassed;
+            }
+
+            // The background is opaque, so the runs' copied pixels match the reference too,
+            // and the second pass skips the blocks that stayed transparent
+            memset(&blockKinds[0], cAlphaBlockUnknown, blockKinds.size());
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                memcpy(&output[0], &background[0], bytes);
+                AlphaCompositeRuns(&foreground[0], &output[0], &output[0], count, &blockKinds[0]);
+                bPassed = Expect(0 == memcmp(&expected[0], &output[0], bytes), cCheckName, "runs match the reference") && bPassed;
+            }
+        }
+    }
+
+    printf("%s: %s%s\n", cCheckName, bPassed ? "passed" : "FAILED", bHasAVX2 ? "" : " (no AVX2 on this CPU)");
+
+    return bPassed;
+}
+
+/// <summary>
+/// Time every implementation on a color sized frame with a soft edged figure in the middle,
+/// like the frames the sample composes
+/// </summary>
+void AlphaCompositorBenchmark()
+{
+    const unsigned int width = 640;
+    const unsigned int height = 480;
+    const unsigned int pixels = width * height;
+    const int frames = 200;
+
+    std::vector<unsigned char> foreground(pixels * cBytesPerPixel);
+    std::vector<unsigned char> background(pixels * cBytesPerPixel);
+    std::vector<unsigned char> output(pixels * cBytesPerPixel);
+    FillSyntheticFrame(2, width, height, &foreground[0], &background[0]);
+
+    const bool bHasAVX2 = AlphaCompositeHasAVX2();
+    double milliseconds[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+    for (int implementation = 0; implementation < 4; ++implementation)
+    {
+        if (2 == implementation && !bHasAVX2)
+        {
+            continue;
+        }
+
+        const double start = GetSeconds();
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            switch (implementation)
+            {
+            case 0:  AlphaCompositeScalar(&foreground[0], &background[0], &output[0], pixels); break;
+            case 1:  AlphaCompositeSSE2(&foreground[0], &background[0], &output[0], pixels); break;
+            case 2:  AlphaCompositeAVX2(&foreground[0], &background[0], &output[0], pixels); break;
+            default: AlphaCompositeRuns(&foreground[0], &background[0], &output[0], pixels); break;
+            }
+        }
+
+        milliseconds[implementation] = (GetSeconds() - start) * 1000.0 / frames;
+    }
+
+    printf("%s benchmark, %ux%u, ms per frame: scalar %.3f, SSE2 %.3f, AVX2 %.3f, runs %.3f\n",
+        cCheckName, width, height, milliseconds[0], milliseconds[1], milliseconds[2], milliseconds[3]);
+}
@@ -0,0 +1,82 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="BackgroundRemovalTests.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Runs the checks of the portable parts of the sample, and their benchmarks when given "bench".
+// Given "replay" and the files of a recording, times the depth engine on it instead
+// (take a look at DepthBackgroundRemoverTests.cpp for the layout of the files).
+// Builds with BackgroundRemovalTests.vcxproj, or with any C++ compiler from this folder, e.g.
+//     g++ -O2 -I.. *.cpp ../DirtyTileTracker.cpp ../AlphaCompositor.cpp ../StreamScheduler.cpp
+//         ../DepthBackgroundRemover.cpp ../GuidedMaskUpsampler.cpp ../HybridKeyer.cpp ../MaskStabilizer.cpp
+// Exits with 0 when every check holds.
+
+#include "BackgroundRemovalTests.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/// <summary>
+/// Report a case of a check when it does not hold
+/// </summary>
+/// <param name="bHolds">whether the case holds</param>
+/// <param name="check">name of the check</param>
+/// <param name="what">what the case expects</param>
+/// <returns>bHolds</returns>
+bool Expect(bool bHolds, const char* check, const char* what)
+{
+    if (!bHolds)
+    {
+        printf("%s: FAILED %s\n", check, what);
+    }
+
+    return bHolds;
+}
+
+/// <summary>
+/// Seconds of processor time since the program started
+/// </summary>
+double GetSeconds()
+{
+    return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+}
+
+/// <summary>
+/// Entry point
+/// </summary>
+/// <param name="argc">number of arguments</param>
+/// <param name="argv">arguments, "bench" to also run the benchmarks, or "replay" followed by the depth, color and optionally registration files of a recording</param>
+/// <returns>0 when every check holds, 1 otherwise</returns>
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && 0 == strcmp(argv[1], "replay"))
+    {
+        if (argc < 4)
+        {
+            printf("Usage: %s replay <depth file> <color file> [<registration file>]\n", argv[0]);
+            return 1;
+        }
+
+        return DepthBackgroundRemoverReplay(argv[2], argv[3], (argc > 4) ? argv[4] : NULL) ? 0 : 1;
+    }
+
+    const bool bBenchmark = argc > 1 && 0 == strcmp(argv[1], "bench");
+
+    bool bPassed = true;
+    bPassed = DirtyTileTrackerCheck() && bPassed;
+    bPassed = AlphaCompositorCheck() && bPassed;
+    bPassed = StreamSchedulerCheck() && bPassed;
+    bPassed = DepthBackgroundRemoverCheck() && bPassed;
+
+    if (bBenchmark)
+    {
+        DirtyTileTrackerBenchmark();
+        AlphaCompositorBenchmark();
+        DepthBackgroundRemoverBenchmark();
+    }
+
+    printf(bPassed ? "All checks passed\n" : "Some checks FAILED\n");
+
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="BackgroundRemovalTests.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Checks and measurements of the parts of the sample that only depend on the C++ standard
+// library, run headless by BackgroundRemovalTests.cpp. A check prints every case that does not
+// hold and returns false; a benchmark prints its timings.
+
+#pragma once
+
+/// <summary>
+/// Report a case of a check when it does not hold
+/// </summary>
+/// <param name="bHolds">whether the case holds</param>
+/// <param name="check">name of the check</param>
+/// <param name="what">what the case expects</param>
+/// <returns>bHolds</returns>
+bool Expect(bool bHolds, const char* check, const char* what);
+
+/// <summary>
+/// Seconds of processor time since the program started
+/// </summary>
+double GetSeconds();
+
+bool DirtyTileTrackerCheck();
+void DirtyTileTrackerBenchmark();
+
+bool AlphaCompositorCheck();
+void AlphaCompositorBenchmark();
+
+bool StreamSchedulerCheck();
+
+bool DepthBackgroundRemoverCheck();
+void DepthBackgroundRemoverBenchmark();
+bool DepthBackgroundRemoverReplay(const char* depthPath, const char* colorPath, const char* registrationPath);
@@ -0,0 +1,339 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthBackgroundRemoverTests.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Runs the depth engine on a synthetic stream, or replays a recorded one, through each refine
+// setting and reports the time of every stage, to tune the speed/quality tradeoff.
+// A recording is a pair of raw files of frames as the sample gets them, one after the other:
+//     depth          320x240 NUI_DEPTH_IMAGE_PIXEL (player index, then depth) per frame
+//     color          640x480 BGRX per frame
+//     registration   optional, 320x240 NUI_COLOR_IMAGE_POINT per frame as given by
+//                    INuiCoordinateMapper::MapDepthFrameToColorFrame, scaled coordinates without it
+
+#include "BackgroundRemovalTests.h"
+#include "DepthBackgroundRemover.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static const char* cCheckName = "DepthBackgroundRemover";
+static const int cDepthWidth = 320;
+static const int cDepthHeight = 240;
+static const int cColorWidth = 640;
+static const int cColorHeight = 480;
+static const int cBytesPerPixel = 4;
+
+// Player 1 is a rectangle moving left to right, player 2 stands still on the right
+static const int cFigureWidth = 60;
+static const int cFigureTop = 40;
+static const int cFigureBottom = 200;
+static const int cStillLeft = 250;
+static const int cStillRight = 300;
+
+/// <summary>
+/// Source of the frames the engine is run on
+/// </summary>
+class DepthFrameSource
+{
+public:
+    virtual ~DepthFrameSource() {}
+
+    /// <summary>
+    /// Go back to the first frame
+    /// </summary>
+    virtual void Rewind() = 0;
+
+    /// <summary>
+    /// Read the next frame
+    /// </summary>
+    /// <param name="pDepth">receives the depth frame</param>
+    /// <param name="pRegistration">receives the depth to color table</param>
+    /// <param name="pColor">receives the color frame</param>
+    /// <returns>true when there was a frame, false at the end of the stream</returns>
+    virtual bool Read(DepthPlayerPixel* pDepth, ColorPoint* pRegistration, unsigned char* pColor) = 0;
+
+    /// <summary>
+    /// Whether Read fills the depth to color table, the engine scales coordinates otherwise
+    /// </summary>
+    virtual bool HasRegistration() const = 0;
+};
+
+/// <summary>
+/// A synthetic stream: a textured background, the two players in flat colors
+/// </summary>
+class SyntheticDepthFrameSource : public DepthFrameSource
+{
+public:
+    SyntheticDepthFrameSource(int frameCount) : m_frameCount(frameCount), m_frame(0) {}
+
+    void Rewind() { m_frame = 0; }
+
+    bool HasRegistration() const { return false; }
+
+    bool Read(DepthPlayerPixel* pDepth, ColorPoint*, unsigned char* pColor)
+    {
+        if (m_frame >= m_frameCount)
+        {
+            return false;
+        }
+
+        const int figureLeft = 10 + (m_frame * 4) % 160;
+
+        for (int y = 0; y < cDepthHeight; ++y)
+        {
+            for (int x = 0; x < cDepthWidth; ++x)
+            {
+                DepthPlayerPixel& pixel = pDepth[y * cDepthWidth + x];
+                pixel.playerIndex = static_cast<unsigned short>(GetPlayerIndex(figureLeft, x, y));
+                pixel.depth = static_cast<unsigned short>((0 != pixel.playerIndex) ? 1500 : 3500);
+            }
+        }
+
+        for (int y = 0; y < cColorHeight; ++y)
+        {
+            for (int x = 0; x < cColorWidth; ++x)
+            {
+                unsigned char* pPixel = pColor + (y * cColorWidth + x) * cBytesPerPixel;
+                const int player = GetPlayerIndex(figureLeft, x / 2, y / 2);
+
+                pPixel[0] = static_cast<unsigned char>((1 == player) ? 40 : ((2 == player) ? 200 : x));
+                pPixel[1] = static_cast<unsigned char>((1 == player) ? 90 : ((2 == player) ? 60 : y));
+                pPixel[2] = static_cast<unsigned char>((1 == player) ? 220 : ((2 == player) ? 30 : (x ^ y)));
+                pPixel[3] = 0;
+            }
+        }
+
+        ++m_frame;
+        return true;
+    }
+
+    /// <summary>
+    /// Player index of a depth pixel
+    /// </summary>
+    static int GetPlayerIndex(int figureLeft, int x, int y)
+    {
+        if (y < cFigureTop || y > cFigureBottom)
+        {
+            return 0;
+        }
+        if (x >= figureLeft && x < figureLeft + cFigureWidth)
+        {
+            return 1;
+        }
+        return (x >= cStillLeft && x <= cStillRight) ? 2 : 0;
+    }
+
+private:
+    int m_frameCount;
+    int m_frame;
+};
+
+/// <summary>
+/// A recorded stream, read from raw files one frame at a time
+/// </summary>
+class RecordedDepthFrameSource : public DepthFrameSource
+{
+public:
+    RecordedDepthFrameSource() : m_pDepthFile(NULL), m_pColorFile(NULL), m_pRegistrationFile(NULL) {}
+
+    ~RecordedDepthFrameSource()
+    {
+        Close(m_pDepthFile);
+        Close(m_pColorFile);
+        Close(m_pRegistrationFile);
+    }
+
+    /// <summary>
+    /// Open the files of a recording
+    /// </summary>
+    /// <param name="depthPath">file of depth frames</param>
+    /// <param name="colorPath">file of color frames</param>
+    /// <param name="registrationPath">file of depth to color tables, NULL when there is none</param>
+    /// <returns>true when every file could be opened</returns>
+    bool Open(const char* depthPath, const char* colorPath, const char* registrationPath)
+    {
+        m_pDepthFile = fopen(depthPath, "rb");
+        m_pColorFile = fopen(colorPath, "rb");
+        m_pRegistrationFile = (NULL != registrationPath) ? fopen(registrationPath, "rb") : NULL;
+
+        return NULL != m_pDepthFile && NULL != m_pColorFile && (NULL == registrationPath || NULL != m_pRegistrationFile);
+    }
+
+    void Rewind()
+    {
+        rewind(m_pDepthFile);
+        rewind(m_pColorFile);
+        if (NULL != m_pRegistrationFile)
+        {
+            rewind(m_pRegistrationFile);
+        }
+    }
+
+    bool HasRegistration() const { return NULL != m_pRegistrationFile; }
+
+    bool Read(DepthPlayerPixel* pDepth, ColorPoint* pRegistration, unsigned char* pColor)
+    {
+        const size_t depthPixels = cDepthWidth * cDepthHeight;
+        const size_t colorPixels = cColorWidth * cColorHeight;
+
+        return depthPixels == fread(pDepth, sizeof(DepthPlayerPixel), depthPixels, m_pDepthFile) &&
+            colorPixels * cBytesPerPixel == fread(pColor, 1, colorPixels * cBytesPerPixel, m_pColorFile) &&
+            (NULL == m_pRegistrationFile || depthPixels == fread(pRegistration, sizeof(ColorPoint), depthPixels, m_pRegistrationFile));
+    }
+
+private:
+    FILE* m_pDepthFile;
+    FILE* m_pColorFile;
+    FILE* m_pRegistrationFile;
+
+    static void Close(FILE* pFile)
+    {
+        if (NULL != pFile)
+        {
+            fclose(pFile);
+        }
+    }
+};
+
+/// <summary>
+/// Run a stream through each refine setting and print the average time of every stage
+/// </summary>
+/// <param name="source">stream to run, rewound for every setting</param>
+/// <param name="name">name of the stream in the report</param>
+static void ReportStageTimings(DepthFrameSource& source, const char* name)
+{
+    static const char* cSettings[] = { "feather", "guided", "guided, keyed", "guided, not stabilized" };
+
+    std::vector<DepthPlayerPixel> depth(cDepthWidth * cDepthHeight);
+    std::vector<ColorPoint> registration(cDepthWidth * cDepthHeight);
+    std::vector<unsigned char> color(cColorWidth * cColorHeight * cBytesPerPixel);
+    std::vector<unsigned char> output(cColorWidth * cColorHeight * cBytesPerPixel);
+
+    for (int setting = 0; setting < static_cast<int>(sizeof(cSettings) / sizeof(cSettings[0])); ++setting)
+    {
+        DepthBackgroundRemover remover;
+        remover.Initialize(cDepthWidth, cDepthHeight, cColorWidth, cColorHeight);
+        remover.SetRefineMode((0 == setting) ? DepthRefineFeather : DepthRefineGuided);
+        remover.SetKeying(2 == setting);
+        remover.SetStabilization(3 != setting);
+
+        DepthBackgroundRemoverTimings sums;
+        memset(&sums, 0, sizeof(sums));
+        int frames = 0;
+
+        source.Rewind();
+        while (source.Read(&depth[0], &registration[0], &color[0]))
+        {
+            remover.Process(&depth[0], source.HasRegistration() ? &registration[0] : NULL, &color[0], &output[0]);
+
+            const DepthBackgroundRemoverTimings& timings = remover.GetTimings();
+            sums.mask         += timings.mask;
+            sums.registration += timings.registration;
+            sums.refine       += timings.refine;
+            sums.stabilize    += timings.stabilize;
+            sums.compose      += timings.compose;
+            sums.total        += timings.total;
+            ++frames;
+        }
+
+        if (0 == frames)
+        {
+            printf("%s: %s has no complete frame\n", cCheckName, name);
+            return;
+        }
+
+        printf("%s %s, %d frames, %s, ms per frame: mask %.3f, registration %.3f, refine %.3f, stabilize %.3f, compose %.3f, total %.3f\n",
+            cCheckName, name, frames, cSettings[setting],
+            sums.mask / frames, sums.registration / frames, sums.refine / frames,
+            sums.stabilize / frames, sums.compose / frames, sums.total / frames);
+    }
+}
+
+/// <summary>
+/// Check which pixels a synthetic frame keeps, and the player bounds found on the way
+/// </summary>
+/// <returns>true when every case holds</returns>
+bool DepthBackgroundRemoverCheck()
+{
+    std::vector<DepthPlayerPixel> depth(cDepthWidth * cDepthHeight);
+    std::vector<unsigned char> color(cColorWidth * cColorHeight * cBytesPerPixel);
+    std::vector<unsigned char> output(cColorWidth * cColorHeight * cBytesPerPixel);
+
+    SyntheticDepthFrameSource source(1);
+    source.Read(&depth[0], NULL, &color[0]);
+
+    // Hard edges and no history, so every color pixel is either kept whole or dropped
+    DepthBackgroundRemover remover;
+    bool bPassed = Expect(remover.Initialize(cDepthWidth, cDepthHeight, cColorWidth, cColorHeight), cCheckName, "the engine initializes") &&
+        Expect(!remover.Process(NULL, NULL, &color[0], &output[0]), cCheckName, "a missing depth frame is refused");
+
+    remover.SetRefineMode(DepthRefineFeather);
+    remover.SetRefinement(0, 0);
+    remover.SetStabilization(false);
+    remover.SetTrackedPlayer(1);
+    bPassed = Expect(remover.Process(&depth[0], NULL, &color[0], &output[0]), cCheckName, "a frame is processed") && bPassed;
+
+    const DepthPlayerStats& figure = remover.GetPlayerStats(1);
+    bPassed = Expect(cFigureWidth * (cFigureBottom - cFigureTop + 1) == figure.pixelCount, cCheckName, "the pixels of player 1 are counted") && bPassed;
+    bPassed = Expect(10 == figure.left && 10 + cFigureWidth - 1 == figure.right && cFigureTop == figure.top && cFigureBottom == figure.bottom,
+        cCheckName, "the bounds of player 1 are found") && bPassed;
+    bPassed = Expect(cStillLeft == remover.GetPlayerStats(2).left && cStillRight == remover.GetPlayerStats(2).right,
+        cCheckName, "the bounds of a player not kept are found too") && bPassed;
+
+    // Compare every color pixel with the player it was drawn from
+    bool bKeptRight = true;
+    for (int y = 0; y < cColorHeight && bKeptRight; ++y)
+    {
+        for (int x = 0; x < cColorWidth && bKeptRight; ++x)
+        {
+            const unsigned char* pIn = &color[(y * cColorWidth + x) * cBytesPerPixel];
+            const unsigned char* pOut = &output[(y * cColorWidth + x) * cBytesPerPixel];
+            const bool bKept = 1 == SyntheticDepthFrameSource::GetPlayerIndex(10, x / 2, y / 2);
+
+            bKeptRight = bKept ? (255 == pOut[3] && 0 == memcmp(pIn, pOut, 3)) : (0 == pOut[3] && 0 == pOut[0] && 0 == pOut[1] && 0 == pOut[2]);
+        }
+    }
+    bPassed = Expect(bKeptRight, cCheckName, "only the pixels of the tracked player are kept, with their color") && bPassed;
+
+    // Every player, in one pass
+    remover.SetTrackedPlayer(0);
+    remover.Process(&depth[0], NULL, &color[0], &output[0]);
+    const int stillCenter = ((cFigureTop + cFigureBottom) * cColorWidth + (cStillLeft + cStillRight)) * cBytesPerPixel;
+    bPassed = Expect(255 == output[stillCenter + 3], cCheckName, "keeping every player keeps player 2") && bPassed;
+
+    printf("%s: %s\n", cCheckName, bPassed ? "passed" : "FAILED");
+
+    return bPassed;
+}
+
+/// <summary>
+/// Time every stage on a synthetic stream
+/// </summary>
+void DepthBackgroundRemoverBenchmark()
+{
+    SyntheticDepthFrameSource source(100);
+    ReportStageTimings(source, "synthetic stream");
+}
+
+/// <summary>
+/// Time every stage on a recorded stream
+/// </summary>
+/// <param name="depthPath">file of depth frames</param>
+/// <param name="colorPath">file of color frames</param>
+/// <param name="registrationPath">file of depth to color tables, NULL when there is none</param>
+/// <returns>true when the recording could be opened</returns>
+bool DepthBackgroundRemoverReplay(const char* depthPath, const char* colorPath, const char* registrationPath)
+{
+    RecordedDepthFrameSource source;
+    if (!source.Open(depthPath, colorPath, registrationPath))
+    {
+        printf("%s: cannot open the recording\n", cCheckName);
+        return false;
+    }
+
+    ReportStageTimings(source, depthPath);
+
+    return true;
+}
@@ -0,0 +1,164 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DirtyTileTrackerTests.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "BackgroundRemovalTests.h"
+#include "DirtyTileTracker.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static const char* cCheckName = "DirtyTileTracker";
+
+/// <summary>
+/// Tell whether the last update found exactly one rectangle, the given one
+/// </summary>
+static bool IsSingleRect(const DirtyTileTracker& tracker, unsigned int left, unsigned int top, unsigned int right, unsigned int bottom)
+{
+    if (1 != tracker.GetDirtyRectCount())
+    {
+        return false;
+    }
+
+    const DirtyRect& rect = tracker.GetDirtyRect(0);
+    return left == rect.left && top == rect.top && right == rect.right && bottom == rect.bottom;
+}
+
+/// <summary>
+/// Fill an image with a pattern that differs from tile to tile and from frame to frame
+/// </summary>
+static void FillImage(std::vector<unsigned char>& image, unsigned int seed)
+{
+    for (size_t i = 0; i < image.size(); ++i)
+    {
+        image[i] = static_cast<unsigned char>((i * 2654435761u + seed * 40503u) >> 13);
+    }
+}
+
+/// <summary>
+/// Check the dirty rectangles of single pixel changes, static frames, full changes and merges,
+/// on an image whose size is not a multiple of the tile size and whose rows are padded
+/// </summary>
+/// <returns>true when every case holds</returns>
+bool DirtyTileTrackerCheck()
+{
+    const unsigned int width = 650;
+    const unsigned int height = 490;
+    const unsigned int bytesPerPixel = 4;
+    const unsigned int stride = width * bytesPerPixel + 16;
+
+    std::vector<unsigned char> image(stride * height);
+    FillImage(image, 1);
+
+    DirtyTileTracker tracker;
+    bool bPassed = Expect(tracker.Initialize(width, height, stride, bytesPerPixel), cCheckName, "the format is taken");
+    bPassed = Expect(!tracker.Initialize(width, height, width * bytesPerPixel - 1, bytesPerPixel), cCheckName, "a stride shorter than a row is refused") && bPassed;
+    tracker.Initialize(width, height, stride, bytesPerPixel);
+
+    tracker.Update(&image[0]);
+    bPassed = Expect(IsSingleRect(tracker, 0, 0, width, height), cCheckName, "the first frame is all dirty") && bPassed;
+    bPassed = Expect(0 == tracker.Update(&image[0]), cCheckName, "a static frame has nothing dirty") && bPassed;
+
+    // Single pixels, at the corners, in the partial tiles of the last column and row, and inside
+    static const unsigned int pixels[][2] = { { 0, 0 }, { 649, 489 }, { 100, 200 }, { 640, 0 }, { 0, 480 } };
+    static const unsigned int tiles[][4] = { { 0, 0, 64, 64 }, { 640, 448, 650, 490 }, { 64, 192, 128, 256 }, { 640, 0, 650, 64 }, { 0, 448, 64, 490 } };
+    for (size_t i = 0; i < sizeof(pixels) / sizeof(pixels[0]); ++i)
+    {
+        image[pixels[i][1] * stride + pixels[i][0] * bytesPerPixel + 2] ^= 0x01;
+        tracker.Update(&image[0]);
+        bPassed = Expect(IsSingleRect(tracker, tiles[i][0], tiles[i][1], tiles[i][2], tiles[i][3]), cCheckName, "a single changed pixel dirties its tile only") && bPassed;
+        bPassed = Expect(0 == tracker.Update(&image[0]), cCheckName, "the frame after a change is static") && bPassed;
+    }
+
+    // Row padding is not part of the image
+    image[10 * stride + width * bytesPerPixel + 3] ^= 0xFF;
+    bPassed = Expect(0 == tracker.Update(&image[0]), cCheckName, "a change in the row padding is ignored") && bPassed;
+
+    // Tiles next to each other merge, across and down
+    image[10 * stride + 10 * bytesPerPixel] ^= 0x80;
+    image[10 * stride + 70 * bytesPerPixel] ^= 0x80;
+    tracker.Update(&image[0]);
+    bPassed = Expect(IsSingleRect(tracker, 0, 0, 128, 64), cCheckName, "tiles side by side merge") && bPassed;
+
+    image[10 * stride + 100 * bytesPerPixel] ^= 0x80;
+    image[70 * stride + 100 * bytesPerPixel] ^= 0x80;
+    tracker.Update(&image[0]);
+    bPassed = Expect(IsSingleRect(tracker, 64, 0, 128, 128), cCheckName, "tiles one above the other merge") && bPassed;
+
+    // Tiles apart stay apart
+    image[10 * stride + 10 * bytesPerPixel] ^= 0x80;
+    image[300 * stride + 300 * bytesPerPixel] ^= 0x80;
+    bPassed = Expect(2 == tracker.Update(&image[0]), cCheckName, "tiles apart are two rectangles") && bPassed;
+
+    // Changing most of the frame uploads all of it
+    FillImage(image, 2);
+    tracker.Update(&image[0]);
+    bPassed = Expect(IsSingleRect(tracker, 0, 0, width, height), cCheckName, "a full change is one full rectangle") && bPassed;
+    bPassed = Expect(0 == tracker.Update(&image[0]), cCheckName, "the frame after a full change is static") && bPassed;
+
+    tracker.Invalidate();
+    tracker.Update(&image[0]);
+    bPassed = Expect(IsSingleRect(tracker, 0, 0, width, height), cCheckName, "an invalidated frame is all dirty") && bPassed;
+
+    printf("%s: %s\n", cCheckName, bPassed ? "passed" : "FAILED");
+
+    return bPassed;
+}
+
+/// <summary>
+/// Time the tracking of a depth sized BGRA frame, static, with one changed pixel and fully changed,
+/// against the copy of the whole frame a full upload makes
+/// </summary>
+void DirtyTileTrackerBenchmark()
+{
+    const unsigned int width = 640;
+    const unsigned int height = 480;
+    const unsigned int stride = width * 4;
+    const int frames = 500;
+
+    std::vector<unsigned char> images[2] = { std::vector<unsigned char>(stride * height), std::vector<unsigned char>(stride * height) };
+    std::vector<unsigned char> upload(stride * height);
+    FillImage(images[0], 1);
+    FillImage(images[1], 2);
+
+    DirtyTileTracker tracker;
+    tracker.Initialize(width, height, stride, 4);
+    tracker.Update(&images[0][0]);
+
+    unsigned int rects = 0;
+
+    double start = GetSeconds();
+    for (int i = 0; i < frames; ++i)
+    {
+        rects += tracker.Update(&images[0][0]);
+    }
+    const double staticTime = GetSeconds() - start;
+
+    start = GetSeconds();
+    for (int i = 0; i < frames; ++i)
+    {
+        images[0][(i * 7919 % height) * stride + (i * 104729 % width) * 4] ^= 0x01;
+        rects += tracker.Update(&images[0][0]);
+    }
+    const double pixelTime = GetSeconds() - start;
+
+    start = GetSeconds();
+    for (int i = 0; i < frames; ++i)
+    {
+        rects += tracker.Update(&images[i & 1][0]);
+    }
+    const double fullTime = GetSeconds() - start;
+
+    start = GetSeconds();
+    for (int i = 0; i < frames; ++i)
+    {
+        memcpy(&upload[0], &images[i & 1][0], upload.size());
+        rects += upload[i];
+    }
+    const double copyTime = GetSeconds() - start;
+
+    printf("%s benchmark, %ux%u BGRA, ms per frame: static %.3f, one pixel %.3f, full change %.3f, full frame copy %.3f (checksum %u)\n",
+        cCheckName, width, height, staticTime * 1000.0 / frames, pixelTime * 1000.0 / frames, fullTime * 1000.0 / frames, copyTime * 1000.0 / frames, rects);
+}
@@ -0,0 +1,154 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="StreamSchedulerTests.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "BackgroundRemovalTests.h"
+#include "StreamScheduler.h"
+#include <stdio.h>
+
+static const char* cCheckName = "StreamScheduler";
+
+/// <summary>
+/// Check the dispatch order, coalescing and latencies on synthetic signals, then drive the
+/// scheduler the way the sample's Update loop does, from events that stay set until their
+/// frame is taken
+/// </summary>
+/// <returns>true when every case holds</returns>
+bool StreamSchedulerCheck()
+{
+    bool bPassed = true;
+
+    // The sample's streams: skeleton, depth and color, composite
+    {
+        StreamScheduler scheduler;
+        const int skeleton  = scheduler.AddStream(3, 5000);
+        const int depth     = scheduler.AddStream(2, 30000);
+        const int color     = scheduler.AddStream(2, 30000);
+        const int composite = scheduler.AddStream(1, 60000);
+
+        bPassed = Expect(-1 == scheduler.Next(0), cCheckName, "nothing is dispatched before a signal") && bPassed;
+
+        // Priority goes before arrival
+        scheduler.Signal(composite, 0);
+        scheduler.Signal(color, 100);
+        scheduler.Signal(skeleton, 200);
+        bPassed = Expect(skeleton == scheduler.Next(300), cCheckName, "the skeleton goes before heavier streams that came first") && bPassed;
+        bPassed = Expect(color == scheduler.Next(400), cCheckName, "color goes before the composite") && bPassed;
+
+        // A skeleton frame that comes in while color is handled goes before the composite still waiting
+        scheduler.Signal(skeleton, 500);
+        bPassed = Expect(skeleton == scheduler.Next(600), cCheckName, "a skeleton frame that comes in later goes before the waiting composite") && bPassed;
+        bPassed = Expect(composite == scheduler.Next(700), cCheckName, "the composite goes last") && bPassed;
+        bPassed = Expect(-1 == scheduler.Next(800), cCheckName, "a stream is dispatched once per signal") && bPassed;
+
+        // Streams of equal priority go in the order their frames fall due
+        scheduler.Signal(color, 1000);
+        scheduler.Signal(depth, 2000);
+        bPassed = Expect(color == scheduler.Next(3000), cCheckName, "of equal deadlines the earlier signal goes first") && bPassed;
+        bPassed = Expect(depth == scheduler.Next(3000), cCheckName, "the later signal goes next") && bPassed;
+
+        // A stream signaled again before it was handled is handled once, measured from its first signal
+        scheduler.ResetStats();
+        scheduler.Signal(depth, 10000);
+        scheduler.Signal(depth, 12000);
+        bPassed = Expect(depth == scheduler.Next(15000) && -1 == scheduler.Next(15000), cCheckName, "a stream signaled twice is dispatched once") && bPassed;
+
+        const StreamSchedulerStats& stats = scheduler.GetStats();
+        bPassed = Expect(1 == stats.coalesced[depth] && 1 == stats.dispatched[depth], cCheckName, "the stale frame is counted as coalesced") && bPassed;
+        bPassed = Expect(5000 == stats.latencySum[depth] && 5000 == stats.maxLatency[depth], cCheckName, "the latency runs from the first signal") && bPassed;
+
+        scheduler.Signal(color, 20000);
+        scheduler.Reset();
+        bPassed = Expect(!scheduler.IsPending(color) && -1 == scheduler.Next(20000), cCheckName, "Reset forgets every signal") && bPassed;
+    }
+
+    // Deadlines order streams of equal priority even against their arrival
+    {
+        StreamScheduler scheduler;
+        const int slow = scheduler.AddStream(1, 10000);
+        const int fast = scheduler.AddStream(1, 5000);
+        scheduler.Signal(slow, 0);
+        scheduler.Signal(fast, 2000);
+        bPassed = Expect(fast == scheduler.Next(2500), cCheckName, "the stream due first goes first") && bPassed;
+        bPassed = Expect(slow == scheduler.Next(2500), cCheckName, "the stream due later goes next") && bPassed;
+    }
+
+    // Too many streams
+    {
+        StreamScheduler scheduler;
+        for (int s = 0; s < cMaxScheduledStreams; ++s)
+        {
+            scheduler.AddStream(0, 0);
+        }
+        bPassed = Expect(-1 == scheduler.AddStream(0, 0), cCheckName, "a stream past the maximum is refused") && bPassed;
+    }
+
+    // The Update loop of the sample, on manual reset events that a handler clears when it takes the frame.
+    // Handlers set the events of the streams they feed, as a frame coming in meanwhile would
+    {
+        StreamScheduler scheduler;
+        const int skeleton  = scheduler.AddStream(3, 5000);
+        const int depth     = scheduler.AddStream(2, 30000);
+        const int color     = scheduler.AddStream(2, 30000);
+        const int composite = scheduler.AddStream(1, 60000);
+
+        bool events[cMaxScheduledStreams] = { false };
+        events[composite] = true;
+        events[depth] = true;
+        events[color] = true;
+
+        int order[16];
+        int dispatches = 0;
+        unsigned int handledStreams = 0;
+        long long now = 0;
+
+        for (;;)
+        {
+            for (int stream = 0; stream < scheduler.GetStreamCount(); ++stream)
+            {
+                if (0 == (handledStreams & (1 << stream)) && !scheduler.IsPending(stream) && events[stream])
+                {
+                    scheduler.Signal(stream, now);
+                }
+            }
+
+            const int stream = scheduler.Next(now);
+            if (stream < 0 || dispatches >= 16)
+            {
+                break;
+            }
+            handledStreams |= 1 << stream;
+            order[dispatches++] = stream;
+
+            events[stream] = false;
+            if (depth == stream)
+            {
+                events[skeleton] = true;
+            }
+            now += 1000;
+        }
+
+        const int expected[4] = { depth, skeleton, color, composite };
+        bool bOrderHolds = 4 == dispatches;
+        for (int d = 0; bOrderHolds && d < dispatches; ++d)
+        {
+            bOrderHolds = expected[d] == order[d];
+        }
+        bPassed = Expect(bOrderHolds, cCheckName, "the loop dispatches depth, the skeleton it let in, color, then the composite") && bPassed;
+
+        const StreamSchedulerStats& stats = scheduler.GetStats();
+        int coalesced = 0;
+        for (int stream = 0; stream < scheduler.GetStreamCount(); ++stream)
+        {
+            coalesced += stats.coalesced[stream];
+        }
+        bPassed = Expect(0 == coalesced, cCheckName, "events still set for a waiting stream are not counted as coalesced") && bPassed;
+        bPassed = Expect(3000 == stats.maxLatency[composite], cCheckName, "the composite waited for the three streams before it") && bPassed;
+    }
+
+    printf("%s: %s\n", cCheckName, bPassed ? "passed" : "FAILED");
+
+    return bPassed;
+}
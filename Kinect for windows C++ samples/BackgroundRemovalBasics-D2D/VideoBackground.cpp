@@ -0,0 +1,598 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="VideoBackground.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "VideoBackground.h"
+#include "BackgroundAssetCache.h"
+#include <algorithm>
+
+// Stream header and frame headers of a Y4M file are short lines of text
+static const DWORD cMaxY4MHeaderSize = 1024;
+
+/// <summary>
+/// Clamp a color component to a byte
+/// </summary>
+static inline BYTE ClampByte(int value)
+{
+    return static_cast<BYTE>((value < 0) ? 0 : ((value > 255) ? 255 : value));
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+VideoBackground::VideoBackground() :
+    m_width(0),
+    m_height(0),
+    m_pPool(NULL),
+    m_shownSlot(-1),
+    m_hThread(NULL),
+    m_bStop(FALSE),
+    m_wantedFrame(0),
+    m_bClockStarted(false),
+    m_startTime(0),
+    m_lastTime(0),
+    m_frameCount(0),
+    m_rateNumerator(cSequenceRate),
+    m_rateDenominator(1),
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_dataOffset(0),
+    m_frameStride(0),
+    m_frameHeaderSize(0),
+    m_sourceWidth(0),
+    m_sourceHeight(0),
+    m_chromaWidth(0),
+    m_chromaHeight(0),
+    m_bFullRange(false)
+{
+    for (int slot = 0; slot < cPoolSize; ++slot)
+    {
+        m_slotStates[slot] = SlotFree;
+        m_slotFrames[slot] = 0;
+    }
+
+    InitializeCriticalSection(&m_lock);
+
+    // Signaled when the compositor frees a slot the decoder may be waiting for
+    m_hSlotFreed = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+/// <summary>
+/// Destructor, stops the decoding thread
+/// </summary>
+VideoBackground::~VideoBackground()
+{
+    Close();
+
+    delete[] m_pPool;
+    DeleteCriticalSection(&m_lock);
+    CloseHandle(m_hSlotFreed);
+}
+
+/// <summary>
+/// Set the resolution the frames are scaled to and allocate the buffers
+/// </summary>
+/// <param name="width">width (in pixels) of the frames</param>
+/// <param name="height">height (in pixels) of the frames</param>
+void VideoBackground::Initialize(UINT width, UINT height)
+{
+    Close();
+
+    m_width = width;
+    m_height = height;
+
+    delete[] m_pPool;
+    m_pPool = new BYTE[cPoolSize * m_width * m_height * cBytesPerPixel];
+}
+
+/// <summary>
+/// Start playing a video, from its first frame
+/// </summary>
+/// <param name="path">.y4m file, or folder of images played in name order</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT VideoBackground::Open(PCWSTR path)
+{
+    Close();
+
+    if (NULL == m_pPool)
+    {
+        return E_UNEXPECTED;
+    }
+
+    const DWORD attributes = GetFileAttributesW(path);
+    if (INVALID_FILE_ATTRIBUTES == attributes)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = (0 != (attributes & FILE_ATTRIBUTE_DIRECTORY)) ? OpenSequence(path) : OpenY4M(path);
+
+    if (SUCCEEDED(hr))
+    {
+        m_hThread = CreateThread(NULL, 0, DecodeThread, this, 0, NULL);
+        hr = (NULL != m_hThread) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Stop playing
+/// </summary>
+void VideoBackground::Close()
+{
+    if (NULL != m_hThread)
+    {
+        InterlockedExchange(&m_bStop, TRUE);
+        SetEvent(m_hSlotFreed);
+        WaitForSingleObject(m_hThread, INFINITE);
+        CloseHandle(m_hThread);
+        m_hThread = NULL;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    m_images.clear();
+    m_frameCount = 0;
+
+    for (int slot = 0; slot < cPoolSize; ++slot)
+    {
+        m_slotStates[slot] = SlotFree;
+    }
+
+    m_shownSlot = -1;
+    m_bStop = FALSE;
+    m_wantedFrame = 0;
+    m_bClockStarted = false;
+}
+
+/// <summary>
+/// Get the frame to show at a time, without waiting for it to be decoded
+/// </summary>
+/// <param name="timestamp">time stamp (in ms) of the frame being composed</param>
+/// <returns>the frame in BGRX format, valid until the next call, NULL until the first frame is decoded</returns>
+const BYTE* VideoBackground::GetFrame(LONGLONG timestamp)
+{
+    if (NULL == m_hThread)
+    {
+        return NULL;
+    }
+
+    // The video carries on from where it was when the time stamps start over or stop for a while,
+    // as they do when the sensor changes
+    if (!m_bClockStarted || timestamp < m_lastTime || timestamp - m_lastTime > cMaxClockGap)
+    {
+        const LONGLONG rateDivisor = 1000LL * m_rateDenominator;
+        m_startTime = timestamp - (m_wantedFrame * rateDivisor + m_rateNumerator - 1) / m_rateNumerator;
+        m_bClockStarted = true;
+    }
+    m_lastTime = timestamp;
+
+    const LONG wantedFrame = static_cast<LONG>((timestamp - m_startTime) * m_rateNumerator / (1000LL * m_rateDenominator));
+    InterlockedExchange(&m_wantedFrame, wantedFrame);
+
+    EnterCriticalSection(&m_lock);
+
+    int best = -1;
+    for (int slot = 0; slot < cPoolSize; ++slot)
+    {
+        if (SlotReady == m_slotStates[slot] && m_slotFrames[slot] <= wantedFrame && (best < 0 || m_slotFrames[slot] > m_slotFrames[best]))
+        {
+            best = slot;
+        }
+    }
+
+    // Frames ahead stay for later, older ones are past due and their slots are decoded into again
+    if (best >= 0)
+    {
+        for (int slot = 0; slot < cPoolSize; ++slot)
+        {
+            if (SlotShown == m_slotStates[slot] || (SlotReady == m_slotStates[slot] && m_slotFrames[slot] < m_slotFrames[best]))
+            {
+                m_slotStates[slot] = SlotFree;
+            }
+        }
+
+        m_slotStates[best] = SlotShown;
+        m_shownSlot = best;
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    if (best >= 0)
+    {
+        SetEvent(m_hSlotFreed);
+    }
+
+    return (m_shownSlot >= 0) ? m_pPool + m_shownSlot * m_width * m_height * cBytesPerPixel : NULL;
+}
+
+/// <summary>
+/// Decoding thread entry point
+/// </summary>
+DWORD WINAPI VideoBackground::DecodeThread(LPVOID pParam)
+{
+    reinterpret_cast<VideoBackground*>(pParam)->Decode();
+    return 0;
+}
+
+/// <summary>
+/// Decode the next frames into free slots until stopped
+/// </summary>
+void VideoBackground::Decode()
+{
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    const bool bUninitialize = SUCCEEDED(hr);
+
+    IWICImagingFactory* pIWICFactory = NULL;
+    if (!m_images.empty())
+    {
+        CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_IWICImagingFactory, (LPVOID*)&pIWICFactory);
+    }
+
+    const UINT frameSize = m_width * m_height * cBytesPerPixel;
+    LONG nextFrame = 0;
+
+    while (!InterlockedCompareExchange(&m_bStop, FALSE, FALSE))
+    {
+        const int slot = AcquireSlot();
+        if (slot < 0)
+        {
+            WaitForSingleObject(m_hSlotFreed, INFINITE);
+            continue;
+        }
+
+        // Frames the compositor is already past are not worth decoding
+        const LONG wantedFrame = InterlockedCompareExchange(&m_wantedFrame, 0, 0);
+        if (nextFrame < wantedFrame)
+        {
+            nextFrame = wantedFrame;
+        }
+
+        BYTE* pPixels = m_pPool + slot * frameSize;
+        const LONG frame = nextFrame % m_frameCount;
+
+        if (m_images.empty())
+        {
+            hr = DecodeY4MFrame(frame, pPixels);
+        }
+        else
+        {
+            IWICBitmapDecoder* pDecoder = NULL;
+            hr = (NULL != pIWICFactory) ? pIWICFactory->CreateDecoderFromFilename(m_images[frame].c_str(), NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &pDecoder) : E_FAIL;
+
+            if (SUCCEEDED(hr))
+            {
+                hr = BackgroundAssetCache::DecodeScaled(pIWICFactory, pDecoder, m_width, m_height, pPixels);
+            }
+
+            SafeRelease(pDecoder);
+        }
+
+        // A frame that cannot be decoded shows black rather than stopping the video
+        if (FAILED(hr))
+        {
+            ZeroMemory(pPixels, frameSize);
+        }
+
+        EnterCriticalSection(&m_lock);
+        m_slotFrames[slot] = nextFrame;
+        m_slotStates[slot] = SlotReady;
+        LeaveCriticalSection(&m_lock);
+
+        ++nextFrame;
+    }
+
+    SafeRelease(pIWICFactory);
+    if (bUninitialize)
+    {
+        CoUninitialize();
+    }
+}
+
+/// <summary>
+/// Take a free slot to decode into
+/// </summary>
+/// <returns>slot index, -1 when the pool is full</returns>
+int VideoBackground::AcquireSlot()
+{
+    int acquired = -1;
+
+    EnterCriticalSection(&m_lock);
+
+    for (int slot = 0; slot < cPoolSize; ++slot)
+    {
+        if (SlotFree == m_slotStates[slot])
+        {
+            m_slotStates[slot] = SlotDecoding;
+            acquired = slot;
+            break;
+        }
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    return acquired;
+}
+
+/// <summary>
+/// Read the stream header of a Y4M file and prepare the conversion of its frames
+/// </summary>
+/// <param name="path">path of the file</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT VideoBackground::OpenY4M(PCWSTR path)
+{
+    m_hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    char header[cMaxY4MHeaderSize + 1];
+    DWORD headerSize = 0;
+    if (!ReadFile(m_hFile, header, cMaxY4MHeaderSize, &headerSize, NULL))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    header[headerSize] = '\0';
+
+    // The stream header is "YUV4MPEG2" followed by space separated parameters, each starting with a letter
+    char* pHeaderEnd = strchr(header, '\n');
+    if (NULL == pHeaderEnd || 0 != strncmp(header, "YUV4MPEG2 ", 10))
+    {
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+    *pHeaderEnd = '\0';
+
+    UINT chromaShiftX = 1;
+    UINT chromaShiftY = 1;
+    bool bMonochrome = false;
+
+    m_sourceWidth = 0;
+    m_sourceHeight = 0;
+    m_rateNumerator = cSequenceRate;
+    m_rateDenominator = 1;
+    m_bFullRange = false;
+
+    char* pContext = NULL;
+    for (char* pToken = strtok_s(header + 10, " ", &pContext); NULL != pToken; pToken = strtok_s(NULL, " ", &pContext))
+    {
+        switch (pToken[0])
+        {
+        case 'W':
+            m_sourceWidth = strtoul(pToken + 1, NULL, 10);
+            break;
+
+        case 'H':
+            m_sourceHeight = strtoul(pToken + 1, NULL, 10);
+            break;
+
+        case 'F':
+            {
+                char* pDenominator = NULL;
+                m_rateNumerator = strtoul(pToken + 1, &pDenominator, 10);
+                m_rateDenominator = (':' == *pDenominator) ? strtoul(pDenominator + 1, NULL, 10) : 0;
+            }
+            break;
+
+        case 'C':
+            // Every 4:2:0 chroma siting is read the same way, higher bit depths are not supported
+            if (0 == strcmp(pToken, "C420") || 0 == strcmp(pToken, "C420jpeg") || 0 == strcmp(pToken, "C420mpeg2") || 0 == strcmp(pToken, "C420paldv"))
+            {
+                chromaShiftX = chromaShiftY = 1;
+            }
+            else if (0 == strcmp(pToken, "C422"))
+            {
+                chromaShiftX = 1;
+                chromaShiftY = 0;
+            }
+            else if (0 == strcmp(pToken, "C444"))
+            {
+                chromaShiftX = chromaShiftY = 0;
+            }
+            else if (0 == strcmp(pToken, "Cmono"))
+            {
+                bMonochrome = true;
+            }
+            else
+            {
+                return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+            }
+            break;
+
+        case 'X':
+            m_bFullRange = (0 == strcmp(pToken, "XCOLORRANGE=FULL"));
+            break;
+        }
+    }
+
+    if (0 == m_sourceWidth || 0 == m_sourceHeight || 0 == m_rateNumerator || 0 == m_rateDenominator)
+    {
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    // Every frame starts with a "FRAME" line, taken to be the same length throughout
+    const char* pFrameHeader = pHeaderEnd + 1;
+    const char* pFrameHeaderEnd = reinterpret_cast<const char*>(memchr(pFrameHeader, '\n', header + headerSize - pFrameHeader));
+    if (NULL == pFrameHeaderEnd || 0 != strncmp(pFrameHeader, "FRAME", 5))
+    {
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    m_chromaWidth = bMonochrome ? 0 : (m_sourceWidth + (1 << chromaShiftX) - 1) >> chromaShiftX;
+    m_chromaHeight = bMonochrome ? 0 : (m_sourceHeight + (1 << chromaShiftY) - 1) >> chromaShiftY;
+
+    m_dataOffset = pFrameHeader - header;
+    m_frameHeaderSize = static_cast<UINT>(pFrameHeaderEnd - pFrameHeader + 1);
+    m_frameStride = m_frameHeaderSize + static_cast<LONGLONG>(m_sourceWidth) * m_sourceHeight + 2LL * m_chromaWidth * m_chromaHeight;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_hFile, &fileSize))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    const LONGLONG frameCount = (fileSize.QuadPart - m_dataOffset) / m_frameStride;
+    if (frameCount <= 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+    m_frameCount = static_cast<LONG>((frameCount < LONG_MAX) ? frameCount : LONG_MAX);
+
+    // A monochrome video reads its chroma from a single neutral sample that frames never overwrite
+    if (bMonochrome)
+    {
+        m_chromaWidth = m_chromaHeight = 1;
+    }
+
+    m_planes.assign(m_frameHeaderSize + m_sourceWidth * m_sourceHeight + 2 * m_chromaWidth * m_chromaHeight, 128);
+
+    // Frames are scaled to the output resolution by taking the nearest source sample
+    m_mapX.resize(m_width);
+    m_mapChromaX.resize(m_width);
+    for (UINT x = 0; x < m_width; ++x)
+    {
+        m_mapX[x] = static_cast<UINT>((2ULL * x + 1) * m_sourceWidth / (2ULL * m_width));
+        m_mapChromaX[x] = bMonochrome ? 0 : m_mapX[x] >> chromaShiftX;
+    }
+
+    m_mapY.resize(m_height);
+    m_mapChromaY.resize(m_height);
+    for (UINT y = 0; y < m_height; ++y)
+    {
+        m_mapY[y] = static_cast<UINT>((2ULL * y + 1) * m_sourceHeight / (2ULL * m_height));
+        m_mapChromaY[y] = bMonochrome ? 0 : m_mapY[y] >> chromaShiftY;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// List the images of a folder in name order, to be played as frames
+/// </summary>
+/// <param name="folder">folder holding the images</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT VideoBackground::OpenSequence(PCWSTR folder)
+{
+    WCHAR pattern[MAX_PATH];
+    if (0 > _snwprintf_s(pattern, _TRUNCATE, L"%s\\*", folder))
+    {
+        return E_INVALIDARG;
+    }
+
+    WIN32_FIND_DATAW findData;
+    HANDLE hFind = FindFirstFileW(pattern, &findData);
+    if (INVALID_HANDLE_VALUE == hFind)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    do
+    {
+        const WCHAR* extension = wcsrchr(findData.cFileName, L'.');
+        if (0 == (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && NULL != extension &&
+            (0 == _wcsicmp(extension, L".jpg") || 0 == _wcsicmp(extension, L".png") || 0 == _wcsicmp(extension, L".bmp")))
+        {
+            m_images.push_back(std::wstring(folder) + L"\\" + findData.cFileName);
+        }
+    }
+    while (FindNextFileW(hFind, &findData));
+
+    FindClose(hFind);
+
+    if (m_images.empty())
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    // Numbered frames are expected to be zero padded, so name order is frame order
+    std::sort(m_images.begin(), m_images.end());
+
+    m_frameCount = static_cast<LONG>(m_images.size());
+    m_rateNumerator = cSequenceRate;
+    m_rateDenominator = 1;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Read a frame of the Y4M file and convert it to the output resolution
+/// </summary>
+/// <param name="frame">frame index</param>
+/// <param name="pPixels">receives the frame in BGRX format</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT VideoBackground::DecodeY4MFrame(LONG frame, BYTE* pPixels)
+{
+    LARGE_INTEGER offset;
+    offset.QuadPart = m_dataOffset + frame * m_frameStride;
+    if (!SetFilePointerEx(m_hFile, offset, NULL, FILE_BEGIN))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    const DWORD frameSize = static_cast<DWORD>(m_frameStride);
+    DWORD readSize = 0;
+    if (!ReadFile(m_hFile, &m_planes[0], frameSize, &readSize, NULL))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (readSize != frameSize || 0 != memcmp(&m_planes[0], "FRAME", 5))
+    {
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    ConvertYUV(pPixels);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Convert the frame read into m_planes to BGRX at the output resolution
+/// </summary>
+/// <param name="pPixels">receives the frame in BGRX format</param>
+void VideoBackground::ConvertYUV(BYTE* pPixels) const
+{
+    const BYTE* pY = &m_planes[m_frameHeaderSize];
+    const BYTE* pU = pY + m_sourceWidth * m_sourceHeight;
+    const BYTE* pV = pU + m_chromaWidth * m_chromaHeight;
+
+    // BT.601 in 8 bit fixed point, studio swing unless the file says otherwise
+    const int lumaOffset = m_bFullRange ? 0 : 16;
+    const int lumaScale  = m_bFullRange ? 256 : 298;
+    const int redV       = m_bFullRange ? 359 : 409;
+    const int greenU     = m_bFullRange ? 88 : 100;
+    const int greenV     = m_bFullRange ? 183 : 208;
+    const int blueU      = m_bFullRange ? 454 : 516;
+
+    for (UINT y = 0; y < m_height; ++y)
+    {
+        const BYTE* pRowY = pY + m_mapY[y] * m_sourceWidth;
+        const BYTE* pRowU = pU + m_mapChromaY[y] * m_chromaWidth;
+        const BYTE* pRowV = pV + m_mapChromaY[y] * m_chromaWidth;
+
+        for (UINT x = 0; x < m_width; ++x)
+        {
+            const int luma = (pRowY[m_mapX[x]] - lumaOffset) * lumaScale + 128;
+            const int u = pRowU[m_mapChromaX[x]] - 128;
+            const int v = pRowV[m_mapChromaX[x]] - 128;
+
+            pPixels[0] = ClampByte((luma + blueU * u) >> 8);
+            pPixels[1] = ClampByte((luma - greenU * u - greenV * v) >> 8);
+            pPixels[2] = ClampByte((luma + redV * v) >> 8);
+            pPixels[3] = 0xFF;
+            pPixels += cBytesPerPixel;
+        }
+    }
+}
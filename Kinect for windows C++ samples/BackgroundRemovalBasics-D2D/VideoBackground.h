@@ -0,0 +1,136 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="VideoBackground.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Plays a moving background, looped, from a Y4M file (raw 8 bit YUV frames) or from a
+// folder of numbered images. Frames are decoded ahead on a thread into a small pool of
+// buffers already scaled to the output resolution:
+//     decoder      fills free buffers with the next frames, waiting while the pool is full,
+//                  and skips ahead when it falls behind the frame being shown
+//     compositor   picks the newest decoded frame due at its frame's time stamp and frees
+//                  the older ones, it never waits: a late frame keeps the last one on screen
+// Frames are numbered from the start of playback, frame n shows frame n modulo the length
+// of the video, so looping needs nothing more than the decoder wrapping around.
+
+#pragma once
+
+#include <Wincodec.h>
+#include <string>
+#include <vector>
+
+class VideoBackground
+{
+    static const int        cBytesPerPixel = 4;
+
+    // One buffer is shown while the others are decoded ahead
+    static const int        cPoolSize      = 4;
+
+    // Time stamp jumps larger than this (in ms) restart the clock where it stopped
+    static const LONGLONG   cMaxClockGap   = 1000;
+
+    // Frame rate of image sequences, which have none of their own
+    static const UINT       cSequenceRate  = 30;
+
+    enum SlotState
+    {
+        SlotFree,
+        SlotDecoding,
+        SlotReady,
+        SlotShown
+    };
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    VideoBackground();
+
+    /// <summary>
+    /// Destructor, stops the decoding thread
+    /// </summary>
+    ~VideoBackground();
+
+    /// <summary>
+    /// Set the resolution the frames are scaled to and allocate the buffers
+    /// </summary>
+    /// <param name="width">width (in pixels) of the frames</param>
+    /// <param name="height">height (in pixels) of the frames</param>
+    void Initialize(UINT width, UINT height);
+
+    /// <summary>
+    /// Start playing a video, from its first frame
+    /// </summary>
+    /// <param name="path">.y4m file, or folder of images played in name order</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Open(PCWSTR path);
+
+    /// <summary>
+    /// Stop playing
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Get the frame to show at a time, without waiting for it to be decoded
+    /// </summary>
+    /// <param name="timestamp">time stamp (in ms) of the frame being composed</param>
+    /// <returns>the frame in BGRX format, valid until the next call, NULL until the first frame is decoded</returns>
+    const BYTE* GetFrame(LONGLONG timestamp);
+
+private:
+    UINT                        m_width;
+    UINT                        m_height;
+
+    // Pool of decoded frames, a slot being decoded or shown belongs to one thread,
+    // every state change happens under m_lock
+    BYTE*                       m_pPool;
+    SlotState                   m_slotStates[cPoolSize];
+    LONG                        m_slotFrames[cPoolSize];
+    int                         m_shownSlot;
+    CRITICAL_SECTION            m_lock;
+    HANDLE                      m_hSlotFreed;
+
+    HANDLE                      m_hThread;
+    volatile LONG               m_bStop;
+
+    // Frame the compositor wants, the decoder never decodes an older one
+    volatile LONG               m_wantedFrame;
+
+    // Compositor clock
+    bool                        m_bClockStarted;
+    LONGLONG                    m_startTime;
+    LONGLONG                    m_lastTime;
+
+    // Source, frame rate is m_rateNumerator / m_rateDenominator frames per second
+    LONG                        m_frameCount;
+    UINT                        m_rateNumerator;
+    UINT                        m_rateDenominator;
+    std::vector<std::wstring>   m_images;
+
+    // Y4M file: frame n starts at m_dataOffset + n * m_frameStride, with a header of m_frameHeaderSize bytes
+    HANDLE                      m_hFile;
+    LONGLONG                    m_dataOffset;
+    LONGLONG                    m_frameStride;
+    UINT                        m_frameHeaderSize;
+    UINT                        m_sourceWidth;
+    UINT                        m_sourceHeight;
+    UINT                        m_chromaWidth;
+    UINT                        m_chromaHeight;
+    bool                        m_bFullRange;
+    std::vector<BYTE>           m_planes;
+
+    // Source luma and chroma column and row of every output pixel
+    std::vector<UINT>           m_mapX;
+    std::vector<UINT>           m_mapY;
+    std::vector<UINT>           m_mapChromaX;
+    std::vector<UINT>           m_mapChromaY;
+
+    static DWORD WINAPI         DecodeThread(LPVOID pParam);
+    void                        Decode();
+    int                         AcquireSlot();
+    HRESULT                     OpenY4M(PCWSTR path);
+    HRESULT                     OpenSequence(PCWSTR folder);
+    HRESULT                     DecodeY4MFrame(LONG frame, BYTE* pPixels);
+    void                        ConvertYUV(BYTE* pPixels) const;
+};
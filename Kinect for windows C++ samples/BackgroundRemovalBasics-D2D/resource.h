@@ -14,6 +14,13 @@
 #define IDC_STATUS                      1002
 #define IDC_CHECK_NEARMODE              1003
 #define IDC_SENSORCHOOSER               1004
+#define IDC_CHECK_DEPTHENGINE           1005
+#define IDC_CHECK_ALLPLAYERS            1006
+#define IDC_CHECK_BLUR                  1007
+#define IDC_BUTTON_NEXTBACKGROUND       1008
+#define IDC_CHECK_COLORKEY              1009
+#define IDC_CHECK_CENTERZONE            1011
+#define IDC_CHECK_LOCKPLAYERS           1012
 #define IDC_STATIC                      -1
 
 
@@ -24,7 +31,7 @@
 #define _APS_NO_MFC                     1
 #define _APS_NEXT_RESOURCE_VALUE        103
 #define _APS_NEXT_COMMAND_VALUE         32771
-#define _APS_NEXT_CONTROL_VALUE         1005
+#define _APS_NEXT_CONTROL_VALUE         1013
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
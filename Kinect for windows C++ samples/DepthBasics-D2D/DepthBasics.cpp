@@ -32,10 +32,12 @@ CDepthBasics::CDepthBasics() :
     m_hNextDepthFrameEvent(INVALID_HANDLE_VALUE),
     m_pDepthStreamHandle(INVALID_HANDLE_VALUE),
     m_bNearMode(false),
-    m_pNuiSensor(NULL)
+    m_pNuiSensor(NULL),
+    m_depthPaletteNearMode(-1),
+    m_pacingReportFrames(0)
 {
-    // create heap storage for depth pixel data in RGBX format
-    m_depthRGBX = new BYTE[cDepthWidth*cDepthHeight*cBytesPerPixel];
+    // create heap storage for the depth value to RGBX color lookup table
+    m_depthPalette = new UINT[cDepthPaletteSize];
 }
 
 /// <summary>
@@ -57,8 +59,8 @@ CDepthBasics::~CDepthBasics()
     delete m_pDrawDepth;
     m_pDrawDepth = NULL;
 
-    // done with depth pixel data
-    delete[] m_depthRGBX;
+    // done with the depth palette
+    delete[] m_depthPalette;
 
     // clean up Direct2D
     SafeRelease(m_pD2DFactory);
@@ -112,13 +114,21 @@ int CDepthBasics::Run(HINSTANCE hInstance, int nCmdShow)
 
         // Check to see if we have either a message (by passing in QS_ALLINPUT)
         // Or a Kinect event (hEvents)
+        // Or a frame held back by the renderer's pacing being due
         // Update() will check for Kinect events individually, in case more than one are signalled
-        MsgWaitForMultipleObjects(eventCount, hEvents, FALSE, INFINITE, QS_ALLINPUT);
+        DWORD timeout = (NULL != m_pDrawDepth) ? m_pDrawDepth->GetPendingTimeout() : INFINITE;
+        MsgWaitForMultipleObjects(eventCount, hEvents, FALSE, timeout, QS_ALLINPUT);
 
         // Explicitly check the Kinect frame event since MsgWaitForMultipleObjects
         // can return for other reasons even though it is signaled.
         Update();
 
+        // Present the newest coalesced frame once its refresh slot arrives
+        if (NULL != m_pDrawDepth)
+        {
+            m_pDrawDepth->PresentPending();
+        }
+
         while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
         {
             // If a dialog message will be taken care of by the dialog proc
@@ -225,6 +235,16 @@ LRESULT CALLBACK CDepthBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam, L
             PostQuitMessage(0);
             break;
 
+        // The renderer skips frames whose content did not change, so once the window
+        // was uncovered, restored or resized the next frame has to be presented in full
+        case WM_PAINT:
+        case WM_SIZE:
+            if (NULL != m_pDrawDepth)
+            {
+                m_pDrawDepth->Invalidate();
+            }
+            break;
+
         // Handle button press
         case WM_COMMAND:
             // If it was for the near mode control and a clicked event, change near mode
@@ -346,49 +366,18 @@ void CDepthBasics::ProcessDepth()
     // Make sure we've received valid data
     if (LockedRect.Pitch != 0)
     {
-        // Get the min and max reliable depth for the current frame
-        int minDepth = (nearMode ? NUI_IMAGE_DEPTH_MINIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MINIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
-        int maxDepth = (nearMode ? NUI_IMAGE_DEPTH_MAXIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MAXIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
-
-        BYTE * rgbrun = m_depthRGBX;
-        const NUI_DEPTH_IMAGE_PIXEL * pBufferRun = reinterpret_cast<const NUI_DEPTH_IMAGE_PIXEL *>(LockedRect.pBits);
-
-        // end pixel is start + width*height - 1
-        const NUI_DEPTH_IMAGE_PIXEL * pBufferEnd = pBufferRun + (cDepthWidth * cDepthHeight);
-
-        while ( pBufferRun < pBufferEnd )
+        // The reliable depth range depends on near mode, so is the palette
+        if (m_depthPaletteNearMode != static_cast<int>(nearMode))
         {
-            // discard the portion of the depth that contains only the player index
-            USHORT depth = pBufferRun->depth;
-
-            // To convert to a byte, we're discarding the most-significant
-            // rather than least-significant bits.
-            // We're preserving detail, although the intensity will "wrap."
-            // Values outside the reliable depth range are mapped to 0 (black).
-
-            // Note: Using conditionals in this loop could degrade performance.
-            // Consider using a lookup table instead when writing production code.
-            BYTE intensity = static_cast<BYTE>(depth >= minDepth && depth <= maxDepth ? depth % 256 : 0);
-
-            // Write out blue byte
-            *(rgbrun++) = intensity;
-
-            // Write out green byte
-            *(rgbrun++) = intensity;
-
-            // Write out red byte
-            *(rgbrun++) = intensity;
-
-            // We're outputting BGR, the last byte in the 32 bits is unused so skip it
-            // If we were outputting BGRA, we would write alpha here.
-            ++rgbrun;
-
-            // Increment our index into the Kinect's depth buffer
-            ++pBufferRun;
+            BuildDepthPalette(nearMode);
+            m_pDrawDepth->Invalidate();
         }
 
-        // Draw the data with Direct2D
-        m_pDrawDepth->Draw(m_depthRGBX, cDepthWidth * cDepthHeight * cBytesPerPixel);
+        const NUI_DEPTH_IMAGE_PIXEL * pBufferRun = reinterpret_cast<const NUI_DEPTH_IMAGE_PIXEL *>(LockedRect.pBits);
+
+        // Draw the depth values with Direct2D, looking each one up in the palette on the way to the bitmap
+        m_pDrawDepth->DrawPalettized(&pBufferRun->depth, sizeof(NUI_DEPTH_IMAGE_PIXEL) / sizeof(USHORT), m_depthPalette);
+        ReportPacing();
     }
 
     // We're done with the texture so unlock it
@@ -401,6 +390,51 @@ ReleaseFrame:
     m_pNuiSensor->NuiImageStreamReleaseFrame(m_pDepthStreamHandle, &imageFrame);
 }
 
+/// <summary>
+/// Fill the depth palette for the reliable depth range of the given mode
+/// </summary>
+/// <param name="nearMode">whether the sensor is in near mode</param>
+void CDepthBasics::BuildDepthPalette(BOOL nearMode)
+{
+    // Get the min and max reliable depth for the mode
+    int minDepth = (nearMode ? NUI_IMAGE_DEPTH_MINIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MINIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
+    int maxDepth = (nearMode ? NUI_IMAGE_DEPTH_MAXIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MAXIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
+
+    for (int depth = 0; depth < cDepthPaletteSize; ++depth)
+    {
+        // To convert to a byte, we're discarding the most-significant
+        // rather than least-significant bits.
+        // We're preserving detail, although the intensity will "wrap."
+        // Values outside the reliable depth range are mapped to 0 (black).
+        UINT intensity = static_cast<BYTE>(depth >= minDepth && depth <= maxDepth ? depth % 256 : 0);
+
+        // Same intensity in the blue, green and red bytes, the last byte in the 32 bits is unused
+        m_depthPalette[depth] = intensity | (intensity << 8) | (intensity << 16);
+    }
+
+    m_depthPaletteNearMode = static_cast<int>(nearMode);
+}
+
+/// <summary>
+/// Show how many frames the renderer presented, every few frames
+/// </summary>
+void CDepthBasics::ReportPacing()
+{
+    if (++m_pacingReportFrames < cPacingReportFrames)
+    {
+        return;
+    }
+
+    WCHAR szMessage[cStatusMessageMaxLen];
+    StringCchPrintfW(szMessage, _countof(szMessage), L"Presented %lu of %lu frames, %lu replaced before their refresh",
+        m_pDrawDepth->GetPresentedFrameCount(),
+        m_pDrawDepth->GetSubmittedFrameCount(),
+        m_pDrawDepth->GetCoalescedFrameCount());
+    SetStatusMessage(szMessage);
+
+    m_pacingReportFrames = 0;
+}
+
 /// <summary>
 /// Set the status bar message
 /// </summary>
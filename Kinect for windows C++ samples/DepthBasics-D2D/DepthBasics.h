@@ -15,9 +15,13 @@ class CDepthBasics
     static const int        cDepthWidth  = 640;
     static const int        cDepthHeight = 480;
     static const int        cBytesPerPixel = 4;
+    static const int        cDepthPaletteSize = USHRT_MAX + 1;
 
     static const int        cStatusMessageMaxLen = MAX_PATH*2;
 
+    // number of frames drawn between two reports of the renderer's frame pacing
+    static const int        cPacingReportFrames = 30;
+
 public:
     /// <summary>
     /// Constructor
@@ -71,7 +75,11 @@ private:
     HANDLE                  m_pDepthStreamHandle;
     HANDLE                  m_hNextDepthFrameEvent;
 
-    BYTE*                   m_depthRGBX;
+    // Maps every possible depth value to an RGBX color, rebuilt when the depth range changes
+    UINT*                   m_depthPalette;
+    int                     m_depthPaletteNearMode;
+
+    int                     m_pacingReportFrames;
 
     /// <summary>
     /// Main processing function
@@ -89,6 +97,17 @@ private:
     /// </summary>
     void                    ProcessDepth();
 
+    /// <summary>
+    /// Fill the depth palette for the reliable depth range of the given mode
+    /// </summary>
+    /// <param name="nearMode">whether the sensor is in near mode</param>
+    void                    BuildDepthPalette(BOOL nearMode);
+
+    /// <summary>
+    /// Show how many frames the renderer presented, every few frames
+    /// </summary>
+    void                    ReportPacing();
+
     /// <summary>
     /// Set the status bar message
     /// </summary>
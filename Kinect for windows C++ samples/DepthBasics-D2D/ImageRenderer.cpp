@@ -17,8 +17,14 @@ ImageRenderer::ImageRenderer() :
     m_sourceStride(0),
     m_pD2DFactory(NULL), 
     m_pRenderTarget(NULL),
-    m_pBitmap(0)
+    m_pBitmap(0),
+    m_bUnshownUpload(false),
+    m_pBand(NULL),
+    m_pBandPalette(NULL),
+    m_bBandHashesValid(false),
+    m_refreshInterval(0)
 {
+    QueryPerformanceFrequency(&m_performanceFrequency);
 }
 
 /// <summary>
@@ -28,6 +34,8 @@ ImageRenderer::~ImageRenderer()
 {
     DiscardResources();
     SafeRelease(m_pD2DFactory);
+
+    delete[] m_pBand;
 }
 
 /// <summary>
@@ -82,6 +90,11 @@ void ImageRenderer::DiscardResources()
 {
     SafeRelease(m_pRenderTarget);
     SafeRelease(m_pBitmap);
+
+    // A new bitmap starts out empty, so everything has to be uploaded again
+    m_dirtyTiles.Invalidate();
+    m_bBandHashesValid = false;
+    m_bUnshownUpload = false;
 }
 
 /// <summary>
@@ -113,9 +126,41 @@ HRESULT ImageRenderer::Initialize(HWND hWnd, ID2D1Factory* pD2DFactory, int sour
     m_sourceHeight = sourceHeight;
     m_sourceStride = sourceStride;
 
+    if ( !m_dirtyTiles.Initialize(m_sourceWidth, m_sourceHeight, m_sourceStride, 4) )
+    {
+        return E_INVALIDARG;
+    }
+
+    // Present at most once per refresh of the display the window is on
+    int refreshRate = 0;
+    HDC hdc = GetDC(m_hWnd);
+    if (NULL != hdc)
+    {
+        refreshRate = GetDeviceCaps(hdc, VREFRESH);
+        ReleaseDC(m_hWnd, hdc);
+    }
+
+    // 0 and 1 mean the hardware default refresh rate
+    if (refreshRate <= 1)
+    {
+        refreshRate = cDefaultRefreshRate;
+    }
+
+    m_refreshInterval = 1000000 / refreshRate;
+    m_pacer.SetInterval(m_refreshInterval);
+
     return S_OK;
 }
 
+/// <summary>
+/// Force the next Draw to upload and present the full image even if its content did not change
+/// </summary>
+void ImageRenderer::Invalidate()
+{
+    m_dirtyTiles.Invalidate();
+    m_bBandHashesValid = false;
+}
+
 /// <summary>
 /// Draws a 32 bit per pixel image of previously specified width, height, and stride to the associated hwnd
 /// </summary>
@@ -130,6 +175,28 @@ HRESULT ImageRenderer::Draw(BYTE* pImage, unsigned long cbImage)
         return E_INVALIDARG;
     }
 
+    LONGLONG now = GetTimeMicroseconds();
+    const bool bDue = m_pacer.Submit(now);
+
+    // A frame too early for the display is uploaded all the same and waits in the bitmap
+    // as the newest pending frame, so holding it back copies nothing
+    HRESULT hr = UploadImage(pImage);
+
+    if ( FAILED(hr) || !bDue || !m_bUnshownUpload )
+    {
+        return hr;
+    }
+
+    return Present();
+}
+
+/// <summary>
+/// Upload an RGBX image into the bitmap, skipping unchanged regions
+/// </summary>
+/// <param name="pImage">image data in RGBX format</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ImageRenderer::UploadImage(const BYTE* pImage)
+{
     // create the resources for this draw device
     // they will be recreated if previously lost
     HRESULT hr = EnsureResources();
@@ -139,20 +206,224 @@ HRESULT ImageRenderer::Draw(BYTE* pImage, unsigned long cbImage)
         return hr;
     }
     
-    // Copy the image that was passed in into the direct2d bitmap
-    hr = m_pBitmap->CopyFromMemory(NULL, pImage, m_sourceStride);
+    // Find the regions that changed since the last frame we uploaded
+    // If the producer handed us the same content again there is nothing to upload
+    UINT dirtyRectCount = m_dirtyTiles.Update(pImage);
+    if (0 == dirtyRectCount)
+    {
+        return S_OK;
+    }
+
+    // Copy only the changed regions of the image that was passed in into the direct2d bitmap
+    for (UINT i = 0; i < dirtyRectCount; ++i)
+    {
+        const DirtyRect& dirty = m_dirtyTiles.GetDirtyRect(i);
+        D2D1_RECT_U rect = D2D1::RectU(dirty.left, dirty.top, dirty.right, dirty.bottom);
+
+        hr = m_pBitmap->CopyFromMemory(&rect, pImage + (dirty.top * m_sourceStride) + (dirty.left * 4), m_sourceStride);
+
+        if ( FAILED(hr) )
+        {
+            // The bitmap now only partially matches the tracked state
+            m_dirtyTiles.Invalidate();
+            return hr;
+        }
+    }
+
+    // The bitmap no longer holds what palettized drawing last uploaded
+    m_bBandHashesValid = false;
+    m_bUnshownUpload = true;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Draws a plane of 16 bit values of previously specified width and height, mapping each value
+/// through a palette straight into the upload path, without a full-frame RGBX intermediate
+/// </summary>
+/// <param name="pValues">first value of the plane, rows are packed back to back</param>
+/// <param name="valueStep">distance (in USHORTs) between two consecutive values</param>
+/// <param name="pPalette">65536 RGBX colors indexed by value</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ImageRenderer::DrawPalettized(const USHORT* pValues, UINT valueStep, const UINT* pPalette)
+{
+    if ( NULL == pValues || NULL == pPalette || 0 == valueStep )
+    {
+        return E_INVALIDARG;
+    }
+
+    LONGLONG now = GetTimeMicroseconds();
+    const bool bDue = m_pacer.Submit(now);
+
+    // A frame too early for the display is converted and uploaded all the same and waits in the
+    // bitmap as the newest pending frame, so the values are never copied
+    HRESULT hr = UploadPalettized(pValues, valueStep, pPalette);
+
+    if ( FAILED(hr) || !bDue || !m_bUnshownUpload )
+    {
+        return hr;
+    }
+
+    return Present();
+}
+
+/// <summary>
+/// Map a plane of values through a palette band by band into the bitmap, skipping unchanged bands
+/// </summary>
+/// <param name="pValues">first value of the plane</param>
+/// <param name="valueStep">distance (in USHORTs) between two consecutive values</param>
+/// <param name="pPalette">65536 RGBX colors indexed by value</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ImageRenderer::UploadPalettized(const USHORT* pValues, UINT valueStep, const UINT* pPalette)
+{
+    // create the resources for this draw device
+    // they will be recreated if previously lost
+    HRESULT hr = EnsureResources();
 
     if ( FAILED(hr) )
     {
         return hr;
     }
-       
+
+    if (NULL == m_pBand)
+    {
+        m_pBand = new BYTE[cBandHeight * m_sourceStride];
+        m_bandHashes.assign((m_sourceHeight + cBandHeight - 1) / cBandHeight, 0);
+    }
+
+    // Values hash the same under a new palette, so a palette switch means a full upload
+    if (pPalette != m_pBandPalette)
+    {
+        m_pBandPalette = pPalette;
+        m_bBandHashesValid = false;
+    }
+
+    // The bitmap no longer holds what the RGBX change tracking last saw
+    m_dirtyTiles.Invalidate();
+
+    const UINT rowValues = m_sourceWidth * valueStep;
+    bool bChanged = false;
+
+    for (UINT top = 0, band = 0; top < m_sourceHeight; top += cBandHeight, ++band)
+    {
+        const UINT rows = min(cBandHeight, m_sourceHeight - top);
+        const USHORT* pBandValues = pValues + (top * rowValues);
+
+        // Skip bands whose input did not change since the last upload
+        unsigned long long hash = DirtyTileTracker::HashBytes(0, reinterpret_cast<const unsigned char*>(pBandValues), rows * rowValues * sizeof(USHORT));
+        if (m_bBandHashesValid && hash == m_bandHashes[band])
+        {
+            continue;
+        }
+        m_bandHashes[band] = hash;
+
+        // Look every value up in the palette while the band's input is still hot in the cache
+        for (UINT y = 0; y < rows; ++y)
+        {
+            const USHORT* pValueRun = pBandValues + (y * rowValues);
+            UINT* pColorRun = reinterpret_cast<UINT*>(m_pBand + (y * m_sourceStride));
+
+            for (UINT x = 0; x < m_sourceWidth; ++x)
+            {
+                pColorRun[x] = pPalette[*pValueRun];
+                pValueRun += valueStep;
+            }
+        }
+
+        D2D1_RECT_U rect = D2D1::RectU(0, top, m_sourceWidth, top + rows);
+        hr = m_pBitmap->CopyFromMemory(&rect, m_pBand, m_sourceStride);
+
+        if ( FAILED(hr) )
+        {
+            m_bBandHashesValid = false;
+            return hr;
+        }
+
+        bChanged = true;
+    }
+
+    m_bBandHashesValid = true;
+
+    if (bChanged)
+    {
+        m_bUnshownUpload = true;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Present the newest frame held back by pacing, if its refresh slot has arrived
+/// Call this whenever the wait returned by GetPendingTimeout elapses
+/// </summary>
+/// <returns>S_OK if a frame was presented, S_FALSE if nothing was due, otherwise failure code</returns>
+HRESULT ImageRenderer::PresentPending()
+{
+    LONGLONG now = GetTimeMicroseconds();
+
+    if ( !m_pacer.TakePending(now) )
+    {
+        return S_FALSE;
+    }
+
+    // The pending frame is already in the bitmap
+    return m_bUnshownUpload ? Present() : S_FALSE;
+}
+
+/// <summary>
+/// How long the caller may wait before PresentPending needs to be called
+/// </summary>
+/// <returns>timeout in milliseconds, INFINITE if no frame is pending</returns>
+DWORD ImageRenderer::GetPendingTimeout()
+{
+    LONGLONG wait = m_pacer.GetTimeUntilDue(GetTimeMicroseconds());
+
+    if (wait < 0)
+    {
+        return INFINITE;
+    }
+
+    // Round up, waking early would only make us wait again
+    return static_cast<DWORD>((wait + 999) / 1000);
+}
+
+/// <summary>
+/// Turn presenting at most once per display refresh on or off, it is on by default
+/// </summary>
+/// <param name="enabled">whether draws are coalesced to the refresh interval</param>
+void ImageRenderer::SetPacingEnabled(bool enabled)
+{
+    m_pacer.SetInterval(enabled ? m_refreshInterval : 0);
+}
+
+/// <summary>
+/// Current time for pacing decisions
+/// </summary>
+/// <returns>time in microseconds</returns>
+LONGLONG ImageRenderer::GetTimeMicroseconds()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    // Split the conversion so the multiplication cannot overflow
+    LONGLONG seconds = counter.QuadPart / m_performanceFrequency.QuadPart;
+    LONGLONG remainder = counter.QuadPart % m_performanceFrequency.QuadPart;
+
+    return (seconds * 1000000) + (remainder * 1000000 / m_performanceFrequency.QuadPart);
+}
+
+/// <summary>
+/// Draw the bitmap to the window, only frames that reach the window count as presented for pacing
+/// </summary>
+/// <returns>indicates success or failure</returns>
+HRESULT ImageRenderer::Present()
+{
     m_pRenderTarget->BeginDraw();
 
     // Draw the bitmap stretched to the size of the window
     m_pRenderTarget->DrawBitmap(m_pBitmap);
             
-    hr = m_pRenderTarget->EndDraw();
+    HRESULT hr = m_pRenderTarget->EndDraw();
 
     // Device lost, need to recreate the render target
     // We'll dispose it now and retry drawing
@@ -161,6 +432,11 @@ HRESULT ImageRenderer::Draw(BYTE* pImage, unsigned long cbImage)
         hr = S_OK;
         DiscardResources();
     }
+    else if (SUCCEEDED(hr))
+    {
+        m_bUnshownUpload = false;
+        m_pacer.OnPresented(GetTimeMicroseconds());
+    }
 
     return hr;
 }
\ No newline at end of file
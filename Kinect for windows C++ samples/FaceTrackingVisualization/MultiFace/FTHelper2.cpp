@@ -186,10 +186,10 @@ void FTHelper2::CheckCameraInput()
 
     if (m_KinectSensorPresent && m_KinectSensor.GetVideoBuffer())
     {
-        HRESULT hrCopy = m_KinectSensor.GetVideoBuffer()->CopyTo(m_colorImage, NULL, 0, 0);
+        HRESULT hrCopy = m_KinectSensor.CopyVideoFrame(m_colorImage);
         if (SUCCEEDED(hrCopy) && m_KinectSensor.GetDepthBuffer())
         {
-            hrCopy = m_KinectSensor.GetDepthBuffer()->CopyTo(m_depthImage, NULL, 0, 0);
+            hrCopy = m_KinectSensor.CopyDepthFrame(m_depthImage);
         }
         // Do face tracking
         if (SUCCEEDED(hrCopy))
@@ -355,17 +355,21 @@ void FTHelper2::SelectUserToTrack(KinectSensor * pKinectSensor,
     {
         SkeletonIsAvailable[i] = pKinectSensor->IsTracked(i);
     }
-    // If the user's skeleton is still tracked, mark it unavailable
-    // and make sure we will keep associating the user context to that skeleton
-    // If the skeleton is not track anaymore, decrease a counter until we 
-    // deassociate the user context from that skeleton id.
+    // If the user's person is still tracked, mark their skeleton unavailable
+    // and make sure we will keep associating the user context to that skeleton.
+    // The person keeps their ID when the sensor loses them for a moment and tracks them
+    // again in another skeleton, so the context and its face tracker follow them there.
+    // If the person is not tracked anymore, decrease a counter until we 
+    // deassociate the user context from that person.
     for (UINT i=0; i<nbUsers; i++)
     {
         if (pUserContexts[i].m_CountUntilFailure > 0)
         {
-            if (SkeletonIsAvailable[pUserContexts[i].m_SkeletonId])
+            int skeletonId = FindPerson(pKinectSensor, pUserContexts[i].m_PersonId, SkeletonIsAvailable);
+            if (skeletonId >= 0)
             {
-                SkeletonIsAvailable[pUserContexts[i].m_SkeletonId] = false;
+                pUserContexts[i].m_SkeletonId = skeletonId;
+                SkeletonIsAvailable[skeletonId] = false;
                 pUserContexts[i].m_CountUntilFailure++;
                 if (pUserContexts[i].m_CountUntilFailure > 5)
                 {
@@ -379,21 +383,42 @@ void FTHelper2::SelectUserToTrack(KinectSensor * pKinectSensor,
         }
     }
 
-    // Try to find an available skeleton for users who do not have one
-    for (UINT i=0; i<nbUsers; i++)
+    // Try to find an available skeleton for users who do not have one,
+    // first the person the user context followed if they are back, then any other
+    for (int pass=0; pass<2; pass++)
     {
-        if (pUserContexts[i].m_CountUntilFailure == 0)
+        for (UINT i=0; i<nbUsers; i++)
         {
-            for (UINT j=0; j<NUI_SKELETON_COUNT; j++)
+            if (pUserContexts[i].m_CountUntilFailure == 0)
             {
-                if (SkeletonIsAvailable[j])
+                int skeletonId = (pass == 0) ? FindPerson(pKinectSensor, pUserContexts[i].m_PersonId, SkeletonIsAvailable) : -1;
+                for (UINT j=0; pass == 1 && skeletonId < 0 && j<NUI_SKELETON_COUNT; j++)
+                {
+                    if (SkeletonIsAvailable[j])
+                    {
+                        skeletonId = j;
+                    }
+                }
+                if (skeletonId >= 0)
                 {
-                    pUserContexts[i].m_SkeletonId = j;
+                    pUserContexts[i].m_SkeletonId = skeletonId;
+                    pUserContexts[i].m_PersonId = pKinectSensor->PersonId(skeletonId);
                     pUserContexts[i].m_CountUntilFailure = 1;
-                    SkeletonIsAvailable[j] = false;
-                    break;
+                    SkeletonIsAvailable[skeletonId] = false;
                 }
             }
         }
     }
 }
+
+int FTHelper2::FindPerson(KinectSensor * pKinectSensor, UINT personId, const bool* pSkeletonIsAvailable)
+{
+    for (UINT j=0; personId != 0 && j<NUI_SKELETON_COUNT; j++)
+    {
+        if (pSkeletonIsAvailable[j] && pKinectSensor->PersonId(j) == personId)
+        {
+            return j;
+        }
+    }
+    return -1;
+}
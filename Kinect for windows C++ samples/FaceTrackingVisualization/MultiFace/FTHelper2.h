@@ -16,6 +16,7 @@ struct FTHelperContext
     bool                m_LastTrackSucceeded;
     int                 m_CountUntilFailure;
     UINT                m_SkeletonId;
+    UINT                m_PersonId;     // person followed, which keeps the context when their skeleton id changes
 };
 
 typedef void (*FTHelper2CallBack)(PVOID lpParam, UINT userId);
@@ -40,6 +41,9 @@ public:
     IFTFaceTracker* GetTracker(UINT userId) { return(m_UserContext[userId].m_pFaceTracker);}
     HRESULT GetCameraConfig(FT_CAMERA_CONFIG* cameraConfig);
 
+    // Default user selection, keeps each user context on the same person
+    static void SelectUserToTrack(KinectSensor * pKinectSensor, UINT nbUsers, FTHelperContext* pUserContexts);
+
 private:
     KinectSensor                m_KinectSensor;
     BOOL                        m_KinectSensorPresent;
@@ -70,5 +74,5 @@ private:
     void CheckCameraInput();
     DWORD WINAPI FaceTrackingThread();
     static DWORD WINAPI FaceTrackingStaticThread(PVOID lpParam);
-    static void SelectUserToTrack(KinectSensor * pKinectSensor, UINT nbUsers, FTHelperContext* pUserContexts);
+    static int FindPerson(KinectSensor * pKinectSensor, UINT personId, const bool* pSkeletonIsAvailable);
 };
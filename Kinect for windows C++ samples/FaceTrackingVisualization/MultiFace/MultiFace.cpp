@@ -404,53 +404,8 @@ void MultiFace::FTHelperUserSelection(PVOID pVoid, KinectSensor * pKinectSensor,
     MultiFace* pApp = reinterpret_cast<MultiFace*>(pVoid);
     if (!pApp)
         return;
-    // Initialize an array of the available skeletons
-    bool SkeletonIsAvailable[NUI_SKELETON_COUNT];
-    for (UINT i=0; i<NUI_SKELETON_COUNT; i++)
-    {
-        SkeletonIsAvailable[i] = pKinectSensor->IsTracked(i);
-    }
-    // If the user's skeleton is still tracked, mark it unavailable
-    // and make sure we will keep associating the user context to that skeleton
-    // If the skeleton is not track anaymore, decrease a counter until we 
-    // deassociate the user context from that skeleton id.
-    for (UINT i=0; i<nbUsers; i++)
-    {
-        if (pUserContexts[i].m_CountUntilFailure > 0)
-        {
-            if (SkeletonIsAvailable[pUserContexts[i].m_SkeletonId])
-            {
-                SkeletonIsAvailable[pUserContexts[i].m_SkeletonId] = false;
-                pUserContexts[i].m_CountUntilFailure++;
-                if (pUserContexts[i].m_CountUntilFailure > 5)
-                {
-                    pUserContexts[i].m_CountUntilFailure = 5;
-                }
-            }
-            else
-            {
-                pUserContexts[i].m_CountUntilFailure--;
-            }
-        }
-    }
-
-    // Try to find an available skeleton for users who do not have one
-    for (UINT i=0; i<nbUsers; i++)
-    {
-        if (pUserContexts[i].m_CountUntilFailure == 0)
-        {
-            for (UINT j=0; j<NUI_SKELETON_COUNT; j++)
-            {
-                if (SkeletonIsAvailable[j])
-                {
-                    pUserContexts[i].m_SkeletonId = j;
-                    pUserContexts[i].m_CountUntilFailure = 1;
-                    SkeletonIsAvailable[j] = false;
-                    break;
-                }
-            }
-        }
-    }
+    // Keep each user context on the same person, even when the sensor gives them a new skeleton
+    FTHelper2::SelectUserToTrack(pKinectSensor, nbUsers, pUserContexts);
 }
 
 /*
@@ -144,10 +144,10 @@ void FTHelper::CheckCameraInput()
 
     if (m_KinectSensorPresent && m_KinectSensor.GetVideoBuffer())
     {
-        HRESULT hrCopy = m_KinectSensor.GetVideoBuffer()->CopyTo(m_colorImage, NULL, 0, 0);
+        HRESULT hrCopy = m_KinectSensor.CopyVideoFrame(m_colorImage);
         if (SUCCEEDED(hrCopy) && m_KinectSensor.GetDepthBuffer())
         {
-            hrCopy = m_KinectSensor.GetDepthBuffer()->CopyTo(m_depthImage, NULL, 0, 0);
+            hrCopy = m_KinectSensor.CopyDepthFrame(m_depthImage);
         }
         // Do face tracking
         if (SUCCEEDED(hrCopy))
@@ -0,0 +1,303 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="FrameRing.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "StdAfx.h"
+#include "FrameRing.h"
+
+static DWORD AlignUp(DWORD value)
+{
+    return (value + FRAMERING_ALIGNMENT - 1) & ~(FRAMERING_ALIGNMENT - 1);
+}
+
+static const DWORD cRingHeaderSize = (sizeof(FrameRingHeader) + FRAMERING_ALIGNMENT - 1) & ~(FRAMERING_ALIGNMENT - 1);
+static const DWORD cSlotHeaderSize = (sizeof(FrameRingSlot) + FRAMERING_ALIGNMENT - 1) & ~(FRAMERING_ALIGNMENT - 1);
+
+static FrameRingSlot* SlotAt(const FrameRingHeader* pHeader, DWORD slot)
+{
+    return reinterpret_cast<FrameRingSlot*>(PBYTE(pHeader) + cRingHeaderSize + slot * pHeader->SlotStride);
+}
+
+FrameRingWriter::FrameRingWriter()
+{
+    m_hMapping = NULL;
+    m_pHeader = NULL;
+    m_WriteSlot = -1;
+}
+
+FrameRingWriter::~FrameRingWriter()
+{
+    Release();
+}
+
+HRESULT FrameRingWriter::Create(LPCWSTR name, NUI_IMAGE_RESOLUTION resolution, DWORD bytesPerPixel, DWORD slotCount)
+{
+    Release(); // Deal with double initializations.
+
+    if (!name || bytesPerPixel == 0 || slotCount < 2)
+    {
+        return E_INVALIDARG;
+    }
+
+    DWORD width = 0;
+    DWORD height = 0;
+    NuiImageResolutionToSize(resolution, width, height);
+    if (width == 0 || height == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    DWORD slotSize = width * height * bytesPerPixel;
+    DWORD slotStride = cSlotHeaderSize + AlignUp(slotSize);
+    DWORD mappingSize = cRingHeaderSize + slotStride * slotCount;
+
+    m_hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, mappingSize, name);
+    if (!m_hMapping)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // Only one writer per ring, a second sensor owner must pick another name
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+        return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+    }
+
+    m_pHeader = reinterpret_cast<FrameRingHeader*>(MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize));
+    if (!m_pHeader)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+        return hr;
+    }
+
+    // A fresh mapping is zero filled, so every slot sequence starts even (stable)
+    m_pHeader->SlotCount = slotCount;
+    m_pHeader->SlotStride = slotStride;
+    m_pHeader->SlotSize = slotSize;
+    m_pHeader->Width = width;
+    m_pHeader->Height = height;
+    m_pHeader->BytesPerPixel = bytesPerPixel;
+    m_pHeader->LatestSlot = -1;
+    m_pHeader->FrameNumber = 0;
+
+    // Publish the magic last so readers never see a half-initialized header
+    MemoryBarrier();
+    m_pHeader->Magic = FRAMERING_MAGIC;
+
+    m_WriteSlot = -1;
+    return S_OK;
+}
+
+void FrameRingWriter::Release()
+{
+    if (m_pHeader)
+    {
+        UnmapViewOfFile(m_pHeader);
+        m_pHeader = NULL;
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+    m_WriteSlot = -1;
+}
+
+BYTE* FrameRingWriter::GetSlotData(DWORD slot)
+{
+    if (!m_pHeader || slot >= m_pHeader->SlotCount)
+    {
+        return NULL;
+    }
+
+    return PBYTE(SlotAt(m_pHeader, slot)) + cSlotHeaderSize;
+}
+
+BYTE* FrameRingWriter::BeginWrite()
+{
+    if (!m_pHeader || m_WriteSlot >= 0)
+    {
+        return NULL;
+    }
+
+    // Never write into the slot readers are most likely looking at
+    m_WriteSlot = (m_pHeader->LatestSlot + 1) % LONG(m_pHeader->SlotCount);
+
+    // Odd sequence marks the slot as in flux; the interlocked op is a full barrier
+    InterlockedIncrement(&SlotAt(m_pHeader, m_WriteSlot)->Sequence);
+
+    return PBYTE(SlotAt(m_pHeader, m_WriteSlot)) + cSlotHeaderSize;
+}
+
+void FrameRingWriter::EndWrite(LARGE_INTEGER timeStamp)
+{
+    if (!m_pHeader || m_WriteSlot < 0)
+    {
+        return;
+    }
+
+    FrameRingSlot* pSlot = SlotAt(m_pHeader, m_WriteSlot);
+    pSlot->FrameNumber = m_pHeader->FrameNumber + 1;
+    pSlot->TimeStamp = timeStamp;
+
+    // Back to even: the frame is complete
+    InterlockedIncrement(&pSlot->Sequence);
+
+    InterlockedExchange(&m_pHeader->LatestSlot, m_WriteSlot);
+    InterlockedIncrement(&m_pHeader->FrameNumber);
+
+    m_WriteSlot = -1;
+}
+
+FrameRingReader::FrameRingReader()
+{
+    m_hMapping = NULL;
+    m_pHeader = NULL;
+    m_pAcquiredSlot = NULL;
+    m_AcquiredSequence = 0;
+}
+
+FrameRingReader::~FrameRingReader()
+{
+    Release();
+}
+
+HRESULT FrameRingReader::Open(LPCWSTR name)
+{
+    Release();
+
+    if (!name)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_hMapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+    if (!m_hMapping)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // Map the whole section, its size is only known to the writer
+    m_pHeader = reinterpret_cast<const FrameRingHeader*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_pHeader)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+        return hr;
+    }
+
+    if (m_pHeader->Magic != FRAMERING_MAGIC)
+    {
+        Release();
+        return E_UNEXPECTED;
+    }
+
+    return S_OK;
+}
+
+void FrameRingReader::Release()
+{
+    if (m_pHeader)
+    {
+        UnmapViewOfFile(m_pHeader);
+        m_pHeader = NULL;
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+    m_pAcquiredSlot = NULL;
+}
+
+const BYTE* FrameRingReader::AcquireLatest(LONG* pFrameNumber, LARGE_INTEGER* pTimeStamp)
+{
+    m_pAcquiredSlot = NULL;
+
+    if (!m_pHeader)
+    {
+        return NULL;
+    }
+
+    LONG latest = m_pHeader->LatestSlot;
+    if (latest < 0)
+    {
+        return NULL;
+    }
+
+    const FrameRingSlot* pSlot = SlotAt(m_pHeader, latest);
+    LONG sequence = pSlot->Sequence;
+    if (sequence & 1)
+    {
+        // The writer lapped the whole ring and is refilling this slot right now
+        return NULL;
+    }
+    MemoryBarrier();
+
+    if (pFrameNumber)
+    {
+        *pFrameNumber = pSlot->FrameNumber;
+    }
+    if (pTimeStamp)
+    {
+        *pTimeStamp = pSlot->TimeStamp;
+    }
+
+    m_pAcquiredSlot = pSlot;
+    m_AcquiredSequence = sequence;
+
+    return reinterpret_cast<const BYTE*>(pSlot) + cSlotHeaderSize;
+}
+
+BOOL FrameRingReader::IsStillValid()
+{
+    if (!m_pAcquiredSlot)
+    {
+        return FALSE;
+    }
+
+    MemoryBarrier();
+    return m_pAcquiredSlot->Sequence == m_AcquiredSequence;
+}
+
+HRESULT FrameRingReader::CopyLatest(BYTE* pDest, DWORD cbDest, LONG* pFrameNumber, LARGE_INTEGER* pTimeStamp)
+{
+    if (!pDest)
+    {
+        return E_POINTER;
+    }
+    if (!m_pHeader)
+    {
+        return E_UNEXPECTED;
+    }
+    if (cbDest < m_pHeader->SlotSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    // A few attempts are plenty: the writer only laps us if we stall a whole ring
+    for (int attempt = 0; attempt < 4; ++attempt)
+    {
+        const BYTE* pData = AcquireLatest(pFrameNumber, pTimeStamp);
+        if (!pData)
+        {
+            continue;
+        }
+
+        memcpy(pDest, pData, m_pHeader->SlotSize);
+
+        if (IsStillValid())
+        {
+            return S_OK;
+        }
+    }
+
+    return E_PENDING;
+}
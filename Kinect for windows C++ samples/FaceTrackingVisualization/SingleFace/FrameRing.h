@@ -0,0 +1,98 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="FrameRing.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Shared-memory ring of fixed-size frame slots. One process (the sensor owner)
+// writes frames straight into the slots; any number of processes on the same
+// host can map the ring read-only and consume frames in place.
+//
+// Each slot carries a sequence counter (seqlock): it is odd while the writer
+// fills the slot and even once the frame is published. Readers never take a
+// lock, so they can never stall the writer; they snapshot the sequence before
+// touching the payload and check it again afterwards to detect a torn read.
+
+#pragma once
+
+#include <NuiApi.h>
+
+#define FRAMERING_MAGIC         0x474E5246  // 'FRNG'
+#define FRAMERING_ALIGNMENT     64
+
+struct FrameRingHeader
+{
+    DWORD           Magic;
+    DWORD           SlotCount;
+    DWORD           SlotStride;     // bytes between two slot headers
+    DWORD           SlotSize;       // payload bytes per slot
+    DWORD           Width;
+    DWORD           Height;
+    DWORD           BytesPerPixel;
+    volatile LONG   LatestSlot;     // -1 until the first frame is published
+    volatile LONG   FrameNumber;    // frames published so far
+};
+
+struct FrameRingSlot
+{
+    volatile LONG   Sequence;       // odd while the slot is being written
+    LONG            FrameNumber;
+    LARGE_INTEGER   TimeStamp;
+};
+
+class FrameRingWriter
+{
+public:
+    FrameRingWriter();
+    ~FrameRingWriter();
+
+    HRESULT Create(LPCWSTR name, NUI_IMAGE_RESOLUTION resolution, DWORD bytesPerPixel, DWORD slotCount);
+    void    Release();
+
+    BOOL    IsCreated()             { return(m_pHeader != NULL);}
+    DWORD   GetWidth()              { return(m_pHeader ? m_pHeader->Width : 0);}
+    DWORD   GetHeight()             { return(m_pHeader ? m_pHeader->Height : 0);}
+    DWORD   GetStride()             { return(m_pHeader ? m_pHeader->Width * m_pHeader->BytesPerPixel : 0);}
+    DWORD   GetSlotSize()           { return(m_pHeader ? m_pHeader->SlotSize : 0);}
+    BYTE*   GetSlotData(DWORD slot);
+
+    // Claims the next slot and returns its payload; the caller writes the frame
+    // directly into it and then calls EndWrite to publish it.
+    BYTE*   BeginWrite();
+    void    EndWrite(LARGE_INTEGER timeStamp);
+
+private:
+    HANDLE              m_hMapping;
+    FrameRingHeader*    m_pHeader;
+    LONG                m_WriteSlot;
+};
+
+class FrameRingReader
+{
+public:
+    FrameRingReader();
+    ~FrameRingReader();
+
+    HRESULT Open(LPCWSTR name);
+    void    Release();
+
+    DWORD   GetWidth()              { return(m_pHeader ? m_pHeader->Width : 0);}
+    DWORD   GetHeight()             { return(m_pHeader ? m_pHeader->Height : 0);}
+    DWORD   GetBytesPerPixel()      { return(m_pHeader ? m_pHeader->BytesPerPixel : 0);}
+    DWORD   GetSlotSize()           { return(m_pHeader ? m_pHeader->SlotSize : 0);}
+    LONG    GetFrameNumber()        { return(m_pHeader ? m_pHeader->FrameNumber : 0);}
+
+    // Zero-copy access: returns the newest published frame in place. The data is
+    // only guaranteed consistent if IsStillValid() returns TRUE after it was used.
+    const BYTE* AcquireLatest(LONG* pFrameNumber, LARGE_INTEGER* pTimeStamp);
+    BOOL    IsStillValid();
+
+    // Copies the newest published frame, retrying if the writer overtook us.
+    HRESULT CopyLatest(BYTE* pDest, DWORD cbDest, LONG* pFrameNumber, LARGE_INTEGER* pTimeStamp);
+
+private:
+    HANDLE              m_hMapping;
+    const FrameRingHeader* m_pHeader;
+    const FrameRingSlot* m_pAcquiredSlot;
+    LONG                m_AcquiredSequence;
+};
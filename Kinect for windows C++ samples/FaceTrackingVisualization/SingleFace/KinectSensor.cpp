@@ -6,6 +6,7 @@
 
 #include "StdAfx.h"
 #include "KinectSensor.h"
+#include "StreamScheduler.h"
 #include <math.h>
 
 
@@ -125,6 +126,16 @@ HRESULT KinectSensor::Init(NUI_IMAGE_TYPE depthType, NUI_IMAGE_RESOLUTION depthR
 
     NuiImageResolutionToSize(colorRes, width, height);
 
+    // Frames are captured straight into a shared-memory ring, which other processes can consume in place,
+    // and face tracking copies the latest one out of it (take a look at CopyVideoFrame).
+    // If another sensor owner already holds the ring, frames are captured into the buffer instead.
+    if (SUCCEEDED(m_VideoRing.Create(KINECTSENSOR_VIDEO_RING_NAME, colorRes, 4, cFrameRingSlots)))
+    {
+        if (FAILED(m_VideoRingReader.Open(KINECTSENSOR_VIDEO_RING_NAME)))
+        {
+            m_VideoRing.Release();
+        }
+    }
     hr = m_VideoBuffer->Allocate(width, height, FTIMAGEFORMAT_UINT8_B8G8R8X8);
     if (FAILED(hr))
     {
@@ -139,6 +150,13 @@ HRESULT KinectSensor::Init(NUI_IMAGE_TYPE depthType, NUI_IMAGE_RESOLUTION depthR
 
     NuiImageResolutionToSize(depthRes, width, height);
 
+    if (SUCCEEDED(m_DepthRing.Create(KINECTSENSOR_DEPTH_RING_NAME, depthRes, 2, cFrameRingSlots)))
+    {
+        if (FAILED(m_DepthRingReader.Open(KINECTSENSOR_DEPTH_RING_NAME)))
+        {
+            m_DepthRing.Release();
+        }
+    }
     hr = m_DepthBuffer->Allocate(width, height, FTIMAGEFORMAT_UINT16_D13P3);
     if (FAILED(hr))
     {
@@ -152,7 +170,9 @@ HRESULT KinectSensor::Init(NUI_IMAGE_TYPE depthType, NUI_IMAGE_RESOLUTION depthR
     {
         m_HeadPoint[i] = m_NeckPoint[i] = FT_VECTOR3D(0, 0, 0);
         m_SkeletonTracked[i] = false;
+        m_PersonId[i] = 0;
     }
+    m_SkeletonIdentifier.Reset();
 
     m_hNextDepthFrameEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     m_hNextVideoFrameEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
@@ -273,6 +293,43 @@ void KinectSensor::Release()
         m_DepthBuffer->Release();
         m_DepthBuffer = NULL;
     }
+
+    m_VideoRingReader.Release();
+    m_DepthRingReader.Release();
+    m_VideoRing.Release();
+    m_DepthRing.Release();
+}
+
+// Copy the latest video frame, from the shared ring when frames are captured into it
+HRESULT KinectSensor::CopyVideoFrame(IFTImage* pImage)
+{
+    if (!pImage)
+    {
+        return E_POINTER;
+    }
+
+    if (m_VideoRingReader.GetSlotSize())
+    {
+        return m_VideoRingReader.CopyLatest(pImage->GetBuffer(), pImage->GetBufferSize(), NULL, NULL);
+    }
+
+    return m_VideoBuffer ? m_VideoBuffer->CopyTo(pImage, NULL, 0, 0) : E_UNEXPECTED;
+}
+
+// Copy the latest depth frame, from the shared ring when frames are captured into it
+HRESULT KinectSensor::CopyDepthFrame(IFTImage* pImage)
+{
+    if (!pImage)
+    {
+        return E_POINTER;
+    }
+
+    if (m_DepthRingReader.GetSlotSize())
+    {
+        return m_DepthRingReader.CopyLatest(pImage->GetBuffer(), pImage->GetBufferSize(), NULL, NULL);
+    }
+
+    return m_DepthBuffer ? m_DepthBuffer->CopyTo(pImage, NULL, 0, 0) : E_UNEXPECTED;
 }
 
 DWORD WINAPI KinectSensor::ProcessThread(LPVOID pParam)
@@ -286,11 +343,21 @@ DWORD WINAPI KinectSensor::ProcessThread(LPVOID pParam)
     hEvents[2]=pthis->m_hNextVideoFrameEvent;
     hEvents[3]=pthis->m_hNextSkeletonEvent;
 
+    // Skeleton first, it is light and the face tracker hints come from it, then depth, then the large video copy
+    StreamScheduler scheduler;
+    const int skeletonStream = scheduler.AddStream(3, 5000);
+    const int depthStream = scheduler.AddStream(2, 10000);
+    const int videoStream = scheduler.AddStream(1, 20000);
+    HANDLE hStreamEvents[cMaxScheduledStreams];
+    hStreamEvents[skeletonStream] = pthis->m_hNextSkeletonEvent;
+    hStreamEvents[depthStream] = pthis->m_hNextDepthFrameEvent;
+    hStreamEvents[videoStream] = pthis->m_hNextVideoFrameEvent;
+
     // Main thread loop
     while (true)
     {
-        // Wait for an event to be signaled
-        WaitForMultipleObjects(sizeof(hEvents)/sizeof(hEvents[0]),hEvents,FALSE,100);
+        // Wait for an event to be signaled, the stop event is one of them
+        WaitForMultipleObjects(sizeof(hEvents)/sizeof(hEvents[0]),hEvents,FALSE,INFINITE);
 
         // If the stop event is set, stop looping and exit
         if (WAIT_OBJECT_0 == WaitForSingleObject(pthis->m_hEvNuiProcessStop, 0))
@@ -298,20 +365,43 @@ DWORD WINAPI KinectSensor::ProcessThread(LPVOID pParam)
             break;
         }
 
-        // Process signal events
-        if (WAIT_OBJECT_0 == WaitForSingleObject(pthis->m_hNextDepthFrameEvent, 0))
+        // Process signal events, most urgent first, checking again after each one
+        // Each stream is handled once per wake up so one whose frame cannot be taken does not spin,
+        // and the events of streams already waiting stay set, so they are not checked again
+        UINT handledStreams = 0;
+        for (;;)
         {
-            pthis->GotDepthAlert();
-            pthis->m_FramesTotal++;
-        }
-        if (WAIT_OBJECT_0 == WaitForSingleObject(pthis->m_hNextVideoFrameEvent, 0))
-        {
-            pthis->GotVideoAlert();
-        }
-        if (WAIT_OBJECT_0 == WaitForSingleObject(pthis->m_hNextSkeletonEvent, 0))
-        {
-            pthis->GotSkeletonAlert();
-            pthis->m_SkeletonTotal++;
+            const long long now = StreamScheduler::Now();
+            for (int stream = 0; stream < scheduler.GetStreamCount(); ++stream)
+            {
+                if (0 == (handledStreams & (1 << stream)) && !scheduler.IsPending(stream) &&
+                    WAIT_OBJECT_0 == WaitForSingleObject(hStreamEvents[stream], 0))
+                {
+                    scheduler.Signal(stream, now);
+                }
+            }
+
+            const int stream = scheduler.Next(StreamScheduler::Now());
+            if (stream < 0)
+            {
+                break;
+            }
+            handledStreams |= 1 << stream;
+
+            if (stream == depthStream)
+            {
+                pthis->GotDepthAlert();
+                pthis->m_FramesTotal++;
+            }
+            else if (stream == videoStream)
+            {
+                pthis->GotVideoAlert();
+            }
+            else
+            {
+                pthis->GotSkeletonAlert();
+                pthis->m_SkeletonTotal++;
+            }
         }
     }
 
@@ -331,7 +421,13 @@ void KinectSensor::GotVideoAlert( )
     INuiFrameTexture* pTexture = pImageFrame->pFrameTexture;
     NUI_LOCKED_RECT LockedRect;
     pTexture->LockRect(0, &LockedRect, NULL, 0);
-    if (LockedRect.Pitch)
+    BYTE* pSlot = LockedRect.Pitch ? m_VideoRing.BeginWrite() : NULL;
+    if (pSlot)
+    {   // Capture video frame into the shared ring, face tracking reads it from there
+        memcpy(pSlot, PBYTE(LockedRect.pBits), min(m_VideoRing.GetSlotSize(), UINT(pTexture->BufferLen())));
+        m_VideoRing.EndWrite(pImageFrame->liTimeStamp);
+    }
+    else if (LockedRect.Pitch)
     {   // Copy video frame to face tracking
         memcpy(m_VideoBuffer->GetBuffer(), PBYTE(LockedRect.pBits), min(m_VideoBuffer->GetBufferSize(), UINT(pTexture->BufferLen())));
     }
@@ -358,7 +454,13 @@ void KinectSensor::GotDepthAlert( )
     INuiFrameTexture* pTexture = pImageFrame->pFrameTexture;
     NUI_LOCKED_RECT LockedRect;
     pTexture->LockRect(0, &LockedRect, NULL, 0);
-    if (LockedRect.Pitch)
+    BYTE* pSlot = LockedRect.Pitch ? m_DepthRing.BeginWrite() : NULL;
+    if (pSlot)
+    {   // Capture depth frame into the shared ring, face tracking reads it from there
+        memcpy(pSlot, PBYTE(LockedRect.pBits), min(m_DepthRing.GetSlotSize(), UINT(pTexture->BufferLen())));
+        m_DepthRing.EndWrite(pImageFrame->liTimeStamp);
+    }
+    else if (LockedRect.Pitch)
     {   // Copy depth frame to face tracking
         memcpy(m_DepthBuffer->GetBuffer(), PBYTE(LockedRect.pBits), min(m_DepthBuffer->GetBufferSize(), UINT(pTexture->BufferLen())));
     }
@@ -380,8 +482,40 @@ void KinectSensor::GotSkeletonAlert()
         return;
     }
 
+    // Give every skeleton a person ID, which stays the same when the sensor loses someone for a moment
+    // and tracks them again under a new tracking ID, so a face keeps its user (take a look at SkeletonIdentifier.h)
+    C_ASSERT(cIdentityJointCount == NUI_SKELETON_POSITION_COUNT);
+    SkeletonObservation observations[NUI_SKELETON_COUNT];
+    int observationCount = 0;
     for( int i = 0 ; i < NUI_SKELETON_COUNT ; i++ )
     {
+        const NUI_SKELETON_DATA& skeleton = SkeletonFrame.SkeletonData[i];
+        if (skeleton.eTrackingState == NUI_SKELETON_NOT_TRACKED)
+        {
+            continue;
+        }
+
+        SkeletonObservation& observation = observations[observationCount++];
+        observation.trackingId = skeleton.dwTrackingID;
+        observation.x = skeleton.Position.x;
+        observation.y = skeleton.Position.y;
+        observation.z = skeleton.Position.z;
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; j++)
+        {
+            observation.jointX[j] = skeleton.SkeletonPositions[j].x;
+            observation.jointY[j] = skeleton.SkeletonPositions[j].y;
+            observation.jointZ[j] = skeleton.SkeletonPositions[j].z;
+            observation.jointTracked[j] = (skeleton.eTrackingState == NUI_SKELETON_TRACKED &&
+                NUI_SKELETON_POSITION_TRACKED == skeleton.eSkeletonPositionTrackingState[j]) ? 1 : 0;
+        }
+    }
+    m_SkeletonIdentifier.Update(observations, observationCount, SkeletonFrame.liTimeStamp.QuadPart);
+
+    for( int i = 0 ; i < NUI_SKELETON_COUNT ; i++ )
+    {
+        m_PersonId[i] = (SkeletonFrame.SkeletonData[i].eTrackingState == NUI_SKELETON_NOT_TRACKED) ? 0 :
+            m_SkeletonIdentifier.GetPersonId(SkeletonFrame.SkeletonData[i].dwTrackingID);
+
         if( SkeletonFrame.SkeletonData[i].eTrackingState == NUI_SKELETON_TRACKED &&
             NUI_SKELETON_POSITION_TRACKED == SkeletonFrame.SkeletonData[i].eSkeletonPositionTrackingState[NUI_SKELETON_POSITION_HEAD] &&
             NUI_SKELETON_POSITION_TRACKED == SkeletonFrame.SkeletonData[i].eSkeletonPositionTrackingState[NUI_SKELETON_POSITION_SHOULDER_CENTER])
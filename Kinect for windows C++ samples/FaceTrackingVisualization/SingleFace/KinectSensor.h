@@ -8,9 +8,17 @@
 
 #include <FaceTrackLib.h>
 #include <NuiApi.h>
+#include "FrameRing.h"
+#include "SkeletonIdentifier.h"
+
+// Names of the shared-memory rings other processes can attach to with FrameRingReader
+#define KINECTSENSOR_VIDEO_RING_NAME    L"Local\\KinectSensorVideoRing"
+#define KINECTSENSOR_DEPTH_RING_NAME    L"Local\\KinectSensorDepthRing"
 
 class KinectSensor
 {
+    static const DWORD cFrameRingSlots = 4;
+
 public:
     KinectSensor();
     ~KinectSensor();
@@ -23,6 +31,8 @@ public:
 
     IFTImage*   GetVideoBuffer(){ return(m_VideoBuffer); };
     IFTImage*   GetDepthBuffer(){ return(m_DepthBuffer); };
+    HRESULT     CopyVideoFrame(IFTImage* pImage);
+    HRESULT     CopyDepthFrame(IFTImage* pImage);
     float       GetZoomFactor() { return(m_ZoomFactor); };
     POINT*      GetViewOffSet() { return(&m_ViewOffset); };
     HRESULT     GetClosestHint(FT_VECTOR3D* pHint3D);
@@ -30,13 +40,20 @@ public:
     bool        IsTracked(UINT skeletonId) { return(m_SkeletonTracked[skeletonId]);};
     FT_VECTOR3D NeckPoint(UINT skeletonId) { return(m_NeckPoint[skeletonId]);};
     FT_VECTOR3D HeadPoint(UINT skeletonId) { return(m_HeadPoint[skeletonId]);};
+    UINT        PersonId(UINT skeletonId)  { return(m_PersonId[skeletonId]);}; // outlives the tracking ID, 0 when the skeleton is not tracked
 
 private:
     IFTImage*   m_VideoBuffer;
     IFTImage*   m_DepthBuffer;
+    FrameRingWriter m_VideoRing;
+    FrameRingWriter m_DepthRing;
+    FrameRingReader m_VideoRingReader;
+    FrameRingReader m_DepthRingReader;
     FT_VECTOR3D m_NeckPoint[NUI_SKELETON_COUNT];
     FT_VECTOR3D m_HeadPoint[NUI_SKELETON_COUNT];
     bool        m_SkeletonTracked[NUI_SKELETON_COUNT];
+    UINT        m_PersonId[NUI_SKELETON_COUNT];
+    SkeletonIdentifier m_SkeletonIdentifier;
     FLOAT       m_ZoomFactor;   // video frame zoom factor (it is 1.0f if there is no zoom)
     POINT       m_ViewOffset;   // Offset of the view from the top left corner.
 
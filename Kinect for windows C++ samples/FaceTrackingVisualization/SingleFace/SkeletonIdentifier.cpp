@@ -0,0 +1,367 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonIdentifier.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "StdAfx.h"
+#include "SkeletonIdentifier.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// People lost for longer than this (in milliseconds) are forgotten
+static const long long cMaxLostTime = 3000;
+
+// Frames further apart than this (in seconds) say nothing about speed
+static const float cMaxVelocityDeltaTime = 0.5f;
+
+// A lost person is looked for this far (in meters) from where they were heading, plus
+// cMaxSpeed for every second they have been lost, since they may have changed course
+static const float cPositionGate = 0.4f;
+static const float cMaxSpeed = 1.0f;
+
+// Predictions do not go further ahead than this (in seconds)
+static const float cMaxPredictionTime = 1.0f;
+
+// Builds match when their bones differ by less than this fraction on average
+static const float cBuildTolerance = 0.12f;
+
+// Bones the build is made of need to be compared for it to count, and bone lengths settle over this many frames
+static const int cMinComparedBones = 3;
+static const int cMaxBoneSamples = 30;
+
+// Weight of the velocity measured in a frame against the one so far
+static const float cVelocitySmoothing = 0.3f;
+
+// Joints at both ends of the bones of the build, same values as NUI_SKELETON_POSITION_INDEX:
+// shoulders, spine, upper and lower arms, upper and lower legs
+static const int cBuildBones[cIdentityBoneCount][2] =
+{
+    { 4, 8 }, { 0, 2 },
+    { 4, 5 }, { 8, 9 }, { 5, 6 }, { 9, 10 },
+    { 12, 13 }, { 16, 17 }, { 13, 14 }, { 17, 18 },
+};
+
+/// <summary>
+/// Constructor
+/// </summary>
+SkeletonIdentifier::SkeletonIdentifier()
+{
+    Reset();
+}
+
+/// <summary>
+/// Forget everyone
+/// </summary>
+void SkeletonIdentifier::Reset()
+{
+    memset(m_people, 0, sizeof(m_people));
+    m_nextPersonId = 1;
+    m_reidentifiedCount = 0;
+}
+
+/// <summary>
+/// Identify the skeletons of a new frame
+/// </summary>
+/// <param name="pObservations">skeletons of the frame</param>
+/// <param name="count">number of skeletons, up to six</param>
+/// <param name="timestamp">time stamp (in milliseconds) of the frame</param>
+void SkeletonIdentifier::Update(const SkeletonObservation* pObservations, int count, long long timestamp)
+{
+    // Tracks that go on keep their person, people whose track ended are lost
+    bool bContinued[cMaxNewTracks] = { false };
+    count = (count < cMaxNewTracks) ? count : cMaxNewTracks;
+
+    for (int p = 0; p < cMaxPeople; ++p)
+    {
+        Person& person = m_people[p];
+        if (0 == person.personId || 0 == person.trackingId)
+        {
+            continue;
+        }
+
+        int found = -1;
+        for (int i = 0; i < count && found < 0; ++i)
+        {
+            found = (pObservations[i].trackingId == person.trackingId) ? i : -1;
+        }
+
+        if (found >= 0)
+        {
+            Observe(person, pObservations[found], timestamp, true);
+            bContinued[found] = true;
+        }
+        else
+        {
+            person.trackingId = 0;
+        }
+    }
+
+    // Forget the people lost too long ago, and gather those who could be back
+    int lost[cMaxPeople];
+    int lostCount = 0;
+
+    for (int p = 0; p < cMaxPeople; ++p)
+    {
+        Person& person = m_people[p];
+        if (0 == person.personId || 0 != person.trackingId)
+        {
+            continue;
+        }
+
+        if (timestamp - person.lastSeen > cMaxLostTime || timestamp < person.lastSeen)
+        {
+            person.personId = 0;
+            continue;
+        }
+
+        lost[lostCount++] = p;
+    }
+
+    // Only the most recently lost can be paired, everyone else was lost longer ago than them
+    while (lostCount > cMaxNewTracks)
+    {
+        int oldest = 0;
+        for (int i = 1; i < lostCount; ++i)
+        {
+            oldest = (m_people[lost[i]].lastSeen < m_people[lost[oldest]].lastSeen) ? i : oldest;
+        }
+
+        lost[oldest] = lost[--lostCount];
+    }
+
+    // Cost of every pair of a new track and a lost person, FLT_MAX when they cannot be the same
+    float costs[cMaxNewTracks][cMaxNewTracks];
+    for (int i = 0; i < count; ++i)
+    {
+        for (int j = 0; j < lostCount; ++j)
+        {
+            costs[i][j] = bContinued[i] ? FLT_MAX : MatchCost(m_people[lost[j]], pObservations[i], timestamp);
+        }
+    }
+
+    // Pair the cheapest first, each track and person at most once
+    bool bPaired[cMaxNewTracks] = { false };
+    for (;;)
+    {
+        int bestTrack = -1;
+        int bestPerson = -1;
+        float bestCost = FLT_MAX;
+
+        for (int i = 0; i < count; ++i)
+        {
+            for (int j = 0; j < lostCount; ++j)
+            {
+                if (!bPaired[j] && costs[i][j] < bestCost)
+                {
+                    bestCost = costs[i][j];
+                    bestTrack = i;
+                    bestPerson = j;
+                }
+            }
+        }
+
+        if (bestTrack < 0)
+        {
+            break;
+        }
+
+        Observe(m_people[lost[bestPerson]], pObservations[bestTrack], timestamp, false);
+        bContinued[bestTrack] = true;
+        bPaired[bestPerson] = true;
+        ++m_reidentifiedCount;
+
+        for (int j = 0; j < lostCount; ++j)
+        {
+            costs[bestTrack][j] = FLT_MAX;
+        }
+    }
+
+    // Everyone else is someone new
+    for (int i = 0; i < count; ++i)
+    {
+        if (bContinued[i] || 0 == pObservations[i].trackingId)
+        {
+            continue;
+        }
+
+        Person* pPerson = FindPlace();
+        memset(pPerson, 0, sizeof(*pPerson));
+        pPerson->personId = m_nextPersonId;
+        m_nextPersonId = (m_nextPersonId + 1 != 0) ? m_nextPersonId + 1 : 1;
+
+        Observe(*pPerson, pObservations[i], timestamp, false);
+    }
+}
+
+/// <summary>
+/// Person ID of a skeleton of the last frame
+/// </summary>
+/// <param name="trackingId">tracking ID of the skeleton</param>
+/// <returns>person ID, 0 if the tracking ID was not in the last frame</returns>
+unsigned int SkeletonIdentifier::GetPersonId(unsigned long trackingId) const
+{
+    for (int p = 0; p < cMaxPeople && 0 != trackingId; ++p)
+    {
+        if (0 != m_people[p].personId && trackingId == m_people[p].trackingId)
+        {
+            return m_people[p].personId;
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Tracking ID a person has in the last frame
+/// </summary>
+/// <param name="personId">person ID</param>
+/// <returns>tracking ID, 0 if the person was not in the last frame</returns>
+unsigned long SkeletonIdentifier::GetTrackingId(unsigned int personId) const
+{
+    for (int p = 0; p < cMaxPeople && 0 != personId; ++p)
+    {
+        if (personId == m_people[p].personId)
+        {
+            return m_people[p].trackingId;
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Take in a skeleton seen as a person
+/// </summary>
+/// <param name="person">person the skeleton is</param>
+/// <param name="observation">skeleton</param>
+/// <param name="timestamp">time stamp (in milliseconds) of the frame</param>
+/// <param name="bContinued">whether the skeleton goes on the person's track of the previous frame</param>
+void SkeletonIdentifier::Observe(Person& person, const SkeletonObservation& observation, long long timestamp, bool bContinued)
+{
+    const float position[3] = { observation.x, observation.y, observation.z };
+    const float deltaTime = static_cast<float>(timestamp - person.lastSeen) / 1000.0f;
+
+    // Speed is only measured between frames of the same track, a new track starts where the sensor found it
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (bContinued && deltaTime > 0.0f && deltaTime <= cMaxVelocityDeltaTime)
+        {
+            const float measured = (position[axis] - person.position[axis]) / deltaTime;
+            person.velocity[axis] += (measured - person.velocity[axis]) * cVelocitySmoothing;
+        }
+        else if (!bContinued)
+        {
+            person.velocity[axis] = 0.0f;
+        }
+
+        person.position[axis] = position[axis];
+    }
+
+    for (int b = 0; b < cIdentityBoneCount; ++b)
+    {
+        const int joint0 = cBuildBones[b][0];
+        const int joint1 = cBuildBones[b][1];
+        if (!observation.jointTracked[joint0] || !observation.jointTracked[joint1])
+        {
+            continue;
+        }
+
+        const float dx = observation.jointX[joint1] - observation.jointX[joint0];
+        const float dy = observation.jointY[joint1] - observation.jointY[joint0];
+        const float dz = observation.jointZ[joint1] - observation.jointZ[joint0];
+        const float length = sqrtf(dx * dx + dy * dy + dz * dz);
+
+        // Running average, turning into a moving one once settled
+        if (person.boneSamples[b] < cMaxBoneSamples)
+        {
+            ++person.boneSamples[b];
+        }
+
+        person.boneLengths[b] += (length - person.boneLengths[b]) / person.boneSamples[b];
+    }
+
+    person.trackingId = observation.trackingId;
+    person.lastSeen = timestamp;
+}
+
+/// <summary>
+/// How well a new track fits a lost person
+/// </summary>
+/// <param name="person">lost person</param>
+/// <param name="observation">skeleton of the new track</param>
+/// <param name="timestamp">time stamp (in milliseconds) of the frame</param>
+/// <returns>cost, lower fits better, FLT_MAX when they cannot be the same</returns>
+float SkeletonIdentifier::MatchCost(const Person& person, const SkeletonObservation& observation, long long timestamp) const
+{
+    const float lostTime = static_cast<float>(timestamp - person.lastSeen) / 1000.0f;
+    const float predictionTime = (lostTime < cMaxPredictionTime) ? lostTime : cMaxPredictionTime;
+
+    const float dx = observation.x - (person.position[0] + person.velocity[0] * predictionTime);
+    const float dy = observation.y - (person.position[1] + person.velocity[1] * predictionTime);
+    const float dz = observation.z - (person.position[2] + person.velocity[2] * predictionTime);
+    const float gate = cPositionGate + cMaxSpeed * lostTime;
+    const float positionCost = sqrtf(dx * dx + dy * dy + dz * dz) / gate;
+    if (positionCost > 1.0f)
+    {
+        return FLT_MAX;
+    }
+
+    // Relative difference of the bones measured in both
+    float difference = 0.0f;
+    int compared = 0;
+    for (int b = 0; b < cIdentityBoneCount; ++b)
+    {
+        const int joint0 = cBuildBones[b][0];
+        const int joint1 = cBuildBones[b][1];
+        if (0 == person.boneSamples[b] || !observation.jointTracked[joint0] || !observation.jointTracked[joint1])
+        {
+            continue;
+        }
+
+        const float bx = observation.jointX[joint1] - observation.jointX[joint0];
+        const float by = observation.jointY[joint1] - observation.jointY[joint0];
+        const float bz = observation.jointZ[joint1] - observation.jointZ[joint0];
+        const float length = sqrtf(bx * bx + by * by + bz * bz);
+        const float longest = (length > person.boneLengths[b]) ? length : person.boneLengths[b];
+
+        difference += (longest > 0.0f) ? fabsf(length - person.boneLengths[b]) / longest : 0.0f;
+        ++compared;
+    }
+
+    // Without enough bones to tell, the build neither helps nor rules out
+    const float buildCost = (compared >= cMinComparedBones) ? difference / compared / cBuildTolerance : 0.5f;
+    if (buildCost > 1.0f)
+    {
+        return FLT_MAX;
+    }
+
+    return positionCost + buildCost;
+}
+
+/// <summary>
+/// Find a place for a new person, the place of the person lost the longest if there is no free one
+/// </summary>
+/// <returns>the place</returns>
+SkeletonIdentifier::Person* SkeletonIdentifier::FindPlace()
+{
+    Person* pOldest = NULL;
+
+    for (int p = 0; p < cMaxPeople; ++p)
+    {
+        Person& person = m_people[p];
+        if (0 == person.personId)
+        {
+            return &person;
+        }
+
+        if (0 == person.trackingId && (NULL == pOldest || person.lastSeen < pOldest->lastSeen))
+        {
+            pOldest = &person;
+        }
+    }
+
+    // There are more places than skeletons in a frame, so someone is always lost or gone
+    return (NULL != pOldest) ? pOldest : &m_people[0];
+}
@@ -0,0 +1,115 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonIdentifier.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Gives the people in front of the sensor person IDs that outlive their tracking IDs.
+// The sensor hands out a new tracking ID whenever it loses someone, even for a moment, so
+// state kept per tracking ID starts over. A new tracking ID is matched against the people lost
+// in the last few seconds on:
+//     position    where the person was last seen, moved on by the speed they were going at
+//     build       the lengths of their bones, averaged while they were tracked, which stay
+//                 the same whatever the person does
+// New tracks and lost people are paired cheapest first, at most six of each, and a pair is only
+// made when both its distance and its build are close enough; anyone else gets a new person ID.
+// The number of people remembered is fixed, the ones lost the longest are forgotten first.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+// Same count as NUI_SKELETON_POSITION_COUNT
+static const int cIdentityJointCount = 20;
+
+// Bones whose lengths make up the build of a person
+static const int cIdentityBoneCount = 10;
+
+// A skeleton of a frame
+struct SkeletonObservation
+{
+    unsigned long trackingId;
+
+    // Skeleton position in meters
+    float         x;
+    float         y;
+    float         z;
+
+    // Joint positions in meters, indexed as NUI_SKELETON_POSITION_INDEX, and nonzero where the
+    // joint was tracked; position only skeletons have no tracked joints
+    float         jointX[cIdentityJointCount];
+    float         jointY[cIdentityJointCount];
+    float         jointZ[cIdentityJointCount];
+    unsigned char jointTracked[cIdentityJointCount];
+};
+
+class SkeletonIdentifier
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SkeletonIdentifier();
+
+    /// <summary>
+    /// Forget everyone
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Identify the skeletons of a new frame
+    /// </summary>
+    /// <param name="pObservations">skeletons of the frame</param>
+    /// <param name="count">number of skeletons, up to six</param>
+    /// <param name="timestamp">time stamp (in milliseconds) of the frame</param>
+    void Update(const SkeletonObservation* pObservations, int count, long long timestamp);
+
+    /// <summary>
+    /// Person ID of a skeleton of the last frame
+    /// </summary>
+    /// <param name="trackingId">tracking ID of the skeleton</param>
+    /// <returns>person ID, 0 if the tracking ID was not in the last frame</returns>
+    unsigned int GetPersonId(unsigned long trackingId) const;
+
+    /// <summary>
+    /// Tracking ID a person has in the last frame
+    /// </summary>
+    /// <param name="personId">person ID</param>
+    /// <returns>tracking ID, 0 if the person was not in the last frame</returns>
+    unsigned long GetTrackingId(unsigned int personId) const;
+
+    /// <summary>
+    /// Number of new tracking IDs given the person ID of someone lost, since the last reset
+    /// </summary>
+    int GetReidentifiedCount() const { return m_reidentifiedCount; }
+
+private:
+    // People remembered, and new tracks and lost people paired in a frame
+    static const int    cMaxPeople = 12;
+    static const int    cMaxNewTracks = 6;
+
+    struct Person
+    {
+        // 0 for a free place
+        unsigned int  personId;
+
+        // Tracking ID in the last frame, 0 once lost
+        unsigned long trackingId;
+        long long     lastSeen;
+
+        // Last position and velocity, in meters and meters per second
+        float         position[3];
+        float         velocity[3];
+
+        // Average length of each bone, and the number of frames averaged
+        float         boneLengths[cIdentityBoneCount];
+        int           boneSamples[cIdentityBoneCount];
+    };
+
+    Person              m_people[cMaxPeople];
+    unsigned int        m_nextPersonId;
+    int                 m_reidentifiedCount;
+
+    void                Observe(Person& person, const SkeletonObservation& observation, long long timestamp, bool bContinued);
+    float               MatchCost(const Person& person, const SkeletonObservation& observation, long long timestamp) const;
+    Person*             FindPlace();
+};
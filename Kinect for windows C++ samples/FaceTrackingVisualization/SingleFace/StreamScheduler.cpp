@@ -0,0 +1,142 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="StreamScheduler.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "StdAfx.h"
+#include "StreamScheduler.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+/// <summary>
+/// Constructor
+/// </summary>
+StreamScheduler::StreamScheduler() :
+    m_streamCount(0)
+{
+    memset(m_streams, 0, sizeof(m_streams));
+    ResetStats();
+}
+
+/// <summary>
+/// Add a stream
+/// </summary>
+/// <param name="priority">streams of higher priority are handled first</param>
+/// <param name="deadline">time after its signal by which a frame should be handled, orders streams of equal priority</param>
+/// <returns>index of the stream, -1 when there are too many streams</returns>
+int StreamScheduler::AddStream(int priority, long long deadline)
+{
+    if (m_streamCount >= cMaxScheduledStreams)
+    {
+        return -1;
+    }
+
+    Stream& stream = m_streams[m_streamCount];
+    stream.priority = priority;
+    stream.deadline = deadline;
+    stream.pending = false;
+
+    return m_streamCount++;
+}
+
+/// <summary>
+/// A stream has a new frame to handle, a pending stream counts the frame it had as coalesced
+/// </summary>
+/// <param name="stream">index of the stream</param>
+/// <param name="time">time the frame was seen</param>
+void StreamScheduler::Signal(int stream, long long time)
+{
+    Stream& signaled = m_streams[stream];
+
+    // The frame waiting is stale, the newest one is handled in its place. It keeps the place in
+    // line of the first signal, so a stream signaled over and over still falls due
+    if (signaled.pending)
+    {
+        ++m_stats.coalesced[stream];
+        return;
+    }
+
+    signaled.pending = true;
+    signaled.signalTime = time;
+}
+
+/// <summary>
+/// Take the most urgent signaled stream
+/// </summary>
+/// <param name="time">time of the dispatch</param>
+/// <returns>index of the stream to handle, -1 when none is signaled</returns>
+int StreamScheduler::Next(long long time)
+{
+    int next = -1;
+
+    for (int s = 0; s < m_streamCount; ++s)
+    {
+        const Stream& stream = m_streams[s];
+        if (!stream.pending)
+        {
+            continue;
+        }
+
+        if (next < 0 || stream.priority > m_streams[next].priority ||
+            (stream.priority == m_streams[next].priority &&
+             stream.signalTime + stream.deadline < m_streams[next].signalTime + m_streams[next].deadline))
+        {
+            next = s;
+        }
+    }
+
+    if (next >= 0)
+    {
+        Stream& stream = m_streams[next];
+        stream.pending = false;
+
+        const long long latency = (time > stream.signalTime) ? time - stream.signalTime : 0;
+        ++m_stats.dispatched[next];
+        m_stats.latencySum[next] += latency;
+        m_stats.maxLatency[next] = (latency > m_stats.maxLatency[next]) ? latency : m_stats.maxLatency[next];
+    }
+
+    return next;
+}
+
+/// <summary>
+/// Forget every signal
+/// </summary>
+void StreamScheduler::Reset()
+{
+    for (int s = 0; s < m_streamCount; ++s)
+    {
+        m_streams[s].pending = false;
+    }
+}
+
+/// <summary>
+/// Clear the dispatch statistics
+/// </summary>
+void StreamScheduler::ResetStats()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Current time, for callers driven by real events
+/// </summary>
+/// <returns>time in microseconds from an arbitrary origin</returns>
+long long StreamScheduler::Now()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart / frequency.QuadPart * 1000000 + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+#else
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
@@ -0,0 +1,105 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="StreamScheduler.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Decides in which order the streams that have a frame waiting are handled.
+// The caller signals a stream when its frame comes in and asks for the next stream
+// to handle, again after every handler, so a frame of an urgent stream that comes in
+// while a heavy one is being handled goes before the streams already waiting:
+//     priority     higher priority streams always go first, so a light, time critical
+//                  stream never queues behind a heavy one
+//     deadline     streams of equal priority go in the order their frames fall due
+//     coalescing   a stream signaled again before it was handled is handled once, for
+//                  its newest frame, the older one being stale by then
+// A caller polling manual reset events only signals the streams that are not pending: the
+// event of a pending stream stays set until its handler takes the frame, so seeing it set
+// again does not mean a newer frame came in.
+// The time from a signal to its dispatch is measured for every stream.
+// Time comes from the caller, so the scheduler can be driven by synthetic event sources.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+static const int cMaxScheduledStreams = 8;
+
+// Dispatch statistics of each stream since the last reset, latencies are in time units
+struct StreamSchedulerStats
+{
+    int       dispatched[cMaxScheduledStreams];
+    int       coalesced[cMaxScheduledStreams];
+    long long latencySum[cMaxScheduledStreams];
+    long long maxLatency[cMaxScheduledStreams];
+};
+
+class StreamScheduler
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    StreamScheduler();
+
+    /// <summary>
+    /// Add a stream
+    /// </summary>
+    /// <param name="priority">streams of higher priority are handled first</param>
+    /// <param name="deadline">time after its signal by which a frame should be handled, orders streams of equal priority</param>
+    /// <returns>index of the stream, -1 when there are too many streams</returns>
+    int AddStream(int priority, long long deadline);
+
+    /// <summary>
+    /// Number of streams added
+    /// </summary>
+    int GetStreamCount() const { return m_streamCount; }
+
+    /// <summary>
+    /// A stream has a new frame to handle, a pending stream counts the frame it had as coalesced
+    /// </summary>
+    /// <param name="stream">index of the stream</param>
+    /// <param name="time">time the frame was seen</param>
+    void Signal(int stream, long long time);
+
+    /// <summary>
+    /// Tell whether a stream was signaled and not handled yet
+    /// </summary>
+    bool IsPending(int stream) const { return m_streams[stream].pending; }
+
+    /// <summary>
+    /// Take the most urgent signaled stream
+    /// </summary>
+    /// <param name="time">time of the dispatch</param>
+    /// <returns>index of the stream to handle, -1 when none is signaled</returns>
+    int Next(long long time);
+
+    /// <summary>
+    /// Forget every signal
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Dispatch statistics since the last call to ResetStats
+    /// </summary>
+    const StreamSchedulerStats& GetStats() const { return m_stats; }
+    void ResetStats();
+
+    /// <summary>
+    /// Current time, for callers driven by real events
+    /// </summary>
+    /// <returns>time in microseconds from an arbitrary origin</returns>
+    static long long Now();
+
+private:
+    struct Stream
+    {
+        int       priority;
+        long long deadline;
+        bool      pending;
+        long long signalTime;
+    };
+
+    int                  m_streamCount;
+    Stream               m_streams[cMaxScheduledStreams];
+    StreamSchedulerStats m_stats;
+};
@@ -0,0 +1,397 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="GestureRecognizer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "GestureRecognizer.h"
+#include "SkeletonTopology.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define GESTURE_RECOGNIZER_X86
+#include <xmmintrin.h>
+#endif
+
+// Shoulder width (in meters) used when the shoulders are too close to measure it
+static const float cDefaultShoulderWidth = 0.35f;
+static const float cMinShoulderWidth     = 0.1f;
+
+static const int cDefaultBand = 4;
+
+#ifdef GESTURE_RECOGNIZER_X86
+/// <summary>
+/// Add the four lanes, as ((0 + 2) + (1 + 3)) like the scalar code
+/// </summary>
+static inline float SumLanes(__m128 sum)
+{
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(sum);
+}
+#endif
+
+/// <summary>
+/// Weighted squared distance between two frames
+/// </summary>
+static inline float FrameDistance(const float* pA, const float* pB, const float* pWeights)
+{
+#ifdef GESTURE_RECOGNIZER_X86
+    const __m128 low = _mm_sub_ps(_mm_loadu_ps(pA), _mm_loadu_ps(pB));
+    const __m128 high = _mm_sub_ps(_mm_loadu_ps(pA + 4), _mm_loadu_ps(pB + 4));
+    return SumLanes(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(low, low), _mm_loadu_ps(pWeights)), _mm_mul_ps(_mm_mul_ps(high, high), _mm_loadu_ps(pWeights + 4))));
+#else
+    float lanes[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        const float low = pA[i] - pB[i];
+        const float high = pA[i + 4] - pB[i + 4];
+        lanes[i] = low * low * pWeights[i] + high * high * pWeights[i + 4];
+    }
+
+    return (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+#endif
+}
+
+/// <summary>
+/// Weighted squared distance from a frame to an envelope, 0 inside it
+/// </summary>
+static inline float EnvelopeDistance(const float* pFrame, const float* pUpper, const float* pLower, const float* pWeights)
+{
+#ifdef GESTURE_RECOGNIZER_X86
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 frameLow = _mm_loadu_ps(pFrame);
+    const __m128 frameHigh = _mm_loadu_ps(pFrame + 4);
+    const __m128 low = _mm_add_ps(_mm_max_ps(_mm_sub_ps(frameLow, _mm_loadu_ps(pUpper)), zero), _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(pLower), frameLow), zero));
+    const __m128 high = _mm_add_ps(_mm_max_ps(_mm_sub_ps(frameHigh, _mm_loadu_ps(pUpper + 4)), zero), _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(pLower + 4), frameHigh), zero));
+    return SumLanes(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(low, low), _mm_loadu_ps(pWeights)), _mm_mul_ps(_mm_mul_ps(high, high), _mm_loadu_ps(pWeights + 4))));
+#else
+    float lanes[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        float outside[2];
+        for (int half = 0; half < 2; ++half)
+        {
+            const int d = i + 4 * half;
+            const float above = pFrame[d] - pUpper[d];
+            const float below = pLower[d] - pFrame[d];
+            outside[half] = ((above > 0.0f) ? above : 0.0f) + ((below > 0.0f) ? below : 0.0f);
+        }
+
+        lanes[i] = outside[0] * outside[0] * pWeights[i] + outside[1] * outside[1] * pWeights[i + 4];
+    }
+
+    return (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+#endif
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+GestureRecognizer::GestureRecognizer() :
+    m_band(cDefaultBand),
+    m_templateFrames(0)
+{
+    m_previousRow.resize(cMaxGestureLength);
+    m_currentRow.resize(cMaxGestureLength);
+
+    for (int i = 0; i < cMaxGesturePlayers; ++i)
+    {
+        m_players[i].trackingId = 0;
+        ResetPlayer(m_players[i]);
+    }
+
+    ResetStats();
+}
+
+/// <summary>
+/// Compute the features of a frame from the joints of a skeleton
+/// </summary>
+/// <param name="pX">x of every joint in meters, indexed as NUI_SKELETON_POSITION_INDEX</param>
+/// <param name="pY">y of every joint</param>
+/// <param name="pZ">z of every joint</param>
+/// <param name="pFeatures">receives cGestureDimensions features</param>
+void GestureRecognizer::ComputeFeatures(const float* pX, const float* pY, const float* pZ, float* pFeatures)
+{
+    const float shoulderX = pX[SkeletonJointShoulderLeft] - pX[SkeletonJointShoulderRight];
+    const float shoulderY = pY[SkeletonJointShoulderLeft] - pY[SkeletonJointShoulderRight];
+    const float shoulderZ = pZ[SkeletonJointShoulderLeft] - pZ[SkeletonJointShoulderRight];
+    const float shoulderWidth = sqrtf(shoulderX * shoulderX + shoulderY * shoulderY + shoulderZ * shoulderZ);
+    const float scale = 1.0f / ((shoulderWidth > cMinShoulderWidth) ? shoulderWidth : cDefaultShoulderWidth);
+
+    const int hands[2] = { SkeletonJointHandLeft, SkeletonJointHandRight };
+    for (int i = 0; i < 2; ++i)
+    {
+        pFeatures[3 * i]     = (pX[hands[i]] - pX[SkeletonJointShoulderCenter]) * scale;
+        pFeatures[3 * i + 1] = (pY[hands[i]] - pY[SkeletonJointShoulderCenter]) * scale;
+        pFeatures[3 * i + 2] = (pZ[hands[i]] - pZ[SkeletonJointShoulderCenter]) * scale;
+    }
+
+    pFeatures[6] = 0.0f;
+    pFeatures[7] = 0.0f;
+}
+
+/// <summary>
+/// Set how far the warping may stray from the diagonal, call it before adding templates
+/// </summary>
+/// <param name="band">frames of warping allowed</param>
+void GestureRecognizer::SetBand(int band)
+{
+    m_band = (band > 0) ? band : 0;
+}
+
+/// <summary>
+/// Add a template
+/// </summary>
+/// <param name="pFrames">features of every frame of the template</param>
+/// <param name="length">number of frames, up to cMaxGestureLength</param>
+/// <param name="pWeights">weight of every feature, 0 to leave it out, NULL to weigh them all 1</param>
+/// <param name="threshold">largest warped distance per frame that still matches</param>
+/// <returns>index of the template, -1 on failure</returns>
+int GestureRecognizer::AddTemplate(const float* pFrames, int length, const float* pWeights, float threshold)
+{
+    if (NULL == pFrames || length <= 0 || length > cMaxGestureLength)
+    {
+        return -1;
+    }
+
+    GestureTemplate gesture;
+    gesture.start = m_templateFrames;
+    gesture.length = length;
+    gesture.threshold = threshold;
+    for (int d = 0; d < cGestureDimensions; ++d)
+    {
+        gesture.weights[d] = (NULL != pWeights) ? pWeights[d] : 1.0f;
+    }
+
+    m_frames.insert(m_frames.end(), pFrames, pFrames + length * cGestureDimensions);
+    m_upper.resize(m_frames.size());
+    m_lower.resize(m_frames.size());
+
+    // Envelope of the frames the band lets each frame be matched with
+    for (int i = 0; i < length; ++i)
+    {
+        const int first = (i > m_band) ? i - m_band : 0;
+        const int last = (i + m_band < length) ? i + m_band : length - 1;
+
+        for (int d = 0; d < cGestureDimensions; ++d)
+        {
+            float upper = pFrames[first * cGestureDimensions + d];
+            float lower = upper;
+            for (int k = first + 1; k <= last; ++k)
+            {
+                const float value = pFrames[k * cGestureDimensions + d];
+                upper = (value > upper) ? value : upper;
+                lower = (value < lower) ? value : lower;
+            }
+
+            m_upper[(gesture.start + i) * cGestureDimensions + d] = upper;
+            m_lower[(gesture.start + i) * cGestureDimensions + d] = lower;
+        }
+    }
+
+    m_templates.push_back(gesture);
+    m_templateFrames += length;
+
+    for (int i = 0; i < cMaxGesturePlayers; ++i)
+    {
+        ResetPlayer(m_players[i]);
+    }
+
+    return static_cast<int>(m_templates.size()) - 1;
+}
+
+/// <summary>
+/// Forget the frames of every player
+/// </summary>
+void GestureRecognizer::Reset()
+{
+    for (int i = 0; i < cMaxGesturePlayers; ++i)
+    {
+        m_players[i].trackingId = 0;
+        ResetPlayer(m_players[i]);
+    }
+}
+
+/// <summary>
+/// Clear the work counters
+/// </summary>
+void GestureRecognizer::ResetStats()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Match a new frame of a player
+/// </summary>
+/// <param name="player">index of the player</param>
+/// <param name="trackingId">tracking ID of the player, 0 when nobody is tracked; the player starts over when it changes</param>
+/// <param name="pFeatures">features of the frame, from ComputeFeatures</param>
+/// <param name="pMatches">receives the templates matched by the window ending at this frame</param>
+/// <param name="maxMatches">size of pMatches</param>
+/// <returns>number of matches</returns>
+int GestureRecognizer::Update(int player, unsigned long trackingId, const float* pFeatures, GestureMatch* pMatches, int maxMatches)
+{
+    if (player < 0 || player >= cMaxGesturePlayers)
+    {
+        return 0;
+    }
+
+    PlayerState& state = m_players[player];
+    if (trackingId != state.trackingId)
+    {
+        state.trackingId = trackingId;
+        ResetPlayer(state);
+    }
+
+    if (0 == trackingId || NULL == pFeatures)
+    {
+        return 0;
+    }
+
+    const int frame = state.frameCount;
+    memcpy(state.frames + (frame % cMaxGestureLength) * cGestureDimensions, pFeatures, cGestureDimensions * sizeof(float));
+    ++state.frameCount;
+
+    int matchCount = 0;
+
+    for (size_t t = 0; t < m_templates.size(); ++t)
+    {
+        const GestureTemplate& gesture = m_templates[t];
+        const int length = gesture.length;
+        float* pBounds = &state.bounds[gesture.start];
+
+        // The window ending j frames from now has this frame at template frame length - 1 - j,
+        // the lower bound of the window ending at frame n is kept at n % length
+        int slot = frame % length;
+        for (int j = 0; j < length; ++j)
+        {
+            const int row = (gesture.start + length - 1 - j) * cGestureDimensions;
+            pBounds[slot] += EnvelopeDistance(pFeatures, &m_upper[row], &m_lower[row], gesture.weights);
+            slot = (slot + 1 < length) ? slot + 1 : 0;
+        }
+
+        // The window ending at this frame is complete, its place goes to the window ending length frames from now
+        slot = frame % length;
+        const float bound = pBounds[slot];
+        pBounds[slot] = 0.0f;
+
+        if (state.holds[t] > 0)
+        {
+            --state.holds[t];
+            continue;
+        }
+
+        if (state.frameCount < length)
+        {
+            continue;
+        }
+
+        ++m_stats.windows;
+
+        const float limit = gesture.threshold * length;
+        if (bound > limit)
+        {
+            continue;
+        }
+
+        ++m_stats.warped;
+
+        const float cost = Warp(state, gesture, limit);
+        if (cost <= limit && matchCount < maxMatches)
+        {
+            pMatches[matchCount].player = player;
+            pMatches[matchCount].gesture = static_cast<int>(t);
+            pMatches[matchCount].cost = cost / length;
+            ++matchCount;
+
+            // The same gesture would match the next few windows too
+            state.holds[t] = length;
+        }
+    }
+
+    return matchCount;
+}
+
+/// <summary>
+/// Start a player over
+/// </summary>
+/// <param name="player">state of the player</param>
+void GestureRecognizer::ResetPlayer(PlayerState& player)
+{
+    player.frameCount = 0;
+    player.bounds.assign(m_templateFrames, 0.0f);
+    player.holds.assign(m_templates.size(), 0);
+}
+
+/// <summary>
+/// Warped distance between a template and the window of the player's last frames as long as it,
+/// within the band around the diagonal
+/// </summary>
+/// <param name="player">state of the player</param>
+/// <param name="gesture">template</param>
+/// <param name="limit">distance past which the warping is given up</param>
+/// <returns>the distance, FLT_MAX when over the limit</returns>
+float GestureRecognizer::Warp(const PlayerState& player, const GestureTemplate& gesture, float limit)
+{
+    const int length = gesture.length;
+    const int firstFrame = player.frameCount - length;
+    const float* pTemplate = &m_frames[gesture.start * cGestureDimensions];
+    float* pPrevious = &m_previousRow[0];
+    float* pCurrent = &m_currentRow[0];
+
+    for (int i = 0; i < length; ++i)
+    {
+        const float* pWindow = player.frames + ((firstFrame + i) % cMaxGestureLength) * cGestureDimensions;
+        const int first = (i > m_band) ? i - m_band : 0;
+        const int last = (i + m_band < length) ? i + m_band : length - 1;
+        float rowMin = FLT_MAX;
+
+        // Only the band is computed; the cells just outside it are read by this row and the next,
+        // and are out of reach
+        if (first > 0)
+        {
+            pCurrent[first - 1] = FLT_MAX;
+        }
+
+        if (last + 1 < length)
+        {
+            pCurrent[last + 1] = FLT_MAX;
+        }
+
+        for (int j = first; j <= last; ++j)
+        {
+            float best;
+            if (0 == i)
+            {
+                best = (0 == j) ? 0.0f : pCurrent[j - 1];
+            }
+            else
+            {
+                best = pPrevious[j];
+                if (j > 0)
+                {
+                    best = (pPrevious[j - 1] < best) ? pPrevious[j - 1] : best;
+                    best = (pCurrent[j - 1] < best) ? pCurrent[j - 1] : best;
+                }
+            }
+
+            pCurrent[j] = (FLT_MAX == best) ? FLT_MAX : best + FrameDistance(pWindow, pTemplate + j * cGestureDimensions, gesture.weights);
+            rowMin = (pCurrent[j] < rowMin) ? pCurrent[j] : rowMin;
+        }
+
+        // Every path goes through this row, none can end under the limit any more
+        if (rowMin > limit)
+        {
+            return FLT_MAX;
+        }
+
+        float* pSwap = pPrevious;
+        pPrevious = pCurrent;
+        pCurrent = pSwap;
+    }
+
+    return pPrevious[length - 1];
+}
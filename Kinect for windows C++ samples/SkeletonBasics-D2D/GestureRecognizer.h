@@ -0,0 +1,146 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="GestureRecognizer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Recognizes gestures by matching the recent motion of every player against recorded templates
+// with dynamic time warping (DTW).
+// A frame of a player is a feature vector: the hand positions relative to the shoulder center,
+// in shoulder widths, so neither where the player stands nor their size matters.
+// Every template is matched against the window of the player's last frames as long as the
+// template, at every frame:
+//     lower bound   LB_Keogh, the distance of the window to the envelope of the template, is
+//                   kept up to date as frames come in: each new frame adds its distance to the
+//                   envelope to each of the windows it will be part of, so a frame costs
+//                   a pass over the template rather than over the whole window
+//     DTW           only windows whose lower bound is within the template's threshold are
+//                   warped, within a band around the diagonal so a warp costs the length
+//                   times the band, and given up as soon as a row is over the threshold
+// Distances between frames take two SSE registers.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+#include <vector>
+
+// Features of a frame: left hand x, y, z then right hand x, y, z, padded to two SSE registers
+static const int cGestureDimensions  = 8;
+static const int cMaxGesturePlayers  = 6;
+static const int cMaxGestureLength   = 64;
+
+// A template matched the motion of a player
+struct GestureMatch
+{
+    int   player;
+    int   gesture;
+
+    // Warped distance per frame of the template
+    float cost;
+};
+
+// Work done since the last reset
+struct GestureRecognizerStats
+{
+    // Windows looked at, and how many of them the lower bound did not rule out
+    int   windows;
+    int   warped;
+};
+
+class GestureRecognizer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    GestureRecognizer();
+
+    /// <summary>
+    /// Compute the features of a frame from the joints of a skeleton
+    /// </summary>
+    /// <param name="pX">x of every joint in meters, indexed as NUI_SKELETON_POSITION_INDEX</param>
+    /// <param name="pY">y of every joint</param>
+    /// <param name="pZ">z of every joint</param>
+    /// <param name="pFeatures">receives cGestureDimensions features</param>
+    static void ComputeFeatures(const float* pX, const float* pY, const float* pZ, float* pFeatures);
+
+    /// <summary>
+    /// Set how far the warping may stray from the diagonal, call it before adding templates
+    /// </summary>
+    /// <param name="band">frames of warping allowed</param>
+    void SetBand(int band);
+
+    /// <summary>
+    /// Add a template
+    /// </summary>
+    /// <param name="pFrames">features of every frame of the template</param>
+    /// <param name="length">number of frames, up to cMaxGestureLength</param>
+    /// <param name="pWeights">weight of every feature, 0 to leave it out, NULL to weigh them all 1</param>
+    /// <param name="threshold">largest warped distance per frame that still matches</param>
+    /// <returns>index of the template, -1 on failure</returns>
+    int AddTemplate(const float* pFrames, int length, const float* pWeights, float threshold);
+
+    int GetTemplateCount() const { return static_cast<int>(m_templates.size()); }
+
+    /// <summary>
+    /// Forget the frames of every player
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Match a new frame of a player
+    /// </summary>
+    /// <param name="player">index of the player</param>
+    /// <param name="trackingId">tracking ID of the player, 0 when nobody is tracked; the player starts over when it changes</param>
+    /// <param name="pFeatures">features of the frame, from ComputeFeatures</param>
+    /// <param name="pMatches">receives the templates matched by the window ending at this frame</param>
+    /// <param name="maxMatches">size of pMatches</param>
+    /// <returns>number of matches</returns>
+    int Update(int player, unsigned long trackingId, const float* pFeatures, GestureMatch* pMatches, int maxMatches);
+
+    const GestureRecognizerStats& GetStats() const { return m_stats; }
+    void ResetStats();
+
+private:
+    struct GestureTemplate
+    {
+        // First frame of the template in m_frames, m_upper and m_lower
+        int   start;
+        int   length;
+        float weights[cGestureDimensions];
+        float threshold;
+    };
+
+    struct PlayerState
+    {
+        unsigned long      trackingId;
+        int                frameCount;
+
+        // Last cMaxGestureLength frames, frame n at n % cMaxGestureLength
+        float              frames[cMaxGestureLength * cGestureDimensions];
+
+        // Lower bounds of the windows each template is going through, and the frames to wait after a match
+        std::vector<float> bounds;
+        std::vector<int>   holds;
+    };
+
+    int                             m_band;
+    std::vector<GestureTemplate>    m_templates;
+    int                             m_templateFrames;
+
+    // Features of every template frame, and the envelope of the template around it
+    std::vector<float>              m_frames;
+    std::vector<float>              m_upper;
+    std::vector<float>              m_lower;
+
+    PlayerState                     m_players[cMaxGesturePlayers];
+
+    // Rows of the DTW matrix
+    std::vector<float>              m_previousRow;
+    std::vector<float>              m_currentRow;
+
+    GestureRecognizerStats          m_stats;
+
+    void                            ResetPlayer(PlayerState& player);
+    float                           Warp(const PlayerState& player, const GestureTemplate& gesture, float limit);
+};
@@ -0,0 +1,458 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="JointFilter.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "JointFilter.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define JOINT_FILTER_X86
+#include <xmmintrin.h>
+#endif
+
+const float JointFilter::cMaxDeltaTime = 0.5f;
+
+// Frame interval of the skeleton stream, used when the given one cannot be trusted
+static const float cNominalDeltaTime = 1.0f / 30.0f;
+
+// Velocity variance of a joint seen for the first time, square meters per second squared
+static const float cInitialVelocityVariance = 1.0f;
+
+static const float cTwoPi = 6.2831853f;
+
+// Four joints at a time. Masks are all ones or all zeros in every lane, as SSE compares give them,
+// so the filters are written once and run the same with or without SSE
+#ifdef JOINT_FILTER_X86
+typedef __m128 Lanes;
+
+static inline Lanes Load(const float* p)                      { return _mm_loadu_ps(p); }
+static inline void  Store(float* p, Lanes a)                  { _mm_storeu_ps(p, a); }
+static inline Lanes Splat(float a)                            { return _mm_set1_ps(a); }
+static inline Lanes Add(Lanes a, Lanes b)                     { return _mm_add_ps(a, b); }
+static inline Lanes Sub(Lanes a, Lanes b)                     { return _mm_sub_ps(a, b); }
+static inline Lanes Mul(Lanes a, Lanes b)                     { return _mm_mul_ps(a, b); }
+static inline Lanes Div(Lanes a, Lanes b)                     { return _mm_div_ps(a, b); }
+static inline Lanes Sqrt(Lanes a)                             { return _mm_sqrt_ps(a); }
+static inline Lanes Min(Lanes a, Lanes b)                     { return _mm_min_ps(a, b); }
+static inline Lanes Less(Lanes a, Lanes b)                    { return _mm_cmplt_ps(a, b); }
+static inline Lanes Select(Lanes mask, Lanes a, Lanes b)      { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+#else
+struct Lanes
+{
+    float v[4];
+};
+
+static inline Lanes Load(const float* p)                      { Lanes r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void  Store(float* p, Lanes a)                  { memcpy(p, a.v, sizeof(a.v)); }
+static inline Lanes Splat(float a)                            { Lanes r = {{a, a, a, a}}; return r; }
+static inline Lanes Add(Lanes a, Lanes b)                     { for (int i = 0; i < 4; ++i) { a.v[i] += b.v[i]; } return a; }
+static inline Lanes Sub(Lanes a, Lanes b)                     { for (int i = 0; i < 4; ++i) { a.v[i] -= b.v[i]; } return a; }
+static inline Lanes Mul(Lanes a, Lanes b)                     { for (int i = 0; i < 4; ++i) { a.v[i] *= b.v[i]; } return a; }
+static inline Lanes Div(Lanes a, Lanes b)                     { for (int i = 0; i < 4; ++i) { a.v[i] /= b.v[i]; } return a; }
+static inline Lanes Sqrt(Lanes a)                             { for (int i = 0; i < 4; ++i) { a.v[i] = sqrtf(a.v[i]); } return a; }
+
+// Same as minps, the second operand when either is not a number
+static inline Lanes Min(Lanes a, Lanes b)                     { for (int i = 0; i < 4; ++i) { a.v[i] = (a.v[i] < b.v[i]) ? a.v[i] : b.v[i]; } return a; }
+static inline Lanes Less(Lanes a, Lanes b)                    { for (int i = 0; i < 4; ++i) { a.v[i] = (a.v[i] < b.v[i]) ? 1.0f : 0.0f; } return a; }
+static inline Lanes Select(Lanes mask, Lanes a, Lanes b)      { for (int i = 0; i < 4; ++i) { a.v[i] = (0.0f != mask.v[i]) ? a.v[i] : b.v[i]; } return a; }
+#endif
+
+/// <summary>
+/// Length of vectors given by their components
+/// </summary>
+static inline Lanes Length(Lanes x, Lanes y, Lanes z)
+{
+    return Sqrt(Add(Add(Mul(x, x), Mul(y, y)), Mul(z, z)));
+}
+
+/// <summary>
+/// Constructor, Holt filter with the defaults of NuiTransformSmooth
+/// </summary>
+JointFilter::JointFilter() :
+    m_mode(JointFilterHolt)
+{
+    memset(m_positionX, 0, sizeof(m_positionX));
+    memset(m_positionY, 0, sizeof(m_positionY));
+    memset(m_positionZ, 0, sizeof(m_positionZ));
+    memset(m_rawX, 0, sizeof(m_rawX));
+    memset(m_rawY, 0, sizeof(m_rawY));
+    memset(m_rawZ, 0, sizeof(m_rawZ));
+    memset(m_velocityX, 0, sizeof(m_velocityX));
+    memset(m_velocityY, 0, sizeof(m_velocityY));
+    memset(m_velocityZ, 0, sizeof(m_velocityZ));
+    memset(m_covariancePP, 0, sizeof(m_covariancePP));
+    memset(m_covariancePV, 0, sizeof(m_covariancePV));
+    memset(m_covarianceVV, 0, sizeof(m_covarianceVV));
+    memset(m_seen, 0, sizeof(m_seen));
+
+    SetParameters(DefaultParameters());
+    Reset();
+}
+
+/// <summary>
+/// Default settings of every filter
+/// </summary>
+JointFilterParameters JointFilter::DefaultParameters()
+{
+    JointFilterParameters parameters;
+
+    // Defaults of NuiTransformSmooth
+    parameters.smoothing          = 0.5f;
+    parameters.correction         = 0.5f;
+    parameters.prediction         = 0.5f;
+    parameters.jitterRadius       = 0.05f;
+    parameters.maxDeviationRadius = 0.04f;
+
+    // Still joints are held below 1 Hz, a hand moving at 1 m/s is followed up to 11 Hz
+    parameters.minCutoff          = 1.0f;
+    parameters.beta               = 10.0f;
+    parameters.derivativeCutoff   = 1.0f;
+
+    // Hands reach about 30 m/s2, the sensor measures within a couple of centimeters
+    parameters.processNoise       = 900.0f;
+    parameters.measurementNoise   = 0.0004f;
+
+    return parameters;
+}
+
+/// <summary>
+/// Select the filter, every joint starts over
+/// </summary>
+/// <param name="mode">filter to run</param>
+void JointFilter::SetMode(JointFilterMode mode)
+{
+    m_mode = mode;
+    Reset();
+}
+
+/// <summary>
+/// Tune the filters of every joint
+/// </summary>
+/// <param name="parameters">filter settings</param>
+void JointFilter::SetParameters(const JointFilterParameters& parameters)
+{
+    for (int joint = 0; joint < cFilterJointCount; ++joint)
+    {
+        SetJointParameters(joint, parameters);
+    }
+}
+
+/// <summary>
+/// Tune the filters of one joint, in every skeleton
+/// </summary>
+/// <param name="joint">joint index, as NUI_SKELETON_POSITION_INDEX</param>
+/// <param name="parameters">filter settings</param>
+void JointFilter::SetJointParameters(int joint, const JointFilterParameters& parameters)
+{
+    if (joint < 0 || joint >= cFilterJointCount)
+    {
+        return;
+    }
+
+    // Keep the weights in range and the radii positive so the divisions stay defined
+    const float smoothing = (parameters.smoothing < 0.0f) ? 0.0f : ((parameters.smoothing > 1.0f) ? 1.0f : parameters.smoothing);
+    const float correction = (parameters.correction < 0.0f) ? 0.0f : ((parameters.correction > 1.0f) ? 1.0f : parameters.correction);
+    const float jitterRadius = (parameters.jitterRadius > 0.0001f) ? parameters.jitterRadius : 0.0001f;
+    const float maxDeviationRadius = (parameters.maxDeviationRadius > 0.0001f) ? parameters.maxDeviationRadius : 0.0001f;
+    const float measurementNoise = (parameters.measurementNoise > 1e-8f) ? parameters.measurementNoise : 1e-8f;
+
+    for (int skeleton = 0; skeleton < cFilterSkeletonCount; ++skeleton)
+    {
+        const int i = skeleton * cFilterJointCount + joint;
+
+        m_smoothing[i]          = smoothing;
+        m_correction[i]         = correction;
+        m_prediction[i]         = (parameters.prediction > 0.0f) ? parameters.prediction : 0.0f;
+        m_jitterRadius[i]       = jitterRadius;
+        m_maxDeviationRadius[i] = maxDeviationRadius;
+        m_minCutoff[i]          = (parameters.minCutoff > 0.0f) ? parameters.minCutoff : 0.0f;
+        m_beta[i]               = (parameters.beta > 0.0f) ? parameters.beta : 0.0f;
+        m_derivativeCutoff[i]   = (parameters.derivativeCutoff > 0.0f) ? parameters.derivativeCutoff : 0.0f;
+        m_processNoise[i]       = (parameters.processNoise > 0.0f) ? parameters.processNoise : 0.0f;
+        m_measurementNoise[i]   = measurementNoise;
+    }
+}
+
+/// <summary>
+/// Forget earlier frames, call it when frames stopped coming for a while
+/// </summary>
+void JointFilter::Reset()
+{
+    memset(m_trackingIds, 0, sizeof(m_trackingIds));
+    memset(m_samples, 0, sizeof(m_samples));
+}
+
+/// <summary>
+/// Filter the joints of a new frame
+/// </summary>
+/// <param name="frame">joints of the frame, the positions are filtered in place</param>
+/// <param name="deltaTime">seconds since the previous frame</param>
+void JointFilter::Update(JointFilterFrame& frame, float deltaTime)
+{
+    if (JointFilterOff == m_mode)
+    {
+        return;
+    }
+
+    // After a gap, or when the time went back, the previous positions say nothing about the new ones
+    if (!(deltaTime > 0.0f && deltaTime <= cMaxDeltaTime))
+    {
+        Reset();
+        deltaTime = cNominalDeltaTime;
+    }
+
+    for (int skeleton = 0; skeleton < cFilterSkeletonCount; ++skeleton)
+    {
+        float* pSamples = m_samples + skeleton * cFilterJointCount;
+        float* pSeen = m_seen + skeleton * cFilterJointCount;
+        const unsigned char* pFrameSeen = frame.seen + skeleton * cFilterJointCount;
+        const unsigned long trackingId = frame.trackingIds[skeleton];
+
+        // Someone else took the place of the skeleton
+        if (trackingId != m_trackingIds[skeleton])
+        {
+            memset(pSamples, 0, cFilterJointCount * sizeof(float));
+            m_trackingIds[skeleton] = trackingId;
+        }
+
+        for (int joint = 0; joint < cFilterJointCount; ++joint)
+        {
+            pSeen[joint] = (0 != trackingId && 0 != pFrameSeen[joint]) ? 1.0f : 0.0f;
+        }
+    }
+
+    switch (m_mode)
+    {
+    case JointFilterHolt:
+        UpdateHolt(frame);
+        break;
+
+    case JointFilterOneEuro:
+        UpdateOneEuro(frame, deltaTime);
+        break;
+
+    case JointFilterKalman:
+        UpdateKalman(frame, deltaTime);
+        break;
+
+    default:
+        break;
+    }
+
+    // A joint lost for a frame starts over when it comes back
+    for (int i = 0; i < cFilterPointCount; ++i)
+    {
+        m_samples[i] = (0.0f == m_seen[i]) ? 0.0f : ((m_samples[i] < 2.0f) ? m_samples[i] + 1.0f : 2.0f);
+    }
+}
+
+/// <summary>
+/// Holt double exponential filter, as NuiTransformSmooth runs it:
+/// the first sample is taken as it is, the second is averaged with the first,
+/// later ones are blended with the previous position pushed by the trend
+/// </summary>
+/// <param name="frame">joints of the frame, the positions are filtered in place</param>
+void JointFilter::UpdateHolt(JointFilterFrame& frame)
+{
+    const Lanes zero = Splat(0.0f);
+    const Lanes half = Splat(0.5f);
+    const Lanes one = Splat(1.0f);
+    const Lanes oneAndHalf = Splat(1.5f);
+
+    for (int i = 0; i < cFilterPointCount; i += 4)
+    {
+        const Lanes seen = Less(half, Load(m_seen + i));
+        const Lanes samples = Load(m_samples + i);
+        const Lanes first = Less(samples, half);
+        const Lanes second = Less(samples, oneAndHalf);
+
+        const Lanes rawX = Load(frame.x + i);
+        const Lanes rawY = Load(frame.y + i);
+        const Lanes rawZ = Load(frame.z + i);
+        const Lanes positionX = Load(m_positionX + i);
+        const Lanes positionY = Load(m_positionY + i);
+        const Lanes positionZ = Load(m_positionZ + i);
+        const Lanes trendX = Load(m_velocityX + i);
+        const Lanes trendY = Load(m_velocityY + i);
+        const Lanes trendZ = Load(m_velocityZ + i);
+
+        // Moves within the jitter radius only go part of the way
+        const Lanes moveX = Sub(rawX, positionX);
+        const Lanes moveY = Sub(rawY, positionY);
+        const Lanes moveZ = Sub(rawZ, positionZ);
+        const Lanes jitter = Min(Div(Length(moveX, moveY, moveZ), Load(m_jitterRadius + i)), one);
+
+        const Lanes smoothing = Load(m_smoothing + i);
+        Lanes filteredX = Add(positionX, Mul(moveX, jitter));
+        Lanes filteredY = Add(positionY, Mul(moveY, jitter));
+        Lanes filteredZ = Add(positionZ, Mul(moveZ, jitter));
+        filteredX = Add(filteredX, Mul(Sub(Add(positionX, trendX), filteredX), smoothing));
+        filteredY = Add(filteredY, Mul(Sub(Add(positionY, trendY), filteredY), smoothing));
+        filteredZ = Add(filteredZ, Mul(Sub(Add(positionZ, trendZ), filteredZ), smoothing));
+
+        filteredX = Select(first, rawX, Select(second, Mul(Add(rawX, Load(m_rawX + i)), half), filteredX));
+        filteredY = Select(first, rawY, Select(second, Mul(Add(rawY, Load(m_rawY + i)), half), filteredY));
+        filteredZ = Select(first, rawZ, Select(second, Mul(Add(rawZ, Load(m_rawZ + i)), half), filteredZ));
+
+        const Lanes correction = Load(m_correction + i);
+        const Lanes newTrendX = Select(first, zero, Add(trendX, Mul(Sub(Sub(filteredX, positionX), trendX), correction)));
+        const Lanes newTrendY = Select(first, zero, Add(trendY, Mul(Sub(Sub(filteredY, positionY), trendY), correction)));
+        const Lanes newTrendZ = Select(first, zero, Add(trendZ, Mul(Sub(Sub(filteredZ, positionZ), trendZ), correction)));
+
+        // Predict ahead, then pull the prediction back within the deviation radius of the input
+        const Lanes prediction = Load(m_prediction + i);
+        const Lanes deviationX = Sub(Add(filteredX, Mul(newTrendX, prediction)), rawX);
+        const Lanes deviationY = Sub(Add(filteredY, Mul(newTrendY, prediction)), rawY);
+        const Lanes deviationZ = Sub(Add(filteredZ, Mul(newTrendZ, prediction)), rawZ);
+        const Lanes deviation = Min(Div(Load(m_maxDeviationRadius + i), Length(deviationX, deviationY, deviationZ)), one);
+
+        Store(m_positionX + i, filteredX);
+        Store(m_positionY + i, filteredY);
+        Store(m_positionZ + i, filteredZ);
+        Store(m_velocityX + i, newTrendX);
+        Store(m_velocityY + i, newTrendY);
+        Store(m_velocityZ + i, newTrendZ);
+        Store(m_rawX + i, rawX);
+        Store(m_rawY + i, rawY);
+        Store(m_rawZ + i, rawZ);
+
+        Store(frame.x + i, Select(seen, Add(rawX, Mul(deviationX, deviation)), rawX));
+        Store(frame.y + i, Select(seen, Add(rawY, Mul(deviationY, deviation)), rawY));
+        Store(frame.z + i, Select(seen, Add(rawZ, Mul(deviationZ, deviation)), rawZ));
+    }
+}
+
+/// <summary>
+/// One Euro filter: a first order low pass whose cutoff rises with the filtered speed
+/// </summary>
+/// <param name="frame">joints of the frame, the positions are filtered in place</param>
+/// <param name="deltaTime">seconds since the previous frame</param>
+void JointFilter::UpdateOneEuro(JointFilterFrame& frame, float deltaTime)
+{
+    const Lanes zero = Splat(0.0f);
+    const Lanes half = Splat(0.5f);
+    const Lanes one = Splat(1.0f);
+    const Lanes rate = Splat(1.0f / deltaTime);
+
+    // The smoothing factor of a cutoff f is k / (k + 1) with k = 2 pi f dt
+    const Lanes period = Splat(cTwoPi * deltaTime);
+
+    for (int i = 0; i < cFilterPointCount; i += 4)
+    {
+        const Lanes seen = Less(half, Load(m_seen + i));
+        const Lanes first = Less(Load(m_samples + i), half);
+
+        const Lanes rawX = Load(frame.x + i);
+        const Lanes rawY = Load(frame.y + i);
+        const Lanes rawZ = Load(frame.z + i);
+        const Lanes positionX = Load(m_positionX + i);
+        const Lanes positionY = Load(m_positionY + i);
+        const Lanes positionZ = Load(m_positionZ + i);
+        const Lanes velocityX = Load(m_velocityX + i);
+        const Lanes velocityY = Load(m_velocityY + i);
+        const Lanes velocityZ = Load(m_velocityZ + i);
+
+        const Lanes moveX = Sub(rawX, positionX);
+        const Lanes moveY = Sub(rawY, positionY);
+        const Lanes moveZ = Sub(rawZ, positionZ);
+
+        const Lanes derivativeFactor = Mul(Load(m_derivativeCutoff + i), period);
+        const Lanes derivativeAlpha = Div(derivativeFactor, Add(derivativeFactor, one));
+        const Lanes newVelocityX = Select(first, zero, Add(velocityX, Mul(Sub(Mul(moveX, rate), velocityX), derivativeAlpha)));
+        const Lanes newVelocityY = Select(first, zero, Add(velocityY, Mul(Sub(Mul(moveY, rate), velocityY), derivativeAlpha)));
+        const Lanes newVelocityZ = Select(first, zero, Add(velocityZ, Mul(Sub(Mul(moveZ, rate), velocityZ), derivativeAlpha)));
+
+        const Lanes cutoff = Add(Load(m_minCutoff + i), Mul(Load(m_beta + i), Length(newVelocityX, newVelocityY, newVelocityZ)));
+        const Lanes factor = Mul(cutoff, period);
+        const Lanes alpha = Div(factor, Add(factor, one));
+
+        const Lanes filteredX = Select(first, rawX, Add(positionX, Mul(moveX, alpha)));
+        const Lanes filteredY = Select(first, rawY, Add(positionY, Mul(moveY, alpha)));
+        const Lanes filteredZ = Select(first, rawZ, Add(positionZ, Mul(moveZ, alpha)));
+
+        Store(m_positionX + i, filteredX);
+        Store(m_positionY + i, filteredY);
+        Store(m_positionZ + i, filteredZ);
+        Store(m_velocityX + i, newVelocityX);
+        Store(m_velocityY + i, newVelocityY);
+        Store(m_velocityZ + i, newVelocityZ);
+
+        Store(frame.x + i, Select(seen, filteredX, rawX));
+        Store(frame.y + i, Select(seen, filteredY, rawY));
+        Store(frame.z + i, Select(seen, filteredZ, rawZ));
+    }
+}
+
+/// <summary>
+/// Kalman filter with a constant velocity model, the three axes share the covariance
+/// since they share the noise and the measurements
+/// </summary>
+/// <param name="frame">joints of the frame, the positions are filtered in place</param>
+/// <param name="deltaTime">seconds since the previous frame</param>
+void JointFilter::UpdateKalman(JointFilterFrame& frame, float deltaTime)
+{
+    const Lanes zero = Splat(0.0f);
+    const Lanes half = Splat(0.5f);
+    const Lanes step = Splat(deltaTime);
+    const Lanes initialVelocityVariance = Splat(cInitialVelocityVariance);
+
+    // Contributions of the acceleration noise to the covariance over a frame
+    const Lanes noisePP = Splat(deltaTime * deltaTime * deltaTime * deltaTime * 0.25f);
+    const Lanes noisePV = Splat(deltaTime * deltaTime * deltaTime * 0.5f);
+    const Lanes noiseVV = Splat(deltaTime * deltaTime);
+
+    for (int i = 0; i < cFilterPointCount; i += 4)
+    {
+        const Lanes seen = Less(half, Load(m_seen + i));
+        const Lanes first = Less(Load(m_samples + i), half);
+
+        const Lanes rawX = Load(frame.x + i);
+        const Lanes rawY = Load(frame.y + i);
+        const Lanes rawZ = Load(frame.z + i);
+        const Lanes velocityX = Load(m_velocityX + i);
+        const Lanes velocityY = Load(m_velocityY + i);
+        const Lanes velocityZ = Load(m_velocityZ + i);
+
+        // Predict
+        const Lanes predictedX = Add(Load(m_positionX + i), Mul(velocityX, step));
+        const Lanes predictedY = Add(Load(m_positionY + i), Mul(velocityY, step));
+        const Lanes predictedZ = Add(Load(m_positionZ + i), Mul(velocityZ, step));
+
+        const Lanes processNoise = Load(m_processNoise + i);
+        const Lanes covariancePV = Load(m_covariancePV + i);
+        const Lanes covarianceVV = Load(m_covarianceVV + i);
+        const Lanes predictedPP = Add(Add(Load(m_covariancePP + i), Mul(Add(Add(covariancePV, covariancePV), Mul(covarianceVV, step)), step)), Mul(processNoise, noisePP));
+        const Lanes predictedPV = Add(Add(covariancePV, Mul(covarianceVV, step)), Mul(processNoise, noisePV));
+        const Lanes predictedVV = Add(covarianceVV, Mul(processNoise, noiseVV));
+
+        // Correct with the measurement
+        const Lanes measurementNoise = Load(m_measurementNoise + i);
+        const Lanes innovationVariance = Add(predictedPP, measurementNoise);
+        const Lanes gainP = Div(predictedPP, innovationVariance);
+        const Lanes gainV = Div(predictedPV, innovationVariance);
+
+        const Lanes innovationX = Sub(rawX, predictedX);
+        const Lanes innovationY = Sub(rawY, predictedY);
+        const Lanes innovationZ = Sub(rawZ, predictedZ);
+        const Lanes filteredX = Select(first, rawX, Add(predictedX, Mul(innovationX, gainP)));
+        const Lanes filteredY = Select(first, rawY, Add(predictedY, Mul(innovationY, gainP)));
+        const Lanes filteredZ = Select(first, rawZ, Add(predictedZ, Mul(innovationZ, gainP)));
+
+        Store(m_positionX + i, filteredX);
+        Store(m_positionY + i, filteredY);
+        Store(m_positionZ + i, filteredZ);
+        Store(m_velocityX + i, Select(first, zero, Add(velocityX, Mul(innovationX, gainV))));
+        Store(m_velocityY + i, Select(first, zero, Add(velocityY, Mul(innovationY, gainV))));
+        Store(m_velocityZ + i, Select(first, zero, Add(velocityZ, Mul(innovationZ, gainV))));
+        Store(m_covariancePP + i, Select(first, measurementNoise, Sub(predictedPP, Mul(gainP, predictedPP))));
+        Store(m_covariancePV + i, Select(first, zero, Sub(predictedPV, Mul(gainP, predictedPV))));
+        Store(m_covarianceVV + i, Select(first, initialVelocityVariance, Sub(predictedVV, Mul(gainV, predictedPV))));
+
+        Store(frame.x + i, Select(seen, filteredX, rawX));
+        Store(frame.y + i, Select(seen, filteredY, rawY));
+        Store(frame.z + i, Select(seen, filteredZ, rawZ));
+    }
+}
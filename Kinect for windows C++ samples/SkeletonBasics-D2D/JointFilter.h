@@ -0,0 +1,160 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="JointFilter.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Smooths the joint positions of every skeleton of a frame, as an alternative to
+// NuiTransformSmooth whose smoothing and latency can be tuned per joint and measured.
+// Three filters are offered:
+//     Holt       double exponential smoothing with jitter removal and prediction, the
+//                filter NuiTransformSmooth is built on
+//     One Euro   a low pass filter whose cutoff rises with speed, smooth while still
+//                and quick to follow fast moves
+//     Kalman     constant velocity model, each joint position and velocity is estimated
+//                from a process and a measurement noise
+// The state of the 6 x 20 joints is kept as structure of arrays, so every filter updates
+// four joints at once with SSE and the whole frame in one call, whatever the joints'
+// parameters.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+// Same counts as NUI_SKELETON_COUNT and NUI_SKELETON_POSITION_COUNT
+static const int cFilterSkeletonCount = 6;
+static const int cFilterJointCount    = 20;
+static const int cFilterPointCount    = cFilterSkeletonCount * cFilterJointCount;
+
+enum JointFilterMode
+{
+    JointFilterOff,
+    JointFilterHolt,
+    JointFilterOneEuro,
+    JointFilterKalman
+};
+
+// Settings of the filters, each filter only reads its own
+struct JointFilterParameters
+{
+    // Holt, same meaning as NUI_TRANSFORM_SMOOTH_PARAMETERS
+    float smoothing;            // 0 to 1, weight of the previous position, higher is smoother and slower
+    float correction;           // 0 to 1, how quickly the trend follows, higher is quicker
+    float prediction;           // frames of trend added to the output, makes up for the latency
+    float jitterRadius;         // meters, moves smaller than this are damped
+    float maxDeviationRadius;   // meters, the output never strays farther than this from the input
+
+    // One Euro
+    float minCutoff;            // hertz, cutoff of a still joint, lower is smoother
+    float beta;                 // cutoff added per meter per second of speed, higher lags less
+    float derivativeCutoff;     // hertz, cutoff of the speed estimate
+
+    // Kalman
+    float processNoise;         // variance of the acceleration, (meters per second squared) squared
+    float measurementNoise;     // variance of the measured position, square meters
+};
+
+// Joints of a skeleton frame, or the parts the filter needs
+struct JointFilterFrame
+{
+    // Tracking ID of each skeleton, 0 where no one is tracked; a skeleton starts over when it changes
+    unsigned long trackingIds[cFilterSkeletonCount];
+
+    // Positions in meters, joint j of skeleton s is at s * cFilterJointCount + j
+    float         x[cFilterPointCount];
+    float         y[cFilterPointCount];
+    float         z[cFilterPointCount];
+
+    // Nonzero where the joint was tracked or inferred, other joints pass through and start over
+    unsigned char seen[cFilterPointCount];
+};
+
+class JointFilter
+{
+public:
+    /// <summary>
+    /// Constructor, Holt filter with the defaults of NuiTransformSmooth
+    /// </summary>
+    JointFilter();
+
+    /// <summary>
+    /// Default settings of every filter
+    /// </summary>
+    static JointFilterParameters DefaultParameters();
+
+    /// <summary>
+    /// Select the filter, every joint starts over
+    /// </summary>
+    /// <param name="mode">filter to run</param>
+    void SetMode(JointFilterMode mode);
+    JointFilterMode GetMode() const { return m_mode; }
+
+    /// <summary>
+    /// Tune the filters of every joint
+    /// </summary>
+    /// <param name="parameters">filter settings</param>
+    void SetParameters(const JointFilterParameters& parameters);
+
+    /// <summary>
+    /// Tune the filters of one joint, in every skeleton
+    /// </summary>
+    /// <param name="joint">joint index, as NUI_SKELETON_POSITION_INDEX</param>
+    /// <param name="parameters">filter settings</param>
+    void SetJointParameters(int joint, const JointFilterParameters& parameters);
+
+    /// <summary>
+    /// Forget earlier frames, call it when frames stopped coming for a while
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Filter the joints of a new frame
+    /// </summary>
+    /// <param name="frame">joints of the frame, the positions are filtered in place</param>
+    /// <param name="deltaTime">seconds since the previous frame</param>
+    void Update(JointFilterFrame& frame, float deltaTime);
+
+private:
+    // Frames further apart than this have nothing to do with each other
+    static const float  cMaxDeltaTime;
+
+    JointFilterMode     m_mode;
+    unsigned long       m_trackingIds[cFilterSkeletonCount];
+
+    // Samples seen in a row by each joint, up to 2, and whether the joint is seen in this frame
+    float               m_samples[cFilterPointCount];
+    float               m_seen[cFilterPointCount];
+
+    // Parameters of each joint
+    float               m_smoothing[cFilterPointCount];
+    float               m_correction[cFilterPointCount];
+    float               m_prediction[cFilterPointCount];
+    float               m_jitterRadius[cFilterPointCount];
+    float               m_maxDeviationRadius[cFilterPointCount];
+    float               m_minCutoff[cFilterPointCount];
+    float               m_beta[cFilterPointCount];
+    float               m_derivativeCutoff[cFilterPointCount];
+    float               m_processNoise[cFilterPointCount];
+    float               m_measurementNoise[cFilterPointCount];
+
+    // Filtered position, and the previous input of the Holt filter
+    float               m_positionX[cFilterPointCount];
+    float               m_positionY[cFilterPointCount];
+    float               m_positionZ[cFilterPointCount];
+    float               m_rawX[cFilterPointCount];
+    float               m_rawY[cFilterPointCount];
+    float               m_rawZ[cFilterPointCount];
+
+    // Trend of the Holt filter, or velocity of the One Euro and Kalman filters
+    float               m_velocityX[cFilterPointCount];
+    float               m_velocityY[cFilterPointCount];
+    float               m_velocityZ[cFilterPointCount];
+
+    // Covariance of position and velocity of the Kalman filter, the same for the three axes
+    float               m_covariancePP[cFilterPointCount];
+    float               m_covariancePV[cFilterPointCount];
+    float               m_covarianceVV[cFilterPointCount];
+
+    void UpdateHolt(JointFilterFrame& frame);
+    void UpdateOneEuro(JointFilterFrame& frame, float deltaTime);
+    void UpdateKalman(JointFilterFrame& frame, float deltaTime);
+};
@@ -0,0 +1,412 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="PoseIndex.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "PoseIndex.h"
+#include "SkeletonTopology.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define POSE_INDEX_X86
+#include <xmmintrin.h>
+#endif
+
+// Torsos shorter than this (in meters) are not measured well enough to scale by
+static const float cMinTorsoLength = 0.1f;
+
+// Deep enough for the tree of any index that fits in memory, branches split their poses in half
+static const int cMaxSearchDepth = 128;
+
+/// <summary>
+/// Distance between two poses
+/// </summary>
+static inline float PoseDistance(const float* pA, const float* pB)
+{
+#ifdef POSE_INDEX_X86
+    __m128 sum = _mm_setzero_ps();
+    for (int i = 0; i < cPoseDimensions; i += 4)
+    {
+        const __m128 d = _mm_sub_ps(_mm_loadu_ps(pA + i), _mm_loadu_ps(pB + i));
+        sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+    }
+
+    // Add the lanes as ((0 + 2) + (1 + 3)) like the scalar code
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    return sqrtf(_mm_cvtss_f32(sum));
+#else
+    float lanes[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < cPoseDimensions; i += 4)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            const float d = pA[i + lane] - pB[i + lane];
+            lanes[lane] += d * d;
+        }
+    }
+
+    return sqrtf((lanes[0] + lanes[2]) + (lanes[1] + lanes[3]));
+#endif
+}
+
+/// <summary>
+/// Add a pose to the nearest found so far, if it is near enough
+/// </summary>
+/// <param name="pNeighbors">nearest poses found, nearest first</param>
+/// <param name="found">number found</param>
+/// <param name="k">number wanted</param>
+/// <param name="pose">ID of the pose</param>
+/// <param name="distance">its distance to the query</param>
+static inline void AddNeighbor(PoseNeighbor* pNeighbors, int& found, int k, int pose, float distance)
+{
+    if (found == k && distance >= pNeighbors[k - 1].distance)
+    {
+        return;
+    }
+
+    int i = (found < k) ? found++ : k - 1;
+    for (; i > 0 && pNeighbors[i - 1].distance > distance; --i)
+    {
+        pNeighbors[i] = pNeighbors[i - 1];
+    }
+
+    pNeighbors[i].pose = pose;
+    pNeighbors[i].distance = distance;
+}
+
+/// <summary>
+/// Constructor, an empty index
+/// </summary>
+PoseIndex::PoseIndex()
+{
+    Clear();
+}
+
+/// <summary>
+/// Make a pose from the joints of a skeleton
+/// </summary>
+/// <param name="pX">x of every joint in meters, indexed as NUI_SKELETON_POSITION_INDEX</param>
+/// <param name="pY">y of every joint</param>
+/// <param name="pZ">z of every joint</param>
+/// <param name="pPose">receives cPoseDimensions values</param>
+/// <returns>false when the torso is too short to scale by, the pose is then only moved and turned</returns>
+bool PoseIndex::NormalizePose(const float* pX, const float* pY, const float* pZ, float* pPose)
+{
+    const float rootX = pX[SkeletonJointHipCenter];
+    const float rootY = pY[SkeletonJointHipCenter];
+    const float rootZ = pZ[SkeletonJointHipCenter];
+
+    // Facing: the line across the shoulders and across the hips, on the floor
+    const float acrossX = (pX[SkeletonJointShoulderRight] - pX[SkeletonJointShoulderLeft]) + (pX[SkeletonJointHipRight] - pX[SkeletonJointHipLeft]);
+    const float acrossZ = (pZ[SkeletonJointShoulderRight] - pZ[SkeletonJointShoulderLeft]) + (pZ[SkeletonJointHipRight] - pZ[SkeletonJointHipLeft]);
+    const float acrossLength = sqrtf(acrossX * acrossX + acrossZ * acrossZ);
+    const float cosine = (acrossLength > 0.0f) ? acrossX / acrossLength : 1.0f;
+    const float sine = (acrossLength > 0.0f) ? acrossZ / acrossLength : 0.0f;
+
+    const float torsoX = pX[SkeletonJointShoulderCenter] - rootX;
+    const float torsoY = pY[SkeletonJointShoulderCenter] - rootY;
+    const float torsoZ = pZ[SkeletonJointShoulderCenter] - rootZ;
+    const float torsoLength = sqrtf(torsoX * torsoX + torsoY * torsoY + torsoZ * torsoZ);
+    const bool bScaled = torsoLength >= cMinTorsoLength;
+    const float scale = bScaled ? 1.0f / torsoLength : 1.0f;
+
+    // Turn the line across the body onto the x axis
+    for (int j = 0; j < cPoseJointCount; ++j)
+    {
+        const float x = pX[j] - rootX;
+        const float z = pZ[j] - rootZ;
+
+        pPose[3 * j]     = (x * cosine + z * sine) * scale;
+        pPose[3 * j + 1] = (pY[j] - rootY) * scale;
+        pPose[3 * j + 2] = (z * cosine - x * sine) * scale;
+    }
+
+    return bScaled;
+}
+
+/// <summary>
+/// Build the index of a set of poses, in memory the index owns
+/// </summary>
+/// <param name="pPoses">cPoseDimensions values of every pose, from NormalizePose</param>
+/// <param name="count">number of poses</param>
+/// <returns>true on success</returns>
+bool PoseIndex::Build(const float* pPoses, int count)
+{
+    Clear();
+
+    if (NULL == pPoses || count <= 0)
+    {
+        return false;
+    }
+
+    std::vector<int> order(count);
+    for (int i = 0; i < count; ++i)
+    {
+        order[i] = i;
+    }
+
+    std::vector<Node> nodes;
+    nodes.reserve(2 * (count / cLeafSize + 1));
+
+    unsigned int seed = 1;
+    BuildNode(pPoses, order, nodes, 0, count, seed);
+
+    // Header, poses in tree order, their IDs, then the nodes, each part a whole number of floats
+    const size_t headerFloats = sizeof(Header) / sizeof(float);
+    const size_t poseFloats = static_cast<size_t>(count) * cPoseDimensions;
+    const size_t idFloats = static_cast<size_t>(count);
+    const size_t nodeFloats = nodes.size() * sizeof(Node) / sizeof(float);
+    m_ownedImage.resize(headerFloats + poseFloats + idFloats + nodeFloats);
+
+    float* pImage = &m_ownedImage[0];
+    Header header = { cPoseIndexMagic, cPoseIndexVersion, cPoseDimensions, count, static_cast<int>(nodes.size()), { 0, 0, 0 } };
+    memcpy(pImage, &header, sizeof(header));
+
+    float* pTreePoses = pImage + headerFloats;
+    int* pIds = reinterpret_cast<int*>(pTreePoses + poseFloats);
+    for (int i = 0; i < count; ++i)
+    {
+        memcpy(pTreePoses + static_cast<size_t>(i) * cPoseDimensions, pPoses + static_cast<size_t>(order[i]) * cPoseDimensions, cPoseDimensions * sizeof(float));
+        pIds[i] = order[i];
+    }
+
+    memcpy(pTreePoses + poseFloats + idFloats, &nodes[0], nodes.size() * sizeof(Node));
+
+    return Attach(pImage, m_ownedImage.size() * sizeof(float));
+}
+
+/// <summary>
+/// Build the branch holding a range of poses
+/// </summary>
+/// <param name="pPoses">poses the index is built from</param>
+/// <param name="order">poses in tree order, the range is reordered</param>
+/// <param name="nodes">nodes built so far, the branch is added</param>
+/// <param name="first">first place of the range in order</param>
+/// <param name="count">number of poses in the range</param>
+/// <param name="seed">state of the generator picking vantage poses</param>
+/// <returns>node of the branch</returns>
+int PoseIndex::BuildNode(const float* pPoses, std::vector<int>& order, std::vector<Node>& nodes, int first, int count, unsigned int& seed)
+{
+    const int index = static_cast<int>(nodes.size());
+    Node node = { first, count, 0.0f, -1, -1 };
+    nodes.push_back(node);
+
+    if (count <= cLeafSize)
+    {
+        return index;
+    }
+
+    // Any pose makes a good enough vantage point, a random one avoids the worst splits of sorted data
+    seed = seed * 1664525 + 1013904223;
+    std::swap(order[first], order[first + (seed >> 8) % count]);
+
+    const float* pVantage = pPoses + static_cast<size_t>(order[first]) * cPoseDimensions;
+    std::vector<std::pair<float, int> > distances(count - 1);
+    for (int i = 1; i < count; ++i)
+    {
+        distances[i - 1] = std::make_pair(PoseDistance(pVantage, pPoses + static_cast<size_t>(order[first + i]) * cPoseDimensions), order[first + i]);
+    }
+
+    // The nearer half goes inside
+    const int insideCount = (count - 1) / 2;
+    std::nth_element(distances.begin(), distances.begin() + insideCount, distances.end());
+    for (int i = 1; i < count; ++i)
+    {
+        order[first + i] = distances[i - 1].second;
+    }
+
+    nodes[index].count = 1;
+    nodes[index].radius = distances[insideCount].first;
+
+    const int inside = BuildNode(pPoses, order, nodes, first + 1, insideCount, seed);
+    const int outside = BuildNode(pPoses, order, nodes, first + 1 + insideCount, count - 1 - insideCount, seed);
+    nodes[index].inside = inside;
+    nodes[index].outside = outside;
+
+    return index;
+}
+
+/// <summary>
+/// Search an index built earlier in place, such as a mapped index file
+/// </summary>
+/// <param name="pImage">the index, as GetImage gave it; it must outlive the search</param>
+/// <param name="size">size (in bytes) of the index</param>
+/// <returns>true when the block holds a whole index</returns>
+bool PoseIndex::Attach(const void* pImage, size_t size)
+{
+    if (NULL == pImage || size < sizeof(Header))
+    {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, pImage, sizeof(header));
+    if (cPoseIndexMagic != header.magic || cPoseIndexVersion != header.version || cPoseDimensions != header.dimensions ||
+        header.poseCount <= 0 || header.nodeCount <= 0)
+    {
+        return false;
+    }
+
+    const size_t poseBytes = static_cast<size_t>(header.poseCount) * cPoseDimensions * sizeof(float);
+    const size_t idBytes = static_cast<size_t>(header.poseCount) * sizeof(int);
+    const size_t nodeBytes = static_cast<size_t>(header.nodeCount) * sizeof(Node);
+    if (size < sizeof(Header) + poseBytes + idBytes + nodeBytes)
+    {
+        return false;
+    }
+
+    // An index built earlier is let go for the one attached
+    if (m_ownedImage.empty() || pImage != &m_ownedImage[0])
+    {
+        std::vector<float>().swap(m_ownedImage);
+    }
+
+    const char* pBytes = static_cast<const char*>(pImage);
+    const Node* pNodes = reinterpret_cast<const Node*>(pBytes + sizeof(Header) + poseBytes + idBytes);
+
+    // A damaged file must not send the search out of the block
+    for (int i = 0; i < header.nodeCount; ++i)
+    {
+        const Node& node = pNodes[i];
+        if (node.first < 0 || node.count <= 0 || node.first > header.poseCount - node.count ||
+            node.inside < -1 || node.inside >= header.nodeCount || node.outside < -1 || node.outside >= header.nodeCount ||
+            (node.inside >= 0 && node.inside <= i) || (node.outside >= 0 && node.outside <= i))
+        {
+            return false;
+        }
+    }
+
+    m_pImage = pImage;
+    m_imageSize = size;
+    m_poseCount = header.poseCount;
+    m_nodeCount = header.nodeCount;
+    m_pPoses = reinterpret_cast<const float*>(pBytes + sizeof(Header));
+    m_pIds = reinterpret_cast<const int*>(pBytes + sizeof(Header) + poseBytes);
+    m_pNodes = pNodes;
+
+    return true;
+}
+
+/// <summary>
+/// Forget the index
+/// </summary>
+void PoseIndex::Clear()
+{
+    m_ownedImage.clear();
+    m_pImage = NULL;
+    m_imageSize = 0;
+    m_poseCount = 0;
+    m_nodeCount = 0;
+    m_pPoses = NULL;
+    m_pIds = NULL;
+    m_pNodes = NULL;
+}
+
+/// <summary>
+/// Find the nearest poses to each of several queries
+/// </summary>
+/// <param name="pQueries">cPoseDimensions values of every query, from NormalizePose</param>
+/// <param name="queryCount">number of queries</param>
+/// <param name="k">neighbors wanted per query, up to cMaxPoseNeighbors</param>
+/// <param name="pNeighbors">receives k neighbors per query, nearest first</param>
+/// <returns>number of pose distances computed, to measure the search</returns>
+int PoseIndex::Search(const float* pQueries, int queryCount, int k, PoseNeighbor* pNeighbors) const
+{
+    if (k <= 0 || k > cMaxPoseNeighbors)
+    {
+        return 0;
+    }
+
+    int distanceCount = 0;
+
+    for (int q = 0; q < queryCount; ++q)
+    {
+        PoseNeighbor* pQueryNeighbors = pNeighbors + q * k;
+        for (int i = 0; i < k; ++i)
+        {
+            pQueryNeighbors[i].pose = -1;
+            pQueryNeighbors[i].distance = FLT_MAX;
+        }
+
+        if (m_poseCount > 0)
+        {
+            distanceCount += SearchOne(pQueries + q * cPoseDimensions, k, pQueryNeighbors);
+        }
+    }
+
+    return distanceCount;
+}
+
+/// <summary>
+/// Find the nearest poses to a query
+/// </summary>
+/// <param name="pQuery">cPoseDimensions values of the query</param>
+/// <param name="k">neighbors wanted</param>
+/// <param name="pNeighbors">receives k neighbors, nearest first</param>
+/// <returns>number of pose distances computed</returns>
+int PoseIndex::SearchOne(const float* pQuery, int k, PoseNeighbor* pNeighbors) const
+{
+    // Branches still to look at, with the least distance a pose in them can have
+    int pending[cMaxSearchDepth];
+    float pendingBound[cMaxSearchDepth];
+    int pendingCount = 1;
+    pending[0] = 0;
+    pendingBound[0] = 0.0f;
+
+    int found = 0;
+    int distanceCount = 0;
+
+    while (pendingCount > 0)
+    {
+        --pendingCount;
+        const Node& node = m_pNodes[pending[pendingCount]];
+
+        // The branch may have been ruled out by poses found since it was put aside
+        if (found == k && pendingBound[pendingCount] >= pNeighbors[k - 1].distance)
+        {
+            continue;
+        }
+
+        // A branch only holds its vantage pose, d ends up its distance
+        float d = 0.0f;
+        for (int i = node.first; i < node.first + node.count; ++i)
+        {
+            d = PoseDistance(pQuery, m_pPoses + static_cast<size_t>(i) * cPoseDimensions);
+            AddNeighbor(pNeighbors, found, k, m_pIds[i], d);
+        }
+
+        distanceCount += node.count;
+
+        if (node.inside < 0 || pendingCount + 2 > cMaxSearchDepth)
+        {
+            continue;
+        }
+
+        // Poses inside are no nearer than d - radius, those outside no nearer than radius - d.
+        // The branch the query is in goes last, so it is looked at first
+        const float insideBound = (d > node.radius) ? d - node.radius : 0.0f;
+        const float outsideBound = (d < node.radius) ? node.radius - d : 0.0f;
+
+        if (d <= node.radius)
+        {
+            pending[pendingCount] = node.outside;
+            pendingBound[pendingCount++] = outsideBound;
+            pending[pendingCount] = node.inside;
+            pendingBound[pendingCount++] = insideBound;
+        }
+        else
+        {
+            pending[pendingCount] = node.inside;
+            pendingBound[pendingCount++] = insideBound;
+            pending[pendingCount] = node.outside;
+            pendingBound[pendingCount++] = outsideBound;
+        }
+    }
+
+    return distanceCount;
+}
@@ -0,0 +1,131 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="PoseIndex.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Finds the reference poses nearest to live poses in a library of many thousands.
+// A pose is the 20 joints of a skeleton moved so the hip center is at the origin, turned
+// about the vertical so the hips and shoulders face the sensor, and scaled to a torso of
+// length 1, so where the player stands, which way they face and their size do not matter.
+// Poses are kept in a vantage point tree: every node splits the poses below it into those
+// nearer to and farther from its vantage pose than the median, so a search can skip every
+// branch the triangle inequality rules out. Small branches are leaves whose poses are
+// compared one after the other, each distance taking 15 SSE registers.
+// The tree, its poses and their IDs are one block of memory, which can be written to a
+// file as is and searched in place once the file is mapped.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Same count as NUI_SKELETON_POSITION_COUNT, x, y and z of each joint
+static const int          cPoseJointCount   = 20;
+static const int          cPoseDimensions   = cPoseJointCount * 3;
+
+static const unsigned int cPoseIndexMagic   = 0x58444950;  // 'PIDX'
+static const unsigned int cPoseIndexVersion = 1;
+
+static const int          cMaxPoseNeighbors = 16;
+
+// A pose found near a query
+struct PoseNeighbor
+{
+    // ID of the pose, its place among the poses the index was built from, -1 when there is none
+    int   pose;
+    float distance;
+};
+
+class PoseIndex
+{
+public:
+    /// <summary>
+    /// Constructor, an empty index
+    /// </summary>
+    PoseIndex();
+
+    /// <summary>
+    /// Make a pose from the joints of a skeleton
+    /// </summary>
+    /// <param name="pX">x of every joint in meters, indexed as NUI_SKELETON_POSITION_INDEX</param>
+    /// <param name="pY">y of every joint</param>
+    /// <param name="pZ">z of every joint</param>
+    /// <param name="pPose">receives cPoseDimensions values</param>
+    /// <returns>false when the torso is too short to scale by, the pose is then only moved and turned</returns>
+    static bool NormalizePose(const float* pX, const float* pY, const float* pZ, float* pPose);
+
+    /// <summary>
+    /// Build the index of a set of poses, in memory the index owns
+    /// </summary>
+    /// <param name="pPoses">cPoseDimensions values of every pose, from NormalizePose</param>
+    /// <param name="count">number of poses</param>
+    /// <returns>true on success</returns>
+    bool Build(const float* pPoses, int count);
+
+    /// <summary>
+    /// Search an index built earlier in place, such as a mapped index file
+    /// </summary>
+    /// <param name="pImage">the index, as GetImage gave it; it must outlive the search</param>
+    /// <param name="size">size (in bytes) of the index</param>
+    /// <returns>true when the block holds a whole index</returns>
+    bool Attach(const void* pImage, size_t size);
+
+    /// <summary>
+    /// Forget the index
+    /// </summary>
+    void Clear();
+
+    const void* GetImage() const { return m_pImage; }
+    size_t GetImageSize() const { return m_imageSize; }
+    int GetPoseCount() const { return m_poseCount; }
+
+    /// <summary>
+    /// Find the nearest poses to each of several queries
+    /// </summary>
+    /// <param name="pQueries">cPoseDimensions values of every query, from NormalizePose</param>
+    /// <param name="queryCount">number of queries</param>
+    /// <param name="k">neighbors wanted per query, up to cMaxPoseNeighbors</param>
+    /// <param name="pNeighbors">receives k neighbors per query, nearest first</param>
+    /// <returns>number of pose distances computed, to measure the search</returns>
+    int Search(const float* pQueries, int queryCount, int k, PoseNeighbor* pNeighbors) const;
+
+private:
+    struct Header
+    {
+        unsigned int magic;
+        unsigned int version;
+        int          dimensions;
+        int          poseCount;
+        int          nodeCount;
+        int          reserved[3];
+    };
+
+    // Poses [first, first + count) in tree order. A branch has its vantage pose alone at first,
+    // and its children hold the poses nearer and farther than radius; a leaf has no children
+    struct Node
+    {
+        int   first;
+        int   count;
+        float radius;
+        int   inside;
+        int   outside;
+    };
+
+    // Poses are compared one by one below this many
+    static const int    cLeafSize = 8;
+
+    std::vector<float>  m_ownedImage;
+    const void*         m_pImage;
+    size_t              m_imageSize;
+
+    int                 m_poseCount;
+    int                 m_nodeCount;
+    const float*        m_pPoses;
+    const int*          m_pIds;
+    const Node*         m_pNodes;
+
+    int                 BuildNode(const float* pPoses, std::vector<int>& order, std::vector<Node>& nodes, int first, int count, unsigned int& seed);
+    int                 SearchOne(const float* pQuery, int k, PoseNeighbor* pNeighbors) const;
+};
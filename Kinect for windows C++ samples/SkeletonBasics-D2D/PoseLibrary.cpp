@@ -0,0 +1,207 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="PoseLibrary.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include <strsafe.h>
+#include "PoseLibrary.h"
+#include "SkeletonRecorder.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+PoseLibrary::PoseLibrary() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hMapping(NULL),
+    m_pView(NULL)
+{
+}
+
+/// <summary>
+/// Destructor, closes the file
+/// </summary>
+PoseLibrary::~PoseLibrary()
+{
+    Close();
+}
+
+/// <summary>
+/// Build a library file from the tracked skeletons of a recording that have every joint, replacing it
+/// </summary>
+/// <param name="recordingPath">path of the skeleton recording</param>
+/// <param name="libraryPath">path of the library file</param>
+/// <param name="pPoseCount">receives the number of poses in the library, may be NULL</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT PoseLibrary::BuildFromRecording(PCWSTR recordingPath, PCWSTR libraryPath, int* pPoseCount)
+{
+    SkeletonPlayer player;
+    HRESULT hr = player.Open(recordingPath);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Every frame is wanted, as fast as it can be read
+    player.SetRealTime(false);
+
+    std::vector<float> poses;
+    NUI_SKELETON_FRAME frame;
+    float x[NUI_SKELETON_POSITION_COUNT];
+    float y[NUI_SKELETON_POSITION_COUNT];
+    float z[NUI_SKELETON_POSITION_COUNT];
+
+    C_ASSERT(cPoseJointCount == NUI_SKELETON_POSITION_COUNT);
+
+    while (S_OK == (hr = player.ReadFrame(&frame)))
+    {
+        for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+        {
+            const NUI_SKELETON_DATA & skel = frame.SkeletonData[i];
+            if (NUI_SKELETON_TRACKED != skel.eTrackingState)
+            {
+                continue;
+            }
+
+            // Joints that were not tracked are recorded at the origin, a pose with one is left out
+            bool bComplete = true;
+            for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+            {
+                x[j] = skel.SkeletonPositions[j].x;
+                y[j] = skel.SkeletonPositions[j].y;
+                z[j] = skel.SkeletonPositions[j].z;
+                bComplete = bComplete && NUI_SKELETON_POSITION_NOT_TRACKED != skel.eSkeletonPositionTrackingState[j];
+            }
+
+            if (!bComplete)
+            {
+                continue;
+            }
+
+            poses.resize(poses.size() + cPoseDimensions);
+            PoseIndex::NormalizePose(x, y, z, &poses[poses.size() - cPoseDimensions]);
+        }
+    }
+
+    if (HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) != hr)
+    {
+        return hr;
+    }
+
+    const int poseCount = static_cast<int>(poses.size() / cPoseDimensions);
+    PoseIndex index;
+    if (!index.Build(poses.empty() ? NULL : &poses[0], poseCount) || index.GetImageSize() > MAXDWORD)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    // The library is written next to the old one and only replaces it once complete,
+    // so a failed write leaves the old library in place
+    WCHAR newLibraryPath[MAX_PATH];
+    hr = StringCchPrintfW(newLibraryPath, _countof(newLibraryPath), L"%s.new", libraryPath);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    HANDLE hFile = CreateFileW(newLibraryPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    DWORD written = 0;
+    const DWORD size = static_cast<DWORD>(index.GetImageSize());
+    if (!WriteFile(hFile, index.GetImage(), size, &written, NULL) || written != size)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    CloseHandle(hFile);
+
+    if (SUCCEEDED(hr) && !MoveFileExW(newLibraryPath, libraryPath, MOVEFILE_REPLACE_EXISTING))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (NULL != pPoseCount)
+        {
+            *pPoseCount = poseCount;
+        }
+    }
+    else
+    {
+        DeleteFileW(newLibraryPath);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Map a library file and search it
+/// </summary>
+/// <param name="path">path of the library file</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT PoseLibrary::Open(PCWSTR path)
+{
+    Close();
+
+    m_hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_hFile, &fileSize) || 0 == fileSize.QuadPart || static_cast<ULONGLONG>(fileSize.QuadPart) > static_cast<SIZE_T>(-1))
+    {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    m_pView = (NULL != m_hMapping) ? MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (NULL == m_pView)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    if (!m_index.Attach(m_pView, static_cast<size_t>(fileSize.QuadPart)))
+    {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Close the library file
+/// </summary>
+void PoseLibrary::Close()
+{
+    m_index.Clear();
+
+    if (NULL != m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = NULL;
+    }
+
+    if (NULL != m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
@@ -0,0 +1,59 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="PoseLibrary.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Library of reference poses kept in a file, so a large one is neither rebuilt nor read in
+// whenever it is used: the file is the pose index as built, and opening it maps it and
+// searches it in place. A library is built from the tracked skeletons of a skeleton recording,
+// each pose's ID being its place in the recording.
+
+#pragma once
+
+#include "PoseIndex.h"
+
+class PoseLibrary
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    PoseLibrary();
+
+    /// <summary>
+    /// Destructor, closes the file
+    /// </summary>
+    ~PoseLibrary();
+
+    /// <summary>
+    /// Build a library file from the tracked skeletons of a recording that have every joint, replacing it
+    /// only once the new one is written, so the old library stays when the build fails
+    /// </summary>
+    /// <param name="recordingPath">path of the skeleton recording</param>
+    /// <param name="libraryPath">path of the library file</param>
+    /// <param name="pPoseCount">receives the number of poses in the library, may be NULL</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT BuildFromRecording(PCWSTR recordingPath, PCWSTR libraryPath, int* pPoseCount);
+
+    /// <summary>
+    /// Map a library file and search it
+    /// </summary>
+    /// <param name="path">path of the library file</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Open(PCWSTR path);
+
+    /// <summary>
+    /// Close the library file
+    /// </summary>
+    void Close();
+
+    bool IsOpen() const { return NULL != m_pView; }
+    const PoseIndex& GetIndex() const { return m_index; }
+
+private:
+    HANDLE          m_hFile;
+    HANDLE          m_hMapping;
+    const void*     m_pView;
+    PoseIndex       m_index;
+};
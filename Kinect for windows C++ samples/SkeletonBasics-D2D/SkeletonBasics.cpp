@@ -13,6 +13,13 @@ static const float g_JointThickness = 3.0f;
 static const float g_TrackedBoneThickness = 6.0f;
 static const float g_InferredBoneThickness = 1.0f;
 
+// Files of the sample, in the Documents folder
+static const WCHAR* g_RecordingFileName = L"SkeletonBasics.skr";
+static const WCHAR* g_PoseLibraryFileName = L"SkeletonBasics.poses";
+
+const float CSkeletonBasics::cPoseMatchDistance = 0.5f;
+const float CSkeletonBasics::cPoseHoldSpeed = 0.3f;
+
 /// <summary>
 /// Entry point for the application
 /// </summary>
@@ -40,9 +47,17 @@ CSkeletonBasics::CSkeletonBasics() :
     m_pBrushJointInferred(NULL),
     m_pBrushBoneTracked(NULL),
     m_pBrushBoneInferred(NULL),
-    m_pNuiSensor(NULL)
+    m_pNuiSensor(NULL),
+    m_previousSkeletonTime(0)
 {
     ZeroMemory(m_Points,sizeof(m_Points));
+    ZeroMemory(&m_jointFrame,sizeof(m_jointFrame));
+    ZeroMemory(m_pSkeletonGeometry,sizeof(m_pSkeletonGeometry));
+    ZeroMemory(m_pSkeletonSink,sizeof(m_pSkeletonSink));
+    ZeroMemory(m_skeletonFigureCount,sizeof(m_skeletonFigureCount));
+    ZeroMemory(m_bPoseMatched,sizeof(m_bPoseMatched));
+
+    AddGestureTemplates();
 }
 
 /// <summary>
@@ -115,7 +130,8 @@ int CSkeletonBasics::Run(HINSTANCE hInstance, int nCmdShow)
         // Check to see if we have either a message (by passing in QS_ALLEVENTS)
         // Or a Kinect event (hEvents)
         // Update() will check for Kinect events individually, in case more than one are signalled
-        MsgWaitForMultipleObjects(eventCount, hEvents, FALSE, INFINITE, QS_ALLINPUT);
+        // A recording being played has no event, it is polled
+        MsgWaitForMultipleObjects(eventCount, hEvents, FALSE, m_skeletonPlayer.IsOpen() ? cPlaybackPollInterval : INFINITE, QS_ALLINPUT);
 
         // Explicitly check the Kinect frame event since MsgWaitForMultipleObjects
         // can return for other reasons even though it is signaled.
@@ -142,6 +158,11 @@ int CSkeletonBasics::Run(HINSTANCE hInstance, int nCmdShow)
 /// </summary>
 void CSkeletonBasics::Update()
 {
+    if (m_skeletonPlayer.IsOpen())
+    {
+        PlaySkeletons();
+    }
+
     if (NULL == m_pNuiSensor)
     {
         return;
@@ -206,6 +227,13 @@ LRESULT CALLBACK CSkeletonBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam
 
             // Look for a connected Kinect, and create it if found
             CreateFirstConnected();
+
+            // Poses are matched against the library of the last recording, if there is one
+            WCHAR path[MAX_PATH];
+            if (SUCCEEDED(GetDocumentPath(g_PoseLibraryFileName, path, _countof(path))))
+            {
+                m_poseLibrary.Open(path);
+            }
         }
         break;
 
@@ -233,6 +261,25 @@ LRESULT CALLBACK CSkeletonBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam
                 m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, m_bSeatedMode ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0);
             }
         }
+
+        // If it was for the joint filter control and a clicked event, switch to the next filter
+        if (IDC_BUTTON_JOINTFILTER == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+        {
+            m_jointFilter.SetMode(static_cast<JointFilterMode>((m_jointFilter.GetMode() + 1) % (JointFilterKalman + 1)));
+            ReportJointFilter();
+        }
+
+        // If it was for the record control and a clicked event, start or stop recording
+        if (IDC_CHECK_RECORD == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+        {
+            ToggleRecording();
+        }
+
+        // If it was for the play control and a clicked event, start or stop playing the recording
+        if (IDC_CHECK_PLAY == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+        {
+            TogglePlayback();
+        }
         break;
     }
 
@@ -312,11 +359,58 @@ void CSkeletonBasics::ProcessSkeleton()
         return;
     }
 
+    // Record the frame as it came, before smoothing
+    if (m_skeletonRecorder.IsRecording() && FAILED(m_skeletonRecorder.Record(skeletonFrame)))
+    {
+        ToggleRecording();
+        CheckDlgButton(m_hWnd, IDC_CHECK_RECORD, BST_UNCHECKED);
+    }
+
+    // The recording being played is shown instead
+    if (m_skeletonPlayer.IsOpen())
+    {
+        return;
+    }
+
+    DrawSkeletonFrame(skeletonFrame);
+}
+
+/// <summary>
+/// Handle the next skeleton frame of the recording being played
+/// </summary>
+void CSkeletonBasics::PlaySkeletons()
+{
+    NUI_SKELETON_FRAME skeletonFrame = {0};
+
+    HRESULT hr = m_skeletonPlayer.ReadFrame(&skeletonFrame);
+
+    // Loop the recording
+    if (HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) == hr)
+    {
+        m_skeletonPlayer.Seek(0);
+        hr = m_skeletonPlayer.ReadFrame(&skeletonFrame);
+    }
+
+    if (S_OK == hr)
+    {
+        DrawSkeletonFrame(skeletonFrame);
+    }
+}
+
+/// <summary>
+/// Smooth and draw a skeleton frame
+/// </summary>
+/// <param name="skeletonFrame">skeleton frame, smoothed in place</param>
+void CSkeletonBasics::DrawSkeletonFrame(NUI_SKELETON_FRAME & skeletonFrame)
+{
     // smooth out the skeleton data
-    m_pNuiSensor->NuiTransformSmooth(&skeletonFrame, NULL);
+    SmoothSkeletons(skeletonFrame);
+
+    RecognizeGestures();
+    MatchPoses();
 
     // Endure Direct2D is ready to draw
-    hr = EnsureDirect2DResources( );
+    HRESULT hr = EnsureDirect2DResources( );
     if ( FAILED(hr) )
     {
         return;
@@ -330,26 +424,31 @@ void CSkeletonBasics::ProcessSkeleton()
     int width = rct.right;
     int height = rct.bottom;
 
-    for (int i = 0 ; i < NUI_SKELETON_COUNT; ++i)
-    {
-        NUI_SKELETON_TRACKING_STATE trackingState = skeletonFrame.SkeletonData[i].eTrackingState;
+    // Project the smoothed joints of every skeleton in one pass
+    C_ASSERT(sizeof(D2D1_POINT_2F) == 2 * sizeof(float) && sizeof(m_Points) == cFilterPointCount * sizeof(D2D1_POINT_2F));
+    m_skeletonProjector.SetViewport(width, height);
+    m_skeletonProjector.Project(m_jointFrame.x, m_jointFrame.y, m_jointFrame.z, cFilterPointCount, reinterpret_cast<float*>(m_Points));
 
-        if (NUI_SKELETON_TRACKED == trackingState)
-        {
-            // We're tracking the skeleton, draw it
-            DrawSkeleton(skeletonFrame.SkeletonData[i], width, height);
-        }
-        else if (NUI_SKELETON_POSITION_ONLY == trackingState)
+    hr = BeginSkeletonGeometry();
+    if (SUCCEEDED(hr))
+    {
+        for (int i = 0 ; i < NUI_SKELETON_COUNT; ++i)
         {
-            // we've only received the center point of the skeleton, draw that
-            D2D1_ELLIPSE ellipse = D2D1::Ellipse(
-                SkeletonToScreen(skeletonFrame.SkeletonData[i].Position, width, height),
-                g_JointThickness,
-                g_JointThickness
-                );
-
-            m_pRenderTarget->DrawEllipse(ellipse, m_pBrushJointTracked);
+            NUI_SKELETON_TRACKING_STATE trackingState = skeletonFrame.SkeletonData[i].eTrackingState;
+
+            if (NUI_SKELETON_TRACKED == trackingState)
+            {
+                // We're tracking the skeleton, draw it
+                AddSkeleton(skeletonFrame.SkeletonData[i], m_Points[i]);
+            }
+            else if (NUI_SKELETON_POSITION_ONLY == trackingState)
+            {
+                // we've only received the center point of the skeleton, draw that
+                AddJoint(StrokeJointTracked, SkeletonToScreen(skeletonFrame.SkeletonData[i].Position, width, height));
+            }
         }
+
+        DrawSkeletonGeometry();
     }
 
     hr = m_pRenderTarget->EndDraw();
@@ -364,99 +463,449 @@ void CSkeletonBasics::ProcessSkeleton()
 }
 
 /// <summary>
-/// Draws a skeleton
+/// Smooth the joints of every tracked skeleton with the joint filter, and derive their motion
 /// </summary>
-/// <param name="skel">skeleton to draw</param>
-/// <param name="windowWidth">width (in pixels) of output buffer</param>
-/// <param name="windowHeight">height (in pixels) of output buffer</param>
-void CSkeletonBasics::DrawSkeleton(const NUI_SKELETON_DATA & skel, int windowWidth, int windowHeight)
-{      
-    int i;
-
-    for (i = 0; i < NUI_SKELETON_POSITION_COUNT; ++i)
-    {
-        m_Points[i] = SkeletonToScreen(skel.SkeletonPositions[i], windowWidth, windowHeight);
-    }
-
-    // Render Torso
-    DrawBone(skel, NUI_SKELETON_POSITION_HEAD, NUI_SKELETON_POSITION_SHOULDER_CENTER);
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_CENTER, NUI_SKELETON_POSITION_SHOULDER_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_CENTER, NUI_SKELETON_POSITION_SHOULDER_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_CENTER, NUI_SKELETON_POSITION_SPINE);
-    DrawBone(skel, NUI_SKELETON_POSITION_SPINE, NUI_SKELETON_POSITION_HIP_CENTER);
-    DrawBone(skel, NUI_SKELETON_POSITION_HIP_CENTER, NUI_SKELETON_POSITION_HIP_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_HIP_CENTER, NUI_SKELETON_POSITION_HIP_RIGHT);
-
-    // Left Arm
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_LEFT, NUI_SKELETON_POSITION_ELBOW_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_ELBOW_LEFT, NUI_SKELETON_POSITION_WRIST_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_WRIST_LEFT, NUI_SKELETON_POSITION_HAND_LEFT);
-
-    // Right Arm
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_RIGHT, NUI_SKELETON_POSITION_ELBOW_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_ELBOW_RIGHT, NUI_SKELETON_POSITION_WRIST_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_WRIST_RIGHT, NUI_SKELETON_POSITION_HAND_RIGHT);
-
-    // Left Leg
-    DrawBone(skel, NUI_SKELETON_POSITION_HIP_LEFT, NUI_SKELETON_POSITION_KNEE_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_KNEE_LEFT, NUI_SKELETON_POSITION_ANKLE_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_ANKLE_LEFT, NUI_SKELETON_POSITION_FOOT_LEFT);
-
-    // Right Leg
-    DrawBone(skel, NUI_SKELETON_POSITION_HIP_RIGHT, NUI_SKELETON_POSITION_KNEE_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_KNEE_RIGHT, NUI_SKELETON_POSITION_ANKLE_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_ANKLE_RIGHT, NUI_SKELETON_POSITION_FOOT_RIGHT);
+/// <param name="skeletonFrame">skeleton frame, the joint positions are smoothed in place</param>
+void CSkeletonBasics::SmoothSkeletons(NUI_SKELETON_FRAME & skeletonFrame)
+{
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+    {
+        const NUI_SKELETON_DATA & skel = skeletonFrame.SkeletonData[i];
 
-    // Draw the joints in a different color
-    for (i = 0; i < NUI_SKELETON_POSITION_COUNT; ++i)
+        // Only fully tracked skeletons have joints
+        m_jointFrame.trackingIds[i] = (NUI_SKELETON_TRACKED == skel.eTrackingState) ? skel.dwTrackingID : 0;
+
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            const int point = i * cFilterJointCount + j;
+
+            m_jointFrame.x[point] = skel.SkeletonPositions[j].x;
+            m_jointFrame.y[point] = skel.SkeletonPositions[j].y;
+            m_jointFrame.z[point] = skel.SkeletonPositions[j].z;
+            m_jointFrame.seen[point] = (NUI_SKELETON_POSITION_NOT_TRACKED != skel.eSkeletonPositionTrackingState[j]);
+        }
+    }
+
+    // Time stamps are in milliseconds, the first frame starts every joint over
+    const float deltaTime = static_cast<float>(skeletonFrame.liTimeStamp.QuadPart - m_previousSkeletonTime) / 1000.0f;
+    m_previousSkeletonTime = skeletonFrame.liTimeStamp.QuadPart;
+
+    m_jointFilter.Update(m_jointFrame, deltaTime);
+    m_skeletonKinematics.Update(m_jointFrame, deltaTime);
+
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
     {
-        D2D1_ELLIPSE ellipse = D2D1::Ellipse( m_Points[i], g_JointThickness, g_JointThickness );
+        if (0 == m_jointFrame.trackingIds[i])
+        {
+            continue;
+        }
 
-        if ( skel.eSkeletonPositionTrackingState[i] == NUI_SKELETON_POSITION_INFERRED )
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
         {
-            m_pRenderTarget->DrawEllipse(ellipse, m_pBrushJointInferred);
+            const int point = i * cFilterJointCount + j;
+
+            skeletonFrame.SkeletonData[i].SkeletonPositions[j].x = m_jointFrame.x[point];
+            skeletonFrame.SkeletonData[i].SkeletonPositions[j].y = m_jointFrame.y[point];
+            skeletonFrame.SkeletonData[i].SkeletonPositions[j].z = m_jointFrame.z[point];
         }
-        else if ( skel.eSkeletonPositionTrackingState[i] == NUI_SKELETON_POSITION_TRACKED )
+    }
+}
+
+/// <summary>
+/// Start or stop recording the skeletons of the sensor
+/// </summary>
+void CSkeletonBasics::ToggleRecording()
+{
+    WCHAR szMessage[cStatusMessageMaxLen];
+
+    if (m_skeletonRecorder.IsRecording())
+    {
+        HRESULT hr = m_skeletonRecorder.Close();
+
+        StringCchPrintfW(szMessage, _countof(szMessage), SUCCEEDED(hr) ? L"Recorded %u skeleton frames in %I64u bytes" : L"Skeleton recording failed after %u frames and %I64u bytes",
+            m_skeletonRecorder.GetFrameCount(), m_skeletonRecorder.GetSize());
+
+        // The poses of the recording become the pose library
+        int poseCount = 0;
+        if (SUCCEEDED(hr) && SUCCEEDED(BuildPoseLibrary(&poseCount)))
         {
-            m_pRenderTarget->DrawEllipse(ellipse, m_pBrushJointTracked);
+            size_t length = 0;
+            StringCchLengthW(szMessage, _countof(szMessage), &length);
+            StringCchPrintfW(szMessage + length, _countof(szMessage) - length, L", %d poses in the pose library", poseCount);
         }
+
+        SetStatusMessage(szMessage);
+        return;
+    }
+
+    WCHAR path[MAX_PATH];
+    HRESULT hr = GetDocumentPath(g_RecordingFileName, path, _countof(path));
+    if (SUCCEEDED(hr))
+    {
+        hr = m_skeletonRecorder.Open(path, cKeyframeInterval);
+    }
+
+    if (FAILED(hr))
+    {
+        CheckDlgButton(m_hWnd, IDC_CHECK_RECORD, BST_UNCHECKED);
+        SetStatusMessage(L"Couldn't create the skeleton recording!");
+        return;
     }
+
+    StringCchPrintfW(szMessage, _countof(szMessage), L"Recording skeletons to %s", path);
+    SetStatusMessage(szMessage);
 }
 
 /// <summary>
-/// Draws a bone line between two joints
+/// Start or stop playing the recording in place of the sensor
 /// </summary>
-/// <param name="skel">skeleton to draw bones from</param>
-/// <param name="joint0">joint to start drawing from</param>
-/// <param name="joint1">joint to end drawing at</param>
-void CSkeletonBasics::DrawBone(const NUI_SKELETON_DATA & skel, NUI_SKELETON_POSITION_INDEX joint0, NUI_SKELETON_POSITION_INDEX joint1)
+void CSkeletonBasics::TogglePlayback()
 {
-    NUI_SKELETON_POSITION_TRACKING_STATE joint0State = skel.eSkeletonPositionTrackingState[joint0];
-    NUI_SKELETON_POSITION_TRACKING_STATE joint1State = skel.eSkeletonPositionTrackingState[joint1];
+    if (m_skeletonPlayer.IsOpen())
+    {
+        m_skeletonPlayer.Close();
+        SetStatusMessage(L"Showing the skeletons of the sensor");
+        return;
+    }
+
+    WCHAR path[MAX_PATH];
+    HRESULT hr = GetDocumentPath(g_RecordingFileName, path, _countof(path));
+    if (SUCCEEDED(hr))
+    {
+        hr = m_skeletonPlayer.Open(path);
+    }
 
-    // If we can't find either of these joints, exit
-    if (joint0State == NUI_SKELETON_POSITION_NOT_TRACKED || joint1State == NUI_SKELETON_POSITION_NOT_TRACKED)
+    if (FAILED(hr))
     {
+        CheckDlgButton(m_hWnd, IDC_CHECK_PLAY, BST_UNCHECKED);
+        SetStatusMessage(L"Couldn't open the skeleton recording, stop recording or record one first!");
         return;
     }
 
-    // Don't draw if both points are inferred
-    if (joint0State == NUI_SKELETON_POSITION_INFERRED && joint1State == NUI_SKELETON_POSITION_INFERRED)
+    m_skeletonPlayer.SetRealTime(true);
+    SetStatusMessage(L"Playing the skeleton recording");
+}
+
+/// <summary>
+/// Get the path of a file of the sample in the Documents folder
+/// </summary>
+/// <param name="fileName">name of the file</param>
+/// <param name="path">receives the path</param>
+/// <param name="size">size (in characters) of path</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::GetDocumentPath(PCWSTR fileName, WCHAR* path, UINT size)
+{
+    WCHAR folder[MAX_PATH];
+
+    HRESULT hr = SHGetFolderPathW(NULL, CSIDL_PERSONAL, NULL, SHGFP_TYPE_CURRENT, folder);
+    if (SUCCEEDED(hr))
+    {
+        hr = StringCchPrintfW(path, size, L"%s\\%s", folder, fileName);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Build the pose library from the skeleton recording and open it, on the UI thread since it
+/// only happens when a recording stops. The previous library stays open when the build fails
+/// </summary>
+/// <param name="pPoseCount">receives the number of poses in the library</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::BuildPoseLibrary(int* pPoseCount)
+{
+    WCHAR recordingPath[MAX_PATH];
+    WCHAR libraryPath[MAX_PATH];
+
+    HRESULT hr = GetDocumentPath(g_RecordingFileName, recordingPath, _countof(recordingPath));
+    if (SUCCEEDED(hr))
+    {
+        hr = GetDocumentPath(g_PoseLibraryFileName, libraryPath, _countof(libraryPath));
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // The mapped library would keep its file from being replaced
+        m_poseLibrary.Close();
+        ZeroMemory(m_bPoseMatched, sizeof(m_bPoseMatched));
+
+        hr = PoseLibrary::BuildFromRecording(recordingPath, libraryPath, pPoseCount);
+
+        // A failed build leaves the previous library, which goes on being matched against
+        const HRESULT hrOpen = m_poseLibrary.Open(libraryPath);
+        if (SUCCEEDED(hr))
+        {
+            hr = hrOpen;
+        }
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Show the joint filter in use on the status bar
+/// </summary>
+void CSkeletonBasics::ReportJointFilter()
+{
+    static WCHAR* filterNames[] = { L"Joint filter: off", L"Joint filter: Holt", L"Joint filter: One Euro", L"Joint filter: Kalman" };
+
+    SetStatusMessage(filterNames[m_jointFilter.GetMode()]);
+}
+
+/// <summary>
+/// Add the built in gestures to the gesture recognizer
+/// </summary>
+void CSkeletonBasics::AddGestureTemplates()
+{
+    // Right hand relative to the shoulder center (in shoulder widths) where each gesture starts and ends:
+    // swipe left, swipe right, raise hand, push
+    static const float gestureStart[cGestureCount][3] = { {  2.0f,  0.0f, -1.5f }, { -0.5f, 0.0f, -1.5f }, { 1.0f, -2.0f, -0.5f }, { 0.8f, 0.0f, -0.3f } };
+    static const float gestureEnd[cGestureCount][3]   = { { -0.5f,  0.0f, -1.5f }, {  2.0f, 0.0f, -1.5f }, { 1.0f,  1.5f, -0.5f }, { 0.8f, 0.0f, -2.0f } };
+
+    // Only the right hand counts, and it may stray about half a shoulder width from the path
+    static const float weights[cGestureDimensions] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f };
+    static const float threshold = 0.25f;
+
+    float frames[cGestureLength * cGestureDimensions];
+
+    m_gestureRecognizer.SetBand(cGestureBand);
+
+    for (int i = 0; i < cGestureCount; ++i)
+    {
+        ZeroMemory(frames, sizeof(frames));
+
+        for (int f = 0; f < cGestureLength; ++f)
+        {
+            // The hand speeds up then slows down
+            float t = static_cast<float>(f) / (cGestureLength - 1);
+            t = t * t * (3.0f - 2.0f * t);
+
+            for (int d = 0; d < 3; ++d)
+            {
+                frames[f * cGestureDimensions + 3 + d] = gestureStart[i][d] + (gestureEnd[i][d] - gestureStart[i][d]) * t;
+            }
+        }
+
+        m_gestureRecognizer.AddTemplate(frames, cGestureLength, weights, threshold);
+    }
+}
+
+/// <summary>
+/// Match the smoothed joints of every tracked skeleton against the gestures, and show the ones made
+/// </summary>
+void CSkeletonBasics::RecognizeGestures()
+{
+    static WCHAR* gestureNames[cGestureCount] = { L"Swipe left", L"Swipe right", L"Raise hand", L"Push" };
+
+    float features[cGestureDimensions];
+    GestureMatch matches[cGestureCount];
+
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+    {
+        const int firstPoint = i * cFilterJointCount;
+        const unsigned long trackingId = m_jointFrame.trackingIds[i];
+
+        if (0 != trackingId)
+        {
+            GestureRecognizer::ComputeFeatures(m_jointFrame.x + firstPoint, m_jointFrame.y + firstPoint, m_jointFrame.z + firstPoint, features);
+        }
+
+        const int matchCount = m_gestureRecognizer.Update(i, trackingId, features, matches, cGestureCount);
+
+        if (matchCount > 0)
+        {
+            WCHAR szMessage[cStatusMessageMaxLen];
+            StringCchPrintfW(szMessage, _countof(szMessage), L"Gesture: %s (player %d)", gestureNames[matches[0].gesture], i + 1);
+            SetStatusMessage(szMessage);
+        }
+    }
+}
+
+/// <summary>
+/// Look up the pose of every tracked skeleton holding still in the pose library, and show the ones that match
+/// </summary>
+void CSkeletonBasics::MatchPoses()
+{
+    if (!m_poseLibrary.IsOpen())
     {
         return;
     }
 
-    // We assume all drawn bones are inferred unless BOTH joints are tracked
-    if (joint0State == NUI_SKELETON_POSITION_TRACKED && joint1State == NUI_SKELETON_POSITION_TRACKED)
+    // Every tracked skeleton is looked up in one search
+    float queries[NUI_SKELETON_COUNT * cPoseDimensions];
+    int players[NUI_SKELETON_COUNT];
+    int queryCount = 0;
+
+    const SkeletonKinematicsFrame& motion = m_skeletonKinematics.GetFrame();
+
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
     {
-        m_pRenderTarget->DrawLine(m_Points[joint0], m_Points[joint1], m_pBrushBoneTracked, g_TrackedBoneThickness);
+        const int firstPoint = i * cFilterJointCount;
+
+        // A player passing through a pose on the way to another is not taking it up, and is not looked up.
+        // Neither is one missing joints: the library only holds poses with every joint, and a joint
+        // the sensor does not see would be compared at a stale or zero position
+        bool bHolding = 0 != m_jointFrame.trackingIds[i];
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT && bHolding; ++j)
+        {
+            const int point = firstPoint + j;
+            const float speedSquared = motion.velocityX[point] * motion.velocityX[point] +
+                motion.velocityY[point] * motion.velocityY[point] + motion.velocityZ[point] * motion.velocityZ[point];
+
+            bHolding = m_jointFrame.seen[point] && (!motion.velocityValid[point] || speedSquared < cPoseHoldSpeed * cPoseHoldSpeed);
+        }
+
+        if (!bHolding)
+        {
+            m_bPoseMatched[i] = false;
+            continue;
+        }
+
+        PoseIndex::NormalizePose(m_jointFrame.x + firstPoint, m_jointFrame.y + firstPoint, m_jointFrame.z + firstPoint, queries + queryCount * cPoseDimensions);
+        players[queryCount++] = i;
     }
-    else
+
+    PoseNeighbor neighbors[NUI_SKELETON_COUNT];
+    m_poseLibrary.GetIndex().Search(queries, queryCount, 1, neighbors);
+
+    for (int q = 0; q < queryCount; ++q)
     {
-        m_pRenderTarget->DrawLine(m_Points[joint0], m_Points[joint1], m_pBrushBoneInferred, g_InferredBoneThickness);
+        const int player = players[q];
+        const bool bMatched = neighbors[q].pose >= 0 && neighbors[q].distance < cPoseMatchDistance;
+
+        // Only say so when the player takes up a pose of the library, not for every frame they hold it
+        if (bMatched && !m_bPoseMatched[player])
+        {
+            WCHAR szMessage[cStatusMessageMaxLen];
+            StringCchPrintfW(szMessage, _countof(szMessage), L"Pose: matches library pose %d (player %d)", neighbors[q].pose, player + 1);
+            SetStatusMessage(szMessage);
+        }
+
+        m_bPoseMatched[player] = bMatched;
     }
 }
 
+/// <summary>
+/// Start gathering the skeleton geometry of a frame
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::BeginSkeletonGeometry()
+{
+    HRESULT hr = S_OK;
+
+    for (int i = 0; i < StrokeCount && SUCCEEDED(hr); ++i)
+    {
+        m_skeletonFigureCount[i] = 0;
+
+        hr = m_pD2DFactory->CreatePathGeometry(&m_pSkeletonGeometry[i]);
+        if (SUCCEEDED(hr))
+        {
+            hr = m_pSkeletonGeometry[i]->Open(&m_pSkeletonSink[i]);
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        for (int i = 0; i < StrokeCount; ++i)
+        {
+            SafeRelease(m_pSkeletonSink[i]);
+            SafeRelease(m_pSkeletonGeometry[i]);
+        }
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Draw the skeleton geometry gathered, one call per brush, and release it
+/// </summary>
+void CSkeletonBasics::DrawSkeletonGeometry()
+{
+    ID2D1SolidColorBrush* brushes[StrokeCount] = { m_pBrushBoneTracked, m_pBrushBoneInferred, m_pBrushJointTracked, m_pBrushJointInferred };
+    const float thicknesses[StrokeCount] = { g_TrackedBoneThickness, g_InferredBoneThickness, 1.0f, 1.0f };
+
+    for (int i = 0; i < StrokeCount; ++i)
+    {
+        // The geometry can only be drawn once its sink is closed
+        if (SUCCEEDED(m_pSkeletonSink[i]->Close()) && m_skeletonFigureCount[i] > 0)
+        {
+            m_pRenderTarget->DrawGeometry(m_pSkeletonGeometry[i], brushes[i], thicknesses[i]);
+        }
+
+        SafeRelease(m_pSkeletonSink[i]);
+        SafeRelease(m_pSkeletonGeometry[i]);
+    }
+}
+
+/// <summary>
+/// Add the bones and joints of a skeleton to the skeleton geometry
+/// </summary>
+/// <param name="skel">skeleton to draw</param>
+/// <param name="pPoints">screen positions of the skeleton's joints</param>
+void CSkeletonBasics::AddSkeleton(const NUI_SKELETON_DATA & skel, const D2D1_POINT_2F* pPoints)
+{
+    C_ASSERT(SkeletonJointCount == NUI_SKELETON_POSITION_COUNT);
+
+    for (int i = 0; i < cSkeletonBoneCount; ++i)
+    {
+        const int joint0 = cSkeletonBones[i].joint0;
+        const int joint1 = cSkeletonBones[i].joint1;
+        NUI_SKELETON_POSITION_TRACKING_STATE joint0State = skel.eSkeletonPositionTrackingState[joint0];
+        NUI_SKELETON_POSITION_TRACKING_STATE joint1State = skel.eSkeletonPositionTrackingState[joint1];
+
+        // If we can't find either of these joints, skip the bone
+        if (joint0State == NUI_SKELETON_POSITION_NOT_TRACKED || joint1State == NUI_SKELETON_POSITION_NOT_TRACKED)
+        {
+            continue;
+        }
+
+        // Don't draw if both points are inferred
+        if (joint0State == NUI_SKELETON_POSITION_INFERRED && joint1State == NUI_SKELETON_POSITION_INFERRED)
+        {
+            continue;
+        }
+
+        // We assume all drawn bones are inferred unless BOTH joints are tracked
+        const SkeletonStroke stroke = (joint0State == NUI_SKELETON_POSITION_TRACKED && joint1State == NUI_SKELETON_POSITION_TRACKED) ? StrokeBoneTracked : StrokeBoneInferred;
+
+        m_pSkeletonSink[stroke]->BeginFigure(pPoints[joint0], D2D1_FIGURE_BEGIN_HOLLOW);
+        m_pSkeletonSink[stroke]->AddLine(pPoints[joint1]);
+        m_pSkeletonSink[stroke]->EndFigure(D2D1_FIGURE_END_OPEN);
+        ++m_skeletonFigureCount[stroke];
+    }
+
+    // Draw the joints in a different color
+    for (int i = 0; i < NUI_SKELETON_POSITION_COUNT; ++i)
+    {
+        if ( skel.eSkeletonPositionTrackingState[i] == NUI_SKELETON_POSITION_INFERRED )
+        {
+            AddJoint(StrokeJointInferred, pPoints[i]);
+        }
+        else if ( skel.eSkeletonPositionTrackingState[i] == NUI_SKELETON_POSITION_TRACKED )
+        {
+            AddJoint(StrokeJointTracked, pPoints[i]);
+        }
+    }
+}
+
+/// <summary>
+/// Add a joint circle to the skeleton geometry
+/// </summary>
+/// <param name="stroke">geometry to add it to</param>
+/// <param name="center">screen position of the joint</param>
+void CSkeletonBasics::AddJoint(SkeletonStroke stroke, D2D1_POINT_2F center)
+{
+    const D2D1_SIZE_F radius = D2D1::SizeF(g_JointThickness, g_JointThickness);
+    ID2D1GeometrySink* pSink = m_pSkeletonSink[stroke];
+
+    // A circle is two half circle arcs
+    pSink->BeginFigure(D2D1::Point2F(center.x + g_JointThickness, center.y), D2D1_FIGURE_BEGIN_HOLLOW);
+    pSink->AddArc(D2D1::ArcSegment(D2D1::Point2F(center.x - g_JointThickness, center.y), radius, 0.0f, D2D1_SWEEP_DIRECTION_CLOCKWISE, D2D1_ARC_SIZE_SMALL));
+    pSink->AddArc(D2D1::ArcSegment(D2D1::Point2F(center.x + g_JointThickness, center.y), radius, 0.0f, D2D1_SWEEP_DIRECTION_CLOCKWISE, D2D1_ARC_SIZE_SMALL));
+    pSink->EndFigure(D2D1_FIGURE_END_CLOSED);
+    ++m_skeletonFigureCount[stroke];
+}
+
 /// <summary>
 /// Converts a skeleton point to screen space
 /// </summary>
@@ -466,17 +915,13 @@ void CSkeletonBasics::DrawBone(const NUI_SKELETON_DATA & skel, NUI_SKELETON_POSI
 /// <returns>point in screen-space</returns>
 D2D1_POINT_2F CSkeletonBasics::SkeletonToScreen(Vector4 skeletonPoint, int width, int height)
 {
-    LONG x, y;
-    USHORT depth;
-
-    // Calculate the skeleton's position on the screen
-    // NuiTransformSkeletonToDepthImage returns coordinates in NUI_IMAGE_RESOLUTION_320x240 space
-    NuiTransformSkeletonToDepthImage(skeletonPoint, &x, &y, &depth);
+    D2D1_POINT_2F screenPoint;
 
-    float screenPointX = static_cast<float>(x * width) / cScreenWidth;
-    float screenPointY = static_cast<float>(y * height) / cScreenHeight;
+    // Same projection as the joints, so the point lines up with them
+    m_skeletonProjector.SetViewport(width, height);
+    m_skeletonProjector.Project(&skeletonPoint.x, &skeletonPoint.y, &skeletonPoint.z, 1, &screenPoint.x);
 
-    return D2D1::Point2F(screenPointX, screenPointY);
+    return screenPoint;
 }
 
 /// <summary>
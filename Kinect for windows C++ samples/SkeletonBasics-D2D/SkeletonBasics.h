@@ -8,6 +8,13 @@
 
 #include "resource.h"
 #include "NuiApi.h"
+#include "JointFilter.h"
+#include "SkeletonRecorder.h"
+#include "GestureRecognizer.h"
+#include "SkeletonProjector.h"
+#include "SkeletonTopology.h"
+#include "SkeletonKinematics.h"
+#include "PoseLibrary.h"
 
 class CSkeletonBasics
 {
@@ -16,6 +23,20 @@ class CSkeletonBasics
 
     static const int        cStatusMessageMaxLen = MAX_PATH*2;
 
+    // Recordings get a keyframe every second, and are polled this often (in milliseconds) while playing
+    static const UINT       cKeyframeInterval = 30;
+    static const DWORD      cPlaybackPollInterval = 5;
+
+    // Built in gestures, their frames, and how far frames may warp when matched with them
+    static const int        cGestureCount = 4;
+    static const int        cGestureLength = 20;
+    static const int        cGestureBand = 4;
+
+    // Live poses nearer than this to a pose of the library match it, once every joint of the player
+    // moves slower than this (in meters per second)
+    static const float      cPoseMatchDistance;
+    static const float      cPoseHoldSpeed;
+
 public:
     /// <summary>
     /// Constructor
@@ -68,7 +89,44 @@ private:
     ID2D1SolidColorBrush*    m_pBrushJointInferred;
     ID2D1SolidColorBrush*    m_pBrushBoneTracked;
     ID2D1SolidColorBrush*    m_pBrushBoneInferred;
-    D2D1_POINT_2F            m_Points[NUI_SKELETON_POSITION_COUNT];
+
+    // Screen position of every joint of every skeleton, projected together
+    SkeletonProjector        m_skeletonProjector;
+    D2D1_POINT_2F            m_Points[NUI_SKELETON_COUNT][NUI_SKELETON_POSITION_COUNT];
+
+    // Bones and joints of every skeleton are gathered into one geometry per brush and drawn together
+    enum SkeletonStroke
+    {
+        StrokeBoneTracked,
+        StrokeBoneInferred,
+        StrokeJointTracked,
+        StrokeJointInferred,
+        StrokeCount
+    };
+
+    ID2D1PathGeometry*       m_pSkeletonGeometry[StrokeCount];
+    ID2D1GeometrySink*       m_pSkeletonSink[StrokeCount];
+    UINT                     m_skeletonFigureCount[StrokeCount];
+
+    // Joint smoothing, in place of NuiTransformSmooth
+    JointFilter             m_jointFilter;
+    JointFilterFrame        m_jointFrame;
+    LONGLONG                m_previousSkeletonTime;
+
+    // Velocities, accelerations and joint angles of the smoothed joints, derived once per frame;
+    // the pose matching waits for the joints to come to rest
+    SkeletonKinematics      m_skeletonKinematics;
+
+    // Skeleton recording, and playback in place of the sensor
+    SkeletonRecorder        m_skeletonRecorder;
+    SkeletonPlayer          m_skeletonPlayer;
+
+    // Gestures of the tracked skeletons
+    GestureRecognizer       m_gestureRecognizer;
+
+    // Library of the poses of the last recording, and whether each player's pose matched one last frame
+    PoseLibrary             m_poseLibrary;
+    bool                    m_bPoseMatched[NUI_SKELETON_COUNT];
 
     // Direct2D
     ID2D1Factory*           m_pD2DFactory;
@@ -92,6 +150,69 @@ private:
     /// </summary>
     void                    ProcessSkeleton();
 
+    /// <summary>
+    /// Handle the next skeleton frame of the recording being played
+    /// </summary>
+    void                    PlaySkeletons();
+
+    /// <summary>
+    /// Smooth and draw a skeleton frame
+    /// </summary>
+    /// <param name="skeletonFrame">skeleton frame, smoothed in place</param>
+    void                    DrawSkeletonFrame(NUI_SKELETON_FRAME & skeletonFrame);
+
+    /// <summary>
+    /// Start or stop recording the skeletons of the sensor
+    /// </summary>
+    void                    ToggleRecording();
+
+    /// <summary>
+    /// Start or stop playing the recording in place of the sensor
+    /// </summary>
+    void                    TogglePlayback();
+
+    /// <summary>
+    /// Get the path of a file of the sample in the Documents folder
+    /// </summary>
+    /// <param name="fileName">name of the file</param>
+    /// <param name="path">receives the path</param>
+    /// <param name="size">size (in characters) of path</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 GetDocumentPath(PCWSTR fileName, WCHAR* path, UINT size);
+
+    /// <summary>
+    /// Build the pose library from the skeleton recording and open it, the previous library stays open when the build fails
+    /// </summary>
+    /// <param name="pPoseCount">receives the number of poses in the library</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 BuildPoseLibrary(int* pPoseCount);
+
+    /// <summary>
+    /// Look up the pose of every tracked skeleton in the pose library, and show the ones that match
+    /// </summary>
+    void                    MatchPoses();
+
+    /// <summary>
+    /// Smooth the joints of every tracked skeleton with the joint filter, and derive their motion
+    /// </summary>
+    /// <param name="skeletonFrame">skeleton frame, the joint positions are smoothed in place</param>
+    void                    SmoothSkeletons(NUI_SKELETON_FRAME & skeletonFrame);
+
+    /// <summary>
+    /// Show the joint filter in use on the status bar
+    /// </summary>
+    void                    ReportJointFilter();
+
+    /// <summary>
+    /// Add the built in gestures to the gesture recognizer
+    /// </summary>
+    void                    AddGestureTemplates();
+
+    /// <summary>
+    /// Match the smoothed joints of every tracked skeleton against the gestures, and show the ones made
+    /// </summary>
+    void                    RecognizeGestures();
+
     /// <summary>
     /// Ensure necessary Direct2d resources are created
     /// </summary>
@@ -104,20 +225,29 @@ private:
     void                    DiscardDirect2DResources( );
 
     /// <summary>
-    /// Draws a bone line between two joints
+    /// Start gathering the skeleton geometry of a frame
     /// </summary>
-    /// <param name="skel">skeleton to draw bones from</param>
-    /// <param name="joint0">joint to start drawing from</param>
-    /// <param name="joint1">joint to end drawing at</param>
-    void                    DrawBone(const NUI_SKELETON_DATA & skel, NUI_SKELETON_POSITION_INDEX bone0, NUI_SKELETON_POSITION_INDEX bone1);
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 BeginSkeletonGeometry();
 
     /// <summary>
-    /// Draws a skeleton
+    /// Draw the skeleton geometry gathered, one call per brush, and release it
+    /// </summary>
+    void                    DrawSkeletonGeometry();
+
+    /// <summary>
+    /// Add the bones and joints of a skeleton to the skeleton geometry
     /// </summary>
     /// <param name="skel">skeleton to draw</param>
-    /// <param name="windowWidth">width (in pixels) of output buffer</param>
-    /// <param name="windowHeight">height (in pixels) of output buffer</param>
-    void                    DrawSkeleton(const NUI_SKELETON_DATA & skel, int windowWidth, int windowHeight);
+    /// <param name="pPoints">screen positions of the skeleton's joints</param>
+    void                    AddSkeleton(const NUI_SKELETON_DATA & skel, const D2D1_POINT_2F* pPoints);
+
+    /// <summary>
+    /// Add a joint circle to the skeleton geometry
+    /// </summary>
+    /// <param name="stroke">geometry to add it to</param>
+    /// <param name="center">screen position of the joint</param>
+    void                    AddJoint(SkeletonStroke stroke, D2D1_POINT_2F center);
 
     /// <summary>
     /// Converts a skeleton point to screen space
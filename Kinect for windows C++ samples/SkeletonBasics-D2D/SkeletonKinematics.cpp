@@ -0,0 +1,202 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonKinematics.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SkeletonKinematics.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SKELETON_KINEMATICS_X86
+#include <xmmintrin.h>
+#endif
+
+const float SkeletonKinematics::cMaxDeltaTime = 0.5f;
+
+/// <summary>
+/// Constructor
+/// </summary>
+SkeletonKinematics::SkeletonKinematics()
+{
+    Reset();
+}
+
+/// <summary>
+/// Forget earlier frames, call it when frames stopped coming for a while
+/// </summary>
+void SkeletonKinematics::Reset()
+{
+    memset(&m_frame, 0, sizeof(m_frame));
+    memset(m_trackingIds, 0, sizeof(m_trackingIds));
+    memset(m_samples, 0, sizeof(m_samples));
+    memset(m_previousX, 0, sizeof(m_previousX));
+    memset(m_previousY, 0, sizeof(m_previousY));
+    memset(m_previousZ, 0, sizeof(m_previousZ));
+}
+
+/// <summary>
+/// Derive the motion of the skeletons of a new frame
+/// </summary>
+/// <param name="frame">joints of the frame, as smoothed by the joint filter</param>
+/// <param name="deltaTime">seconds since the previous frame, from the frames' time stamps</param>
+void SkeletonKinematics::Update(const JointFilterFrame& frame, float deltaTime)
+{
+    // Frames too far apart, or out of order, say nothing about the motion
+    if (!(deltaTime > 0.0f && deltaTime <= cMaxDeltaTime))
+    {
+        memset(m_samples, 0, sizeof(m_samples));
+        memset(m_frame.angleValid, 0, sizeof(m_frame.angleValid));
+    }
+
+    // A skeleton that changed hands starts over
+    for (int i = 0; i < cFilterSkeletonCount; ++i)
+    {
+        if (frame.trackingIds[i] != m_trackingIds[i])
+        {
+            m_trackingIds[i] = frame.trackingIds[i];
+            memset(m_samples + i * cFilterJointCount, 0, cFilterJointCount * sizeof(float));
+            memset(m_frame.angleValid + i * KinematicAngleCount, 0, KinematicAngleCount);
+        }
+    }
+
+    UpdateJoints(frame, deltaTime);
+    UpdateAngles(frame, deltaTime);
+}
+
+/// <summary>
+/// Take the velocity and acceleration of every joint
+/// </summary>
+/// <param name="frame">joints of the frame</param>
+/// <param name="deltaTime">seconds since the previous frame</param>
+void SkeletonKinematics::UpdateJoints(const JointFilterFrame& frame, float deltaTime)
+{
+    // Joints of skeletons nobody is tracked in are not seen, whatever their state says
+    float seen[cFilterPointCount];
+    for (int i = 0; i < cFilterPointCount; ++i)
+    {
+        seen[i] = (0 != frame.trackingIds[i / cFilterJointCount] && 0 != frame.seen[i]) ? 1.0f : 0.0f;
+    }
+
+    // Not used when the samples were reset, any positive value keeps the divisions finite
+    const float inverseTime = 1.0f / ((deltaTime > 0.0f) ? deltaTime : 1.0f);
+
+    int i = 0;
+
+#ifdef SKELETON_KINEMATICS_X86
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 oneAndHalf = _mm_set1_ps(1.5f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 inverse = _mm_set1_ps(inverseTime);
+
+    for (; i + 4 <= cFilterPointCount; i += 4)
+    {
+        const __m128 samples = _mm_loadu_ps(m_samples + i);
+        const __m128 isSeen = _mm_cmplt_ps(half, _mm_loadu_ps(seen + i));
+        const __m128 hasVelocity = _mm_and_ps(isSeen, _mm_cmplt_ps(half, samples));
+        const __m128 hasAcceleration = _mm_and_ps(isSeen, _mm_cmplt_ps(oneAndHalf, samples));
+
+        const float* pPositions[3] = { frame.x + i, frame.y + i, frame.z + i };
+        float* pPrevious[3] = { m_previousX + i, m_previousY + i, m_previousZ + i };
+        float* pVelocities[3] = { m_frame.velocityX + i, m_frame.velocityY + i, m_frame.velocityZ + i };
+        float* pAccelerations[3] = { m_frame.accelerationX + i, m_frame.accelerationY + i, m_frame.accelerationZ + i };
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const __m128 position = _mm_loadu_ps(pPositions[axis]);
+            const __m128 velocity = _mm_and_ps(hasVelocity, _mm_mul_ps(_mm_sub_ps(position, _mm_loadu_ps(pPrevious[axis])), inverse));
+            const __m128 acceleration = _mm_and_ps(hasAcceleration, _mm_mul_ps(_mm_sub_ps(velocity, _mm_loadu_ps(pVelocities[axis])), inverse));
+
+            _mm_storeu_ps(pPrevious[axis], position);
+            _mm_storeu_ps(pVelocities[axis], velocity);
+            _mm_storeu_ps(pAccelerations[axis], acceleration);
+        }
+
+        _mm_storeu_ps(m_samples + i, _mm_and_ps(isSeen, _mm_min_ps(_mm_add_ps(samples, one), two)));
+
+        const int velocityMask = _mm_movemask_ps(hasVelocity);
+        const int accelerationMask = _mm_movemask_ps(hasAcceleration);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            m_frame.velocityValid[i + lane] = static_cast<unsigned char>((velocityMask >> lane) & 1);
+            m_frame.accelerationValid[i + lane] = static_cast<unsigned char>((accelerationMask >> lane) & 1);
+        }
+    }
+#endif
+
+    for (; i < cFilterPointCount; ++i)
+    {
+        const bool isSeen = seen[i] > 0.5f;
+        const bool hasVelocity = isSeen && m_samples[i] > 0.5f;
+        const bool hasAcceleration = isSeen && m_samples[i] > 1.5f;
+
+        const float* pPositions[3] = { frame.x + i, frame.y + i, frame.z + i };
+        float* pPrevious[3] = { m_previousX + i, m_previousY + i, m_previousZ + i };
+        float* pVelocities[3] = { m_frame.velocityX + i, m_frame.velocityY + i, m_frame.velocityZ + i };
+        float* pAccelerations[3] = { m_frame.accelerationX + i, m_frame.accelerationY + i, m_frame.accelerationZ + i };
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float position = *pPositions[axis];
+            const float velocity = hasVelocity ? (position - *pPrevious[axis]) * inverseTime : 0.0f;
+            const float acceleration = hasAcceleration ? (velocity - *pVelocities[axis]) * inverseTime : 0.0f;
+
+            *pPrevious[axis] = position;
+            *pVelocities[axis] = velocity;
+            *pAccelerations[axis] = acceleration;
+        }
+
+        m_samples[i] = isSeen ? ((m_samples[i] + 1.0f < 2.0f) ? m_samples[i] + 1.0f : 2.0f) : 0.0f;
+        m_frame.velocityValid[i] = hasVelocity ? 1 : 0;
+        m_frame.accelerationValid[i] = hasAcceleration ? 1 : 0;
+    }
+}
+
+/// <summary>
+/// Measure the joint angles of every skeleton and how fast they change
+/// </summary>
+/// <param name="frame">joints of the frame</param>
+/// <param name="deltaTime">seconds since the previous frame</param>
+void SkeletonKinematics::UpdateAngles(const JointFilterFrame& frame, float deltaTime)
+{
+    for (int s = 0; s < cFilterSkeletonCount; ++s)
+    {
+        const int firstPoint = s * cFilterJointCount;
+
+        for (int a = 0; a < KinematicAngleCount; ++a)
+        {
+            const int index = s * KinematicAngleCount + a;
+            const int joint = firstPoint + cKinematicAngles[a].joint;
+            const int neighbour0 = firstPoint + cKinematicAngles[a].neighbour0;
+            const int neighbour1 = firstPoint + cKinematicAngles[a].neighbour1;
+
+            const bool wasValid = 0 != m_frame.angleValid[index];
+            const bool isValid = 0 != frame.trackingIds[s] && frame.seen[joint] && frame.seen[neighbour0] && frame.seen[neighbour1];
+
+            float angle = 0.0f;
+            if (isValid)
+            {
+                const float ax = frame.x[neighbour0] - frame.x[joint];
+                const float ay = frame.y[neighbour0] - frame.y[joint];
+                const float az = frame.z[neighbour0] - frame.z[joint];
+                const float bx = frame.x[neighbour1] - frame.x[joint];
+                const float by = frame.y[neighbour1] - frame.y[joint];
+                const float bz = frame.z[neighbour1] - frame.z[joint];
+
+                // atan2 of the sine and cosine keeps its precision near straight and folded joints, unlike acos
+                const float cx = ay * bz - az * by;
+                const float cy = az * bx - ax * bz;
+                const float cz = ax * by - ay * bx;
+                angle = atan2f(sqrtf(cx * cx + cy * cy + cz * cz), ax * bx + ay * by + az * bz);
+            }
+
+            const bool hasRate = isValid && wasValid;
+            m_frame.angularRates[index] = hasRate ? (angle - m_frame.angles[index]) / deltaTime : 0.0f;
+            m_frame.angularRateValid[index] = hasRate ? 1 : 0;
+            m_frame.angles[index] = angle;
+            m_frame.angleValid[index] = isValid ? 1 : 0;
+        }
+    }
+}
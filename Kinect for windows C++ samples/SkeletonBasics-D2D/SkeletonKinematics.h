@@ -0,0 +1,117 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonKinematics.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Derives the motion of every skeleton of a frame once, for everything that needs it:
+//     velocity       of each joint, the difference from the previous position over the time
+//                    between the frames
+//     acceleration   of each joint, the difference from the previous velocity likewise
+//     angles         at the elbows, knees and shoulders, between the two bones meeting there,
+//                    and how fast they open or close
+// Joints start over whenever they are not seen or their skeleton changes, and derivatives stay
+// 0 until there are enough frames for them. The results are kept as structure of arrays laid
+// out as JointFilterFrame, and the derivatives of four joints are taken at once with SSE.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+#include "JointFilter.h"
+#include "SkeletonTopology.h"
+
+// Angle measured at a joint, between the bones to two of its neighbours
+struct KinematicAngle
+{
+    SkeletonJoint joint;
+    SkeletonJoint neighbour0;
+    SkeletonJoint neighbour1;
+};
+
+enum KinematicAngleIndex
+{
+    KinematicAngleElbowLeft,
+    KinematicAngleElbowRight,
+    KinematicAngleKneeLeft,
+    KinematicAngleKneeRight,
+    KinematicAngleShoulderLeft,
+    KinematicAngleShoulderRight,
+    KinematicAngleCount
+};
+
+static const KinematicAngle cKinematicAngles[KinematicAngleCount] =
+{
+    { SkeletonJointElbowLeft,     SkeletonJointShoulderLeft,   SkeletonJointWristLeft },
+    { SkeletonJointElbowRight,    SkeletonJointShoulderRight,  SkeletonJointWristRight },
+    { SkeletonJointKneeLeft,      SkeletonJointHipLeft,        SkeletonJointAnkleLeft },
+    { SkeletonJointKneeRight,     SkeletonJointHipRight,       SkeletonJointAnkleRight },
+    { SkeletonJointShoulderLeft,  SkeletonJointShoulderCenter, SkeletonJointElbowLeft },
+    { SkeletonJointShoulderRight, SkeletonJointShoulderCenter, SkeletonJointElbowRight },
+};
+
+// Angle a of skeleton s is at s * KinematicAngleCount + a
+static const int cKinematicAngleTotal = cFilterSkeletonCount * KinematicAngleCount;
+
+// Motion of the skeletons of a frame
+struct SkeletonKinematicsFrame
+{
+    // Meters per second and meters per second squared, joint j of skeleton s at s * cFilterJointCount + j
+    float         velocityX[cFilterPointCount];
+    float         velocityY[cFilterPointCount];
+    float         velocityZ[cFilterPointCount];
+    float         accelerationX[cFilterPointCount];
+    float         accelerationY[cFilterPointCount];
+    float         accelerationZ[cFilterPointCount];
+
+    // Radians, 0 for a folded joint and pi for a straight one, and radians per second
+    float         angles[cKinematicAngleTotal];
+    float         angularRates[cKinematicAngleTotal];
+
+    // Nonzero where the velocity, acceleration, angle and angular rate are known
+    unsigned char velocityValid[cFilterPointCount];
+    unsigned char accelerationValid[cFilterPointCount];
+    unsigned char angleValid[cKinematicAngleTotal];
+    unsigned char angularRateValid[cKinematicAngleTotal];
+};
+
+class SkeletonKinematics
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SkeletonKinematics();
+
+    /// <summary>
+    /// Forget earlier frames, call it when frames stopped coming for a while
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Derive the motion of the skeletons of a new frame
+    /// </summary>
+    /// <param name="frame">joints of the frame, as smoothed by the joint filter</param>
+    /// <param name="deltaTime">seconds since the previous frame, from the frames' time stamps</param>
+    void Update(const JointFilterFrame& frame, float deltaTime);
+
+    /// <summary>
+    /// Motion of the skeletons of the last frame
+    /// </summary>
+    const SkeletonKinematicsFrame& GetFrame() const { return m_frame; }
+
+private:
+    // Frames further apart than this have nothing to do with each other
+    static const float          cMaxDeltaTime;
+
+    SkeletonKinematicsFrame     m_frame;
+    unsigned long               m_trackingIds[cFilterSkeletonCount];
+
+    // Frames seen in a row by each joint, up to 2, and its position in the previous frame
+    float                       m_samples[cFilterPointCount];
+    float                       m_previousX[cFilterPointCount];
+    float                       m_previousY[cFilterPointCount];
+    float                       m_previousZ[cFilterPointCount];
+
+    void                        UpdateJoints(const JointFilterFrame& frame, float deltaTime);
+    void                        UpdateAngles(const JointFilterFrame& frame, float deltaTime);
+};
@@ -0,0 +1,135 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonProjector.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SkeletonProjector.h"
+#include <float.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SKELETON_PROJECTOR_X86
+#include <xmmintrin.h>
+#endif
+
+/// <summary>
+/// Constructor, the nominal intrinsics of the depth camera and a 320x240 window
+/// </summary>
+SkeletonProjector::SkeletonProjector() :
+    m_focalLength(cProjectorFocalLength),
+    m_centerX(cProjectorDepthWidth / 2.0f),
+    m_centerY(cProjectorDepthHeight / 2.0f),
+    m_depthWidth(cProjectorDepthWidth),
+    m_depthHeight(cProjectorDepthHeight),
+    m_viewportWidth(cProjectorDepthWidth),
+    m_viewportHeight(cProjectorDepthHeight)
+{
+    UpdateScale();
+}
+
+/// <summary>
+/// Set the intrinsics of the depth camera
+/// </summary>
+/// <param name="focalLength">focal length (in depth pixels)</param>
+/// <param name="centerX">x of the optical center (in depth pixels)</param>
+/// <param name="centerY">y of the optical center (in depth pixels)</param>
+/// <param name="depthWidth">width (in pixels) of the depth image</param>
+/// <param name="depthHeight">height (in pixels) of the depth image</param>
+void SkeletonProjector::SetIntrinsics(float focalLength, float centerX, float centerY, int depthWidth, int depthHeight)
+{
+    if (depthWidth <= 0 || depthHeight <= 0)
+    {
+        return;
+    }
+
+    m_focalLength = focalLength;
+    m_centerX = centerX;
+    m_centerY = centerY;
+    m_depthWidth = depthWidth;
+    m_depthHeight = depthHeight;
+
+    UpdateScale();
+}
+
+/// <summary>
+/// Set the size of the window the depth image is stretched over
+/// </summary>
+/// <param name="width">width (in pixels) of the window</param>
+/// <param name="height">height (in pixels) of the window</param>
+void SkeletonProjector::SetViewport(int width, int height)
+{
+    if (width == m_viewportWidth && height == m_viewportHeight)
+    {
+        return;
+    }
+
+    m_viewportWidth = width;
+    m_viewportHeight = height;
+
+    UpdateScale();
+}
+
+/// <summary>
+/// Fold the intrinsics and the window size into the scale and offset of each axis
+/// </summary>
+void SkeletonProjector::UpdateScale()
+{
+    const float windowPerDepthX = static_cast<float>(m_viewportWidth) / m_depthWidth;
+    const float windowPerDepthY = static_cast<float>(m_viewportHeight) / m_depthHeight;
+
+    m_scaleX = m_focalLength * windowPerDepthX;
+    m_scaleY = -m_focalLength * windowPerDepthY;
+    m_offsetX = m_centerX * windowPerDepthX;
+    m_offsetY = m_centerY * windowPerDepthY;
+}
+
+/// <summary>
+/// Project points onto the window
+/// </summary>
+/// <param name="pX">x of every point in meters</param>
+/// <param name="pY">y of every point</param>
+/// <param name="pZ">z of every point</param>
+/// <param name="count">number of points</param>
+/// <param name="pPoints">receives x and y of every point (in window pixels), interleaved;
+/// points that are not in front of the camera go to 0, 0</param>
+void SkeletonProjector::Project(const float* pX, const float* pY, const float* pZ, int count, float* pPoints) const
+{
+    int i = 0;
+
+#ifdef SKELETON_PROJECTOR_X86
+    const __m128 scaleX = _mm_set1_ps(m_scaleX);
+    const __m128 scaleY = _mm_set1_ps(m_scaleY);
+    const __m128 offsetX = _mm_set1_ps(m_offsetX);
+    const __m128 offsetY = _mm_set1_ps(m_offsetY);
+    const __m128 minDepth = _mm_set1_ps(FLT_EPSILON);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 z = _mm_loadu_ps(pZ + i);
+        const __m128 inFront = _mm_cmpgt_ps(z, minDepth);
+
+        // Points behind the camera divide by zero or less, the mask clears whatever comes out
+        const __m128 x = _mm_and_ps(inFront, _mm_add_ps(offsetX, _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(pX + i), scaleX), z)));
+        const __m128 y = _mm_and_ps(inFront, _mm_add_ps(offsetY, _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(pY + i), scaleY), z)));
+
+        _mm_storeu_ps(pPoints + 2 * i, _mm_unpacklo_ps(x, y));
+        _mm_storeu_ps(pPoints + 2 * i + 4, _mm_unpackhi_ps(x, y));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        const float z = pZ[i];
+
+        if (z > FLT_EPSILON)
+        {
+            pPoints[2 * i] = m_offsetX + (pX[i] * m_scaleX) / z;
+            pPoints[2 * i + 1] = m_offsetY + (pY[i] * m_scaleY) / z;
+        }
+        else
+        {
+            pPoints[2 * i] = 0.0f;
+            pPoints[2 * i + 1] = 0.0f;
+        }
+    }
+}
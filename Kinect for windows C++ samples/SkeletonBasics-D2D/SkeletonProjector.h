@@ -0,0 +1,76 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonProjector.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Projects skeleton space points onto the screen, as NuiTransformSkeletonToDepthImage followed
+// by scaling from the depth image to the window would, but for a whole frame of joints at once.
+// The depth camera is a pinhole with the nominal focal length and its center in the middle of
+// the image, so each point takes a multiply, a divide and an add per axis: the focal length and
+// the depth to window scaling are folded into one factor when the window size is set. Points
+// come in as structure of arrays and four are projected at a time with SSE; they go out as
+// x, y pairs, the layout of D2D1_POINT_2F. Positions keep their fractions, rather than being
+// rounded to depth pixels first.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+// Same values as NUI_CAMERA_DEPTH_NOMINAL_FOCAL_LENGTH_IN_PIXELS and NUI_IMAGE_RESOLUTION_320x240
+static const float cProjectorFocalLength = 285.63f;
+static const int   cProjectorDepthWidth  = 320;
+static const int   cProjectorDepthHeight = 240;
+
+class SkeletonProjector
+{
+public:
+    /// <summary>
+    /// Constructor, the nominal intrinsics of the depth camera and a 320x240 window
+    /// </summary>
+    SkeletonProjector();
+
+    /// <summary>
+    /// Set the intrinsics of the depth camera
+    /// </summary>
+    /// <param name="focalLength">focal length (in depth pixels)</param>
+    /// <param name="centerX">x of the optical center (in depth pixels)</param>
+    /// <param name="centerY">y of the optical center (in depth pixels)</param>
+    /// <param name="depthWidth">width (in pixels) of the depth image</param>
+    /// <param name="depthHeight">height (in pixels) of the depth image</param>
+    void SetIntrinsics(float focalLength, float centerX, float centerY, int depthWidth, int depthHeight);
+
+    /// <summary>
+    /// Set the size of the window the depth image is stretched over
+    /// </summary>
+    /// <param name="width">width (in pixels) of the window</param>
+    /// <param name="height">height (in pixels) of the window</param>
+    void SetViewport(int width, int height);
+
+    /// <summary>
+    /// Project points onto the window
+    /// </summary>
+    /// <param name="pX">x of every point in meters</param>
+    /// <param name="pY">y of every point</param>
+    /// <param name="pZ">z of every point</param>
+    /// <param name="count">number of points</param>
+    /// <param name="pPoints">receives x and y of every point (in window pixels), interleaved;
+    /// points that are not in front of the camera go to 0, 0</param>
+    void Project(const float* pX, const float* pY, const float* pZ, int count, float* pPoints) const;
+
+private:
+    float   m_focalLength;
+    float   m_centerX;
+    float   m_centerY;
+    int     m_depthWidth;
+    int     m_depthHeight;
+    int     m_viewportWidth;
+    int     m_viewportHeight;
+
+    // Window = offset + scale * skeleton / z, y is flipped by a negative scale
+    float   m_scaleX;
+    float   m_scaleY;
+    float   m_offsetX;
+    float   m_offsetY;
+
+    void    UpdateScale();
+};
@@ -0,0 +1,922 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonRecorder.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include <math.h>
+#include "SkeletonRecorder.h"
+
+// Kinds of record, and what a frame record holds besides the skeletons
+static const BYTE cRecordKeyframe       = 0x01;
+static const BYTE cRecordFloorClipPlane = 0x02;
+static const BYTE cRecordGravity        = 0x04;
+static const BYTE cRecordKeyframeList   = 0x80;
+
+// Skeleton byte: slot in the low 3 bits, tracking state in the next 2, and whether positions are differences
+static const BYTE cSkeletonSlotMask     = 0x07;
+static const int  cSkeletonStateShift   = 3;
+static const BYTE cSkeletonDelta        = 0x20;
+
+// Joint tracking states take 2 bits each
+static const int  cJointStateBytes      = (NUI_SKELETON_POSITION_COUNT + 3) / 4;
+
+struct RecordingHeader
+{
+    DWORD magic;
+    DWORD version;
+    DWORD keyframeInterval;
+    DWORD reserved;
+};
+
+// The file ends with the offset of the keyframe list record and the magic again
+static const UINT cTrailerSize = sizeof(ULONGLONG) + sizeof(DWORD);
+
+/// <summary>
+/// Append bytes to a buffer
+/// </summary>
+static void PutBytes(std::vector<BYTE>& buffer, const void* pData, size_t size)
+{
+    const BYTE* pBytes = reinterpret_cast<const BYTE*>(pData);
+    buffer.insert(buffer.end(), pBytes, pBytes + size);
+}
+
+/// <summary>
+/// Append an unsigned number, 7 bits per byte with the high bit set on every byte but the last
+/// </summary>
+static void PutUnsigned(std::vector<BYTE>& buffer, ULONGLONG value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<BYTE>(value | 0x80));
+        value >>= 7;
+    }
+
+    buffer.push_back(static_cast<BYTE>(value));
+}
+
+/// <summary>
+/// Append a signed number, zigzag coded so small negative numbers stay short too
+/// </summary>
+static void PutSigned(std::vector<BYTE>& buffer, LONGLONG value)
+{
+    PutUnsigned(buffer, (static_cast<ULONGLONG>(value) << 1) ^ static_cast<ULONGLONG>(value >> 63));
+}
+
+/// <summary>
+/// Read an unsigned number written by PutUnsigned
+/// </summary>
+/// <returns>false when the data ends before the number does</returns>
+static bool GetUnsigned(const BYTE*& pData, const BYTE* pEnd, ULONGLONG* pValue)
+{
+    ULONGLONG value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (pData >= pEnd)
+        {
+            return false;
+        }
+
+        const BYTE b = *pData++;
+        value |= static_cast<ULONGLONG>(b & 0x7F) << shift;
+
+        if (0 == (b & 0x80))
+        {
+            *pValue = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Read a signed number written by PutSigned
+/// </summary>
+/// <returns>false when the data ends before the number does</returns>
+static bool GetSigned(const BYTE*& pData, const BYTE* pEnd, LONGLONG* pValue)
+{
+    ULONGLONG value;
+    if (!GetUnsigned(pData, pEnd, &value))
+    {
+        return false;
+    }
+
+    *pValue = static_cast<LONGLONG>((value >> 1) ^ (0 - (value & 1)));
+    return true;
+}
+
+/// <summary>
+/// Read an unsigned number that must fit a DWORD
+/// </summary>
+static bool GetDword(const BYTE*& pData, const BYTE* pEnd, DWORD* pValue)
+{
+    ULONGLONG value;
+    if (!GetUnsigned(pData, pEnd, &value) || value > MAXDWORD)
+    {
+        return false;
+    }
+
+    *pValue = static_cast<DWORD>(value);
+    return true;
+}
+
+/// <summary>
+/// Round a position to millimeters
+/// </summary>
+static void ToMillimeters(const Vector4& position, int* pMillimeters)
+{
+    pMillimeters[0] = static_cast<int>(floorf(position.x * 1000.0f + 0.5f));
+    pMillimeters[1] = static_cast<int>(floorf(position.y * 1000.0f + 0.5f));
+    pMillimeters[2] = static_cast<int>(floorf(position.z * 1000.0f + 0.5f));
+}
+
+/// <summary>
+/// Position in meters of rounded millimeters
+/// </summary>
+static Vector4 FromMillimeters(const int* pMillimeters)
+{
+    Vector4 position;
+    position.x = pMillimeters[0] / 1000.0f;
+    position.y = pMillimeters[1] / 1000.0f;
+    position.z = pMillimeters[2] / 1000.0f;
+    position.w = 1.0f;
+    return position;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SkeletonRecorder::SkeletonRecorder() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_keyframeInterval(1),
+    m_frameCount(0),
+    m_size(0),
+    m_timestamp(0),
+    m_frameNumber(0)
+{
+    ZeroMemory(&m_floorClipPlane, sizeof(m_floorClipPlane));
+    ZeroMemory(&m_normalToGravity, sizeof(m_normalToGravity));
+    ZeroMemory(m_slots, sizeof(m_slots));
+}
+
+/// <summary>
+/// Destructor, closes the file
+/// </summary>
+SkeletonRecorder::~SkeletonRecorder()
+{
+    Close();
+}
+
+/// <summary>
+/// Start recording into a file, replacing it
+/// </summary>
+/// <param name="path">path of the file</param>
+/// <param name="keyframeInterval">frames from one keyframe to the next</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT SkeletonRecorder::Open(PCWSTR path, UINT keyframeInterval)
+{
+    Close();
+
+    m_hFile = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_keyframeInterval = (keyframeInterval > 0) ? keyframeInterval : 1;
+    m_frameCount = 0;
+    m_size = 0;
+    m_buffer.clear();
+    m_buffer.reserve(cWriteBufferSize + sizeof(NUI_SKELETON_FRAME));
+    m_keyframes.clear();
+
+    RecordingHeader header = { cSkeletonRecordingMagic, cSkeletonRecordingVersion, m_keyframeInterval, 0 };
+    PutBytes(m_buffer, &header, sizeof(header));
+
+    return Flush();
+}
+
+/// <summary>
+/// Add a frame to the recording
+/// </summary>
+/// <param name="frame">skeleton frame, as received from the sensor</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT SkeletonRecorder::Record(const NUI_SKELETON_FRAME& frame)
+{
+    if (!IsRecording())
+    {
+        return E_UNEXPECTED;
+    }
+
+    const bool bKeyframe = 0 == m_frameCount % m_keyframeInterval;
+    const size_t recordStart = m_buffer.size();
+
+    if (bKeyframe)
+    {
+        SkeletonKeyframe keyframe = { frame.liTimeStamp.QuadPart, m_size + recordStart };
+        m_keyframes.push_back(keyframe);
+    }
+
+    // Length of the record, filled in once it is known
+    m_buffer.resize(recordStart + sizeof(DWORD));
+    EncodeFrame(frame, bKeyframe);
+
+    const DWORD length = static_cast<DWORD>(m_buffer.size() - recordStart - sizeof(DWORD));
+    memcpy(&m_buffer[recordStart], &length, sizeof(length));
+
+    ++m_frameCount;
+
+    return (m_buffer.size() >= cWriteBufferSize) ? Flush() : S_OK;
+}
+
+/// <summary>
+/// Write the keyframe list and close the file
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT SkeletonRecorder::Close()
+{
+    if (!IsRecording())
+    {
+        return S_OK;
+    }
+
+    const ULONGLONG listOffset = m_size + m_buffer.size();
+    const size_t recordStart = m_buffer.size();
+    m_buffer.resize(recordStart + sizeof(DWORD));
+
+    m_buffer.push_back(cRecordKeyframeList);
+    PutUnsigned(m_buffer, m_keyframes.size());
+
+    LONGLONG previousTimestamp = 0;
+    ULONGLONG previousOffset = 0;
+    for (size_t i = 0; i < m_keyframes.size(); ++i)
+    {
+        PutSigned(m_buffer, m_keyframes[i].timestamp - previousTimestamp);
+        PutUnsigned(m_buffer, m_keyframes[i].offset - previousOffset);
+        previousTimestamp = m_keyframes[i].timestamp;
+        previousOffset = m_keyframes[i].offset;
+    }
+
+    const DWORD length = static_cast<DWORD>(m_buffer.size() - recordStart - sizeof(DWORD));
+    memcpy(&m_buffer[recordStart], &length, sizeof(length));
+
+    PutBytes(m_buffer, &listOffset, sizeof(listOffset));
+    PutBytes(m_buffer, &cSkeletonRecordingMagic, sizeof(cSkeletonRecordingMagic));
+
+    HRESULT hr = Flush();
+
+    CloseHandle(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+
+    return hr;
+}
+
+/// <summary>
+/// Code a frame into the buffer
+/// </summary>
+/// <param name="frame">skeleton frame</param>
+/// <param name="bKeyframe">true to code it without the previous frame</param>
+void SkeletonRecorder::EncodeFrame(const NUI_SKELETON_FRAME& frame, bool bKeyframe)
+{
+    BYTE flags = bKeyframe ? cRecordKeyframe : 0;
+    if (bKeyframe || 0 != memcmp(&frame.vFloorClipPlane, &m_floorClipPlane, sizeof(Vector4)))
+    {
+        flags |= cRecordFloorClipPlane;
+    }
+    if (bKeyframe || 0 != memcmp(&frame.vNormalToGravity, &m_normalToGravity, sizeof(Vector4)))
+    {
+        flags |= cRecordGravity;
+    }
+
+    m_buffer.push_back(flags);
+    PutSigned(m_buffer, bKeyframe ? frame.liTimeStamp.QuadPart : frame.liTimeStamp.QuadPart - m_timestamp);
+    PutSigned(m_buffer, bKeyframe ? frame.dwFrameNumber : static_cast<LONG>(frame.dwFrameNumber - m_frameNumber));
+    PutUnsigned(m_buffer, frame.dwFlags);
+
+    if (flags & cRecordFloorClipPlane)
+    {
+        PutBytes(m_buffer, &frame.vFloorClipPlane, sizeof(Vector4));
+    }
+    if (flags & cRecordGravity)
+    {
+        PutBytes(m_buffer, &frame.vNormalToGravity, sizeof(Vector4));
+    }
+
+    // Empty slots are left out
+    BYTE skeletonCount = 0;
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+    {
+        if (NUI_SKELETON_NOT_TRACKED != frame.SkeletonData[i].eTrackingState)
+        {
+            ++skeletonCount;
+        }
+    }
+
+    m_buffer.push_back(skeletonCount);
+
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+    {
+        if (NUI_SKELETON_NOT_TRACKED != frame.SkeletonData[i].eTrackingState)
+        {
+            EncodeSkeleton(i, frame.SkeletonData[i], bKeyframe);
+        }
+        else
+        {
+            m_slots[i].valid = false;
+        }
+    }
+
+    m_timestamp = frame.liTimeStamp.QuadPart;
+    m_frameNumber = frame.dwFrameNumber;
+    m_floorClipPlane = frame.vFloorClipPlane;
+    m_normalToGravity = frame.vNormalToGravity;
+}
+
+/// <summary>
+/// Code a skeleton into the buffer, positions are differences from the same skeleton in the previous frame
+/// </summary>
+/// <param name="slot">index of the skeleton in the frame</param>
+/// <param name="skeleton">skeleton, tracked or position only</param>
+/// <param name="bKeyframe">true to code it without the previous frame</param>
+void SkeletonRecorder::EncodeSkeleton(int slot, const NUI_SKELETON_DATA& skeleton, bool bKeyframe)
+{
+    SkeletonSlotHistory& history = m_slots[slot];
+    const bool bDelta = !bKeyframe && history.valid && history.trackingId == skeleton.dwTrackingID && history.trackingState == skeleton.eTrackingState;
+
+    m_buffer.push_back(static_cast<BYTE>(slot | (skeleton.eTrackingState << cSkeletonStateShift) | (bDelta ? cSkeletonDelta : 0)));
+    PutUnsigned(m_buffer, skeleton.dwTrackingID);
+    PutUnsigned(m_buffer, skeleton.dwEnrollmentIndex);
+    PutUnsigned(m_buffer, skeleton.dwUserIndex);
+    PutUnsigned(m_buffer, skeleton.dwQualityFlags);
+
+    int position[3];
+    ToMillimeters(skeleton.Position, position);
+    for (int c = 0; c < 3; ++c)
+    {
+        PutSigned(m_buffer, bDelta ? position[c] - history.position[c] : position[c]);
+        history.position[c] = position[c];
+    }
+
+    if (NUI_SKELETON_TRACKED == skeleton.eTrackingState)
+    {
+        BYTE states[cJointStateBytes] = {0};
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            states[j / 4] |= static_cast<BYTE>((skeleton.eSkeletonPositionTrackingState[j] & 3) << ((j % 4) * 2));
+        }
+
+        PutBytes(m_buffer, states, sizeof(states));
+
+        // Joints that are not tracked have no position, and count as the origin for the next frame
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            int joint[3] = {0};
+            if (NUI_SKELETON_POSITION_NOT_TRACKED != skeleton.eSkeletonPositionTrackingState[j])
+            {
+                ToMillimeters(skeleton.SkeletonPositions[j], joint);
+                for (int c = 0; c < 3; ++c)
+                {
+                    PutSigned(m_buffer, bDelta ? joint[c] - history.joints[j][c] : joint[c]);
+                }
+            }
+
+            memcpy(history.joints[j], joint, sizeof(joint));
+        }
+    }
+
+    history.valid = true;
+    history.trackingId = skeleton.dwTrackingID;
+    history.trackingState = skeleton.eTrackingState;
+}
+
+/// <summary>
+/// Write the buffered records to the file
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT SkeletonRecorder::Flush()
+{
+    if (m_buffer.empty())
+    {
+        return S_OK;
+    }
+
+    DWORD written = 0;
+    if (!WriteFile(m_hFile, &m_buffer[0], static_cast<DWORD>(m_buffer.size()), &written, NULL) || written != m_buffer.size())
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_size += m_buffer.size();
+    m_buffer.clear();
+
+    return S_OK;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SkeletonPlayer::SkeletonPlayer() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hMapping(NULL),
+    m_pView(NULL),
+    m_dataStart(0),
+    m_dataEnd(0),
+    m_offset(0),
+    m_timestamp(0),
+    m_frameNumber(0),
+    m_bRealTime(true),
+    m_bPaced(false),
+    m_paceTimestamp(0),
+    m_bPending(false)
+{
+    ZeroMemory(&m_floorClipPlane, sizeof(m_floorClipPlane));
+    ZeroMemory(&m_normalToGravity, sizeof(m_normalToGravity));
+    ZeroMemory(m_slots, sizeof(m_slots));
+    ZeroMemory(&m_pendingFrame, sizeof(m_pendingFrame));
+    m_paceCounter.QuadPart = 0;
+    QueryPerformanceFrequency(&m_counterFrequency);
+}
+
+/// <summary>
+/// Destructor, closes the file
+/// </summary>
+SkeletonPlayer::~SkeletonPlayer()
+{
+    Close();
+}
+
+/// <summary>
+/// Open a recording and go to its first frame
+/// </summary>
+/// <param name="path">path of the file</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT SkeletonPlayer::Open(PCWSTR path)
+{
+    Close();
+
+    m_hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_hFile, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(RecordingHeader)))
+    {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    m_pView = (NULL != m_hMapping) ? reinterpret_cast<const BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0)) : NULL;
+    if (NULL == m_pView)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    const RecordingHeader* pHeader = reinterpret_cast<const RecordingHeader*>(m_pView);
+    if (cSkeletonRecordingMagic != pHeader->magic || cSkeletonRecordingVersion != pHeader->version)
+    {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    // A recording that was cut off has no keyframe list, its frames are looked through instead
+    m_dataStart = sizeof(RecordingHeader);
+    if (!ReadKeyframeList(fileSize.QuadPart))
+    {
+        m_dataEnd = fileSize.QuadPart;
+        ScanKeyframes();
+    }
+
+    return Seek(0);
+}
+
+/// <summary>
+/// Close the recording
+/// </summary>
+void SkeletonPlayer::Close()
+{
+    if (NULL != m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = NULL;
+    }
+
+    if (NULL != m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    m_keyframes.clear();
+    m_dataStart = m_dataEnd = m_offset = 0;
+    m_bPending = false;
+}
+
+/// <summary>
+/// Play at the pace the frames were recorded, or as fast as they are read
+/// </summary>
+/// <param name="bRealTime">true to pace the frames by their time stamps</param>
+void SkeletonPlayer::SetRealTime(bool bRealTime)
+{
+    m_bRealTime = bRealTime;
+    m_bPaced = false;
+}
+
+/// <summary>
+/// Go to the last keyframe at or before a time
+/// </summary>
+/// <param name="time">time (in milliseconds) from the start of the recording</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT SkeletonPlayer::Seek(LONGLONG time)
+{
+    if (!IsOpen())
+    {
+        return E_UNEXPECTED;
+    }
+
+    // Keyframes hold the sensor's time stamps and the first frame is always one, so the
+    // recording starts at the first keyframe's time stamp
+    const LONGLONG timestamp = m_keyframes.empty() ? 0 : m_keyframes[0].timestamp + time;
+
+    // Keyframes are in time order, a time before the first one goes to the start
+    m_offset = m_dataStart;
+    for (size_t i = 0; i < m_keyframes.size() && m_keyframes[i].timestamp <= timestamp; ++i)
+    {
+        m_offset = m_keyframes[i].offset;
+    }
+
+    ZeroMemory(m_slots, sizeof(m_slots));
+    m_bPending = false;
+    m_bPaced = false;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Read the next frame
+/// </summary>
+/// <param name="pFrame">receives the frame, as the sensor gave it except for the rounding of positions</param>
+/// <returns>S_OK when a frame was read, S_FALSE when playing in real time and the next frame is not due yet,
+/// HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) after the last frame, otherwise failure code</returns>
+HRESULT SkeletonPlayer::ReadFrame(NUI_SKELETON_FRAME* pFrame)
+{
+    if (!IsOpen() || NULL == pFrame)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (!m_bPending)
+    {
+        HRESULT hr = DecodeNextFrame(&m_pendingFrame);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        m_bPending = true;
+    }
+
+    // The first frame played sets the clock, the next ones wait for their time stamp to come
+    if (m_bRealTime)
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+
+        if (!m_bPaced)
+        {
+            m_paceTimestamp = m_pendingFrame.liTimeStamp.QuadPart;
+            m_paceCounter = counter;
+            m_bPaced = true;
+        }
+
+        const LONGLONG elapsed = (counter.QuadPart - m_paceCounter.QuadPart) * 1000 / m_counterFrequency.QuadPart;
+        if (m_pendingFrame.liTimeStamp.QuadPart - m_paceTimestamp > elapsed)
+        {
+            return S_FALSE;
+        }
+    }
+
+    *pFrame = m_pendingFrame;
+    m_bPending = false;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Read the keyframe list at the end of a recording that was closed properly
+/// </summary>
+/// <param name="fileSize">size of the file</param>
+/// <returns>true when the list was found</returns>
+bool SkeletonPlayer::ReadKeyframeList(ULONGLONG fileSize)
+{
+    if (fileSize < m_dataStart + sizeof(DWORD) + cTrailerSize)
+    {
+        return false;
+    }
+
+    ULONGLONG listOffset;
+    DWORD magic;
+    memcpy(&listOffset, m_pView + fileSize - cTrailerSize, sizeof(listOffset));
+    memcpy(&magic, m_pView + fileSize - sizeof(DWORD), sizeof(magic));
+
+    if (cSkeletonRecordingMagic != magic || listOffset < m_dataStart || listOffset + sizeof(DWORD) > fileSize - cTrailerSize)
+    {
+        return false;
+    }
+
+    DWORD length;
+    memcpy(&length, m_pView + listOffset, sizeof(length));
+    if (listOffset + sizeof(DWORD) + length != fileSize - cTrailerSize)
+    {
+        return false;
+    }
+
+    const BYTE* pData = m_pView + listOffset + sizeof(DWORD);
+    const BYTE* pEnd = pData + length;
+    ULONGLONG count;
+    if (pData >= pEnd || cRecordKeyframeList != *pData++ || !GetUnsigned(pData, pEnd, &count))
+    {
+        return false;
+    }
+
+    m_keyframes.clear();
+
+    SkeletonKeyframe keyframe = { 0, 0 };
+    for (ULONGLONG i = 0; i < count; ++i)
+    {
+        LONGLONG timestampDelta;
+        ULONGLONG offsetDelta;
+        if (!GetSigned(pData, pEnd, &timestampDelta) || !GetUnsigned(pData, pEnd, &offsetDelta))
+        {
+            m_keyframes.clear();
+            return false;
+        }
+
+        keyframe.timestamp += timestampDelta;
+        keyframe.offset += offsetDelta;
+        if (keyframe.offset < m_dataStart || keyframe.offset >= listOffset)
+        {
+            m_keyframes.clear();
+            return false;
+        }
+
+        m_keyframes.push_back(keyframe);
+    }
+
+    m_dataEnd = listOffset;
+    return true;
+}
+
+/// <summary>
+/// Find the keyframes by skipping from record to record, up to the last whole one
+/// </summary>
+void SkeletonPlayer::ScanKeyframes()
+{
+    m_keyframes.clear();
+
+    ULONGLONG offset = m_dataStart;
+    while (offset + sizeof(DWORD) <= m_dataEnd)
+    {
+        DWORD length;
+        memcpy(&length, m_pView + offset, sizeof(length));
+        if (0 == length || offset + sizeof(DWORD) + length > m_dataEnd)
+        {
+            break;
+        }
+
+        const BYTE* pData = m_pView + offset + sizeof(DWORD);
+        const BYTE* pEnd = pData + length;
+        const BYTE flags = *pData++;
+        if (flags & cRecordKeyframeList)
+        {
+            break;
+        }
+
+        LONGLONG timestamp;
+        if ((flags & cRecordKeyframe) && GetSigned(pData, pEnd, &timestamp))
+        {
+            SkeletonKeyframe keyframe = { timestamp, offset };
+            m_keyframes.push_back(keyframe);
+        }
+
+        offset += sizeof(DWORD) + length;
+    }
+
+    m_dataEnd = offset;
+}
+
+/// <summary>
+/// Decode the frame at the current offset and move past it
+/// </summary>
+/// <param name="pFrame">receives the frame</param>
+/// <returns>S_OK on success, HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) after the last frame, otherwise failure code</returns>
+HRESULT SkeletonPlayer::DecodeNextFrame(NUI_SKELETON_FRAME* pFrame)
+{
+    if (m_offset + sizeof(DWORD) > m_dataEnd)
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    DWORD length;
+    memcpy(&length, m_pView + m_offset, sizeof(length));
+    if (0 == length || m_offset + sizeof(DWORD) + length > m_dataEnd)
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    const BYTE* pData = m_pView + m_offset + sizeof(DWORD);
+    const BYTE* pEnd = pData + length;
+    const BYTE flags = *pData++;
+    const bool bKeyframe = 0 != (flags & cRecordKeyframe);
+
+    if (flags & cRecordKeyframeList)
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    if (bKeyframe)
+    {
+        ZeroMemory(m_slots, sizeof(m_slots));
+    }
+
+    ZeroMemory(pFrame, sizeof(NUI_SKELETON_FRAME));
+
+    LONGLONG timestamp;
+    LONGLONG frameNumber;
+    DWORD frameFlags;
+    if (!GetSigned(pData, pEnd, &timestamp) || !GetSigned(pData, pEnd, &frameNumber) || !GetDword(pData, pEnd, &frameFlags))
+    {
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    pFrame->liTimeStamp.QuadPart = bKeyframe ? timestamp : m_timestamp + timestamp;
+    pFrame->dwFrameNumber = bKeyframe ? static_cast<DWORD>(frameNumber) : m_frameNumber + static_cast<DWORD>(frameNumber);
+    pFrame->dwFlags = frameFlags;
+
+    if (flags & cRecordFloorClipPlane)
+    {
+        if (pEnd - pData < static_cast<ptrdiff_t>(sizeof(Vector4)))
+        {
+            return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+        }
+
+        memcpy(&m_floorClipPlane, pData, sizeof(Vector4));
+        pData += sizeof(Vector4);
+    }
+    if (flags & cRecordGravity)
+    {
+        if (pEnd - pData < static_cast<ptrdiff_t>(sizeof(Vector4)))
+        {
+            return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+        }
+
+        memcpy(&m_normalToGravity, pData, sizeof(Vector4));
+        pData += sizeof(Vector4);
+    }
+
+    pFrame->vFloorClipPlane = m_floorClipPlane;
+    pFrame->vNormalToGravity = m_normalToGravity;
+
+    if (pData >= pEnd)
+    {
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    const BYTE skeletonCount = *pData++;
+    for (BYTE i = 0; i < skeletonCount; ++i)
+    {
+        if (!DecodeSkeleton(pData, pEnd, pFrame, bKeyframe))
+        {
+            return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+        }
+    }
+
+    // Slots left out of the frame are empty
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+    {
+        if (NUI_SKELETON_NOT_TRACKED == pFrame->SkeletonData[i].eTrackingState)
+        {
+            m_slots[i].valid = false;
+        }
+    }
+
+    m_timestamp = pFrame->liTimeStamp.QuadPart;
+    m_frameNumber = pFrame->dwFrameNumber;
+    m_offset += sizeof(DWORD) + length;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Decode a skeleton of a frame
+/// </summary>
+/// <param name="pData">coded skeleton, moved past it</param>
+/// <param name="pEnd">end of the record</param>
+/// <param name="pFrame">frame receiving the skeleton in its slot</param>
+/// <param name="bKeyframe">true when the frame is a keyframe</param>
+/// <returns>false when the data is not a valid skeleton</returns>
+bool SkeletonPlayer::DecodeSkeleton(const BYTE*& pData, const BYTE* pEnd, NUI_SKELETON_FRAME* pFrame, bool bKeyframe)
+{
+    if (pData >= pEnd)
+    {
+        return false;
+    }
+
+    const BYTE b = *pData++;
+    const int slot = b & cSkeletonSlotMask;
+    const bool bDelta = 0 != (b & cSkeletonDelta);
+    if (slot >= NUI_SKELETON_COUNT)
+    {
+        return false;
+    }
+
+    // Differences need the skeleton of the previous frame
+    SkeletonSlotHistory& history = m_slots[slot];
+    if (bDelta && (bKeyframe || !history.valid))
+    {
+        return false;
+    }
+
+    NUI_SKELETON_DATA& skeleton = pFrame->SkeletonData[slot];
+    skeleton.eTrackingState = static_cast<NUI_SKELETON_TRACKING_STATE>((b >> cSkeletonStateShift) & 3);
+
+    if (!GetDword(pData, pEnd, &skeleton.dwTrackingID) ||
+        !GetDword(pData, pEnd, &skeleton.dwEnrollmentIndex) ||
+        !GetDword(pData, pEnd, &skeleton.dwUserIndex) ||
+        !GetDword(pData, pEnd, &skeleton.dwQualityFlags))
+    {
+        return false;
+    }
+
+    for (int c = 0; c < 3; ++c)
+    {
+        LONGLONG value;
+        if (!GetSigned(pData, pEnd, &value))
+        {
+            return false;
+        }
+
+        history.position[c] = static_cast<int>(bDelta ? history.position[c] + value : value);
+    }
+
+    skeleton.Position = FromMillimeters(history.position);
+
+    if (NUI_SKELETON_TRACKED == skeleton.eTrackingState)
+    {
+        if (pEnd - pData < cJointStateBytes)
+        {
+            return false;
+        }
+
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            skeleton.eSkeletonPositionTrackingState[j] = static_cast<NUI_SKELETON_POSITION_TRACKING_STATE>((pData[j / 4] >> ((j % 4) * 2)) & 3);
+        }
+
+        pData += cJointStateBytes;
+
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            int* pJoint = history.joints[j];
+
+            if (NUI_SKELETON_POSITION_NOT_TRACKED == skeleton.eSkeletonPositionTrackingState[j])
+            {
+                pJoint[0] = pJoint[1] = pJoint[2] = 0;
+            }
+            else
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    LONGLONG value;
+                    if (!GetSigned(pData, pEnd, &value))
+                    {
+                        return false;
+                    }
+
+                    pJoint[c] = static_cast<int>(bDelta ? pJoint[c] + value : value);
+                }
+            }
+
+            skeleton.SkeletonPositions[j] = FromMillimeters(pJoint);
+        }
+    }
+
+    history.valid = true;
+    history.trackingId = skeleton.dwTrackingID;
+    history.trackingState = skeleton.eTrackingState;
+
+    return true;
+}
@@ -0,0 +1,187 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonRecorder.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Records skeleton frames into a compact file and plays them back.
+// Only the skeletons that are tracked or position only are kept, and each frame is a record:
+//     length      bytes of the record, so a player can skip records and stop at a cut off one
+//     frame       time stamp and frame number, as differences from the previous frame, and the
+//                 floor clip plane and gravity only when they changed
+//     skeletons   slot, tracking state and IDs of every skeleton kept, then its positions in
+//                 millimeters, as differences from the same skeleton in the previous frame, with
+//                 the joint tracking states packed 2 bits each
+// Numbers are variable length, so small differences take a byte. Every so often a keyframe
+// records everything in full, and the list of keyframes closes the file so a player can seek
+// without decoding from the start. A file whose recording was cut off plays up to its last
+// whole frame.
+
+#pragma once
+
+#include <vector>
+#include "NuiApi.h"
+
+static const DWORD cSkeletonRecordingMagic   = 0x52454B53;  // 'SKER'
+static const DWORD cSkeletonRecordingVersion = 1;
+
+// What the recorder and the player remember of each skeleton slot to code differences
+struct SkeletonSlotHistory
+{
+    bool                        valid;
+    NUI_SKELETON_TRACKING_STATE trackingState;
+    DWORD                       trackingId;
+    int                         position[3];
+    int                         joints[NUI_SKELETON_POSITION_COUNT][3];
+};
+
+// Where a keyframe starts
+struct SkeletonKeyframe
+{
+    LONGLONG  timestamp;
+    ULONGLONG offset;
+};
+
+class SkeletonRecorder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SkeletonRecorder();
+
+    /// <summary>
+    /// Destructor, closes the file
+    /// </summary>
+    ~SkeletonRecorder();
+
+    /// <summary>
+    /// Start recording into a file, replacing it
+    /// </summary>
+    /// <param name="path">path of the file</param>
+    /// <param name="keyframeInterval">frames from one keyframe to the next</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Open(PCWSTR path, UINT keyframeInterval);
+
+    /// <summary>
+    /// Add a frame to the recording
+    /// </summary>
+    /// <param name="frame">skeleton frame, as received from the sensor</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Record(const NUI_SKELETON_FRAME& frame);
+
+    /// <summary>
+    /// Write the keyframe list and close the file
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Close();
+
+    bool IsRecording() const { return INVALID_HANDLE_VALUE != m_hFile; }
+    UINT GetFrameCount() const { return m_frameCount; }
+    ULONGLONG GetSize() const { return m_size; }
+
+private:
+    // Records are gathered and written this many bytes at a time
+    static const UINT                   cWriteBufferSize = 64 * 1024;
+
+    HANDLE                              m_hFile;
+    UINT                                m_keyframeInterval;
+    UINT                                m_frameCount;
+    ULONGLONG                           m_size;
+    std::vector<BYTE>                   m_buffer;
+    std::vector<SkeletonKeyframe>       m_keyframes;
+
+    // Previous frame
+    LONGLONG                            m_timestamp;
+    DWORD                               m_frameNumber;
+    Vector4                             m_floorClipPlane;
+    Vector4                             m_normalToGravity;
+    SkeletonSlotHistory                 m_slots[NUI_SKELETON_COUNT];
+
+    void                                EncodeFrame(const NUI_SKELETON_FRAME& frame, bool bKeyframe);
+    void                                EncodeSkeleton(int slot, const NUI_SKELETON_DATA& skeleton, bool bKeyframe);
+    HRESULT                             Flush();
+};
+
+class SkeletonPlayer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SkeletonPlayer();
+
+    /// <summary>
+    /// Destructor, closes the file
+    /// </summary>
+    ~SkeletonPlayer();
+
+    /// <summary>
+    /// Open a recording and go to its first frame
+    /// </summary>
+    /// <param name="path">path of the file</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Open(PCWSTR path);
+
+    /// <summary>
+    /// Close the recording
+    /// </summary>
+    void Close();
+
+    bool IsOpen() const { return NULL != m_pView; }
+
+    /// <summary>
+    /// Play at the pace the frames were recorded, or as fast as they are read
+    /// </summary>
+    /// <param name="bRealTime">true to pace the frames by their time stamps</param>
+    void SetRealTime(bool bRealTime);
+
+    /// <summary>
+    /// Go to the last keyframe at or before a time
+    /// </summary>
+    /// <param name="time">time (in milliseconds) from the start of the recording</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Seek(LONGLONG time);
+
+    /// <summary>
+    /// Read the next frame
+    /// </summary>
+    /// <param name="pFrame">receives the frame, as the sensor gave it except for the rounding of positions</param>
+    /// <returns>S_OK when a frame was read, S_FALSE when playing in real time and the next frame is not due yet,
+    /// HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) after the last frame, otherwise failure code</returns>
+    HRESULT ReadFrame(NUI_SKELETON_FRAME* pFrame);
+
+    UINT GetKeyframeCount() const { return static_cast<UINT>(m_keyframes.size()); }
+
+private:
+    HANDLE                              m_hFile;
+    HANDLE                              m_hMapping;
+    const BYTE*                         m_pView;
+
+    // Records take [m_dataStart, m_dataEnd) of the file, m_offset is the next one
+    ULONGLONG                           m_dataStart;
+    ULONGLONG                           m_dataEnd;
+    ULONGLONG                           m_offset;
+    std::vector<SkeletonKeyframe>       m_keyframes;
+
+    // Previous frame
+    LONGLONG                            m_timestamp;
+    DWORD                               m_frameNumber;
+    Vector4                             m_floorClipPlane;
+    Vector4                             m_normalToGravity;
+    SkeletonSlotHistory                 m_slots[NUI_SKELETON_COUNT];
+
+    // Real time pacing: the time stamp shown at a performance counter value, and the frame read ahead
+    bool                                m_bRealTime;
+    bool                                m_bPaced;
+    LONGLONG                            m_paceTimestamp;
+    LARGE_INTEGER                       m_paceCounter;
+    LARGE_INTEGER                       m_counterFrequency;
+    bool                                m_bPending;
+    NUI_SKELETON_FRAME                  m_pendingFrame;
+
+    bool                                ReadKeyframeList(ULONGLONG fileSize);
+    void                                ScanKeyframes();
+    HRESULT                             DecodeNextFrame(NUI_SKELETON_FRAME* pFrame);
+    bool                                DecodeSkeleton(const BYTE*& pData, const BYTE* pEnd, NUI_SKELETON_FRAME* pFrame, bool bKeyframe);
+};
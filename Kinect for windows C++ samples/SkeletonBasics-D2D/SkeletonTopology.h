@@ -0,0 +1,80 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonTopology.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// The joints of a skeleton and the bones between them, in one table that drawing and the
+// analysis of skeletons both read, so they always agree on what is connected to what.
+// Bones run from the joint nearer the hip center to the joint farther from it, and every
+// bone comes after the bone leading to its first joint, so walking the table in order goes
+// down the skeleton from the hip center.
+// Only depends on the C++ standard library so it can be built and measured anywhere.
+
+#pragma once
+
+// Same values as NUI_SKELETON_POSITION_INDEX
+enum SkeletonJoint
+{
+    SkeletonJointHipCenter,
+    SkeletonJointSpine,
+    SkeletonJointShoulderCenter,
+    SkeletonJointHead,
+    SkeletonJointShoulderLeft,
+    SkeletonJointElbowLeft,
+    SkeletonJointWristLeft,
+    SkeletonJointHandLeft,
+    SkeletonJointShoulderRight,
+    SkeletonJointElbowRight,
+    SkeletonJointWristRight,
+    SkeletonJointHandRight,
+    SkeletonJointHipLeft,
+    SkeletonJointKneeLeft,
+    SkeletonJointAnkleLeft,
+    SkeletonJointFootLeft,
+    SkeletonJointHipRight,
+    SkeletonJointKneeRight,
+    SkeletonJointAnkleRight,
+    SkeletonJointFootRight,
+    SkeletonJointCount
+};
+
+struct SkeletonBone
+{
+    SkeletonJoint joint0;   // joint nearer the hip center
+    SkeletonJoint joint1;   // joint farther from it
+};
+
+static const int cSkeletonBoneCount = SkeletonJointCount - 1;
+
+static const SkeletonBone cSkeletonBones[cSkeletonBoneCount] =
+{
+    // Torso
+    { SkeletonJointHipCenter,      SkeletonJointSpine },
+    { SkeletonJointSpine,          SkeletonJointShoulderCenter },
+    { SkeletonJointShoulderCenter, SkeletonJointHead },
+    { SkeletonJointShoulderCenter, SkeletonJointShoulderLeft },
+    { SkeletonJointShoulderCenter, SkeletonJointShoulderRight },
+    { SkeletonJointHipCenter,      SkeletonJointHipLeft },
+    { SkeletonJointHipCenter,      SkeletonJointHipRight },
+
+    // Left Arm
+    { SkeletonJointShoulderLeft,   SkeletonJointElbowLeft },
+    { SkeletonJointElbowLeft,      SkeletonJointWristLeft },
+    { SkeletonJointWristLeft,      SkeletonJointHandLeft },
+
+    // Right Arm
+    { SkeletonJointShoulderRight,  SkeletonJointElbowRight },
+    { SkeletonJointElbowRight,     SkeletonJointWristRight },
+    { SkeletonJointWristRight,     SkeletonJointHandRight },
+
+    // Left Leg
+    { SkeletonJointHipLeft,        SkeletonJointKneeLeft },
+    { SkeletonJointKneeLeft,       SkeletonJointAnkleLeft },
+    { SkeletonJointAnkleLeft,      SkeletonJointFootLeft },
+
+    // Right Leg
+    { SkeletonJointHipRight,       SkeletonJointKneeRight },
+    { SkeletonJointKneeRight,      SkeletonJointAnkleRight },
+    { SkeletonJointAnkleRight,     SkeletonJointFootRight },
+};
@@ -0,0 +1,188 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="JointFilterReplay.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Replays a skeleton recording of the sample through each joint filter and reports, for each one:
+//     throughput   frames filtered per second, the filter alone
+//     jitter       mean acceleration of the joints, the change of their frame to frame move
+//     lag          mean distance of the joints from the positions the sensor gave
+// The recording is decoded once, then every filter sees the same frames, as fast as they go.
+// Usage: JointFilterReplay <recording>, e.g. the SkeletonBasics.skr the sample records in Documents
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "JointFilter.h"
+#include "SkeletonRecorder.h"
+
+/// <summary>
+/// Decode every frame of a recording into joint frames, the way the sample feeds its filter
+/// </summary>
+/// <param name="path">path of the recording</param>
+/// <param name="frames">receives the joints of every frame</param>
+/// <param name="deltaTimes">receives the seconds since the previous frame of every frame</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+static HRESULT ReadRecording(PCWSTR path, std::vector<JointFilterFrame>& frames, std::vector<float>& deltaTimes)
+{
+    SkeletonPlayer player;
+    HRESULT hr = player.Open(path);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    player.SetRealTime(false);
+
+    NUI_SKELETON_FRAME skeletonFrame;
+    LONGLONG previousTime = 0;
+
+    while (S_OK == (hr = player.ReadFrame(&skeletonFrame)))
+    {
+        JointFilterFrame frame;
+
+        for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+        {
+            const NUI_SKELETON_DATA& skel = skeletonFrame.SkeletonData[i];
+
+            // Only fully tracked skeletons have joints
+            frame.trackingIds[i] = (NUI_SKELETON_TRACKED == skel.eTrackingState) ? skel.dwTrackingID : 0;
+
+            for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+            {
+                const int point = i * cFilterJointCount + j;
+
+                frame.x[point] = skel.SkeletonPositions[j].x;
+                frame.y[point] = skel.SkeletonPositions[j].y;
+                frame.z[point] = skel.SkeletonPositions[j].z;
+                frame.seen[point] = (NUI_SKELETON_POSITION_NOT_TRACKED != skel.eSkeletonPositionTrackingState[j]);
+            }
+        }
+
+        // Time stamps are in milliseconds, the first frame starts every joint over
+        frames.push_back(frame);
+        deltaTimes.push_back(static_cast<float>(skeletonFrame.liTimeStamp.QuadPart - previousTime) / 1000.0f);
+        previousTime = skeletonFrame.liTimeStamp.QuadPart;
+    }
+
+    return (HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) == hr) ? S_OK : hr;
+}
+
+/// <summary>
+/// Measure the jitter and lag of filtered joints
+/// </summary>
+/// <param name="input">joints as the sensor gave them</param>
+/// <param name="output">the same joints filtered</param>
+/// <param name="pJitter">receives the mean acceleration, in millimeters per frame per frame</param>
+/// <param name="pLag">receives the mean distance from the input, in millimeters</param>
+static void MeasureJoints(const std::vector<JointFilterFrame>& input, const std::vector<JointFilterFrame>& output, double* pJitter, double* pLag)
+{
+    double jitterSum = 0.0;
+    double lagSum = 0.0;
+    int jitterCount = 0;
+    int lagCount = 0;
+
+    for (size_t f = 0; f < output.size(); ++f)
+    {
+        for (int s = 0; s < cFilterSkeletonCount; ++s)
+        {
+            const unsigned long trackingId = output[f].trackingIds[s];
+            if (0 == trackingId)
+            {
+                continue;
+            }
+
+            // Acceleration only means something over three frames of the same person
+            const bool bHasHistory = f >= 2 && trackingId == output[f - 1].trackingIds[s] && trackingId == output[f - 2].trackingIds[s];
+
+            for (int j = 0; j < cFilterJointCount; ++j)
+            {
+                const int point = s * cFilterJointCount + j;
+                if (!output[f].seen[point])
+                {
+                    continue;
+                }
+
+                const float dx = output[f].x[point] - input[f].x[point];
+                const float dy = output[f].y[point] - input[f].y[point];
+                const float dz = output[f].z[point] - input[f].z[point];
+                lagSum += sqrt(dx * dx + dy * dy + dz * dz);
+                ++lagCount;
+
+                if (bHasHistory && output[f - 1].seen[point] && output[f - 2].seen[point])
+                {
+                    const float ax = output[f].x[point] - 2.0f * output[f - 1].x[point] + output[f - 2].x[point];
+                    const float ay = output[f].y[point] - 2.0f * output[f - 1].y[point] + output[f - 2].y[point];
+                    const float az = output[f].z[point] - 2.0f * output[f - 1].z[point] + output[f - 2].z[point];
+                    jitterSum += sqrt(ax * ax + ay * ay + az * az);
+                    ++jitterCount;
+                }
+            }
+        }
+    }
+
+    *pJitter = 1000.0 * jitterSum / (jitterCount > 0 ? jitterCount : 1);
+    *pLag = 1000.0 * lagSum / (lagCount > 0 ? lagCount : 1);
+}
+
+/// <summary>
+/// Entry point
+/// </summary>
+/// <param name="argc">number of arguments</param>
+/// <param name="argv">arguments, the path of the recording</param>
+/// <returns>0 on success, 1 when the recording cannot be read</returns>
+int wmain(int argc, wchar_t* argv[])
+{
+    static const char* filterNames[] = { "off", "Holt", "One Euro", "Kalman" };
+
+    if (argc < 2)
+    {
+        wprintf(L"Usage: %s <skeleton recording>\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<JointFilterFrame> input;
+    std::vector<float> deltaTimes;
+    HRESULT hr = ReadRecording(argv[1], input, deltaTimes);
+    if (FAILED(hr) || input.empty())
+    {
+        wprintf(L"Cannot read %s (0x%08X)\n", argv[1], hr);
+        return 1;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    printf("%u frames\n", static_cast<UINT>(input.size()));
+
+    for (int mode = JointFilterOff; mode <= JointFilterKalman; ++mode)
+    {
+        JointFilter filter;
+        filter.SetMode(static_cast<JointFilterMode>(mode));
+
+        // Filtered in place, so the output starts as a copy of the input
+        std::vector<JointFilterFrame> output(input);
+
+        LARGE_INTEGER start;
+        LARGE_INTEGER end;
+        QueryPerformanceCounter(&start);
+        for (size_t f = 0; f < output.size(); ++f)
+        {
+            filter.Update(output[f], deltaTimes[f]);
+        }
+        QueryPerformanceCounter(&end);
+
+        const double seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+
+        double jitter = 0.0;
+        double lag = 0.0;
+        MeasureJoints(input, output, &jitter, &lag);
+
+        printf("%-8s  %10.0f frames per second, jitter %.2f mm per frame squared, lag %.2f mm\n",
+            filterNames[mode], (seconds > 0.0) ? output.size() / seconds : 0.0, jitter, lag);
+    }
+
+    return 0;
+}
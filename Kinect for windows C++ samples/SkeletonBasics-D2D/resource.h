@@ -12,6 +12,9 @@
 #define IDD_APP                         110
 #define IDC_VIDEOVIEW                   1003
 #define IDC_CHECK_SEATED                1012
+#define IDC_BUTTON_JOINTFILTER          1013
+#define IDC_CHECK_RECORD                1014
+#define IDC_CHECK_PLAY                  1015
 #define IDC_STATIC                      -1
 #define IDC_STATUS                      -1
 
@@ -22,7 +25,7 @@
 #define _APS_NO_MFC                     1
 #define _APS_NEXT_RESOURCE_VALUE        137
 #define _APS_NEXT_COMMAND_VALUE         32771
-#define _APS_NEXT_CONTROL_VALUE         1013
+#define _APS_NEXT_CONTROL_VALUE         1016
 #define _APS_NEXT_SYMED_VALUE           111
 #endif
 #endif